@@ -0,0 +1,342 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "decompress.hh"
+#include "tools.hh"
+#include "lout/misc.hh"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBZ
+#  include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#  include <zstd.h>
+#endif
+
+// Input is read, and output is written, in chunks of this size.
+#define CHUNK_SIZE (256 * 1024)
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief State of the decompressing thread, which owns it.
+ */
+struct Decompressor::ThreadData
+{
+   Format format;
+   int inFd, outFd;
+   char *head;
+   int headSize;
+};
+
+Decompressor::Format Decompressor::detect (const char *data, int size)
+{
+   const unsigned char *d = (const unsigned char*) data;
+   if (size >= 2 && d[0] == 0x1f && d[1] == 0x8b)
+      return GZIP;
+   else if (size >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f &&
+            d[3] == 0xfd)
+      return ZSTD;
+   else
+      return NONE;
+}
+
+/**
+ * \brief Return whether support for `format` has been compiled in.
+ */
+bool Decompressor::isSupported (Format format)
+{
+   switch (format) {
+#ifdef HAVE_LIBZ
+   case GZIP:
+      return true;
+#endif
+#ifdef HAVE_LIBZSTD
+   case ZSTD:
+      return true;
+#endif
+   default:
+      return false;
+   }
+}
+
+/**
+ * \brief Return whether `fd` refers to a regular file which is compressed.
+ *
+ * The file position is not changed.
+ */
+bool Decompressor::isCompressedFile (int fd)
+{
+   struct stat st;
+   if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode))
+      return false;
+
+   // pread(2) may return less than requested, so read until DETECT_SIZE
+   // bytes or the end of the file.
+   char buf[DETECT_SIZE];
+   int size = 0;
+   while (size < DETECT_SIZE) {
+      ssize_t n = pread (fd, buf + size, DETECT_SIZE - size, size);
+      if (n > 0)
+         size += n;
+      else if (n == 0 || errno != EINTR)
+         break;
+   }
+
+   return detect (buf, size) != NONE;
+}
+
+/**
+ * \brief Start decompressing.
+ *
+ * `head` are the first bytes, which have already been read from `fd` (and
+ * used for detect()); the rest is read from `fd`, which is not closed.
+ */
+Decompressor::Decompressor (Format format, int fd, const char *head,
+                            int headSize)
+{
+   int fds[2];
+   if (pipe (fds) == -1)
+      syserr ("pipe failed");
+   readFd = fds[0];
+   fcntl (readFd, F_SETFL, fcntl (readFd, F_GETFL, 0) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+   // Larger pipe, so that fewer context switches are necessary. Failing is
+   // not fatal.
+   fcntl (fds[1], F_SETPIPE_SZ, CHUNK_SIZE);
+#endif
+
+   ThreadData *data = new ThreadData;
+   data->format = format;
+   data->inFd = fd;
+   data->outFd = fds[1];
+   data->head = (char*) malloc (headSize);
+   memcpy (data->head, head, headSize);
+   data->headSize = headSize;
+
+   // Detached: if the reader stops early, the thread will terminate when
+   // writing fails, but may before block while reading.
+   pthread_t thread;
+   pthread_attr_t attr;
+   pthread_attr_init (&attr);
+   pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+   if (pthread_create (&thread, &attr, run, data) != 0)
+      syserr ("pthread_create failed");
+   pthread_attr_destroy (&attr);
+}
+
+Decompressor::~Decompressor ()
+{
+   close (readFd);
+}
+
+void *Decompressor::run (void *data)
+{
+   ThreadData *threadData = (ThreadData*) data;
+
+   // Writing to the pipe after the reader has closed it should fail with
+   // EPIPE, instead of terminating the process.
+   sigset_t set;
+   sigemptyset (&set);
+   sigaddset (&set, SIGPIPE);
+   pthread_sigmask (SIG_BLOCK, &set, NULL);
+
+   switch (threadData->format) {
+   case GZIP:
+      runGzip (threadData);
+      break;
+
+   case ZSTD:
+      runZstd (threadData);
+      break;
+
+   default:
+      break;
+   }
+
+   close (threadData->outFd);
+   free (threadData->head);
+   delete threadData;
+   return NULL;
+}
+
+/**
+ * \brief Write all data; when this is not possible (reader closed), the
+ *    thread terminates.
+ */
+void Decompressor::writeAll (int fd, const char *data, int size)
+{
+   while (size > 0) {
+      ssize_t n = write (fd, data, size);
+      if (n == -1) {
+         if (errno != EINTR)
+            pthread_exit (NULL);
+      } else {
+         data += n;
+         size -= n;
+      }
+   }
+}
+
+/**
+ * \brief Read the next input, first the head; return 0 at the end (or on
+ *    errors).
+ */
+int Decompressor::readInput (ThreadData *data, char *buf, int size)
+{
+   if (data->headSize > 0) {
+      int n = lout::misc::min (size, data->headSize);
+      memcpy (buf, data->head, n);
+      memmove (data->head, data->head + n, data->headSize - n);
+      data->headSize -= n;
+      return n;
+   }
+
+   while (true) {
+      ssize_t n = read (data->inFd, buf, size);
+      if (n >= 0)
+         return n;
+      else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+         // The file descriptor may be non-blocking (see
+         // BlockingLinesSource::setup).
+         struct pollfd pfd;
+         pfd.fd = data->inFd;
+         pfd.events = POLLIN;
+         poll (&pfd, 1, -1);
+      } else if (errno != EINTR) {
+         perror ("read");
+         return 0;
+      }
+   }
+}
+
+void Decompressor::runGzip (ThreadData *data)
+{
+#ifdef HAVE_LIBZ
+   char *in = (char*) malloc (CHUNK_SIZE), *out = (char*) malloc (CHUNK_SIZE);
+   z_stream z;
+   memset (&z, 0, sizeof (z));
+   // 16: gzip format only.
+   if (inflateInit2 (&z, 15 + 16) != Z_OK)
+      fprintf (stderr, "gzip: cannot initialize\n");
+   else {
+      bool eos = false;
+      while (!eos) {
+         int n = readInput (data, in, CHUNK_SIZE);
+         if (n == 0)
+            eos = true;
+         z.next_in = (Bytef*) in;
+         z.avail_in = n;
+
+         // Continue as long as there is input, or output is pending.
+         bool more = !eos;
+         while (more) {
+            z.next_out = (Bytef*) out;
+            z.avail_out = CHUNK_SIZE;
+            int ret = inflate (&z, Z_NO_FLUSH);
+            writeAll (data->outFd, out, CHUNK_SIZE - z.avail_out);
+
+            if (ret == Z_STREAM_END)
+               // Concatenated gzip files (members) are valid.
+               inflateReset (&z);
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+               fprintf (stderr, "gzip: %s\n", z.msg ? z.msg : "error");
+               eos = true;
+            }
+
+            more = !eos && (z.avail_in > 0 || z.avail_out == 0);
+         }
+      }
+
+      inflateEnd (&z);
+   }
+
+   free (in);
+   free (out);
+#else
+   fprintf (stderr, "Input is compressed with gzip, which is not "
+            "supported.\n");
+#endif
+}
+
+void Decompressor::runZstd (ThreadData *data)
+{
+#ifdef HAVE_LIBZSTD
+   char *in = (char*) malloc (CHUNK_SIZE), *out = (char*) malloc (CHUNK_SIZE);
+   ZSTD_DStream *stream = ZSTD_createDStream ();
+   ZSTD_initDStream (stream);
+
+   bool eos = false;
+   while (!eos) {
+      int n = readInput (data, in, CHUNK_SIZE);
+      if (n == 0)
+         eos = true;
+      ZSTD_inBuffer input = { in, (size_t) n, 0 };
+
+      // Concatenated frames are handled by ZSTD_decompressStream. Continue
+      // as long as there is input, or output is pending.
+      bool more = !eos;
+      while (more) {
+         ZSTD_outBuffer output = { out, CHUNK_SIZE, 0 };
+         size_t ret = ZSTD_decompressStream (stream, &output, &input);
+         if (ZSTD_isError (ret)) {
+            fprintf (stderr, "zstd: %s\n", ZSTD_getErrorName (ret));
+            eos = true;
+         } else
+            writeAll (data->outFd, out, output.pos);
+
+         more = !eos && (input.pos < input.size || output.pos == output.size);
+      }
+   }
+
+   ZSTD_freeDStream (stream);
+   free (in);
+   free (out);
+#else
+   fprintf (stderr, "Input is compressed with zstd, which is not "
+            "supported.\n");
+#endif
+}
+
+} // namespace tools
+
+} // namespace rtfl
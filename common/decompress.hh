@@ -0,0 +1,50 @@
+#ifndef __COMMON_DECOMPRESS_HH__
+#define __COMMON_DECOMPRESS_HH__
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief Decompresses data (gzip or zstd) read from a file descriptor, in a
+ *    separate thread.
+ *
+ * The decompressed data can be read from another file descriptor (the read
+ * end of a pipe, see getFd()), which is non-blocking and can be used with
+ * select(2) etc. like the original one; so FileLinesSource can switch to it
+ * transparently.
+ */
+class Decompressor
+{
+public:
+   enum Format { NONE, GZIP, ZSTD };
+   /// Number of bytes needed by detect(), unless the input is shorter.
+   enum { DETECT_SIZE = 4 };
+
+private:
+   struct ThreadData;
+
+   int readFd;
+
+   static void *run (void *data);
+   static void writeAll (int fd, const char *data, int size);
+   static int readInput (ThreadData *data, char *buf, int size);
+   static void runGzip (ThreadData *data);
+   static void runZstd (ThreadData *data);
+
+public:
+   static Format detect (const char *data, int size);
+   static bool isSupported (Format format);
+   static bool isCompressedFile (int fd);
+
+   Decompressor (Format format, int fd, const char *head, int headSize);
+   ~Decompressor ();
+
+   inline int getFd () { return readFd; }
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_DECOMPRESS_HH__
@@ -31,10 +31,11 @@
 
 #include <stdio.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include <FL/Fl.H>
 
-using namespace lout::container::typed;
-
 namespace rtfl {
 
 namespace common {
@@ -43,20 +44,15 @@ namespace common {
 //      FltkLinesSource
 // -------------------------
 
-FltkLinesSource::TimeoutInfo::TimeoutInfo (FltkLinesSource *source, int type)
-{
-   this->source = source;
-   this->type = type;
-}
-
 FltkLinesSource::FltkLinesSource ()
 {
-   timeoutInfos = new List<TimeoutInfo> (true);
+   armedTime = -1;
 }
 
 FltkLinesSource::~FltkLinesSource ()
 {
-   delete timeoutInfos;
+   if (armedTime != -1)
+      Fl::remove_timeout (timeoutCallback, this);
 }
    
 void FltkLinesSource::staticProcessInputCallback (int fd, void *data)
@@ -75,11 +71,17 @@ void FltkLinesSource::processInputCallback (int fd)
       // (typically that the tested program has terminated). For some
       // reasons, the cpu is hogged then; this is avoided by removing
       // the read function again.
-      Fl::remove_fd(0, FL_READ);
+      Fl::remove_fd(fd, FL_READ);
       getSink()->finish ();
    }
 }
 
+void FltkLinesSource::inputFdChanged (int oldFd, int newFd)
+{
+   Fl::remove_fd(oldFd, FL_READ);
+   Fl::add_fd(newFd, FL_READ, staticProcessInputCallback, (void*)this);
+}
+
 void FltkLinesSource::setup (tools::LinesSink *sink)
 {
    setSink (sink);
@@ -90,36 +92,210 @@ void FltkLinesSource::setup (tools::LinesSink *sink)
    Fl::add_fd(0, FL_READ, staticProcessInputCallback, (void*)this);
 }
 
+/**
+ * \brief Make sure that the FLTK timeout fires not later than the next
+ *    timeout in the queue.
+ *
+ * When the FLTK timeout fires too early (because the next timeout has been
+ * removed or replaced by a later one), it is simply armed again; this way,
+ * FLTK is only called when the next time gets earlier.
+ */
+void FltkLinesSource::arm ()
+{
+   long nextTime = timeouts.getNextTime ();
+   if (nextTime != -1 && (armedTime == -1 || nextTime < armedTime)) {
+      if (armedTime != -1)
+         Fl::remove_timeout (timeoutCallback, this);
+      long delta = nextTime - tools::TimeoutQueue::getCurrentTime ();
+      Fl::add_timeout (delta > 0 ? delta / 1000.0 : 0, timeoutCallback, this);
+      armedTime = nextTime;
+   }
+}
+
 void FltkLinesSource::addTimeout (double secs, int type)
 {
-   TimeoutInfo *timeoutInfo = new TimeoutInfo (this, type);
-   timeoutInfos->append (timeoutInfo);
-   Fl::add_timeout(secs, timeoutCallback, timeoutInfo);
+   timeouts.add (secs, type);
+   arm ();
 }
 
 void FltkLinesSource::timeoutCallback (void *data)
 {
-   TimeoutInfo *timeoutInfo = (TimeoutInfo*) data;
-   timeoutInfo->getSource()->getSink()->timeout (timeoutInfo->getType ());
-   timeoutInfo->getSource()->timeoutInfos->removeRef (timeoutInfo);
+   FltkLinesSource *source = (FltkLinesSource*) data;
+   source->armedTime = -1;
+
+   int type;
+   while (source->timeouts.popExpired (&type))
+      source->getSink()->timeout (type);
+
+   source->arm ();
 }
 
 void FltkLinesSource::removeTimeout (int type)
-{      
-   // Iterators will not work when the set is modified; hence this nested loop.
-   bool found;
-   do {
-      found = false;
-      for (Iterator<TimeoutInfo> it = timeoutInfos->iterator ();
-           !found && it.hasNext (); ) {
-         TimeoutInfo *timeout = it.getNext();
-         if (timeout->getType () == type) {
-            found = true;
-            Fl::remove_timeout(timeoutCallback, timeout);
-            timeoutInfos->removeRef (timeout);
-         }
+{
+   timeouts.remove (type);
+}
+
+// ---------------------------------------
+//      FltkSocketSource::Connection
+// ---------------------------------------
+
+FltkSocketSource::Connection::Connection (FltkSocketSource *source, int fd)
+{
+   this->source = source;
+   this->fd = fd;
+   setSink (this);
+
+   fcntl (fd, F_SETFL, fcntl (fd, F_GETFL, 0) | O_NONBLOCK);
+   Fl::add_fd (fd, FL_READ, readCallback, (void*)this);
+}
+
+FltkSocketSource::Connection::~Connection ()
+{
+   Fl::remove_fd (getInputFd (fd), FL_READ);
+   close (fd);
+}
+
+void FltkSocketSource::Connection::readCallback (int fd, void *data)
+{
+   Connection *connection = (Connection*) data;
+   int n = connection->processInput (connection->fd);
+   if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                  errno != EINTR))
+      connection->source->remove (connection);
+}
+
+void FltkSocketSource::Connection::inputFdChanged (int oldFd, int newFd)
+{
+   Fl::remove_fd (oldFd, FL_READ);
+   Fl::add_fd (newFd, FL_READ, readCallback, (void*)this);
+}
+
+void FltkSocketSource::Connection::setup (tools::LinesSink *sink)
+{
+   // Not used; connections are set up by FltkSocketSource.
+}
+
+void FltkSocketSource::Connection::addTimeout (double secs, int type)
+{
+   // Not used; timeouts are handled by FltkSocketSource.
+}
+
+void FltkSocketSource::Connection::removeTimeout (int type)
+{
+   // Not used; timeouts are handled by FltkSocketSource.
+}
+
+void FltkSocketSource::Connection::setLinesSource (tools::LinesSource *source)
+{
+}
+
+void FltkSocketSource::Connection::processLine (char *line)
+{
+   source->getSink()->processLine (line);
+}
+
+void FltkSocketSource::Connection::processLines (char **lines, int numLines)
+{
+   source->getSink()->processLines (lines, numLines);
+}
+
+void FltkSocketSource::Connection::timeout (int type)
+{
+}
+
+void FltkSocketSource::Connection::finish ()
+{
+}
+
+// --------------------------
+//      FltkSocketSource
+// --------------------------
+
+/**
+ * \brief Accept connections on `listenFd`; the socket file `listenPath` (may
+ *    be NULL) is removed when the source is deleted.
+ */
+FltkSocketSource::FltkSocketSource (int listenFd, const char *listenPath)
+{
+   this->listenFd = listenFd;
+   this->listenPath = listenPath ? strdup (listenPath) : NULL;
+}
+
+FltkSocketSource::~FltkSocketSource ()
+{
+   for (int i = 0; i < connections.size (); i++)
+      delete connections.get (i);
+   Fl::remove_fd (listenFd, FL_READ);
+   close (listenFd);
+   if (listenPath) {
+      unlink (listenPath);
+      free (listenPath);
+   }
+}
+
+void FltkSocketSource::acceptCallback (int fd, void *data)
+{
+   FltkSocketSource *source = (FltkSocketSource*) data;
+   int connFd;
+   while ((connFd = accept (fd, NULL, NULL)) != -1) {
+      fcntl (connFd, F_SETFD, FD_CLOEXEC);
+      source->connections.increase ();
+      source->connections.setLast (new Connection (source, connFd));
+   }
+}
+
+/**
+ * \brief Delete a connection (and so remove it from FLTK) at its end.
+ */
+void FltkSocketSource::remove (Connection *connection)
+{
+   for (int i = 0; i < connections.size (); i++)
+      if (connections.get (i) == connection) {
+         // The order of the connections does not matter.
+         connections.set (i, connections.get (connections.size () - 1));
+         connections.setSize (connections.size () - 1);
+         break;
       }
-   } while (found);
+
+   delete connection;
+}
+
+void FltkSocketSource::setup (tools::LinesSink *sink)
+{
+   setSink (sink);
+
+   fcntl (listenFd, F_SETFL, fcntl (listenFd, F_GETFL, 0) | O_NONBLOCK);
+   Fl::add_fd (listenFd, FL_READ, acceptCallback, (void*)this);
+}
+
+// -----------------------
+//      FltkShmSource
+// -----------------------
+
+FltkShmSource::FltkShmSource (tools::ShmRing *ring)
+{
+   this->ring = ring;
+}
+
+FltkShmSource::~FltkShmSource ()
+{
+   Fl::remove_timeout (pollCallback, this);
+   delete ring;
+}
+
+void FltkShmSource::pollCallback (void *data)
+{
+   FltkShmSource *source = (FltkShmSource*) data;
+   // Poll again immediately as long as lines come in; otherwise, every 10
+   // milliseconds.
+   int n = source->ring->read (source->getSink (), BATCH);
+   Fl::repeat_timeout (n > 0 ? 0 : 0.01, pollCallback, data);
+}
+
+void FltkShmSource::setup (tools::LinesSink *sink)
+{
+   setSink (sink);
+   Fl::add_timeout (0, pollCallback, (void*)this);
 }
 
 // ---------------------------
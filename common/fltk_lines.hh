@@ -2,6 +2,8 @@
 #define __COMMON_FLTK_LINES_HH__
 
 #include "lines.hh"
+#include "shm_ring.hh"
+#include "lout/misc.hh"
 
 namespace rtfl {
 
@@ -9,25 +11,19 @@ namespace common {
 
 class FltkLinesSource: public tools::FileLinesSource
 {
-   class TimeoutInfo: public lout::object::Object
-   {
-   private:
-      FltkLinesSource *source;
-      int type;
-
-   public:
-      TimeoutInfo (FltkLinesSource *source, int type);
-
-      inline FltkLinesSource *getSource () { return source; }
-      inline int getType () { return type; }
-   };
-
-   lout::container::typed::List<TimeoutInfo> *timeoutInfos;
+   // Only one FLTK timeout is used, for the earliest timeout in the queue;
+   // `armedTime` is its time, or -1.
+   tools::TimeoutQueue timeouts;
+   long armedTime;
 
+   void arm ();
    static void staticProcessInputCallback (int fd, void *data);
    static void timeoutCallback (void *data);
    void processInputCallback (int fd);
 
+protected:
+   void inputFdChanged (int oldFd, int newFd);
+
 public:
    FltkLinesSource ();
    ~FltkLinesSource ();
@@ -38,6 +34,80 @@ public:
 };
 
 
+/**
+ * \brief Accepts connections on a listening socket (see
+ *    tools::listenUnixSocket()), and reads lines from all of them.
+ *
+ * Each connection has its own buffer, so lines are never torn. Timeouts are
+ * handled as by FltkLinesSource, but, unlike it, standard input is not read,
+ * and the sink is never finished.
+ */
+class FltkSocketSource: public FltkLinesSource
+{
+   class Connection: public tools::FileLinesSource, public tools::LinesSink
+   {
+   private:
+      FltkSocketSource *source;
+      int fd;
+
+      static void readCallback (int fd, void *data);
+
+   protected:
+      void inputFdChanged (int oldFd, int newFd);
+
+   public:
+      Connection (FltkSocketSource *source, int fd);
+      ~Connection ();
+
+      void setup (tools::LinesSink *sink);
+      void addTimeout (double secs, int type);
+      void removeTimeout (int type);
+
+      void setLinesSource (tools::LinesSource *source);
+      void processLine (char *line);
+      void processLines (char **lines, int numLines);
+      void timeout (int type);
+      void finish ();
+   };
+
+   int listenFd;
+   char *listenPath;
+   lout::misc::SimpleVector<Connection*> connections;
+
+   void remove (Connection *connection);
+
+   static void acceptCallback (int fd, void *data);
+
+public:
+   FltkSocketSource (int listenFd, const char *listenPath);
+   ~FltkSocketSource ();
+
+   void setup (tools::LinesSink *sink);
+};
+
+
+/**
+ * \brief Reads lines from a tools::ShmRing, polled by an FLTK timeout.
+ *
+ * The ring is read in batches, so that the user interface stays responsive.
+ * As with FltkSocketSource, the sink is never finished.
+ */
+class FltkShmSource: public FltkLinesSource
+{
+   enum { BATCH = 4096 };
+
+   tools::ShmRing *ring;
+
+   static void pollCallback (void *data);
+
+public:
+   FltkShmSource (tools::ShmRing *ring);
+   ~FltkShmSource ();
+
+   void setup (tools::LinesSink *sink);
+};
+
+
 class FltkDefaultSource: public tools::LinesSourceSequence
 {
 public:
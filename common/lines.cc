@@ -32,8 +32,9 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <sys/select.h>
-#include <sys/timeb.h>
+#include <time.h>
 
 #if 0
 #   define PRINT(fmt) printf ("---- [%p] " fmt "\n", this)
@@ -43,6 +44,7 @@
 #   define PRINTF(fmt, ...)
 #endif
 
+using namespace lout::object;
 using namespace lout::container::typed;
 using namespace lout::misc;
 
@@ -50,6 +52,23 @@ namespace rtfl {
 
 namespace tools {
 
+// -------------------
+//      LinesSink
+// -------------------
+
+/**
+ * \brief Process several lines, in this order.
+ *
+ * Sources pass all lines available at once (e. g. read by one call of
+ * read(2)) via this method. The default implementation calls processLine()
+ * for each line; sinks may override it to reduce the costs per line.
+ */
+void LinesSink::processLines (char **lines, int numLines)
+{
+   for (int i = 0; i < numLines; i++)
+      processLine (lines[i]);
+}
+
 // -----------------------------
 //      LinesSourceSequence
 // -----------------------------
@@ -63,6 +82,12 @@ void LinesSourceSequence::VirtualSink::processLine (char *line)
    sequence->sink->processLine (line);
 }
 
+void LinesSourceSequence::VirtualSink::processLines (char **lines,
+                                                     int numLines)
+{
+   sequence->sink->processLines (lines, numLines);
+}
+
 void LinesSourceSequence::VirtualSink::setLinesSource (LinesSource *source)
 {
 }
@@ -74,6 +99,7 @@ void LinesSourceSequence::VirtualSink::finish ()
 
    if (sequence->iterator.hasNext ()) {
       LinesSource *source = sequence->iterator.getNext ();
+      sequence->numStarted++;
       source->setup (this);
    } else {
       sequence->sink->finish ();
@@ -90,6 +116,7 @@ LinesSourceSequence::LinesSourceSequence (bool ownerOfSources)
    virtualSink.sequence = this;
    sources = new List<LinesSource> (ownerOfSources);
    setupCalled = false;
+   numStarted = 0;
 }
 
 LinesSourceSequence::~LinesSourceSequence ()
@@ -118,13 +145,18 @@ void LinesSourceSequence::addTimeout (double secs, int type)
    // TODO: Processed timeouts must be removed from other sources as well?
    
    // Sent to all, even if only one child source will actually trigger the
-   // timeout; but we do not know which one.
+   // timeout; but we do not know which one. Sources which have already
+   // finished are skipped, since they would collect repeated timeouts (like
+   // periodic snapshots in rtfl-objcount) forever.
 
    // In the real world, LinesSourceSequence is used for ".rtfl" and stdin, so
    // we do not have to worry too much about correctly handling timeouts.
    
-   for (Iterator<LinesSource> it = sources->iterator (); it.hasNext (); ) {
-      it.getNext()->addTimeout (secs, type);
+   int i = 0;
+   for (Iterator<LinesSource> it = sources->iterator (); it.hasNext (); i++) {
+      LinesSource *source = it.getNext ();
+      if (i >= numStarted - 1)
+         source->addTimeout (secs, type);
    }
 }
 
@@ -143,52 +175,98 @@ FileLinesSource::FileLinesSource ()
 {
    bufPos = 0;
    completeLine = true;
+   firstInput = true;
+   decompressor = NULL;
+}
+
+FileLinesSource::~FileLinesSource ()
+{
+   if (decompressor)
+      delete decompressor;
+}
+
+/**
+ * \brief Called when input is read from another file descriptor, i. e. when
+ *    compressed input has been detected.
+ *
+ * Implementations waiting for input must from now on wait for `newFd`.
+ */
+void FileLinesSource::inputFdChanged (int oldFd, int newFd)
+{
 }
 
 int FileLinesSource::processInput (int fd)
 {
-   int n;
-   if ((n = read (fd, buf + bufPos, MAX_LINE_SIZE - bufPos)) > 0) {
+   int n = read (getInputFd (fd), buf + bufPos, BUF_SIZE - bufPos);
+   bool headPending = false;
+
+   if (firstInput && n >= 0) {
+      // A single read(2) may return fewer bytes than needed for detecting
+      // the format, so they are kept until there are enough, or until the
+      // end of the input.
+      if (n > 0 && bufPos + n < Decompressor::DETECT_SIZE) {
+         bufPos += n;
+         return n;
+      }
+
+      firstInput = false;
+      Decompressor::Format format = Decompressor::detect (buf, bufPos + n);
+      if (n > 0 && format != Decompressor::NONE) {
+         // What has been read is passed to the decompressor, and nothing
+         // is processed now.
+         decompressor = new Decompressor (format, fd, buf, bufPos + n);
+         bufPos = 0;
+         inputFdChanged (fd, decompressor->getFd ());
+         return n;
+      }
+
+      // Short input: the bytes kept are processed below, even at the end.
+      headPending = bufPos > 0;
+   }
+
+   if (n > 0 || headPending) {
       int bytesAvail = bufPos + n;
       int startOfLine = 0;
-      bool lineProcessed;
 
       //printf ("--> %d bytes read, %d available\n", n, bytesAvail);
 
-      do {
-         lineProcessed = false;
-         for (int i = startOfLine; !lineProcessed && i < bytesAvail; i++) {
-            if (buf[i] == '\n') {
-               buf[i] = 0;
+      for (int i = 0; i < bytesAvail; i++) {
+         if (buf[i] == '\n') {
+            buf[i] = 0;
               
-               // If lines are too long (see below, where completeLine
-               // is set to false), they are not processed.
-               if (completeLine)
-                  sink->processLine (buf + startOfLine);
-
-               lineProcessed = true;
-               startOfLine = i + 1;
-
-               completeLine = true;
+            // If lines are too long (see below, where completeLine is set
+            // to false), they are not processed.
+            if (completeLine && i - startOfLine < MAX_LINE_SIZE) {
+               lines.increase ();
+               lines.setLast (buf + startOfLine);
             }
+
+            startOfLine = i + 1;
+            completeLine = true;
          }
-      } while (lineProcessed);
+      }
+
+      // All lines are passed at once, before the buffer is changed.
+      if (lines.size () > 0) {
+         sink->processLines (lines.getArray (), lines.size ());
+         lines.setSize (0);
+      }
 
       memmove (buf, buf + startOfLine, bytesAvail - startOfLine);
       bufPos = bytesAvail - startOfLine;
 
       PRINTF ("processInput: %d bytes left in buffer", bufPos);
       
-      // Handle case when line is to large (> MAX_LINE_SIZE
-      // bytes). The whole line is discarded (completeLine), so we
-      // empty the buffer by setting bufPos to 0.
-      if (bufPos == MAX_LINE_SIZE) {
+      // Handle case when line is to large (>= MAX_LINE_SIZE bytes). The
+      // whole line is discarded (completeLine), so we empty the buffer by
+      // setting bufPos to 0.
+      if (bufPos >= MAX_LINE_SIZE) {
          bufPos = 0;
          completeLine = false;
       }
 
       //printf ("   --> %d processed, new pos: %d; will read %d\n",
-      //        startOfLine, bufPos, MAX_LINE_SIZE - bufPos);
+      //        startOfLine, bufPos, BUF_SIZE - bufPos);
    } 
 
    //printf ("   --> read(2) returns %d\n", n);
@@ -196,41 +274,159 @@ int FileLinesSource::processInput (int fd)
    return n;
 }
    
-// -----------------------------
-//      BlockingLinesSource
-// -----------------------------
+// ----------------------
+//      TimeoutQueue
+// ----------------------
 
-BlockingLinesSource::TimeoutInfo::TimeoutInfo (long time, int type)
+TimeoutQueue::TimeoutQueue ()
 {
-   this->time = time;
-   this->type = type;
+   byType = new HashTable<Integer, Timeout> (true, false);
+   nextSeq = 0;
 }
 
-bool BlockingLinesSource::TimeoutInfo::equals(Object *other)
+TimeoutQueue::~TimeoutQueue ()
 {
-   return time == ((TimeoutInfo*)other)->time &&
-      type == ((TimeoutInfo*)other)->type;
+   for (int i = 0; i < heap.size (); i++)
+      delete heap.get (i);
+   delete byType;
 }
 
-int BlockingLinesSource::TimeoutInfo::hashValue()
+void TimeoutQueue::siftUp (int index)
 {
-   // This should better be hidden in lout::objects. Cf. Pointer::hashValue().
-#if SIZEOF_LONG == 4
-   return (int)time ^ type;
-#else
-   return ((intptr_t)time >> 32) ^ ((intptr_t)time) ^ type;
-#endif
+   Timeout *timeout = heap.get (index);
+   while (index > 0) {
+      int parent = (index - 1) / 2;
+      if (!less (timeout, heap.get (parent)))
+         break;
+      place (heap.get (parent), index);
+      index = parent;
+   }
+   place (timeout, index);
+}
+
+void TimeoutQueue::siftDown (int index)
+{
+   Timeout *timeout = heap.get (index);
+   int size = heap.size ();
+   while (true) {
+      int child = 2 * index + 1;
+      if (child >= size)
+         break;
+      if (child + 1 < size && less (heap.get (child + 1), heap.get (child)))
+         child++;
+      if (!less (heap.get (child), timeout))
+         break;
+      place (heap.get (child), index);
+      index = child;
+   }
+   place (timeout, index);
 }
 
+/**
+ * \brief Add a timeout, which expires after `secs` seconds.
+ *
+ * The returned handle can be passed to cancel(), as long as the timeout has
+ * not expired (see popExpired()) or been removed.
+ */
+TimeoutQueue::Timeout *TimeoutQueue::add (double secs, int type)
+{
+   Timeout *timeout = new Timeout ();
+   timeout->time = getCurrentTime () + (long)(secs * 1000);
+   timeout->seq = nextSeq++;
+   timeout->type = type;
+
+   Integer key (type);
+   timeout->prevOfType = NULL;
+   timeout->nextOfType = byType->get (&key);
+   if (timeout->nextOfType)
+      timeout->nextOfType->prevOfType = timeout;
+   byType->put (new Integer (type), timeout);
+
+   heap.increase ();
+   place (timeout, heap.size () - 1);
+   siftUp (heap.size () - 1);
+
+   return timeout;
+}
+
+void TimeoutQueue::cancel (Timeout *timeout)
+{
+   if (timeout->nextOfType)
+      timeout->nextOfType->prevOfType = timeout->prevOfType;
+   if (timeout->prevOfType)
+      timeout->prevOfType->nextOfType = timeout->nextOfType;
+   else {
+      Integer key (timeout->type);
+      if (timeout->nextOfType)
+         byType->put (new Integer (timeout->type), timeout->nextOfType);
+      else
+         byType->remove (&key);
+   }
+
+   int index = timeout->index;
+   Timeout *last = heap.get (heap.size () - 1);
+   heap.setSize (heap.size () - 1);
+   if (last != timeout) {
+      place (last, index);
+      if (index > 0 && less (last, heap.get ((index - 1) / 2)))
+         siftUp (index);
+      else
+         siftDown (index);
+   }
+
+   delete timeout;
+}
+
+/**
+ * \brief Remove all timeouts of a given type.
+ */
+void TimeoutQueue::remove (int type)
+{
+   Integer key (type);
+   Timeout *timeout;
+   while ((timeout = byType->get (&key)))
+      cancel (timeout);
+}
+
+long TimeoutQueue::getCurrentTime ()
+{
+   // A monotonic clock, so that timeouts are not affected by changes of the
+   // system time. (See also SpscRing and ChunkedObjectsSource, which wait for
+   // conditions with deadlines.)
+   struct timespec ts;
+   if (clock_gettime (CLOCK_MONOTONIC, &ts) == -1)
+      syserr ("clock_gettime() failed");
+   return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief If a timeout has expired, remove it, and return its type in
+ *    `*type`.
+ *
+ * The return value tells whether an expired timeout has been found.
+ */
+bool TimeoutQueue::popExpired (int *type)
+{
+   if (heap.size () == 0 || heap.get(0)->time > getCurrentTime ())
+      return false;
+   else {
+      *type = heap.get(0)->type;
+      cancel (heap.get (0));
+      return true;
+   }
+}
+
+// -----------------------------
+//      BlockingLinesSource
+// -----------------------------
+
 BlockingLinesSource::BlockingLinesSource (int fd)
 {
    this->fd = fd;
-   timeoutInfos = new HashSet<TimeoutInfo> (true);
 }
 
 BlockingLinesSource::~BlockingLinesSource ()
 {
-   delete timeoutInfos;
 }
    
 void BlockingLinesSource::setup (LinesSink *sink)
@@ -244,18 +440,21 @@ void BlockingLinesSource::setup (LinesSink *sink)
 
    bool eos = false;
    while (!eos) {
+      // Changes for compressed input.
+      int inputFd = getInputFd (fd);
+
       fd_set readfds;
       FD_ZERO (&readfds);
-      FD_SET (fd, &readfds);
+      FD_SET (inputFd, &readfds);
 
-      TimeoutInfo *nextTimeout = getNextTimeoutInfo ();
+      long nextTime = timeouts.getNextTime ();
 
       struct timeval tv, *tvp;
-      if (nextTimeout == NULL) {
+      if (nextTime == -1) {
          tvp = NULL;
          PRINT ("no timeout");
       } else {
-         long tdelta = max (nextTimeout->getTime () - getCurrentTime (), 0L);
+         long tdelta = max (nextTime - TimeoutQueue::getCurrentTime (), 0L);
          tv.tv_sec = tdelta / 1000;
          tv.tv_usec = (tdelta % 1000) * 1000;
          tvp = &tv;
@@ -267,13 +466,18 @@ void BlockingLinesSource::setup (LinesSink *sink)
       PRINT ("<< processTimeouts");
 
       PRINT (">> select");
-      if (select (fd + 1, &readfds, NULL, NULL, tvp) == -1)
-         syserr ("select failed");
+      if (select (inputFd + 1, &readfds, NULL, NULL, tvp) == -1) {
+         // Interrupted by a signal (which may e. g. request some output in
+         // the next timeout): simply continue.
+         if (errno != EINTR)
+            syserr ("select failed");
+         FD_ZERO (&readfds);
+      }
       PRINT ("<< select");
 
       processTimeouts ();
 
-      if (FD_ISSET (fd, &readfds)) {
+      if (FD_ISSET (inputFd, &readfds)) {
          PRINT (">> processInput");
          int n = processInput (fd);
          PRINT ("<< processInput");
@@ -290,70 +494,21 @@ void BlockingLinesSource::setup (LinesSink *sink)
 void BlockingLinesSource::addTimeout (double secs, int type)
 {
    PRINTF ("addTimeout (%g, %d)", secs, type);
-   timeoutInfos->put (new TimeoutInfo (getCurrentTime () + secs * 1000, type));
+   timeouts.add (secs, type);
 }
 
 void BlockingLinesSource::removeTimeout (int type)
 {
    PRINTF ("removeTimeout (%d)", type);
-
-   // Iterators will not work when the set is modified; hence this nested loop.
-   bool found;
-   do {
-      found = false;
-      for (Iterator<TimeoutInfo> it = timeoutInfos->iterator ();
-           !found && it.hasNext (); ) {
-         TimeoutInfo *timeout = it.getNext();
-         if (timeout->getType () == type) {
-            found = true;
-            timeoutInfos->remove (timeout);
-         }
-      }
-   } while (found);
-}
-
-long BlockingLinesSource::getCurrentTime ()
-{
-   struct timeb t;
-   if (ftime (&t) == -1)
-      syserr ("ftime() failed");
-   return t.time * 1000L + t.millitm;
-}
-
-BlockingLinesSource::TimeoutInfo *BlockingLinesSource::getNextTimeoutInfo ()
-{
-   TimeoutInfo *nextTimeout = NULL;
-   
-   for (Iterator<TimeoutInfo> it = timeoutInfos->iterator ();
-        it.hasNext (); ) {
-      TimeoutInfo *timeout = it.getNext();
-      if (nextTimeout == NULL ||
-          timeout->getTime () < nextTimeout->getTime ())
-         nextTimeout = timeout;
-   }
-
-   return nextTimeout;
+   timeouts.remove (type);
 }
 
 void BlockingLinesSource::processTimeouts ()
 {
-   long currentTime = getCurrentTime ();
-
-   while (true) {
-      TimeoutInfo *nextTimeout = getNextTimeoutInfo ();
-      if (nextTimeout == NULL)
-         break;
-
-      PRINTF ("processTimeouts: %ld > %ld? %s",
-              nextTimeout->getTime (), currentTime,
-              nextTimeout->getTime () > currentTime ? "yes" : "no");
-      if (nextTimeout->getTime () > currentTime)
-         break;
-
+   int type;
+   while (timeouts.popExpired (&type)) {
       PRINT ("processTimeouts: call timeout");
-
-      getSink()->timeout (nextTimeout->getType ());
-      timeoutInfos->remove (nextTimeout);
+      getSink()->timeout (type);
    }
 }
 
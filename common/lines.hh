@@ -3,6 +3,8 @@
 
 #include "lout/object.hh"
 #include "lout/container.hh"
+#include "lout/misc.hh"
+#include "decompress.hh"
 
 namespace rtfl {
 
@@ -15,6 +17,7 @@ class LinesSink: public lout::object::Object
 public:
    virtual void setLinesSource (LinesSource *source) = 0;
    virtual void processLine (char *line) = 0;
+   virtual void processLines (char **lines, int numLines);
    virtual void timeout (int type) = 0;
    virtual void finish () = 0;
 };
@@ -40,6 +43,7 @@ private:
       VirtualSink ();
       void setLinesSource (LinesSource *source);
       void processLine (char *line);
+      void processLines (char **lines, int numLines);
       void timeout (int type);
       void finish ();
    };
@@ -48,6 +52,7 @@ private:
    LinesSink *sink;
    lout::container::typed::List<LinesSource> *sources;
    bool setupCalled;
+   int numStarted;
    lout::container::typed::Iterator<LinesSource> iterator;
 
 public:
@@ -60,49 +65,113 @@ public:
 };
 
 
+/**
+ * \brief Base for sources reading lines from a file descriptor.
+ *
+ * Compressed input (gzip or zstd; see Decompressor) is detected by the first
+ * bytes read, and decompressed transparently. In this case, input is read
+ * from another file descriptor (see getInputFd() and inputFdChanged()).
+ */
 class FileLinesSource: public LinesSource
 {
-private:
+public:
+   /// Longer lines are discarded.
    enum { MAX_LINE_SIZE = 1000 };
 
+private:
+   /// Read at once. Must be larger than MAX_LINE_SIZE.
+   enum { BUF_SIZE = 64 * 1024 };
+
    tools::LinesSink *sink;
-   char buf[MAX_LINE_SIZE + 1];
+   char buf[BUF_SIZE + 1];
+   lout::misc::SimpleVector<char*> lines;
    int bufPos;
-   bool completeLine;
+   bool completeLine, firstInput;
+   Decompressor *decompressor;
 
 protected:
    FileLinesSource ();
+   ~FileLinesSource ();
    
    int processInput (int fd);
+   virtual void inputFdChanged (int oldFd, int newFd);
+   inline int getInputFd (int fd) {
+      return decompressor ? decompressor->getFd () : fd; }
    inline void setSink (LinesSink *sink) {
       this->sink = sink; sink->setLinesSource (this); }      
    inline LinesSink *getSink () { return sink; }
 };
 
 
-class BlockingLinesSource: public FileLinesSource
+/**
+ * \brief A set of pending timeouts, as used by implementations of
+ *    LinesSource.
+ *
+ * The timeouts are kept in a binary min-heap ordered by time (and, for equal
+ * times, by the order of adding), so that adding, cancelling (by the handle
+ * returned by add()) and popping are O(log n), and getNextTime() is O(1). For
+ * remove(), the timeouts of each type are linked in a list, which is found
+ * via a hash table.
+ *
+ * Times are measured in milliseconds, see getCurrentTime().
+ */
+class TimeoutQueue
 {
-private:
-   class TimeoutInfo: public lout::object::Object
+public:
+   class Timeout: public lout::object::Object
    {
+      friend class TimeoutQueue;
+
    private:
       long time;
-      int type;
+      unsigned long seq;
+      int type, index;
+      Timeout *prevOfType, *nextOfType;
 
    public:
-      TimeoutInfo (long time, int type);
-      bool equals(Object *other);
-      int hashValue();
-
       inline long getTime () { return time; }
       inline int getType () { return type; }
    };
-   
+
+private:
+   lout::misc::SimpleVector<Timeout*> heap;
+   lout::container::typed::HashTable<lout::object::Integer, Timeout> *byType;
+   unsigned long nextSeq;
+
+   inline bool less (Timeout *t1, Timeout *t2)
+   { return t1->time < t2->time || (t1->time == t2->time && t1->seq < t2->seq); }
+
+   inline void place (Timeout *timeout, int index)
+   { heap.set (index, timeout); timeout->index = index; }
+
+   void siftUp (int index);
+   void siftDown (int index);
+
+public:
+   TimeoutQueue ();
+   ~TimeoutQueue ();
+
+   static long getCurrentTime ();
+
+   Timeout *add (double secs, int type);
+   void cancel (Timeout *timeout);
+   void remove (int type);
+   bool popExpired (int *type);
+
+   /**
+    * \brief Returns the time of the next timeout, or -1, if there is none.
+    */
+   inline long getNextTime ()
+   { return heap.size () > 0 ? heap.get(0)->time : -1; }
+};
+
+
+class BlockingLinesSource: public FileLinesSource
+{
+private:
    int fd;
-   lout::container::typed::HashSet<TimeoutInfo> *timeoutInfos;
+   TimeoutQueue timeouts;
 
-   long getCurrentTime ();
-   TimeoutInfo *getNextTimeoutInfo ();
    void processTimeouts ();
 
 public:
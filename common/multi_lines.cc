@@ -0,0 +1,411 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+#include "multi_lines.hh"
+#include "tools.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#   include <sys/epoll.h>
+#else
+#   include <poll.h>
+#endif
+
+namespace rtfl {
+
+namespace tools {
+
+// -----------------------------------
+//      MultiLinesSource::Input
+// -----------------------------------
+
+MultiLinesSource::Input::Input (MultiLinesSource *source, int fd)
+{
+   this->source = source;
+   this->fd = fd;
+   alwaysReady = false;
+   setSink (this);
+}
+
+MultiLinesSource::Input::~Input ()
+{
+   close (fd);
+}
+
+void MultiLinesSource::Input::inputFdChanged (int oldFd, int newFd)
+{
+   // Compressed input: read from the decompressor from now on.
+   source->unwatch (this, oldFd);
+   source->watch (this, newFd);
+}
+
+/**
+ * \brief Read what is available, and pass the complete lines.
+ *
+ * Returns false when the end of this input has been reached.
+ */
+bool MultiLinesSource::Input::read ()
+{
+   int n = processInput (fd);
+   if (n == 0)
+      return false;
+   else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+            errno != EINTR) {
+      perror ("read");
+      return false;
+   } else
+      return true;
+}
+
+void MultiLinesSource::Input::setup (LinesSink *sink)
+{
+   // Not used; see MultiLinesSource::setup().
+}
+
+void MultiLinesSource::Input::addTimeout (double secs, int type)
+{
+   // Not used; timeouts are handled by MultiLinesSource.
+}
+
+void MultiLinesSource::Input::removeTimeout (int type)
+{
+   // Not used; timeouts are handled by MultiLinesSource.
+}
+
+void MultiLinesSource::Input::setLinesSource (LinesSource *source)
+{
+}
+
+void MultiLinesSource::Input::processLine (char *line)
+{
+   source->sink->processLine (line);
+}
+
+void MultiLinesSource::Input::processLines (char **lines, int numLines)
+{
+   source->sink->processLines (lines, numLines);
+}
+
+void MultiLinesSource::Input::timeout (int type)
+{
+}
+
+void MultiLinesSource::Input::finish ()
+{
+}
+
+// --------------------------
+//      MultiLinesSource
+// --------------------------
+
+MultiLinesSource::MultiLinesSource ()
+{
+#ifdef HAVE_SYS_EPOLL_H
+   if ((epollFd = epoll_create1 (EPOLL_CLOEXEC)) == -1)
+      syserr ("epoll_create1 failed");
+#else
+   epollFd = -1;
+#endif
+   sink = NULL;
+   numAlwaysReady = 0;
+   listenFd = -1;
+   listenPath = NULL;
+   stopped = false;
+
+   if (pipe (wakeupFds) == -1)
+      syserr ("pipe failed");
+   for (int i = 0; i < 2; i++)
+      fcntl (wakeupFds[i], F_SETFL,
+             fcntl (wakeupFds[i], F_GETFL, 0) | O_NONBLOCK);
+   watch (wakeupFds[0], wakeupFds);
+}
+
+MultiLinesSource::~MultiLinesSource ()
+{
+   for (int i = 0; i < inputs.size (); i++)
+      delete inputs.get (i);
+   if (listenFd != -1)
+      close (listenFd);
+   if (listenPath) {
+      unlink (listenPath);
+      free (listenPath);
+   }
+   close (wakeupFds[0]);
+   close (wakeupFds[1]);
+   if (epollFd != -1)
+      close (epollFd);
+}
+
+/**
+ * \brief Add an input. The file descriptor is closed at its end.
+ */
+void MultiLinesSource::add (int fd)
+{
+   // Read non-blocking, so that one input cannot block the others.
+   fcntl (fd, F_SETFL, fcntl (fd, F_GETFL, 0) | O_NONBLOCK);
+
+   Input *input = new Input (this, fd);
+   inputs.increase ();
+   inputs.setLast (input);
+   watch (input, fd);
+}
+
+/**
+ * \brief Accept connections on a listening socket (see listenUnixSocket()),
+ *    and add each connection as an input; must be called before setup().
+ *
+ * In this case, setup() only returns after stop() has been called. The
+ * socket file `path` (may be NULL) is removed when the source is deleted.
+ */
+void MultiLinesSource::addListener (int fd, const char *path)
+{
+   assert (listenFd == -1 && sink == NULL);
+
+   fcntl (fd, F_SETFL, fcntl (fd, F_GETFL, 0) | O_NONBLOCK);
+   listenFd = fd;
+   listenPath = path ? strdup (path) : NULL;
+   watch (fd, &listenFd);
+}
+
+/**
+ * \brief Let setup() return soon, even if not all inputs have reached their
+ *    end.
+ *
+ * This may be called from a signal handler.
+ */
+void MultiLinesSource::stop ()
+{
+   // Only async-signal-safe functions here. If the pipe is full, there is
+   // already a wakeup pending, so the result can be ignored.
+   char c = 0;
+   ssize_t n = ::write (wakeupFds[1], &c, 1);
+   (void) n;
+}
+
+void MultiLinesSource::watch (Input *input, int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   struct epoll_event event;
+   event.events = EPOLLIN;
+   event.data.ptr = input;
+   if (epoll_ctl (epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      // Regular files are not supported by epoll(7), but they are always
+      // readable anyway.
+      if (errno == EPERM) {
+         input->alwaysReady = true;
+         numAlwaysReady++;
+      } else
+         syserr ("epoll_ctl failed");
+   }
+#endif
+}
+
+/**
+ * \brief Watch a file descriptor which is not an input (listener or wakeup
+ *    pipe); `tag` identifies it in wait().
+ */
+void MultiLinesSource::watch (int fd, void *tag)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   struct epoll_event event;
+   event.events = EPOLLIN;
+   event.data.ptr = tag;
+   if (epoll_ctl (epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+      syserr ("epoll_ctl failed");
+#endif
+}
+
+void MultiLinesSource::unwatch (Input *input, int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   if (input->alwaysReady) {
+      input->alwaysReady = false;
+      numAlwaysReady--;
+   } else
+      epoll_ctl (epollFd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+void MultiLinesSource::remove (Input *input)
+{
+   unwatch (input, input->getReadFd ());
+
+   for (int i = 0; i < inputs.size (); i++)
+      if (inputs.get (i) == input) {
+         // The order of the inputs does not matter.
+         inputs.set (i, inputs.get (inputs.size () - 1));
+         inputs.setSize (inputs.size () - 1);
+         break;
+      }
+
+   delete input;
+}
+
+void MultiLinesSource::acceptConnections ()
+{
+   int fd;
+   while ((fd = accept (listenFd, NULL, NULL)) != -1) {
+      fcntl (fd, F_SETFD, FD_CLOEXEC);
+      add (fd);
+   }
+
+   if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+       errno != ECONNABORTED)
+      perror ("accept");
+}
+
+void MultiLinesSource::processWakeup ()
+{
+   char buf[64];
+   while (::read (wakeupFds[0], buf, sizeof (buf)) > 0)
+      ;
+   stopped = true;
+}
+
+/**
+ * \brief Wait until some inputs are readable, or the next timeout is due.
+ *
+ * The readable inputs are stored in `ready` (at most MAX_READY); the return
+ * value is their number. New connections and stop() are handled here.
+ */
+int MultiLinesSource::wait (Input **ready)
+{
+   long nextTime = timeouts.getNextTime ();
+   int waitMillis = nextTime == -1 ? -1 :
+      lout::misc::max (nextTime - TimeoutQueue::getCurrentTime (), 0L);
+
+   int n = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+   if (numAlwaysReady > 0)
+      waitMillis = 0;
+
+   struct epoll_event events[MAX_READY];
+   int numEvents = epoll_wait (epollFd, events, MAX_READY, waitMillis);
+   if (numEvents == -1) {
+      if (errno != EINTR)
+         syserr ("epoll_wait failed");
+      numEvents = 0;
+   }
+
+   for (int i = 0; i < numEvents; i++) {
+      if (events[i].data.ptr == &listenFd)
+         acceptConnections ();
+      else if (events[i].data.ptr == wakeupFds)
+         processWakeup ();
+      else
+         ready[n++] = (Input*) events[i].data.ptr;
+   }
+
+   for (int i = 0; numAlwaysReady > 0 && i < inputs.size () && n < MAX_READY;
+        i++)
+      if (inputs.get(i)->alwaysReady)
+         ready[n++] = inputs.get (i);
+#else
+   int numInputs = inputs.size ();
+   struct pollfd *pfds = new struct pollfd[numInputs + 2];
+   for (int i = 0; i < numInputs; i++) {
+      pfds[i].fd = inputs.get(i)->getReadFd ();
+      pfds[i].events = POLLIN;
+   }
+   // Negative file descriptors are ignored by poll(2).
+   pfds[numInputs].fd = listenFd;
+   pfds[numInputs + 1].fd = wakeupFds[0];
+   pfds[numInputs].events = pfds[numInputs + 1].events = POLLIN;
+
+   if (poll (pfds, numInputs + 2, waitMillis) == -1) {
+      if (errno != EINTR)
+         syserr ("poll failed");
+   } else {
+      for (int i = 0; i < numInputs && n < MAX_READY; i++)
+         if (pfds[i].revents)
+            ready[n++] = inputs.get (i);
+      if (pfds[numInputs].revents)
+         acceptConnections ();
+      if (pfds[numInputs + 1].revents)
+         processWakeup ();
+   }
+
+   delete[] pfds;
+#endif
+
+   return n;
+}
+
+void MultiLinesSource::setup (LinesSink *sink)
+{
+   this->sink = sink;
+   sink->setLinesSource (this);
+
+   Input *ready[MAX_READY];
+
+   while (!stopped && (inputs.size () > 0 || listenFd != -1)) {
+      processTimeouts ();
+
+      int n = wait (ready);
+      for (int i = 0; i < n; i++) {
+         // One read per ready input and round, so that no input is
+         // preferred.
+         if (!ready[i]->read ())
+            remove (ready[i]);
+      }
+   }
+
+   while (inputs.size () > 0)
+      remove (inputs.get (0));
+   sink->finish ();
+}
+
+void MultiLinesSource::addTimeout (double secs, int type)
+{
+   timeouts.add (secs, type);
+}
+
+void MultiLinesSource::removeTimeout (int type)
+{
+   timeouts.remove (type);
+}
+
+void MultiLinesSource::processTimeouts ()
+{
+   int type;
+   while (timeouts.popExpired (&type))
+      sink->timeout (type);
+}
+
+} // namespace tools
+
+} // namespace rtfl
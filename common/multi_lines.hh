@@ -0,0 +1,95 @@
+#ifndef __COMMON_MULTI_LINES_HH__
+#define __COMMON_MULTI_LINES_HH__
+
+#include "lines.hh"
+#include "lout/misc.hh"
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief Reads lines from several file descriptors (e. g. pipes or FIFOs of
+ *    different traced processes, or connections to a socket), and passes
+ *    them to one sink.
+ *
+ * Each input has its own line buffer (as a FileLinesSource), so that only
+ * complete lines are passed, never parts of lines written by different
+ * processes. Lines are passed in the order of arrival; the inputs are
+ * multiplexed with epoll(7) (or poll(2), where epoll is not available);
+ * regular files, which epoll does not support, are regarded as always
+ * readable.
+ * The sink is finished when all inputs have reached their end, or, when
+ * connections are accepted (see addListener()), after stop() has been
+ * called.
+ *
+ * Timeouts are handled as in BlockingLinesSource.
+ */
+class MultiLinesSource: public LinesSource
+{
+private:
+   class Input: public FileLinesSource, public LinesSink
+   {
+   private:
+      MultiLinesSource *source;
+
+   protected:
+      void inputFdChanged (int oldFd, int newFd);
+
+   public:
+      int fd;
+      bool alwaysReady;
+
+      Input (MultiLinesSource *source, int fd);
+      ~Input ();
+
+      bool read ();
+      inline int getReadFd () { return getInputFd (fd); }
+
+      void setup (LinesSink *sink);
+      void addTimeout (double secs, int type);
+      void removeTimeout (int type);
+
+      void setLinesSource (LinesSource *source);
+      void processLine (char *line);
+      void processLines (char **lines, int numLines);
+      void timeout (int type);
+      void finish ();
+   };
+
+   enum { MAX_READY = 64 };
+
+   lout::misc::SimpleVector<Input*> inputs;
+   int epollFd, numAlwaysReady, listenFd, wakeupFds[2];
+   char *listenPath;
+   bool stopped;
+   LinesSink *sink;
+   TimeoutQueue timeouts;
+
+   void watch (Input *input, int fd);
+   void watch (int fd, void *tag);
+   void unwatch (Input *input, int fd);
+   void remove (Input *input);
+   void acceptConnections ();
+   void processWakeup ();
+   void processTimeouts ();
+   int wait (Input **ready);
+
+public:
+   MultiLinesSource ();
+   ~MultiLinesSource ();
+
+   void add (int fd);
+   void addListener (int fd, const char *path);
+   void stop ();
+
+   void setup (LinesSink *sink);
+   void addTimeout (double secs, int type);
+   void removeTimeout (int type);
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_MULTI_LINES_HH__
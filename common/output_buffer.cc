@@ -0,0 +1,248 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "output_buffer.hh"
+#include "tools.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZ
+#  include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#  include <zstd.h>
+#endif
+
+namespace rtfl {
+
+namespace tools {
+
+OutputBuffer::OutputBuffer (int fd, Compression compression)
+{
+   assert (isSupported (compression));
+
+   this->fd = fd;
+   this->compression = compression;
+   buf = (char*) malloc (BUF_SIZE);
+   outBuf = compression == NONE ? NULL : (char*) malloc (BUF_SIZE);
+   size = 0;
+   lineFlushed = closed = false;
+   stream = NULL;
+
+   switch (compression) {
+#ifdef HAVE_LIBZ
+   case GZIP:
+      {
+         z_stream *z = new z_stream;
+         memset (z, 0, sizeof (z_stream));
+         // 16: gzip format.
+         if (deflateInit2 (z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                           Z_DEFAULT_STRATEGY) != Z_OK)
+            lout::misc::assertNotReached ();
+         stream = z;
+      }
+      break;
+#endif
+
+#ifdef HAVE_LIBZSTD
+   case ZSTD:
+      stream = ZSTD_createCStream ();
+      ZSTD_initCStream ((ZSTD_CStream*) stream, ZSTD_CLEVEL_DEFAULT);
+      break;
+#endif
+
+   default:
+      break;
+   }
+}
+
+OutputBuffer::~OutputBuffer ()
+{
+   close ();
+   free (buf);
+   if (outBuf)
+      free (outBuf);
+}
+
+bool OutputBuffer::isSupported (Compression compression)
+{
+   switch (compression) {
+   case NONE:
+      return true;
+#ifdef HAVE_LIBZ
+   case GZIP:
+      return true;
+#endif
+#ifdef HAVE_LIBZSTD
+   case ZSTD:
+      return true;
+#endif
+   default:
+      return false;
+   }
+}
+
+void OutputBuffer::put (const char *s)
+{
+   for (int i = 0; s[i]; i++)
+      put (s[i]);
+}
+
+void OutputBuffer::putInt (int n)
+{
+   char s[16];
+   snprintf (s, sizeof (s), "%d", n);
+   put (s);
+}
+
+/**
+ * \brief Called after each line; flushes in line-flushed mode.
+ */
+void OutputBuffer::endLine ()
+{
+   if (lineFlushed)
+      flush ();
+}
+
+void OutputBuffer::flush ()
+{
+   if (!closed)
+      writeBuffer (FLUSH);
+}
+
+/**
+ * \brief Write all data, and end the compressed stream. Called by the
+ *    destructor, when not called before. The file descriptor is not closed.
+ */
+void OutputBuffer::close ()
+{
+   if (!closed) {
+      writeBuffer (FINISH);
+      closed = true;
+
+      switch (compression) {
+#ifdef HAVE_LIBZ
+      case GZIP:
+         deflateEnd ((z_stream*) stream);
+         delete (z_stream*) stream;
+         break;
+#endif
+
+#ifdef HAVE_LIBZSTD
+      case ZSTD:
+         ZSTD_freeCStream ((ZSTD_CStream*) stream);
+         break;
+#endif
+
+      default:
+         break;
+      }
+   }
+}
+
+void OutputBuffer::writeAll (const char *data, int size)
+{
+   while (size > 0) {
+      ssize_t n = write (fd, data, size);
+      if (n == -1) {
+         if (errno != EINTR)
+            syserr ("write failed");
+      } else {
+         data += n;
+         size -= n;
+      }
+   }
+}
+
+/**
+ * \brief Pass the buffer to the compressor (if any) and write what is
+ *    produced. Unless `mode` is CONTINUE, all data is written.
+ */
+void OutputBuffer::writeBuffer (Mode mode)
+{
+   switch (compression) {
+   case NONE:
+      writeAll (buf, size);
+      break;
+
+#ifdef HAVE_LIBZ
+   case GZIP:
+      {
+         z_stream *z = (z_stream*) stream;
+         int flush = mode == CONTINUE ? Z_NO_FLUSH :
+            (mode == FLUSH ? Z_SYNC_FLUSH : Z_FINISH);
+         z->next_in = (Bytef*) buf;
+         z->avail_in = size;
+         // Continue until all input is consumed and the output buffer is
+         // not filled completely (which means that nothing is pending).
+         do {
+            z->next_out = (Bytef*) outBuf;
+            z->avail_out = BUF_SIZE;
+            deflate (z, flush);
+            writeAll (outBuf, BUF_SIZE - z->avail_out);
+         } while (z->avail_in > 0 || z->avail_out == 0);
+      }
+      break;
+#endif
+
+#ifdef HAVE_LIBZSTD
+   case ZSTD:
+      {
+         ZSTD_EndDirective end = mode == CONTINUE ? ZSTD_e_continue :
+            (mode == FLUSH ? ZSTD_e_flush : ZSTD_e_end);
+         ZSTD_inBuffer input = { buf, (size_t) size, 0 };
+         size_t remaining;
+         do {
+            ZSTD_outBuffer output = { outBuf, BUF_SIZE, 0 };
+            remaining = ZSTD_compressStream2 ((ZSTD_CStream*) stream, &output,
+                                              &input, end);
+            if (ZSTD_isError (remaining))
+               lout::misc::assertNotReached ();
+            writeAll (outBuf, output.pos);
+         } while (end == ZSTD_e_continue ? input.pos < input.size :
+                  remaining > 0);
+      }
+      break;
+#endif
+
+   default:
+      break;
+   }
+
+   size = 0;
+}
+
+} // namespace tools
+
+} // namespace rtfl
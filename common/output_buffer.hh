@@ -0,0 +1,67 @@
+#ifndef __COMMON_OUTPUT_BUFFER_HH__
+#define __COMMON_OUTPUT_BUFFER_HH__
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief Writes text to a file descriptor, via a large buffer, and
+ *    optionally compressed (gzip or zstd; the counterpart of Decompressor).
+ *
+ * Data is written when the buffer is full, when flush() is called, or, in
+ * line-flushed mode, after each line (see endLine()). The user is
+ * responsible for calling flush() regularly when latency matters (see e. g.
+ * rtfl::objects::ObjectsWriter). Flushing a compressed stream produces a
+ * complete block, so that all data written so far can be decompressed by
+ * the reader.
+ */
+class OutputBuffer
+{
+public:
+   enum Compression { NONE, GZIP, ZSTD };
+
+private:
+   enum { BUF_SIZE = 1024 * 1024 };
+   enum Mode { CONTINUE, FLUSH, FINISH };
+
+   int fd;
+   Compression compression;
+   char *buf, *outBuf;
+   int size;
+   bool lineFlushed, closed;
+   void *stream;
+
+   void writeAll (const char *data, int size);
+   void writeBuffer (Mode mode);
+
+public:
+   OutputBuffer (int fd, Compression compression);
+   ~OutputBuffer ();
+
+   static bool isSupported (Compression compression);
+
+   inline void setLineFlushed (bool lineFlushed)
+   { this->lineFlushed = lineFlushed; }
+   inline bool isLineFlushed () { return lineFlushed; }
+   inline bool isEmpty () { return size == 0; }
+
+   inline void put (char c)
+   {
+      if (size == BUF_SIZE)
+         writeBuffer (CONTINUE);
+      buf[size++] = c;
+   }
+
+   void put (const char *s);
+   void putInt (int n);
+   void endLine ();
+   void flush ();
+   void close ();
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_OUTPUT_BUFFER_HH__
@@ -41,6 +41,37 @@ void Parser::setLinesSource (LinesSource *source)
 }
 
 void Parser::processLine (char *line)
+{
+   processLines (&line, 1);
+}
+
+void Parser::processLines (char **lines, int numLines)
+{
+   for (int i = 0; i < numLines; i++)
+      parseLine (lines[i]);
+
+   processBatch ();
+
+   for (int i = 0; i < lineCopies.size (); i++)
+      free (lineCopies.get (i));
+   for (int i = 0; i < lineParts.size (); i++)
+      delete[] lineParts.get (i);
+   lineCopies.setSize (0);
+   lineParts.setSize (0);
+}
+
+/**
+ * \brief Called by processLines(), when processCommand() or processVCommand()
+ *    has been called for all lines of the batch.
+ *
+ * The strings passed to these methods are valid until this method returns.
+ * The default implementation does nothing.
+ */
+void Parser::processBatch ()
+{
+}
+
+void Parser::parseLine (char *line)
 {
    char *lineCopy = strdup (line);
    
@@ -57,7 +88,7 @@ void Parser::processLine (char *line)
       } else
          fprintf (stderr, "Incomplete line:\n%s\n", line);
 
-      freeSplit (parts);
+      freeSplitLater (parts);
    } else if (strncmp (lineCopy, "[rtfl-", 6) == 0) {
       // Versioned: starts with "[rtfl-<module>-<major>.<minor>]".
 
@@ -113,7 +144,7 @@ void Parser::processLine (char *line)
                   } else
                      fprintf (stderr, "Incomplete line:\n%s\n", line);
                   
-                  freeSplitEscaped (parts);
+                  freeSplitLater (parts);
                }
             }
          }
@@ -122,7 +153,8 @@ void Parser::processLine (char *line)
       }
    }
 
-   free (lineCopy);
+   lineCopies.increase ();
+   lineCopies.setLast (lineCopy);
 }
 
 void Parser::finish ()
@@ -192,12 +224,6 @@ void Parser::unquote (char *txt)
    txt[j] = 0;
 }
 
-// Free result of splitEscaped().
-void Parser::freeSplitEscaped (char **parts)
-{
-   delete[] parts;
-}
-
 // Split without escaping.
 char **Parser::split (char *txt, int maxNum)
 {
@@ -245,6 +271,14 @@ void Parser::freeSplit (char **parts)
    delete[] parts;
 }
 
+// Free result of split() or splitEscaped(), when the current batch has been
+// processed (see processBatch()).
+void Parser::freeSplitLater (char **parts)
+{
+   lineParts.increase ();
+   lineParts.setLast (parts);
+}
+
 } // namespace tools
 
 } // namespace rtfl
@@ -15,27 +15,44 @@ struct CommonLineInfo
    char *completeLine;
 };
 
+/**
+ * \brief Base for sinks parsing RTFL lines.
+ *
+ * The lines passed at once to processLines() are parsed as a batch: the
+ * strings passed to processCommand() and processVCommand() stay valid until
+ * the batch has been processed (see processBatch()), so subclasses may
+ * collect the commands of a batch before processing them together.
+ * processLine() is the same as a batch of one line.
+ */
 class Parser: public LinesSink
 {
 private:
+   // Copies of the lines of the current batch, and the results of splitting
+   // them, freed when the batch has been processed.
+   lout::misc::SimpleVector<char*> lineCopies;
+   lout::misc::SimpleVector<char**> lineParts;
+
+   void parseLine (char *line);
    char **splitEscaped (char *txt);
    void scanSplit (char *txt, int *numParts, char **parts);
    static void unquote (char *txt);
-   void freeSplitEscaped (char **parts);
 
 protected:
    char **split (char *txt, int maxNum);
    void freeSplit (char **parts);
+   void freeSplitLater (char **parts);
 
    virtual void processCommand (CommonLineInfo *info, char *cmd, char *args)
       = 0;
    virtual void processVCommand (CommonLineInfo *info, const char *module,
                                  int majorVersion, int minorVersion,
                                  const char *cmd, char **args) = 0;
+   virtual void processBatch ();
 
 public:
    void setLinesSource (LinesSource *source);
    void processLine (char *line);
+   void processLines (char **lines, int numLines);
    void finish ();
    void timeout (int type);
 };
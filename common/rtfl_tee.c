@@ -27,6 +27,13 @@
  * Here, the standard output of "foo" is passed to the standard input
  * of both "bar" and "qix".
  *
+ * With option -s, all output is buffered, so that the input is always
+ * read at full speed, even when a reader (typically "rtfl-objview"
+ * laying out a graph) is temporarily slow; without a program, this
+ * is simply a buffer:
+ *
+ * $ foo | rtfl-tee -s | rtfl-objview
+ *
  * More informations in doc/rtfl.html.
  *
  * TODO: Something like "echo -n foo | rtfl-tee -b cat" does not work;
@@ -40,6 +47,8 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include <signal.h>
 #include <sys/select.h>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -71,6 +80,162 @@ static ssize_t ewrite(int fd, const void *buf, size_t count)
    return w;
 }
 
+/*
+ * With option -s, each output has a queue: data is kept in memory up
+ * to "budget" bytes, and further data is appended to a temporary file
+ * (which is read back when the memory is drained, so that the order
+ * is preserved). Data is written when select(2) reports the output as
+ * writable, in portions not larger than PIPE_BUF, so that writing
+ * never blocks. Without -s, data is written immediately.
+ */
+
+struct queue
+{
+   int fd, closewhenempty;
+   char *mem;
+   size_t memstart, memend;
+   int spillfd;
+   off_t spillstart, spillend;
+   unsigned long long maxbacklog, spilled;
+};
+
+static int buffering = 0;
+static size_t budget = 64 * 1024 * 1024;
+static volatile sig_atomic_t reportrequested = 0;
+
+static void qinit (struct queue *q, int fd)
+{
+   q->fd = fd;
+   q->closewhenempty = 0;
+   q->mem = NULL;
+   q->memstart = q->memend = 0;
+   q->spillfd = -1;
+   q->spillstart = q->spillend = 0;
+   q->maxbacklog = q->spilled = 0;
+}
+
+static unsigned long long qbacklog (struct queue *q)
+{
+   return (q->memend - q->memstart) + (q->spillend - q->spillstart);
+}
+
+static int qempty (struct queue *q)
+{
+   return qbacklog (q) == 0;
+}
+
+static void qspill (struct queue *q, const char *buf, size_t count)
+{
+   if (q->spillfd == -1) {
+      const char *dir = getenv ("TMPDIR");
+      char name[PATH_MAX];
+      snprintf (name, sizeof (name), "%s/rtfl-tee-XXXXXX",
+                dir && dir[0] ? dir : "/tmp");
+      if ((q->spillfd = mkstemp (name)) == -1)
+         syserr ("mkstemp(\"%s\") failed", name);
+      // Only accessed via the file descriptor.
+      unlink (name);
+   }
+
+   size_t done = 0;
+   while (done < count) {
+      ssize_t w = pwrite (q->spillfd, buf + done, count - done,
+                          q->spillend + done);
+      if (w == -1)
+         syserr ("pwrite(%d, ...) failed", q->spillfd);
+      done += w;
+   }
+
+   q->spillend += count;
+   q->spilled += count;
+}
+
+static void qput (struct queue *q, const char *buf, size_t count)
+{
+   if (!buffering)
+      ewrite (q->fd, buf, count);
+   else if (count > 0) {
+      if (q->mem == NULL && (q->mem = malloc (budget)) == NULL)
+         usrerr ("cannot allocate %lu bytes", (unsigned long) budget);
+
+      // Once something is spilled, everything following must be spilled,
+      // until the file is read back.
+      if (q->spillend > q->spillstart || count > budget)
+         qspill (q, buf, count);
+      else {
+         if (q->memend + count > budget) {
+            memmove (q->mem, q->mem + q->memstart, q->memend - q->memstart);
+            q->memend -= q->memstart;
+            q->memstart = 0;
+         }
+
+         if (q->memend + count <= budget) {
+            memcpy (q->mem + q->memend, buf, count);
+            q->memend += count;
+         } else
+            qspill (q, buf, count);
+      }
+
+      q->maxbacklog = max (q->maxbacklog, qbacklog (q));
+   }
+}
+
+static void qwrite (struct queue *q)
+{
+   if (q->memstart == q->memend && q->spillend > q->spillstart) {
+      // Read back the next portion of spilled data.
+      size_t n = min ((off_t) budget, q->spillend - q->spillstart), done = 0;
+      while (done < n) {
+         ssize_t r = pread (q->spillfd, q->mem + done, n - done,
+                            q->spillstart + done);
+         if (r <= 0)
+            syserr ("pread(%d, ...) failed", q->spillfd);
+         done += r;
+      }
+
+      q->memstart = 0;
+      q->memend = n;
+      q->spillstart += n;
+      if (q->spillstart == q->spillend) {
+         // Do not let the file grow endlessly.
+         if (ftruncate (q->spillfd, 0) == -1)
+            syserr ("ftruncate(%d, ...) failed", q->spillfd);
+         q->spillstart = q->spillend = 0;
+      }
+   }
+
+   q->memstart += ewrite (q->fd, q->mem + q->memstart,
+                          min (q->memend - q->memstart, PIPE_BUF));
+   if (q->memstart == q->memend)
+      q->memstart = q->memend = 0;
+}
+
+static void qreport (const char *name, struct queue *q)
+{
+   fprintf (stderr, "rtfl-tee: %s: backlog %llu bytes (%llu in memory, "
+            "%llu on disk), maximum %llu bytes, %llu bytes spilled\n",
+            name, qbacklog (q),
+            (unsigned long long) (q->memend - q->memstart),
+            (unsigned long long) (q->spillend - q->spillstart),
+            q->maxbacklog, q->spilled);
+}
+
+static void requestreport (int sig)
+{
+   reportrequested = 1;
+}
+
+static struct queue outqueue, childqueue;
+
+static void growobuf (char **obuf, size_t *osize, size_t needed)
+{
+   if (needed > *osize) {
+      *osize = max (max (*osize * 2, needed), 2048);
+      if ((*obuf = realloc (*obuf, *osize)) == NULL)
+         usrerr ("cannot allocate %lu bytes", (unsigned long) *osize);
+   }
+}
+
 static void writestdout (int orig, char *buf, size_t count)
 {
    // Basic idea: "orig" denotes to 0 (stdin of rtfl-tee) or 1 (stdout
@@ -81,8 +246,8 @@ static void writestdout (int orig, char *buf, size_t count)
    // simply possible.)
 
    static int curorig = 0, startline = 1;
-   static char obuf[2048];
-   static size_t ocount = 0;
+   static char *obuf = NULL;
+   static size_t ocount = 0, osize = 0;
 
    //printf ("\nwritestdout: %d, '%c...' (%d)\n",
    //        orig, count > 0 ? buf[0] : '.', (int)count);
@@ -93,21 +258,21 @@ static void writestdout (int orig, char *buf, size_t count)
       if (orig != curorig) {
          if (startline) {
             // Simple switching case.
-            ewrite (1, obuf, ocount);
+            qput (&outqueue, obuf, ocount);
             ocount = 0;
             curorig = orig;
-            ewrite (1, buf, count);
+            qput (&outqueue, buf, count);
             startline = buf[count - 1] == '\n';
          } else {
             // Buffer.
-            size_t odiff = min (count, ocount - sizeof (obuf));
-            memcpy (obuf + ocount, buf, odiff);
-            ocount += odiff;
+            growobuf (&obuf, &osize, ocount + count);
+            memcpy (obuf + ocount, buf, count);
+            ocount += count;
          }
       } else {
          if (ocount == 0) {
             // Nothing buffered: simply print all data.
-            ewrite (1, buf, count);
+            qput (&outqueue, buf, count);
             startline = buf[count - 1] == '\n';
          } else {
             // Only print everything until the last newline character.
@@ -121,14 +286,15 @@ static void writestdout (int orig, char *buf, size_t count)
          
             if (nl == -1) {
                // No newline: no switch.
-               ewrite (1, buf, count);
+               qput (&outqueue, buf, count);
                startline = 0;
             } else {
                // Newline: switch.
-               ewrite (1, buf, nl + 1);
-               ewrite (1, obuf, ocount);
+               qput (&outqueue, buf, nl + 1);
+               qput (&outqueue, obuf, ocount);
                startline = obuf[ocount - 1] == '\n';
-               ocount = min (sizeof (obuf), count - (nl + 1));
+               ocount = count - (nl + 1);
+               growobuf (&obuf, &osize, ocount);
                memcpy (obuf, buf + nl + 1, ocount);
                curorig = 1 - curorig;
             }
@@ -141,108 +307,177 @@ int main (int argc, char *argv[])
 {
    int parent2child[2], child2parent[2], i, offsetcmd, bypass = 0, erroropt = 0;
    char *argv2[argc - 1 + 1];
-   int done1, done2;
+   int done1, done2, withcmd;
 
    for (offsetcmd = 1; offsetcmd < argc && argv[offsetcmd][0] == '-';
         offsetcmd++) {
       if (argv[offsetcmd][1] == 'b')
          bypass = 1;
-      else if (argv[offsetcmd][1] == '-') {
+      else if (argv[offsetcmd][1] == 's')
+         buffering = 1;
+      else if (argv[offsetcmd][1] == 'm' && offsetcmd + 1 < argc) {
+         // Size in MB.
+         budget = (size_t) atol (argv[++offsetcmd]) * 1024 * 1024;
+         if (budget == 0)
+            erroropt = 1;
+      } else if (argv[offsetcmd][1] == '-') {
          offsetcmd++;
          break;
       } else
          erroropt = 1;                  
    }
 
-   if (erroropt || offsetcmd >= argc)
-      usrerr ("Usage: %s [-b] [--] <program> [<program options>]", argv[0]);
+   // Only with -s, the command is optional.
+   withcmd = offsetcmd < argc;
+   if (erroropt || (!withcmd && (!buffering || bypass)))
+      usrerr ("Usage: %s [-b] [-s [-m <megabytes>]] [--] "
+              "[<program> [<program options>]]", argv[0]);
 
-   if (pipe (parent2child) == -1) syserr ("pipe failed");
-   if (bypass && pipe (child2parent) == -1) syserr ("pipe failed");
+   qinit (&outqueue, 1);
 
-   switch (fork ()) {
-   case -1:
-      syserr ("fork failed");
-      break;
+   if (buffering) {
+      // Print the counters on SIGUSR1. (No SA_RESTART, so that
+      // select(2) is interrupted.)
+      struct sigaction sa;
+      memset (&sa, 0, sizeof (sa));
+      sa.sa_handler = requestreport;
+      sigaction (SIGUSR1, &sa, NULL);
+   }
+
+   if (withcmd) {
+      if (pipe (parent2child) == -1) syserr ("pipe failed");
+      if (bypass && pipe (child2parent) == -1) syserr ("pipe failed");
+
+      switch (fork ()) {
+      case -1:
+         syserr ("fork failed");
+         break;
       
-   case 0:
-      if (close (parent2child[1]) == -1)
-         syserr ("close(%d) failed", parent2child[0]);
-      if (close (0) == -1) syserr ("close(0) failed");
-      if (dup2 (parent2child[0], 0) == -1)
-         syserr ("dup2(%d, 0) failed", parent2child[0]);
-      if (close (parent2child[0]) == -1)
-         syserr ("close(%d) failed", parent2child[0]);
-
-      if (bypass) {
-         if (close (child2parent[0]) == -1)
-            syserr ("close(%d) failed", child2parent[1]);
-         if (close (1) == -1) syserr ("close(1) failed");
-         if (dup2 (child2parent[1], 1) == -1)
-            syserr ("dup2(%d, 1) failed", child2parent[1]);
-         if (close (child2parent[1]) == -1)
-            syserr ("close(%d) failed", child2parent[1]);
-      }
+      case 0:
+         if (close (parent2child[1]) == -1)
+            syserr ("close(%d) failed", parent2child[0]);
+         if (close (0) == -1) syserr ("close(0) failed");
+         if (dup2 (parent2child[0], 0) == -1)
+            syserr ("dup2(%d, 0) failed", parent2child[0]);
+         if (close (parent2child[0]) == -1)
+            syserr ("close(%d) failed", parent2child[0]);
+
+         if (bypass) {
+            if (close (child2parent[0]) == -1)
+               syserr ("close(%d) failed", child2parent[1]);
+            if (close (1) == -1) syserr ("close(1) failed");
+            if (dup2 (child2parent[1], 1) == -1)
+               syserr ("dup2(%d, 1) failed", child2parent[1]);
+            if (close (child2parent[1]) == -1)
+               syserr ("close(%d) failed", child2parent[1]);
+         }
       
-      for (i = 0; i < argc - offsetcmd; i++) argv2[i] = argv[i + offsetcmd];
-      argv2[argc - offsetcmd] = NULL;
-      if (execvp (argv2[0], argv2) == -1)
-         syserr ("execvp(\"%s\", ...) failed", argv2[0]);
-      break;
+         for (i = 0; i < argc - offsetcmd; i++)
+            argv2[i] = argv[i + offsetcmd];
+         argv2[argc - offsetcmd] = NULL;
+         if (execvp (argv2[0], argv2) == -1)
+            syserr ("execvp(\"%s\", ...) failed", argv2[0]);
+         break;
       
-   default:
-      if (close (parent2child[0]) == -1)
-         syserr ("close(%d) failed", parent2child[0]);
-      if (bypass && close (child2parent[1]) == -1)
-         syserr ("close(%d) failed", child2parent[1]);
-
-      done1 = 0;
-      done2 = !bypass;
-      while (!done1 || !done2) {
-         //printf ("==> done1 = %d, done2 = %d\n", done1, done2);
-
-         fd_set set;
-         FD_ZERO (&set);
+      default:
+         if (close (parent2child[0]) == -1)
+            syserr ("close(%d) failed", parent2child[0]);
+         if (bypass && close (child2parent[1]) == -1)
+            syserr ("close(%d) failed", child2parent[1]);
+         break;
+      }
+
+      qinit (&childqueue, parent2child[1]);
+   } else
+      qinit (&childqueue, -1);
+
+   done1 = 0;
+   done2 = !bypass;
+   while (!done1 || !done2 || !qempty (&outqueue) ||
+          (childqueue.fd != -1 && !qempty (&childqueue))) {
+      //printf ("==> done1 = %d, done2 = %d\n", done1, done2);
+
+      if (reportrequested) {
+         reportrequested = 0;
+         qreport ("stdout", &outqueue);
+         if (childqueue.fd != -1)
+            qreport (argv[offsetcmd], &childqueue);
+      }
+
+      fd_set set, wset;
+      FD_ZERO (&set);
+      FD_ZERO (&wset);
+      int nfds = 0;
             
-         if (!done1) FD_SET (0, &set);
-         if (!done2) FD_SET (child2parent[0], &set);
-
-         int s = select ((!done2 ? child2parent[0] : 0) + 1,
-                         &set, NULL, NULL, NULL);
-
-         //printf ("==> s = %d\n", s);
-
-         if (s == -1) syserr ("select failed");
-         else if (s > 0) {
-            char buf[2048];
-            ssize_t n;
-
-            if (!done1 && FD_ISSET(0, &set)) {
-               if ((n = read (0, buf, sizeof (buf))) == -1)
-                  syserr ("read failed");
-               else if (n == 0) {
-                  if (close (parent2child[1]) == -1)
-                     syserr ("close(%d) failed", parent2child[1]);
-                  done1 = 1;
-               } else if (n > 0) {
-                  ewrite (parent2child[1], buf, n);
-                  writestdout (0, buf, n);
-               }
-            } 
-               
-            if (!done2 && FD_ISSET (child2parent[0], &set)) {
-               if ((n = read (child2parent[0], buf, sizeof (buf))) == -1)
-                  syserr ("read failed");
-               else if (n == 0) {
-                  if (close (child2parent[0]) == -1)
-                     syserr ("close(%d) failed", child2parent[0]);
-                  done2 = 1;
-               } else if (n > 0)
-                  writestdout (1, buf, n);
+      if (!done1) FD_SET (0, &set);
+      if (!done2) {
+         FD_SET (child2parent[0], &set);
+         nfds = max (nfds, child2parent[0]);
+      }
+      if (!qempty (&outqueue)) {
+         FD_SET (1, &wset);
+         nfds = max (nfds, 1);
+      }
+      if (childqueue.fd != -1 && !qempty (&childqueue)) {
+         FD_SET (childqueue.fd, &wset);
+         nfds = max (nfds, childqueue.fd);
+      }
+
+      int s = select (nfds + 1, &set, &wset, NULL, NULL);
+
+      //printf ("==> s = %d\n", s);
+
+      if (s == -1) {
+         if (errno != EINTR)
+            syserr ("select failed");
+      } else if (s > 0) {
+         // Larger portions when the input is not mixed with the output
+         // of the command (see writestdout()).
+         char buf[65536];
+         ssize_t n;
+
+         if (!done1 && FD_ISSET(0, &set)) {
+            if ((n = read (0, buf, bypass ? 2048 : sizeof (buf))) == -1)
+               syserr ("read failed");
+            else if (n == 0) {
+               childqueue.closewhenempty = 1;
+               done1 = 1;
+            } else if (n > 0) {
+               if (childqueue.fd != -1)
+                  qput (&childqueue, buf, n);
+               writestdout (0, buf, n);
             }
+         } 
+               
+         if (!done2 && FD_ISSET (child2parent[0], &set)) {
+            if ((n = read (child2parent[0], buf, 2048)) == -1)
+               syserr ("read failed");
+            else if (n == 0) {
+               if (close (child2parent[0]) == -1)
+                  syserr ("close(%d) failed", child2parent[0]);
+               done2 = 1;
+            } else if (n > 0)
+               writestdout (1, buf, n);
          }
+
+         if (FD_ISSET (1, &wset))
+            qwrite (&outqueue);
+         if (childqueue.fd != -1 && FD_ISSET (childqueue.fd, &wset))
+            qwrite (&childqueue);
+      }
+
+      if (childqueue.fd != -1 && childqueue.closewhenempty &&
+          qempty (&childqueue)) {
+         if (close (childqueue.fd) == -1)
+            syserr ("close(%d) failed", childqueue.fd);
+         childqueue.fd = -1;
       }
-      break;
+   }
+
+   if (buffering && outqueue.spilled + childqueue.spilled > 0) {
+      qreport ("stdout", &outqueue);
+      if (withcmd)
+         qreport (argv[offsetcmd], &childqueue);
    }
    
    return 0;
@@ -0,0 +1,454 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "shm_ring.hh"
+#include "tools.hh"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+using namespace lout::misc;
+
+namespace rtfl {
+
+namespace tools {
+
+// -----------------------------
+//      ShmRing::SpillReader
+// -----------------------------
+
+ShmRing::SpillReader::SpillReader ()
+{
+   setSink (this);
+}
+
+/**
+ * \brief Pass the complete lines spilled since the last call; returns their
+ *    number.
+ */
+int ShmRing::SpillReader::read (int fd, LinesSink *sink)
+{
+   this->sink = sink;
+   numLines = 0;
+   while (processInput (fd) > 0)
+      ;
+   return numLines;
+}
+
+void ShmRing::SpillReader::setup (LinesSink *sink)
+{
+   // Not used; see read().
+}
+
+void ShmRing::SpillReader::addTimeout (double secs, int type)
+{
+}
+
+void ShmRing::SpillReader::removeTimeout (int type)
+{
+}
+
+void ShmRing::SpillReader::setLinesSource (LinesSource *source)
+{
+}
+
+void ShmRing::SpillReader::processLine (char *line)
+{
+   sink->processLine (line);
+   numLines++;
+}
+
+void ShmRing::SpillReader::processLines (char **lines, int numLines)
+{
+   sink->processLines (lines, numLines);
+   this->numLines += numLines;
+}
+
+void ShmRing::SpillReader::timeout (int type)
+{
+}
+
+void ShmRing::SpillReader::finish ()
+{
+}
+
+// ---------------
+//      ShmRing
+// ---------------
+
+ShmRing::ShmRing ()
+{
+   path = NULL;
+   header = NULL;
+   spillFd = -1;
+   busySince = -1;
+}
+
+/**
+ * \brief Create the segment `path`, with `dataSize` bytes for the ring
+ *    (rounded up to a power of 2).
+ *
+ * An existing file is overwritten. Returns NULL on error (with `errno` set).
+ */
+ShmRing *ShmRing::create (const char *path, Policy policy, uint32_t dataSize)
+{
+   uint32_t size = 64 * 1024;
+   while (size < dataSize)
+      size *= 2;
+
+   ShmRing *ring = new ShmRing ();
+   ring->path = strdup (path);
+   ring->mapSize = HEADER_SIZE + size;
+
+   // A new file, so that producers still mapping an old one are not
+   // confused.
+   unlink (path);
+   int fd = open (path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+   void *p = MAP_FAILED;
+   if (fd != -1 && ftruncate (fd, ring->mapSize) == 0)
+      p = mmap (NULL, ring->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+   int err = errno;
+   if (fd != -1)
+      close (fd);
+
+   if (p == MAP_FAILED) {
+      delete ring;
+      errno = err;
+      return NULL;
+   }
+
+   ring->header = (Header*) p;
+   ring->data = (char*) p + HEADER_SIZE;
+
+   // The file is zero-filled, which is the initial state of the ring.
+   Header *header = ring->header;
+   header->policy = policy;
+   header->dataSize = size;
+   header->consumerAlive = 1;
+   for (int i = 0; i < NUM_SLOTS; i++)
+      header->slots[i].head = NO_CLAIM;
+   if (policy == SPILL) {
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init (&attr);
+      pthread_mutexattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init (&header->spillLock, &attr);
+      pthread_mutexattr_destroy (&attr);
+
+      snprintf (header->spillFile, sizeof (header->spillFile), "%s.spill",
+                path);
+      unlink (header->spillFile);
+      ring->spillFd = open (header->spillFile, O_RDONLY | O_CREAT | O_CLOEXEC,
+                            0600);
+   }
+
+   // Producers check the magic, so it is set last.
+   __atomic_thread_fence (__ATOMIC_RELEASE);
+   memcpy (header->magic, "RTFLSHM2", 8);
+
+   return ring;
+}
+
+bool ShmRing::parsePolicy (const char *name, Policy *policy)
+{
+   if (strcmp (name, "block") == 0)
+      *policy = BLOCK;
+   else if (strcmp (name, "drop") == 0)
+      *policy = DROP;
+   else if (strcmp (name, "spill") == 0)
+      *policy = SPILL;
+   else
+      return false;
+
+   return true;
+}
+
+ShmRing::~ShmRing ()
+{
+   if (header) {
+      // Producers do not block anymore.
+      __atomic_store_n (&header->consumerAlive, 0, __ATOMIC_RELAXED);
+      if (spillFd != -1) {
+         unlink (header->spillFile);
+         close (spillFd);
+      }
+      munmap (header, mapSize);
+      unlink (path);
+   }
+
+   if (path)
+      free (path);
+}
+
+/**
+ * \brief If the record at `tail` is not finished, because the process which
+ *    has claimed its space has died, return the end of this space; otherwise
+ *    (especially when the process may still write into it), return 0.
+ *
+ * The slots of the dead process are released.
+ */
+uint64_t ShmRing::getDeadClaimEnd (uint64_t tail)
+{
+   uint64_t end = 0;
+
+   // After a failed compare-and-swap, a producer may still announce space
+   // which another one has claimed; so all announcements are regarded.
+   for (int i = 0; i < NUM_SLOTS; i++) {
+      Slot *slot = &header->slots[i];
+      int32_t pid = __atomic_load_n (&slot->pid, __ATOMIC_ACQUIRE);
+      uint64_t head = __atomic_load_n (&slot->head, __ATOMIC_ACQUIRE);
+      uint64_t size = __atomic_load_n (&slot->size, __ATOMIC_RELAXED);
+      if (pid != 0 && head != NO_CLAIM && head <= tail && tail < head + size) {
+         if (kill (pid, 0) == 0 || errno != ESRCH ||
+             (end != 0 && end != head + size))
+            return 0;
+         end = head + size;
+      }
+   }
+
+   if (end != 0)
+      for (int i = 0; i < NUM_SLOTS; i++) {
+         Slot *slot = &header->slots[i];
+         int32_t pid = __atomic_load_n (&slot->pid, __ATOMIC_ACQUIRE);
+         uint64_t head = __atomic_load_n (&slot->head, __ATOMIC_RELAXED);
+         if (pid != 0 && head != NO_CLAIM && head <= tail &&
+             tail < head + __atomic_load_n (&slot->size, __ATOMIC_RELAXED)) {
+            __atomic_store_n (&slot->head, NO_CLAIM, __ATOMIC_RELAXED);
+            __atomic_store_n (&slot->pid, 0, __ATOMIC_RELEASE);
+         }
+      }
+
+   return end;
+}
+
+/**
+ * \brief Zero the ring between the offsets `start` and `end`, which may
+ *    wrap around.
+ */
+void ShmRing::zero (uint64_t start, uint64_t end)
+{
+   uint64_t size = header->dataSize;
+   while (start < end) {
+      uint64_t pos = start & (size - 1);
+      uint64_t n = end - start < size - pos ? end - start : size - pos;
+      memset (data + pos, 0, n);
+      start += n;
+   }
+}
+
+int ShmRing::readRecords (LinesSink *sink, int maxRecords)
+{
+   uint64_t size = header->dataSize;
+   uint64_t tail = header->tail;
+   int numRecords = 0;
+
+   while (numRecords < maxRecords &&
+          tail != __atomic_load_n (&header->head, __ATOMIC_ACQUIRE)) {
+      uint64_t pos = tail & (size - 1);
+      uint32_t word =
+         __atomic_load_n ((uint32_t*)(data + pos), __ATOMIC_ACQUIRE);
+      uint32_t state = word & 3, len = word >> 2;
+
+      if (state == 0 || state == BUSY) {
+         // Space claimed, but the record is not finished yet. When this
+         // takes too long, the producer has perhaps crashed; only then, the
+         // space (whose size is announced in the slot) is skipped.
+         long now = TimeoutQueue::getCurrentTime ();
+         if (busySince == -1)
+            busySince = now;
+         uint64_t end;
+         if (now - busySince < STALE_MILLIS ||
+             (end = getDeadClaimEnd (tail)) == 0)
+            break;
+
+         busySince = -1;
+         zero (tail, end);
+         tail = end;
+         __atomic_store_n (&header->tail, tail, __ATOMIC_RELEASE);
+         numRecords++;
+         continue;
+      }
+      busySince = -1;
+
+      uint64_t recordSize = state == PAD ? len + 4 : (4 + len + 7) & ~7;
+
+      if (state == READY) {
+         // Lines may contain "\n" (within messages); they are split as
+         // FileLinesSource does.
+         const char *rec = data + pos + 4;
+         uint32_t start = 0;
+         for (uint32_t i = 0; i <= len; i++)
+            if (i == len || rec[i] == '\n') {
+               if (i - start < FileLinesSource::MAX_LINE_SIZE) {
+                  memcpy (line, rec + start, i - start);
+                  line[i - start] = 0;
+                  sink->processLine (line);
+               }
+               start = i + 1;
+            }
+      }
+
+      // Producers expect zeroes (especially no stale first words).
+      memset (data + pos, 0, recordSize);
+      tail += recordSize;
+      __atomic_store_n (&header->tail, tail, __ATOMIC_RELEASE);
+      numRecords++;
+   }
+
+   return numRecords;
+}
+
+/**
+ * \brief Read the spill file, when producers are spilling and the ring is
+ *    empty, and clear `spilling`. Returns the number of lines passed.
+ */
+int ShmRing::readSpilled (LinesSink *sink)
+{
+   if (!__atomic_load_n (&header->spilling, __ATOMIC_ACQUIRE))
+      return 0;
+
+   int n = 0, err = pthread_mutex_trylock (&header->spillLock);
+   if (err == EOWNERDEAD) {
+      // A producer has died while holding the lock.
+      pthread_mutex_consistent (&header->spillLock);
+      err = 0;
+   }
+
+   if (err == 0) {
+      // Records put before spilling started are passed first.
+      if (header->tail == __atomic_load_n (&header->head, __ATOMIC_ACQUIRE)) {
+         n = spillReader.read (spillFd, sink);
+         __atomic_store_n (&header->spilling, 0, __ATOMIC_RELEASE);
+      }
+      pthread_mutex_unlock (&header->spillLock);
+   }
+
+   return n;
+}
+
+/**
+ * \brief Pass up to `maxRecords` records to `sink`, and lines spilled in the
+ *    meantime (see ShmRing). Returns the number of records and lines passed.
+ */
+int ShmRing::read (LinesSink *sink, int maxRecords)
+{
+   int n = readRecords (sink, maxRecords);
+
+   // When the ring has become empty, the lines spilled in the meantime
+   // follow.
+   if (spillFd != -1)
+      n += readSpilled (sink);
+
+   return n;
+}
+
+// ----------------------
+//      ShmLinesSource
+// ----------------------
+
+ShmLinesSource::ShmLinesSource (ShmRing *ring)
+{
+   this->ring = ring;
+   stopped = 0;
+}
+
+ShmLinesSource::~ShmLinesSource ()
+{
+   delete ring;
+}
+
+void ShmLinesSource::setup (LinesSink *sink)
+{
+   sink->setLinesSource (this);
+
+   long pauseMicros = MIN_PAUSE_MICROS, numDropped = 0, reportTime = 0;
+
+   while (!stopped) {
+      int type;
+      while (timeouts.popExpired (&type))
+         sink->timeout (type);
+
+      if (ring->read (sink, BATCH) > 0)
+         pauseMicros = MIN_PAUSE_MICROS;
+      else {
+         long nextTime = timeouts.getNextTime ();
+         long micros = pauseMicros;
+         if (nextTime != -1)
+            micros = min (micros, max (nextTime - TimeoutQueue::getCurrentTime
+                                       (), 0L) * 1000);
+
+         struct timespec ts;
+         ts.tv_sec = micros / 1000000;
+         ts.tv_nsec = (micros % 1000000) * 1000;
+         nanosleep (&ts, NULL);
+         pauseMicros = min (pauseMicros * 2, (long)MAX_PAUSE_MICROS);
+      }
+
+      // Reported at most once per second.
+      long now = TimeoutQueue::getCurrentTime ();
+      if (ring->getNumDropped () != numDropped && now - reportTime >= 1000) {
+         numDropped = ring->getNumDropped ();
+         reportTime = now;
+         fprintf (stderr, "rtfl: %ld lines dropped so far (ring full, or "
+                  "lines too long)\n", numDropped);
+      }
+   }
+
+   // Lines put before stop() was called.
+   while (ring->read (sink, BATCH) > 0)
+      ;
+
+   if (ring->getNumDropped () > 0 || ring->getNumSpilled () > 0)
+      fprintf (stderr, "rtfl: %ld lines dropped, %ld lines spilled (ring "
+               "full, or lines too long)\n", ring->getNumDropped (),
+               ring->getNumSpilled ());
+
+   sink->finish ();
+}
+
+void ShmLinesSource::addTimeout (double secs, int type)
+{
+   timeouts.add (secs, type);
+}
+
+void ShmLinesSource::removeTimeout (int type)
+{
+   timeouts.remove (type);
+}
+
+} // namespace tools
+
+} // namespace rtfl
@@ -0,0 +1,172 @@
+#ifndef __COMMON_SHM_RING_HH__
+#define __COMMON_SHM_RING_HH__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lines.hh"
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief A ring buffer in a shared memory segment, into which instrumented
+ *    programs put lines (see RTFL_SHM in debug_rtfl.hh), and from which
+ *    lines are read by the viewer.
+ *
+ * The segment is a file (best on a tmpfs like `/dev/shm`), created by
+ * create(), and mapped by all processes. It starts with a Header; the ring
+ * data (a power of 2 in size) follows at HEADER_SIZE.
+ *
+ * Any number of producers claim space for a record by moving `head` with
+ * compare-and-swap. A record starts with a 32 bit word, `length << 2 |
+ * state`, followed by the line (without "\n"), and is padded to 8 bytes. The
+ * state is set to READY (with release semantics) after the line has been
+ * copied. Records do not wrap around; the space left at the end is filled by
+ * a PAD record. The consumer (there is only one) reads records at `tail`,
+ * zeroes them, and then moves `tail`.
+ *
+ * Each producer thread announces the space it is about to claim in a Slot
+ * (its process id, and the offset and size of the space). A record which is
+ * not finished after STALE_MILLIS is skipped only when the process owning it
+ * has died; as long as it is alive (e. g. only stopped), the consumer waits,
+ * so that a late write cannot overwrite space already reused.
+ *
+ * When there is no space left, the producers act according to the Policy.
+ * With SPILL, a producer finding the ring full sets `spilling`; from then on,
+ * all producers append to the spill file, until the consumer has read the
+ * ring and then the spill file completely, and cleared `spilling` again.
+ * Writing to the spill file, and reading it (which the consumer only does
+ * when the ring is empty) is done with `spillLock` held, so a line spilled
+ * after a record of the same thread is never read before it. The consumer
+ * only tries to get the lock, so that it is not blocked by a stopped
+ * producer.
+ *
+ * The layout must match debug_rtfl.hh.
+ */
+class ShmRing
+{
+public:
+   enum Policy { BLOCK = 0, DROP = 1, SPILL = 2 };
+   enum { HEADER_SIZE = 4096, DEFAULT_DATA_SIZE = 16 * 1024 * 1024 };
+
+private:
+   enum { BUSY = 1, READY = 2, PAD = 3 };
+
+   /// When a record is not finished after this time, it is checked whether
+   /// its producer has crashed.
+   enum { STALE_MILLIS = 1000 };
+
+   enum { NUM_SLOTS = 128 };
+   static const uint64_t NO_CLAIM = ~(uint64_t)0;
+
+   struct Slot
+   {
+      int32_t pid;                // 0 when free.
+      uint32_t size;
+      uint64_t head;              // NO_CLAIM when not claiming.
+   };
+
+   struct Header
+   {
+      char magic[8];
+      uint32_t policy, dataSize;
+      int32_t consumerAlive, spilling;
+      uint64_t numDropped, numSpilled;
+      char spillFile[256];
+      union {
+         pthread_mutex_t spillLock;
+         char pad1[216];
+      };
+      uint64_t head;              // Offset 512; claimed by producers.
+      char pad2[56];
+      uint64_t tail;              // Offset 576; only moved by the consumer.
+      char pad3[440];
+      Slot slots[NUM_SLOTS];      // Offset 1024.
+   };
+
+   class SpillReader: public FileLinesSource, public LinesSink
+   {
+   public:
+      LinesSink *sink;
+      int numLines;
+
+      SpillReader ();
+      int read (int fd, LinesSink *sink);
+
+      void setup (LinesSink *sink);
+      void addTimeout (double secs, int type);
+      void removeTimeout (int type);
+
+      void setLinesSource (LinesSource *source);
+      void processLine (char *line);
+      void processLines (char **lines, int numLines);
+      void timeout (int type);
+      void finish ();
+   };
+
+   char *path;
+   Header *header;
+   char *data;
+   size_t mapSize;
+   int spillFd;
+   SpillReader spillReader;
+   long busySince;
+   char line[FileLinesSource::MAX_LINE_SIZE + 1];
+
+   ShmRing ();
+   int readRecords (LinesSink *sink, int maxRecords);
+   uint64_t getDeadClaimEnd (uint64_t tail);
+   void zero (uint64_t start, uint64_t end);
+   int readSpilled (LinesSink *sink);
+
+public:
+   static ShmRing *create (const char *path, Policy policy,
+                           uint32_t dataSize = DEFAULT_DATA_SIZE);
+   static bool parsePolicy (const char *name, Policy *policy);
+   ~ShmRing ();
+
+   int read (LinesSink *sink, int maxRecords);
+
+   inline long getNumDropped ()
+   { return __atomic_load_n (&header->numDropped, __ATOMIC_RELAXED); }
+   inline long getNumSpilled ()
+   { return __atomic_load_n (&header->numSpilled, __ATOMIC_RELAXED); }
+};
+
+
+/**
+ * \brief Reads lines from an ShmRing, in the calling thread.
+ *
+ * Since the producers do not notify the consumer, the ring is polled, with
+ * pauses between 50 microseconds and 10 milliseconds (depending on how
+ * recently lines have been read). The sink is only finished after stop() has
+ * been called.
+ */
+class ShmLinesSource: public LinesSource
+{
+private:
+   enum { MIN_PAUSE_MICROS = 50, MAX_PAUSE_MICROS = 10000, BATCH = 4096 };
+
+   ShmRing *ring;
+   TimeoutQueue timeouts;
+   volatile int stopped;
+
+public:
+   ShmLinesSource (ShmRing *ring);
+   ~ShmLinesSource ();
+
+   void setup (LinesSink *sink);
+   void addTimeout (double secs, int type);
+   void removeTimeout (int type);
+
+   /// May be called from a signal handler.
+   inline void stop () { stopped = 1; }
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_SHM_RING_HH__
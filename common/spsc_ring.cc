@@ -0,0 +1,149 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spsc_ring.hh"
+#include "tools.hh"
+
+#include <time.h>
+#include <errno.h>
+
+using namespace lout::object;
+
+namespace rtfl {
+
+namespace tools {
+
+SpscRing::SpscRing (int capacity)
+{
+   // Must be a power of 2.
+   assert (capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+   this->capacity = capacity;
+   elements = new Object*[capacity];
+   head = tail = 0;
+   consumerWaiting = producerWaiting = 0;
+
+   pthread_mutex_init (&mutex, NULL);
+   // Deadlines (see pop()) refer to the monotonic clock.
+   pthread_condattr_t attr;
+   pthread_condattr_init (&attr);
+   pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+   pthread_cond_init (&notEmpty, &attr);
+   pthread_condattr_destroy (&attr);
+   pthread_cond_init (&notFull, NULL);
+}
+
+SpscRing::~SpscRing ()
+{
+   // Elements not yet consumed.
+   for (unsigned long i = head; i != tail; i++)
+      delete elements[i & (capacity - 1)];
+   delete[] elements;
+
+   pthread_mutex_destroy (&mutex);
+   pthread_cond_destroy (&notEmpty);
+   pthread_cond_destroy (&notFull);
+}
+
+/**
+ * \brief Add an element; called by the producer. Blocks while the ring is
+ *    full.
+ */
+void SpscRing::push (Object *element)
+{
+   while (tail - __atomic_load_n (&head, __ATOMIC_ACQUIRE) == capacity) {
+      pthread_mutex_lock (&mutex);
+      __atomic_store_n (&producerWaiting, 1, __ATOMIC_SEQ_CST);
+      if (tail - __atomic_load_n (&head, __ATOMIC_SEQ_CST) == capacity)
+         pthread_cond_wait (&notFull, &mutex);
+      __atomic_store_n (&producerWaiting, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock (&mutex);
+   }
+
+   elements[tail & (capacity - 1)] = element;
+   __atomic_store_n (&tail, tail + 1, __ATOMIC_SEQ_CST);
+
+   // Either the consumer sees the new tail before it sleeps, or we see that
+   // it is waiting (both are sequentially consistent); in the latter case,
+   // the signal cannot get lost, since the consumer holds the mutex until it
+   // actually waits.
+   if (__atomic_load_n (&consumerWaiting, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock (&mutex);
+      pthread_cond_signal (&notEmpty);
+      pthread_mutex_unlock (&mutex);
+   }
+}
+
+/**
+ * \brief Remove and return the next element; called by the consumer.
+ *
+ * Blocks while the ring is empty, but at most until `deadline` (as returned
+ * by TimeoutQueue::getCurrentTime(); -1 means no deadline). In this case,
+ * NULL is returned.
+ */
+Object *SpscRing::pop (long deadline)
+{
+   while (__atomic_load_n (&tail, __ATOMIC_ACQUIRE) == head) {
+      bool timedOut = false;
+
+      pthread_mutex_lock (&mutex);
+      __atomic_store_n (&consumerWaiting, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n (&tail, __ATOMIC_SEQ_CST) == head) {
+         if (deadline == -1)
+            pthread_cond_wait (&notEmpty, &mutex);
+         else {
+            struct timespec ts;
+            ts.tv_sec = deadline / 1000;
+            ts.tv_nsec = (deadline % 1000) * 1000000;
+            timedOut =
+               pthread_cond_timedwait (&notEmpty, &mutex, &ts) == ETIMEDOUT;
+         }
+      }
+      __atomic_store_n (&consumerWaiting, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock (&mutex);
+
+      if (timedOut && __atomic_load_n (&tail, __ATOMIC_ACQUIRE) == head)
+         return NULL;
+   }
+
+   Object *element = elements[head & (capacity - 1)];
+   __atomic_store_n (&head, head + 1, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n (&producerWaiting, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock (&mutex);
+      pthread_cond_signal (&notFull);
+      pthread_mutex_unlock (&mutex);
+   }
+
+   return element;
+}
+
+} // namespace tools
+
+} // namespace rtfl
@@ -0,0 +1,48 @@
+#ifndef __COMMON_SPSC_RING_HH__
+#define __COMMON_SPSC_RING_HH__
+
+#include <pthread.h>
+
+#include "lout/object.hh"
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief A bounded ring buffer passing objects from one producer thread to
+ *    one consumer thread.
+ *
+ * Elements are passed without locks, via the atomic indices `head` (only
+ * written by the consumer) and `tail` (only written by the producer). The
+ * mutex and the condition variables are only used when one side has to
+ * wait, i. e. when the ring is empty or full. Ownership of the elements is
+ * passed to the consumer.
+ *
+ * Since passing an element costs at least one cache line transfer, elements
+ * should be batches of work (see e. g. ThreadedLinesSource and
+ * rtfl::objects::ObjectsPipe).
+ */
+class SpscRing
+{
+private:
+   lout::object::Object **elements;
+   unsigned long capacity, head, tail;
+   int consumerWaiting, producerWaiting;
+
+   pthread_mutex_t mutex;
+   pthread_cond_t notEmpty, notFull;
+
+public:
+   SpscRing (int capacity);
+   ~SpscRing ();
+
+   void push (lout::object::Object *element);
+   lout::object::Object *pop (long deadline);
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_SPSC_RING_HH__
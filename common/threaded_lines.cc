@@ -0,0 +1,223 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "threaded_lines.hh"
+#include "tools.hh"
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+using namespace lout::object;
+using namespace lout::misc;
+
+namespace rtfl {
+
+namespace tools {
+
+ThreadedLinesSource::LinesBatch::LinesBatch ()
+{
+   dataAlloc = 8192;
+   data = (char*) malloc (dataAlloc);
+   dataSize = 0;
+   eos = false;
+}
+
+ThreadedLinesSource::LinesBatch::~LinesBatch ()
+{
+   free (data);
+}
+
+void ThreadedLinesSource::LinesBatch::addLine (const char *line)
+{
+   int len = strlen (line) + 1;
+   if (dataSize + len > dataAlloc) {
+      while (dataSize + len > dataAlloc)
+         dataAlloc *= 2;
+      data = (char*) realloc (data, dataAlloc);
+   }
+
+   memcpy (data + dataSize, line, len);
+   lineStarts.increase ();
+   lineStarts.setLast (dataSize);
+   dataSize += len;
+}
+
+// ----------------------------------------------------------------------
+
+ThreadedLinesSource::Reader::Reader (ThreadedLinesSource *source)
+{
+   this->source = source;
+   batch = new LinesBatch ();
+}
+
+ThreadedLinesSource::Reader::~Reader ()
+{
+   if (batch)
+      delete batch;
+}
+
+void ThreadedLinesSource::Reader::pass ()
+{
+   source->ring->push (batch);
+   batch = new LinesBatch ();
+}
+
+void ThreadedLinesSource::Reader::run ()
+{
+   setSink (this);
+
+   bool eos = false;
+   while (!eos) {
+      struct pollfd pfd;
+      pfd.fd = getInputFd (source->fd);
+      pfd.events = POLLIN;
+
+      // If no input is available now, pass what has been read so far, before
+      // blocking.
+      if (batch->getNumLines () > 0 && poll (&pfd, 1, 0) == 0)
+         pass ();
+
+      int n = processInput (source->fd);
+      if (n == 0)
+         eos = true;
+      else if (n == -1) {
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+            poll (&pfd, 1, -1);
+         else if (errno != EINTR) {
+            perror ("read");
+            eos = true;
+         }
+      } else if (batch->getNumLines () >= BATCH_LINES)
+         pass ();
+   }
+
+   batch->eos = true;
+   source->ring->push (batch);
+   batch = NULL;
+}
+
+void ThreadedLinesSource::Reader::setup (LinesSink *sink)
+{
+   // Not used; see run().
+}
+
+void ThreadedLinesSource::Reader::addTimeout (double secs, int type)
+{
+   // Not used; timeouts are handled by ThreadedLinesSource.
+}
+
+void ThreadedLinesSource::Reader::removeTimeout (int type)
+{
+   // Not used; timeouts are handled by ThreadedLinesSource.
+}
+
+void ThreadedLinesSource::Reader::setLinesSource (LinesSource *source)
+{
+}
+
+void ThreadedLinesSource::Reader::processLine (char *line)
+{
+   batch->addLine (line);
+}
+
+void ThreadedLinesSource::Reader::timeout (int type)
+{
+}
+
+void ThreadedLinesSource::Reader::finish ()
+{
+}
+
+// ----------------------------------------------------------------------
+
+ThreadedLinesSource::ThreadedLinesSource (int fd)
+{
+   this->fd = fd;
+   ring = new SpscRing (RING_CAPACITY);
+}
+
+ThreadedLinesSource::~ThreadedLinesSource ()
+{
+   delete ring;
+}
+
+void *ThreadedLinesSource::runReader (void *data)
+{
+   Reader *reader = (Reader*) data;
+   reader->run ();
+   return NULL;
+}
+
+void ThreadedLinesSource::setup (LinesSink *sink)
+{
+   sink->setLinesSource (this);
+
+   Reader reader (this);
+   pthread_t readerThread;
+   if (pthread_create (&readerThread, NULL, runReader, &reader) != 0)
+      syserr ("pthread_create failed");
+
+   SimpleVector<char*> lines;
+   bool eos = false;
+   while (!eos) {
+      int type;
+      while (timeouts.popExpired (&type))
+         sink->timeout (type);
+
+      LinesBatch *batch = (LinesBatch*) ring->pop (timeouts.getNextTime ());
+      if (batch) {
+         lines.setSize (batch->getNumLines ());
+         for (int i = 0; i < batch->getNumLines (); i++)
+            lines.set (i, batch->getLine (i));
+         if (lines.size () > 0)
+            sink->processLines (lines.getArray (), lines.size ());
+         eos = batch->eos;
+         delete batch;
+      }
+   }
+
+   pthread_join (readerThread, NULL);
+   close (fd);
+   sink->finish ();
+}
+
+void ThreadedLinesSource::addTimeout (double secs, int type)
+{
+   timeouts.add (secs, type);
+}
+
+void ThreadedLinesSource::removeTimeout (int type)
+{
+   timeouts.remove (type);
+}
+
+} // namespace tools
+
+} // namespace rtfl
@@ -0,0 +1,88 @@
+#ifndef __COMMON_THREADED_LINES_HH__
+#define __COMMON_THREADED_LINES_HH__
+
+#include "lines.hh"
+#include "spsc_ring.hh"
+#include "lout/misc.hh"
+
+namespace rtfl {
+
+namespace tools {
+
+/**
+ * \brief Like BlockingLinesSource, but reading and splitting into lines is
+ *    done in a separate thread.
+ *
+ * The reader thread collects lines into batches, which are passed to the
+ * thread which called setup() via an SpscRing. A batch is passed when it is
+ * full, or when no more input is available for the moment, so that latency
+ * is not increased for slow input. Timeouts are processed in the thread
+ * calling setup(), between batches, as BlockingLinesSource does between
+ * blocks read.
+ */
+class ThreadedLinesSource: public LinesSource
+{
+private:
+   class LinesBatch: public lout::object::Object
+   {
+   private:
+      char *data;
+      int dataSize, dataAlloc;
+      lout::misc::SimpleVector<int> lineStarts;
+
+   public:
+      bool eos;
+
+      LinesBatch ();
+      ~LinesBatch ();
+
+      void addLine (const char *line);
+      inline int getNumLines () { return lineStarts.size (); }
+      inline char *getLine (int i) { return data + lineStarts.get (i); }
+   };
+
+   class Reader: public FileLinesSource, public LinesSink
+   {
+   private:
+      ThreadedLinesSource *source;
+      LinesBatch *batch;
+
+      void pass ();
+
+   public:
+      Reader (ThreadedLinesSource *source);
+      ~Reader ();
+
+      void run ();
+
+      void setup (LinesSink *sink);
+      void addTimeout (double secs, int type);
+      void removeTimeout (int type);
+
+      void setLinesSource (LinesSource *source);
+      void processLine (char *line);
+      void timeout (int type);
+      void finish ();
+   };
+
+   enum { RING_CAPACITY = 64, BATCH_LINES = 1024 };
+
+   int fd;
+   SpscRing *ring;
+   TimeoutQueue timeouts;
+
+   static void *runReader (void *data);
+
+public:
+   ThreadedLinesSource (int fd);
+   ~ThreadedLinesSource ();
+   void setup (LinesSink *sink);
+   void addTimeout (double secs, int type);
+   void removeTimeout (int type);
+};
+
+} // namespace tools
+
+} // namespace rtfl
+
+#endif // __COMMON_THREADED_LINES_HH__
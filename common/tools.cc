@@ -31,6 +31,12 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 using namespace lout::object;
 using namespace lout::container::untyped;
@@ -83,139 +89,275 @@ void syserr (const char *fmt, ...)
    exit (1);
 }
 
-// ----------------------------------------------------------------------
-
-EquivalenceRelation::RefTarget::RefTarget (Object *object, bool ownerOfObject)
+/**
+ * \brief Create a Unix domain socket bound to `path`, and listen on it.
+ *
+ * A socket left over at `path` (e. g. after a crash) is removed before, but
+ * no other file. Returns the file descriptor, or -1 on error (with `errno`
+ * set).
+ */
+int listenUnixSocket (const char *path)
 {
-   this->object = object;
-   this->ownerOfObject = ownerOfObject;
-   refCount = 1;
-   allKeys = new HashSet (false);
+   struct sockaddr_un addr;
+   if (strlen (path) >= sizeof (addr.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+
+   memset (&addr, 0, sizeof (addr));
+   addr.sun_family = AF_UNIX;
+   strcpy (addr.sun_path, path);
+
+   struct stat st;
+   if (lstat (path, &st) == 0 && S_ISSOCK (st.st_mode))
+      unlink (path);
+
+   int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1)
+      return -1;
+   fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+   // Large buffers for the connections (inherited by them), so that the
+   // traced programs are rarely blocked.
+   int size = 1024 * 1024;
+   setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof (size));
+
+   if (bind (fd, (struct sockaddr*) &addr, sizeof (addr)) == -1 ||
+       listen (fd, SOMAXCONN) == -1) {
+      int err = errno;
+      close (fd);
+      errno = err;
+      return -1;
+   }
+
+   return fd;
 }
 
-EquivalenceRelation::RefTarget::~RefTarget ()
+/**
+ * \brief Return the time of the monotonic clock, in microseconds.
+ */
+long getCurrentMicros ()
 {
-   if (ownerOfObject)
-      delete object;
-   delete allKeys;
+   struct timespec ts;
+   if (clock_gettime (CLOCK_MONOTONIC, &ts) == -1)
+      syserr ("clock_gettime() failed");
+   return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
 }
 
 // ----------------------------------------------------------------------
 
-EquivalenceRelation::RefSource::RefSource (Object *key, RefTarget *target)
+LatencyHistogram::LatencyHistogram ()
 {
-   this->target = target;
-   this->key = key;
-   refTarget ();
+   for (int i = 0; i < NUM_BUCKETS; i++)
+      counts[i] = 0;
+   total = maxMicros = 0;
 }
 
-EquivalenceRelation::RefSource::~RefSource ()
+void LatencyHistogram::add (long micros)
 {
-   unrefTarget ();
+   // Bucket i contains latencies below 2^i microseconds.
+   int i = 0;
+   while (i < NUM_BUCKETS - 1 && micros >= getBucketLimit (i))
+      i++;
+
+   counts[i]++;
+   total++;
+   maxMicros = lout::misc::max (maxMicros, micros);
 }
 
-void EquivalenceRelation::RefSource::refTarget ()
+/**
+ * \brief Return an upper limit of the latency below which `permille` / 1000
+ *    of all latencies are.
+ */
+long LatencyHistogram::getPercentile (int permille)
 {
-   if (target) {
-      target->ref ();
-      target->putKey (key);
+   long n = 0;
+   for (int i = 0; i < NUM_BUCKETS; i++) {
+      n += counts[i];
+      if (n * 1000 >= total * permille)
+         return lout::misc::min (getBucketLimit (i), maxMicros);
    }
+   return maxMicros;
 }
 
-void EquivalenceRelation::RefSource::unrefTarget ()
+void LatencyHistogram::print (FILE *file, const char *title)
 {
-   if (target) {
-      target->removeKey (key);
-      target->unref ();
-      target = NULL;
-   }
+   fprintf (file, "%s: %ld commands, p50 <= %ld us, p90 <= %ld us, "
+            "p99 <= %ld us, max %ld us\n", title, total, getPercentile (500),
+            getPercentile (900), getPercentile (990), maxMicros);
+   for (int i = 0; i < NUM_BUCKETS; i++)
+      if (counts[i] > 0)
+         fprintf (file, "   < %10ld us: %10ld\n", getBucketLimit (i),
+                  counts[i]);
 }
-   
-void EquivalenceRelation::RefSource::setTarget (RefTarget *target)
+
+// ----------------------------------------------------------------------
+
+EquivalenceRelation::Members::MembersIterator::MembersIterator
+   (EquivalenceRelation *relation, int first)
+{
+   this->relation = relation;
+   this->first = first;
+   current = first == -1 ? advance (-1) : first;
+}
+
+/**
+ * \brief Return the next member with a key after `i`, or -1.
+ *
+ * Iterates either over all members (`first` is -1), or over the circular list
+ * starting at `first`.
+ */
+int EquivalenceRelation::Members::MembersIterator::advance (int i)
 {
-   if (target != this->target) {
-      unrefTarget ();
-      this->target = target;
-      refTarget ();
+   if (first == -1) {
+      for (i++; i < relation->members.size (); i++)
+         if (relation->members.getRef(i)->key)
+            return i;
+      return -1;
+   } else {
+      for (i = relation->members.getRef(i)->next; i != first;
+           i = relation->members.getRef(i)->next)
+         if (relation->members.getRef(i)->key)
+            return i;
+      return -1;
    }
 }
 
+bool EquivalenceRelation::Members::MembersIterator::hasNext ()
+{
+   return current != -1;
+}
+
+Object *EquivalenceRelation::Members::MembersIterator::getNext ()
+{
+   Object *key = relation->members.getRef(current)->key;
+   current = advance (current);
+   return key;
+}
+
+Collection0::AbstractIterator *EquivalenceRelation::Members::createIterator ()
+{
+   return new MembersIterator (relation, first);
+}
+
+int EquivalenceRelation::Members::size ()
+{
+   if (first == -1)
+      return relation->numKeys;
+   else
+      return relation->members.getRef(relation->find (first))->numKeys;
+}
+
 // ----------------------------------------------------------------------
 
 EquivalenceRelation::EquivalenceRelation (bool ownerOfKeys, bool ownerOfValues)
 {
    this->ownerOfKeys = ownerOfKeys;
    this->ownerOfValues = ownerOfValues;
-   sources = new HashTable (ownerOfKeys, true);
+   hashTable.setSize (MIN_HASH_SIZE, -1);
+   numKeys = 0;
+   firstFree = -1;
 }
 
 EquivalenceRelation::~EquivalenceRelation ()
 {
-   delete sources;
+   for (int i = 0; i < members.size (); i++) {
+      Member *member = members.getRef (i);
+      if (member->key && ownerOfKeys)
+         delete member->key;
+      if (member->parent == i && ownerOfValues)
+         delete member->value;
+   }
 }
 
 void EquivalenceRelation::put (Object *key, Object *value)
 {
    assert (!contains(key));
 
-   RefTarget *target = new RefTarget (value, ownerOfValues);
-   RefSource *source = new RefSource (key, target);
-   target->unref ();
-   sources->put (key, source);
+   int i = newMember (key, -1);
+   Member *member = members.getRef (i);
+   member->parent = i;
+   member->rank = 0;
+   member->numKeys = 1;
+   member->value = value;
 }
 
 Object *EquivalenceRelation::get (Object *key) const
 {
-   RefSource *source = (RefSource*) sources->get(key);
-   if (source) {
-      Object *object = source->getTarget()->getObject ();
-      return object;
-   } else
-      return NULL;
+   return get (key, key->hashValue ());
+}
+
+/**
+ * \brief Like get (Object*), with the hash value of `key` already known.
+ */
+Object *EquivalenceRelation::get (Object *key, unsigned int hashValue) const
+{
+   int i = lookup (key, hashValue);
+   return i == -1 ? NULL : members.getRef(find (i))->value;
+}
+
+/**
+ * \brief Prefetch the hash bucket for a key with the given hash value, and
+ *    the first member in it, before a number of calls of get().
+ */
+void EquivalenceRelation::prefetch (unsigned int hashValue) const
+{
+   int i = hashTable.get (bucket (hashValue));
+   if (i != -1)
+      __builtin_prefetch (members.getRef (i));
 }
 
 bool EquivalenceRelation::contains (Object *key) const
 {
-   return sources->contains (key);
+   return lookup (key) != -1;
 }
 
 Iterator EquivalenceRelation::iterator ()
 {
-   return sources->iterator ();
+   Members all (this, -1);
+   return all.iterator ();
 }
 
 Iterator EquivalenceRelation::relatedIterator (Object *key)
 {
    assert (contains (key));
 
-   RefSource *source = (RefSource*) sources->get (key);
-   RefTarget *target = source->getTarget ();
-   return target->getAllKeys()->iterator ();
+   Members related (this, lookup (key));
+   return related.iterator ();
 }
 
 void EquivalenceRelation::relate (Object *key1, Object *key2)
 {
    assert (contains(key1) && contains(key2));
 
-   RefSource *source1 = (RefSource*) sources->get (key1);
-   RefSource *source2 = (RefSource*) sources->get (key2);
-   if (source1->getTarget () != source2->getTarget ()) {
+   int root1 = find (lookup (key1)), root2 = find (lookup (key2));
+   if (root1 != root2) {
       // The first value is kept, the second destroyed. The caller has
       // to care about the order.
-
-      // Consider all keys already related to `key2`; this is possible by
-      // iterating over `RefTarget::allKeys`. To avoid accessing freed memory,
-      // copy all keys to a new temporary set.
-      
-      HashSet target2Keys (false);
-      for (Iterator it = source2->getTarget()->getAllKeys()->iterator ();
-           it.hasNext (); )
-         target2Keys.put (it.getNext ());
-      
-      for (Iterator it = target2Keys.iterator (); it.hasNext (); ) {
-         RefSource *otherSource = (RefSource*) sources->get (it.getNext ());
-         otherSource->setTarget (source1->getTarget ());
+      Member *member1 = members.getRef (root1);
+      Member *member2 = members.getRef (root2);
+      if (ownerOfValues)
+         delete member2->value;
+
+      Object *value = member1->value;
+      int numKeys = member1->numKeys + member2->numKeys;
+
+      // Union by rank; the root may change, but the value is kept.
+      if (member1->rank < member2->rank) {
+         member1->parent = root2;
+         member2->value = value;
+         member2->numKeys = numKeys;
+      } else {
+         if (member1->rank == member2->rank)
+            member1->rank++;
+         member2->parent = root1;
+         member1->numKeys = numKeys;
       }
+
+      // Swapping the successors joins the two circular lists.
+      int next1 = member1->next;
+      member1->next = member2->next;
+      member2->next = next1;
    }
 }
 
@@ -223,41 +365,149 @@ void EquivalenceRelation::putRelated (Object *oldKey, Object *newKey)
 {
    assert (contains(oldKey) && !contains(newKey));
 
-   RefSource *oldSource = (RefSource*) sources->get (oldKey);
-   RefSource *newSource = new RefSource (newKey, oldSource->getTarget ());
-   sources->put (newKey, newSource);
+   int root = find (lookup (oldKey));
+   int i = newMember (newKey, root);
+   Member *rootMember = members.getRef (root);
+   members.getRef(i)->next = rootMember->next;
+   rootMember->next = i;
+   rootMember->numKeys++;
 }
    
 void EquivalenceRelation::removeSimple (lout::object::Object *key)
 {
-   // The order is important: a simple "sources->remove (key)" will
-   // cause an access to freed memory.
-      
-   RefSource *source = (RefSource*) sources->get (key);
-   source->setTarget (NULL); // Will unref() the target.
-   sources->remove (key); 
+   int i = lookup (key);
+   int root = find (i);
+   removeKey (i);
+   if (--members.getRef(root)->numKeys == 0)
+      removeClass (root);
 }
    
 void EquivalenceRelation::remove (Object *key)
 {
    assert (contains (key));
 
-   RefSource *source = (RefSource*) sources->get (key);
-   RefTarget *target = source->getTarget ();
-   target->ref ();
+   int root = find (lookup (key));
+   int i = root;
+   do {
+      if (members.getRef(i)->key)
+         removeKey (i);
+      i = members.getRef(i)->next;
+   } while (i != root);
+
+   removeClass (root);
+}
 
-   for (Iterator it = target->getAllKeys()->iterator (); it.hasNext (); ) {
-      Object *otherKey = it.getNext ();
+int EquivalenceRelation::lookup (Object *key, unsigned int hashValue) const
+{
+   for (int i = hashTable.get (bucket (hashValue)); i != -1;
+        i = members.getRef(i)->hashNext)
+      if (members.getRef(i)->key->equals (key))
+         return i;
+   return -1;
+}
 
-      // The order is important: see removeSimple().
-      RefSource *otherSource = (RefSource*) sources->get (otherKey);
-      otherSource->setTarget (NULL); // Will unref() the target.
-      sources->remove (otherKey);
+/**
+ * \brief Return the root of the class of member `i`; the path is compressed
+ *    on the way.
+ */
+int EquivalenceRelation::find (int i) const
+{
+   int root = i;
+   while (members.getRef(root)->parent != root)
+      root = members.getRef(root)->parent;
+
+   while (i != root) {
+      Member *member = members.getRef (i);
+      i = member->parent;
+      member->parent = root;
    }
 
-   target->unref ();
+   return root;
 }
 
+/**
+ * \brief Add a member for `key` to the hash index; `parent`, `next` and the
+ *    fields of the root have to be set by the caller.
+ */
+int EquivalenceRelation::newMember (Object *key, int parent)
+{
+   int i;
+   if (firstFree != -1) {
+      i = firstFree;
+      firstFree = members.getRef(i)->hashNext;
+   } else {
+      i = members.size ();
+      members.increase ();
+   }
+
+   Member *member = members.getRef (i);
+   member->key = key;
+   member->parent = parent;
+   member->next = i;
+
+   int b = bucket (key);
+   member->hashNext = hashTable.get (b);
+   hashTable.set (b, i);
+
+   if (++numKeys > hashTable.size ())
+      rehash ();
+
+   return i;
+}
+
+/**
+ * \brief Remove the key of member `i` from the hash index, and delete it,
+ *    if owned. The member itself remains in the class.
+ */
+void EquivalenceRelation::removeKey (int i)
+{
+   Member *member = members.getRef (i);
+   int *link = hashTable.getRef (bucket (member->key));
+   while (*link != i)
+      link = &members.getRef(*link)->hashNext;
+   *link = member->hashNext;
+
+   if (ownerOfKeys)
+      delete member->key;
+   member->key = NULL;
+   numKeys--;
+}
+
+/**
+ * \brief Free all members of a class (whose keys have been removed before),
+ *    and delete the value, if owned.
+ */
+void EquivalenceRelation::removeClass (int root)
+{
+   if (ownerOfValues)
+      delete members.getRef(root)->value;
+
+   int i = root;
+   do {
+      Member *member = members.getRef (i);
+      int next = member->next;
+      member->parent = -1;
+      member->hashNext = firstFree;
+      firstFree = i;
+      i = next;
+   } while (i != root);
+}
+
+void EquivalenceRelation::rehash ()
+{
+   hashTable.setSize (2 * hashTable.size ());
+   for (int i = 0; i < hashTable.size (); i++)
+      hashTable.set (i, -1);
+
+   for (int i = 0; i < members.size (); i++) {
+      Member *member = members.getRef (i);
+      if (member->key) {
+         int b = bucket (member->key);
+         member->hashNext = hashTable.get (b);
+         hashTable.set (b, i);
+      }
+   }
+}
 
 } // namespace tools
 
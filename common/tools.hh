@@ -1,6 +1,8 @@
 #ifndef __COMMON_TOOLS_HH__
 #define __COMMON_TOOLS_HH__
 
+#include <stdio.h>
+
 #include "lout/object.hh"
 #include "lout/container.hh"
 
@@ -11,50 +13,109 @@ namespace tools {
 const char *numSuffix (int n);
 void numToRoman (int num, char *buf, int buflen);
 void syserr (const char *fmt, ...);
+int listenUnixSocket (const char *path);
+long getCurrentMicros ();
+
+/**
+ * \brief Counts latencies (in microseconds) in buckets of powers of two.
+ *
+ * Used e. g. to measure how long ObjIdentController holds back commands.
+ */
+class LatencyHistogram
+{
+private:
+   enum { NUM_BUCKETS = 32 };
+
+   long counts[NUM_BUCKETS], total, maxMicros;
+
+   static inline long getBucketLimit (int i) { return 1L << i; }
 
+public:
+   LatencyHistogram ();
+
+   void add (long micros);
+   long getPercentile (int permille);
+   void print (FILE *file, const char *title);
+};
+
+/**
+ * \brief Keys, which are partitioned into classes of related keys; all keys
+ *    of a class are mapped to the same value.
+ *
+ * Implemented as a union-find structure (union by rank, path compression) on
+ * an array of members, with an own hash index (growing with the number of
+ * keys) for the keys. The members of each class are linked to a circular
+ * list, which is used by relatedIterator() and remove(). A member removed by
+ * removeSimple() remains in the tree and the list (without key) until the
+ * whole class is removed.
+ *
+ * As for the containers in lout::container, iterators are not valid anymore
+ * after the relation has been changed.
+ */
 class EquivalenceRelation: public lout::object::Object {
 private:
-   class RefTarget: public lout::object::Object {
+   struct Member {
+      lout::object::Object *key; // NULL when removed.
+      int parent;                // Itself for the root; -1 when free.
+      int next;                  // Circular list of the class.
+      int hashNext;              // Hash chain, or list of free members.
+
+      // Only valid for the root.
+      int rank, numKeys;
+      lout::object::Object *value;
+   };
+
+   class Members: public lout::container::untyped::Collection
+   {
    private:
-      bool ownerOfObject;
-      int refCount;
-      lout::object::Object *object;
-      lout::container::untyped::HashSet *allKeys;
+      class MembersIterator: public AbstractIterator
+      {
+      private:
+         EquivalenceRelation *relation;
+         int first, current;
 
-   public:
-      RefTarget (lout::object::Object *object, bool ownerOfObject);
-      ~RefTarget ();
+         int advance (int i);
 
-      inline lout::object::Object *getObject () { return object; }
-      inline void ref () { refCount++; }
-      inline void unref () { if (--refCount == 0) delete this; }
+      public:
+         MembersIterator (EquivalenceRelation *relation, int first);
 
-      inline lout::container::untyped::HashSet *getAllKeys ()
-      { return allKeys; }
-      inline void putKey (Object *key) { allKeys->put (key); }
-      inline void removeKey (Object *key) { allKeys->remove (key); }
-   };
+         bool hasNext ();
+         Object *getNext ();
+      };
 
+      EquivalenceRelation *relation;
+      int first;
 
-   class RefSource: public lout::object::Object {
-      RefTarget *target;
-      lout::object::Object *key;
+   protected:
+      AbstractIterator *createIterator ();
 
-      void refTarget ();
-      void unrefTarget ();
-      
    public:
-      RefSource (lout::object::Object *key, RefTarget *target);
-      ~RefSource ();
+      inline Members (EquivalenceRelation *relation, int first)
+      { this->relation = relation; this->first = first; }
 
-      inline RefTarget *getTarget () { return target; }
-      void setTarget (RefTarget *target);
+      int size ();
    };
-   
-   bool ownerOfKeys, ownerOfValues;
-   lout::container::untyped::HashTable *sources;
 
-   lout::container::untyped::HashSet *initSet (lout::object::Object *o);
+   enum { MIN_HASH_SIZE = 256 };
+
+   bool ownerOfKeys, ownerOfValues;
+   lout::misc::SimpleVector<Member> members;
+   lout::misc::SimpleVector<int> hashTable;
+   int numKeys, firstFree;
+
+   inline int bucket (unsigned int h) const
+   { return (h ^ (h >> 16)) & (hashTable.size () - 1); }
+   inline int bucket (lout::object::Object *key) const
+   { return bucket ((unsigned int) key->hashValue ()); }
+
+   inline int lookup (lout::object::Object *key) const
+   { return lookup (key, key->hashValue ()); }
+   int lookup (lout::object::Object *key, unsigned int hashValue) const;
+   int find (int i) const;
+   int newMember (lout::object::Object *key, int parent);
+   void removeKey (int i);
+   void removeClass (int root);
+   void rehash ();
 
  public:
    EquivalenceRelation (bool ownerOfKeys, bool ownerOfValues);
@@ -62,6 +123,9 @@ private:
   
    void put (lout::object::Object *key, lout::object::Object *value);
    lout::object::Object *get (lout::object::Object *key) const;
+   lout::object::Object *get (lout::object::Object *key,
+                              unsigned int hashValue) const;
+   void prefetch (unsigned int hashValue) const;
    bool contains (lout::object::Object *key) const;
    lout::container::untyped::Iterator iterator ();
    lout::container::untyped::Iterator relatedIterator (Object *key);
@@ -35,14 +35,515 @@
 #include <unistd.h>
 #include <sys/time.h>
 
+// The transports other than stdout are optional, since they need POSIX
+// threads (and the shared memory ring also the "__atomic" built-ins of GCC
+// and Clang).
+
+#if defined (DBG_RTFL_SOCKET) || defined (DBG_RTFL_SHM)
+#define RTFL_PTHREAD
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#endif
+
+#ifdef DBG_RTFL_SOCKET
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#ifdef DBG_RTFL_SHM
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #define DBG_IF_RTFL if(1)
 
 #define STMT_START       do
 #define STMT_END         while (0)
 
-// Prints an RTFL message to stdout. "fmt" contains simple format
-// characters how to deal with the additional arguments (no "%"
-// preceeding, as in printf) or "q" (which additionally
+#ifdef RTFL_PTHREAD
+
+// The process id is cached, since getpid(2) is a system call; it is reset in
+// a child process after fork(2).
+
+inline int *rtfl_pid_cache ()
+{
+   static int pid = 0;
+   return &pid;
+}
+
+inline void rtfl_reset_pid ()
+{
+   *rtfl_pid_cache () = 0;
+}
+
+inline void rtfl_reset_out ();
+
+// Called in the child process after fork(2), when only the forking thread is
+// running.
+
+inline void rtfl_after_fork ()
+{
+   rtfl_reset_pid ();
+   rtfl_reset_out ();
+}
+
+inline void rtfl_init_once ();
+
+inline int rtfl_getpid ()
+{
+   int *pid = rtfl_pid_cache ();
+
+   if (*pid == 0) {
+      rtfl_init_once ();
+      *pid = getpid ();
+   }
+
+   return *pid;
+}
+
+#else /* RTFL_PTHREAD */
+
+inline int rtfl_getpid ()
+{
+   return getpid ();
+}
+
+#endif /* RTFL_PTHREAD */
+
+// Returns the stream RTFL messages are printed to. This is stdout, unless
+// DBG_RTFL_SOCKET is defined and the environment variable RTFL_SOCKET is
+// set: then, on first use, a connection to the Unix domain socket with this
+// name is opened (see option "-u" of "rtfl-objview" and "rtfl-objbase"), so
+// that stdout is left to the program. A child process (after fork(2)) opens
+// its own connection.
+
+#ifdef DBG_RTFL_SOCKET
+
+struct rtfl_out_state
+{
+   pthread_once_t once;        // Reset in the child process after fork(2).
+   FILE *out;
+};
+
+inline rtfl_out_state *rtfl_out_state_ptr ()
+{
+   static rtfl_out_state state = { PTHREAD_ONCE_INIT, NULL };
+   return &state;
+}
+
+inline void rtfl_connect ()
+{
+   rtfl_out_state *state = rtfl_out_state_ptr ();
+
+   // Registers rtfl_after_fork(), before any other thread can use the
+   // connection.
+   rtfl_init_once ();
+
+   if (state->out != NULL && state->out != stdout)
+      fclose (state->out); // Only closes the copy inherited from the parent.
+
+   state->out = stdout;
+
+   const char *path = getenv ("RTFL_SOCKET");
+   if (path && path[0]) {
+      struct sockaddr_un addr;
+      memset (&addr, 0, sizeof (addr));
+      addr.sun_family = AF_UNIX;
+      strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+
+      int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd != -1 &&
+          connect (fd, (struct sockaddr*) &addr, sizeof (addr)) == 0) {
+         // A large buffer, so that the program is rarely blocked.
+         int size = 1024 * 1024;
+         setsockopt (fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof (size));
+         if ((state->out = fdopen (fd, "w")) == NULL)
+            state->out = stdout;
+      } else {
+         perror (path);
+         if (fd != -1)
+            close (fd);
+      }
+   }
+}
+
+inline void rtfl_reset_out ()
+{
+   static const pthread_once_t initialOnce = PTHREAD_ONCE_INIT;
+   rtfl_out_state_ptr ()->once = initialOnce;
+}
+
+inline FILE *rtfl_out ()
+{
+   rtfl_out_state *state = rtfl_out_state_ptr ();
+   pthread_once (&state->once, rtfl_connect);
+   return state->out;
+}
+
+#else /* DBG_RTFL_SOCKET */
+
+inline void rtfl_reset_out ()
+{
+}
+
+inline FILE *rtfl_out ()
+{
+   return stdout;
+}
+
+#endif /* DBG_RTFL_SOCKET */
+
+#ifdef DBG_RTFL_SHM
+
+// Shared memory ring (only when DBG_RTFL_SHM is defined): when the
+// environment variable RTFL_SHM is set to the name of a segment created by the viewer (option "-r" of "rtfl-objview" and
+// "rtfl-objbase"), messages are put into it, without any system call as
+// long as there is space. The layout must match common/shm_ring.hh.
+
+#define RTFL_SHM_MAGIC       "RTFLSHM2"
+#define RTFL_SHM_HEADER_SIZE 4096
+#define RTFL_SHM_NUM_SLOTS   128
+#define RTFL_SHM_NO_CLAIM    (~(uint64_t)0)
+
+enum { RTFL_SHM_BLOCK = 0, RTFL_SHM_DROP = 1, RTFL_SHM_SPILL = 2 };
+enum { RTFL_SHM_BUSY = 1, RTFL_SHM_READY = 2, RTFL_SHM_PAD = 3 };
+
+// Each thread putting lines uses a slot, in which it announces the space it
+// is about to claim, so that the viewer can skip the space when the process
+// has died before finishing the record.
+
+struct rtfl_shm_slot
+{
+   int32_t pid;                // 0 when free.
+   uint32_t size;
+   uint64_t head;              // RTFL_SHM_NO_CLAIM when not claiming.
+};
+
+struct rtfl_shm_header
+{
+   char magic[8];
+   uint32_t policy, dataSize;
+   int32_t consumerAlive, spilling;
+   uint64_t numDropped, numSpilled;
+   char spillFile[256];
+   union {
+      pthread_mutex_t spillLock; // Process-shared and robust.
+      char pad1[216];
+   };
+   uint64_t head;              // Offset 512; claimed by producers.
+   char pad2[56];
+   uint64_t tail;              // Offset 576; consumed by the viewer.
+   char pad3[440];
+   rtfl_shm_slot slots[RTFL_SHM_NUM_SLOTS]; // Offset 1024.
+};
+
+inline rtfl_shm_header **rtfl_shm_ptr ()
+{
+   static rtfl_shm_header *shm = NULL;
+   return &shm;
+}
+
+inline pthread_key_t *rtfl_shm_slot_key ()
+{
+   static pthread_key_t key;
+   return &key;
+}
+
+// Called when a thread terminates: its slot is released (unless it has been
+// inherited from the parent process).
+
+inline void rtfl_shm_release_slot (void *value)
+{
+   rtfl_shm_slot *slot = (rtfl_shm_slot*) value;
+   int pid = rtfl_getpid ();
+   __atomic_compare_exchange_n (&slot->pid, &pid, 0, false, __ATOMIC_RELEASE,
+                                __ATOMIC_RELAXED);
+}
+
+inline void rtfl_shm_init ()
+{
+   const char *path = getenv ("RTFL_SHM");
+   if (path && path[0]) {
+      int fd = open (path, O_RDWR);
+      struct stat st;
+      if (fd == -1 || fstat (fd, &st) == -1)
+         perror (path);
+      else if (st.st_size > RTFL_SHM_HEADER_SIZE) {
+         void *p = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+         if (p != MAP_FAILED &&
+             memcmp (p, RTFL_SHM_MAGIC, 8) == 0 &&
+             RTFL_SHM_HEADER_SIZE + ((rtfl_shm_header*)p)->dataSize
+             <= (uint64_t)st.st_size) {
+            pthread_key_create (rtfl_shm_slot_key (), rtfl_shm_release_slot);
+            *rtfl_shm_ptr () = (rtfl_shm_header*)p;
+         } else
+            fprintf (stderr, "%s: not an RTFL segment\n", path);
+      }
+
+      if (fd != -1)
+         close (fd);
+   }
+}
+
+inline rtfl_shm_header *rtfl_shm ()
+{
+   rtfl_init_once ();
+   return *rtfl_shm_ptr ();
+}
+
+// Returns the slot of the current thread, or NULL, when all slots are used.
+// A slot is taken over when it is free, or when its process has died without
+// a pending claim.
+
+inline rtfl_shm_slot *rtfl_shm_get_slot (rtfl_shm_header *shm)
+{
+   rtfl_shm_slot *slot =
+      (rtfl_shm_slot*) pthread_getspecific (*rtfl_shm_slot_key ());
+   int pid = rtfl_getpid ();
+
+   // After fork(2), the slot still belongs to the parent.
+   if (slot && __atomic_load_n (&slot->pid, __ATOMIC_RELAXED) == pid)
+      return slot;
+
+   for (int i = 0; i < RTFL_SHM_NUM_SLOTS; i++) {
+      slot = &shm->slots[i];
+      int32_t owner = __atomic_load_n (&slot->pid, __ATOMIC_ACQUIRE);
+      if ((owner == 0 ||
+           (__atomic_load_n (&slot->head, __ATOMIC_RELAXED)
+            == RTFL_SHM_NO_CLAIM &&
+            kill (owner, 0) == -1 && errno == ESRCH)) &&
+          __atomic_compare_exchange_n (&slot->pid, &owner, pid, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+         pthread_setspecific (*rtfl_shm_slot_key (), slot);
+         return slot;
+      }
+   }
+
+   return NULL;
+}
+
+// Called when there is no space left in the ring, and the policy is to
+// spill (or the viewer has terminated), and for lines too long.
+
+inline void rtfl_shm_overflow (rtfl_shm_header *shm, const char *line,
+                               int len, bool spill)
+{
+   static int fd = -1;
+
+   if (spill && __atomic_load_n (&fd, __ATOMIC_ACQUIRE) == -1) {
+      int newFd = open (shm->spillFile, O_WRONLY | O_APPEND | O_CREAT, 0644);
+      int noFd = -1;
+      if (newFd != -1 &&
+          !__atomic_compare_exchange_n (&fd, &noFd, newFd, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         close (newFd); // Opened by another thread in the meantime.
+   }
+
+   // One write(2) per line, so that lines of different processes are not
+   // mixed up.
+   if (spill && fd != -1 && write (fd, line, len) == len)
+      __atomic_add_fetch (&shm->numSpilled, 1, __ATOMIC_RELAXED);
+   else
+      __atomic_add_fetch (&shm->numDropped, 1, __ATOMIC_RELAXED);
+}
+
+// Spills a line, when the ring is full ("force"), or when the viewer has not
+// yet read all lines spilled before ("spilling" is set), so that the lines
+// stay in order. The viewer reads the spill file, and clears "spilling",
+// only with "spillLock" held, and only when the ring is empty.
+
+inline bool rtfl_shm_spill (rtfl_shm_header *shm, const char *line, int len,
+                            bool force)
+{
+   if (!force && !__atomic_load_n (&shm->spilling, __ATOMIC_ACQUIRE))
+      return false;
+
+   // The previous owner has died while holding the lock.
+   if (pthread_mutex_lock (&shm->spillLock) == EOWNERDEAD)
+      pthread_mutex_consistent (&shm->spillLock);
+
+   bool spilled = force || shm->spilling;
+   if (spilled) {
+      shm->spilling = 1;
+      rtfl_shm_overflow (shm, line, len, true);
+   }
+
+   pthread_mutex_unlock (&shm->spillLock);
+   return spilled;
+}
+
+// Puts a line (terminated by "\n", which is not part of the record) into
+// the ring. Space is claimed by moving "head"; the record is readable by the
+// viewer as soon as its first word is set to RTFL_SHM_READY.
+
+inline void rtfl_shm_put (rtfl_shm_header *shm, const char *line, int len)
+{
+   uint64_t size = shm->dataSize;
+   uint64_t need = (4 + (len - 1) + 7) & ~(uint64_t)7;
+   char *data = (char*)shm + RTFL_SHM_HEADER_SIZE;
+   uint64_t head, pos, pad;
+   rtfl_shm_slot *slot = rtfl_shm_get_slot (shm);
+
+   if (shm->policy == RTFL_SHM_SPILL && rtfl_shm_spill (shm, line, len, false))
+      return;
+
+   while (true) {
+      head = __atomic_load_n (&shm->head, __ATOMIC_RELAXED);
+      pos = head & (size - 1);
+      // Records are not wrapped around; the rest is filled by padding.
+      pad = pos + need > size ? size - pos : 0;
+
+      if (head + pad + need - __atomic_load_n (&shm->tail, __ATOMIC_ACQUIRE)
+          > size) {
+         if (!__atomic_load_n (&shm->consumerAlive, __ATOMIC_RELAXED) ||
+             shm->policy != RTFL_SHM_BLOCK) {
+            if (slot)
+               __atomic_store_n (&slot->head, RTFL_SHM_NO_CLAIM,
+                                 __ATOMIC_RELEASE);
+            if (shm->policy == RTFL_SHM_SPILL)
+               rtfl_shm_spill (shm, line, len, true);
+            else
+               rtfl_shm_overflow (shm, line, len, false);
+            return;
+         }
+         sched_yield ();
+      } else {
+         // Announced before claiming, so that the viewer knows the owner of
+         // the space even before the first word is set.
+         if (slot) {
+            __atomic_store_n (&slot->size, (uint32_t)(pad + need),
+                              __ATOMIC_RELAXED);
+            __atomic_store_n (&slot->head, head, __ATOMIC_RELEASE);
+         }
+         if (__atomic_compare_exchange_n (&shm->head, &head,
+                                          head + pad + need, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+      }
+   }
+
+   if (pad) {
+      __atomic_store_n ((uint32_t*)(data + pos),
+                        (uint32_t)((pad - 4) << 2 | RTFL_SHM_PAD),
+                        __ATOMIC_RELEASE);
+      pos = 0;
+   }
+
+   uint32_t *word = (uint32_t*)(data + pos);
+   __atomic_store_n (word, (uint32_t)((len - 1) << 2 | RTFL_SHM_BUSY),
+                     __ATOMIC_RELAXED);
+   memcpy (data + pos + 4, line, len - 1);
+   __atomic_store_n (word, (uint32_t)((len - 1) << 2 | RTFL_SHM_READY),
+                     __ATOMIC_RELEASE);
+
+   if (slot)
+      __atomic_store_n (&slot->head, RTFL_SHM_NO_CLAIM, __ATOMIC_RELEASE);
+}
+
+#endif /* DBG_RTFL_SHM */
+
+#ifdef RTFL_PTHREAD
+
+// Done once per program; child processes inherit both the fork handler and
+// the mapping of the shared memory ring.
+
+inline void rtfl_init ()
+{
+   pthread_atfork (NULL, NULL, rtfl_after_fork);
+#ifdef DBG_RTFL_SHM
+   rtfl_shm_init ();
+#endif
+}
+
+inline void rtfl_init_once ()
+{
+   static pthread_once_t once = PTHREAD_ONCE_INIT;
+   pthread_once (&once, rtfl_init);
+}
+
+#endif /* RTFL_PTHREAD */
+
+// A line being printed: either directly to a stream, or collected in a
+// buffer (for the shared memory ring). Lines of 1000 characters and more are
+// discarded by RTFL anyway; this is also done here.
+
+#define RTFL_LINE_SIZE 1024
+
+struct rtfl_line
+{
+   FILE *out;
+   int len;
+   char buf[RTFL_LINE_SIZE];
+};
+
+inline void rtfl_putc (rtfl_line *l, char c)
+{
+   if (l->out)
+      putc (c, l->out);
+   else if (l->len < RTFL_LINE_SIZE)
+      l->buf[l->len++] = c;
+}
+
+inline void rtfl_puts (rtfl_line *l, const char *s)
+{
+   if (l->out)
+      fputs (s, l->out);
+   else
+      for (int i = 0; s[i] && l->len < RTFL_LINE_SIZE; i++)
+         l->buf[l->len++] = s[i];
+}
+
+// Numbers are formatted here, since snprintf(3) is rather slow. The output
+// is the same as for "%d", "%p", and "%0<digits>x".
+
+inline void rtfl_putdec (rtfl_line *l, long n)
+{
+   char s[24];
+   int i = sizeof (s);
+   unsigned long u = n < 0 ? - (unsigned long) n : n;
+   s[--i] = 0;
+   do {
+      s[--i] = '0' + u % 10;
+      u /= 10;
+   } while (u);
+   if (n < 0)
+      s[--i] = '-';
+   rtfl_puts (l, s + i);
+}
+
+inline void rtfl_puthex (rtfl_line *l, unsigned long u, int digits)
+{
+   char s[24];
+   int i = sizeof (s);
+   s[--i] = 0;
+   do {
+      s[--i] = "0123456789abcdef"[u & 15];
+      u >>= 4;
+      digits--;
+   } while (u || digits > 0);
+   rtfl_puts (l, s + i);
+}
+
+inline void rtfl_putptr (rtfl_line *l, void *p)
+{
+   if (p == NULL)
+      rtfl_puts (l, "(nil)");
+   else {
+      rtfl_puts (l, "0x");
+      rtfl_puthex (l, (unsigned long) p, 1);
+   }
+}
+
+// Prints an RTFL message to stdout (or see rtfl_out() and rtfl_shm()). "fmt"
+// contains simple format characters how to deal with the additional
+// arguments (no "%" preceeding, as in printf) or "q" (which additionally
 // (double-)quotes quotation marks) or "c" (short for "#%06x" and used
 // for colors), or other characters, which are simply printed. No
 // quoting: this function cannot be used to print the characters "d",
@@ -52,9 +553,34 @@ inline void rtfl_print (const char *module, const char *version,
                         const char *file, int line, int processId,
                         const char *fmt, ...)
 {
+   rtfl_line l;
+#ifdef DBG_RTFL_SHM
+   rtfl_shm_header *shm = rtfl_shm ();
+   l.out = shm ? NULL : rtfl_out ();
+#else
+   l.out = rtfl_out ();
+#endif
+   l.len = 0;
+
    // "\n" at the beginning just in case that the previous line is not
-   // finished yet.
-   printf ("\n[rtfl-%s-%s]%s:%d:%d:", module, version, file, line, processId);
+   // finished yet. (Not needed for the shared memory ring.) The stream is
+   // locked for the whole line, so that lines of different threads are not
+   // mixed up.
+   if (l.out) {
+      flockfile (l.out);
+      rtfl_putc (&l, '\n');
+   }
+   rtfl_puts (&l, "[rtfl-");
+   rtfl_puts (&l, module);
+   rtfl_putc (&l, '-');
+   rtfl_puts (&l, version);
+   rtfl_putc (&l, ']');
+   rtfl_puts (&l, file);
+   rtfl_putc (&l, ':');
+   rtfl_putdec (&l, line);
+   rtfl_putc (&l, ':');
+   rtfl_putdec (&l, processId);
+   rtfl_putc (&l, ':');
 
    va_list args;
    va_start (args, fmt);
@@ -67,20 +593,20 @@ inline void rtfl_print (const char *module, const char *version,
       switch (fmt[i]) {
       case 'd':
          n = va_arg(args, int);
-         printf ("%d", n);
+         rtfl_putdec (&l, n);
          break;
 
       case 'p':
          p = va_arg(args, void*);
-         printf ("%p", p);
+         rtfl_putptr (&l, p);
          break;
 
       case 's':
          s = va_arg (args, char*);
          for (int j = 0; s[j]; j++) {
             if (s[j] == ':' || s[j] == '\\')
-               putchar ('\\');
-            putchar (s[j]);
+               rtfl_putc (&l, '\\');
+            rtfl_putc (&l, s[j]);
          }
          break;
 
@@ -88,33 +614,44 @@ inline void rtfl_print (const char *module, const char *version,
          s = va_arg (args, char*);
          for (int j = 0; s[j]; j++) {
             if (s[j] == ':' || s[j] == '\\')
-               putchar ('\\');
+               rtfl_putc (&l, '\\');
             else if (s[j] == '\"')
-               printf ("\\\\"); // a quoted quoting character
-            putchar (s[j]);
+               rtfl_puts (&l, "\\\\"); // a quoted quoting character
+            rtfl_putc (&l, s[j]);
          }
          break;
 
       case 'c':
          n = va_arg(args, int);
-         printf ("#%06x", n);
+         rtfl_putc (&l, '#');
+         rtfl_puthex (&l, (unsigned int) n, 6);
          break;
 
       default:
-         putchar (fmt[i]);
+         rtfl_putc (&l, fmt[i]);
          break;
       }
    }
 
    va_end (args);
 
-   putchar ('\n');
-   fflush (stdout);
+   rtfl_putc (&l, '\n');
+   if (l.out) {
+      fflush (l.out);
+      funlockfile (l.out);
+   }
+#ifdef DBG_RTFL_SHM
+   else if (l.len < RTFL_LINE_SIZE)
+      rtfl_shm_put (shm, l.buf, l.len);
+   else
+      // Too long (and truncated), but counted, so that the loss is noticed.
+      __atomic_add_fetch (&shm->numDropped, 1, __ATOMIC_RELAXED);
+#endif
 }
 
 #define RTFL_PRINT(module, version, cmd, fmt, ...) \
    rtfl_print (module, version, CUR_WORKING_DIR "/" __FILE__, __LINE__, \
-               getpid (), "s:" fmt, cmd, __VA_ARGS__)
+               rtfl_getpid (), "s:" fmt, cmd, __VA_ARGS__)
 
 
 // ==================================
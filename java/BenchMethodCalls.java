@@ -0,0 +1,38 @@
+package rtfl;
+
+import java.util.ArrayList;
+import java.util.List;
+
+// Many method calls, both of included classes (package "rtfl") and of
+// excluded classes (java.util and java.lang), to measure the overhead
+// of the agent per METHOD_ENTRY and METHOD_EXIT event. Run with
+// "make run-bench-method-calls", and redirect the output to
+// /dev/null. Argument: number of iterations.
+public class BenchMethodCalls
+{
+   private int value = 0;
+
+   public int add (int n)
+   {
+      value += n;
+      return value;
+   }
+
+   public static void main (String[] args)
+   {
+      int n = args.length > 0 ? Integer.parseInt (args[0]) : 20000;
+      BenchMethodCalls b = new BenchMethodCalls ();
+      List<Integer> list = new ArrayList<Integer> ();
+      long t = System.currentTimeMillis ();
+
+      for (int i = 0; i < n; i++) {
+         b.add (i);
+         list.add (Integer.valueOf (i));
+         if (list.size () > 100)
+            list.clear ();
+      }
+
+      System.err.println (n + " iterations in "
+                          + (System.currentTimeMillis () - t) + " ms");
+   }
+}
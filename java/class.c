@@ -1,5 +1,6 @@
 #include "class.h"
 #include "config.h"
+#include "method_info.h"
 #include "misc.h"
 
 void JNICALL class_prepare(jvmtiEnv *jvmti, JNIEnv* jni, jthread thread,
@@ -11,9 +12,12 @@ void JNICALL class_prepare(jvmtiEnv *jvmti, JNIEnv* jni, jthread thread,
    if ((error = (*jvmti)->GetClassSignature (jvmti, klass, &class_sig, NULL))
        != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error, "GetClassSignature");
-   else {
-      if ((class_name = get_class_name_from_sig (class_sig, TRUE)) &&
-          include_class (class_name)) {
+   else if ((class_name = get_class_name_from_sig (class_sig, TRUE))) {
+      // Also for excluded classes, so that their methods are known
+      // when called.
+      add_class_method_infos (jvmti, klass, class_name);
+
+      if (include_class (class_name)) {
          jint field_count;
          jfieldID* fields;
          if ((error = (*jvmti)->GetClassFields (jvmti, klass, &field_count,
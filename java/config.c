@@ -0,0 +1,46 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+/*
+ * Packages whose classes (including those of sub-packages) are
+ * traced, as passed by the option "include=<package>"; see main.c. If
+ * none is given, "rtfl" is used.
+ */
+static char *default_package = "rtfl";
+static char **packages = &default_package;
+static int num_packages = 1;
+static bool default_packages = TRUE;
+
+void add_included_package (const char *package)
+{
+   if (default_packages) {
+      packages = NULL;
+      num_packages = 0;
+      default_packages = FALSE;
+   }
+
+   packages =
+      (char**)realloc (packages, (num_packages + 1) * sizeof (char*));
+   packages[num_packages++] = strdup (package);
+}
+
+/*
+ * Return whether the class (with a name like "com.acme.Foo") is
+ * traced. Called for every class which is loaded, so this is kept
+ * simple.
+ */
+bool include_class (const char *class_name)
+{
+   int i;
+
+   for (i = 0; i < num_packages; i++) {
+      int len = strlen (packages[i]);
+      if (strncmp (class_name, packages[i], len) == 0 &&
+          class_name[len] == '.')
+         return TRUE;
+   }
+
+   return FALSE;
+}
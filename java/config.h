@@ -0,0 +1,9 @@
+#ifndef __JAVA_CONFIG_H__
+#define __JAVA_CONFIG_H__
+
+#include "misc.h"
+
+void add_included_package (const char *package);
+bool include_class (const char *class_name);
+
+#endif /* __JAVA_CONFIG_H__ */
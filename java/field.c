@@ -100,7 +100,7 @@ void print_field (jvmtiEnv *jvmti, JNIEnv* jni, jclass field_klass,
    else {
       //printf ("==> %s - %s\n", field_name, field_sig);
 
-      fill_object_buf (jni, object_buf1, object);
+      fill_object_buf (jvmti, object_buf1, object);
 
       if ((class_name = get_class_name_from_sig (field_sig, FALSE))) {
          if (include_class (class_name)) {
@@ -110,7 +110,7 @@ void print_field (jvmtiEnv *jvmti, JNIEnv* jni, jclass field_klass,
             // a name.)
             
             if (value.l) {
-               fill_object_buf (jni, object_buf2, value.l);
+               fill_object_buf (jvmti, object_buf2, value.l);
                RTFL_OBJ_PRINT ("assoc", "s:s", object_buf1, object_buf2);
             }
          } else {
@@ -0,0 +1,1104 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "instrument.h"
+#include "config.h"
+#include "method.h"
+#include "misc.h"
+
+/* ----------------------------------------------------------------------
+
+   With the option "instrument", METHOD_ENTRY and METHOD_EXIT events
+   are not used. Those events make the JVM run every method, also of
+   excluded classes, in the interpreter. Instead, the class files of
+   included classes are changed when loaded (ClassFileLoadHook), so that
+   each method calls
+
+      rtfl_jvm_ti.Hooks.enter (Object)
+
+   at the beginning, and
+
+      rtfl_jvm_ti.Hooks.leave (Object)
+
+   before each return instruction, as well as in an additional handler
+   for all exceptions, which then re-throws the exception. The argument
+   is "this", or null for static methods. Both are native methods (see
+   hook_enter and hook_leave), the class itself is defined when the VM
+   is initialized (see instrument_vm_init). All other code can then be
+   compiled by the JIT compiler as usual.
+
+   Each inserted call consists of two instructions with four bytes
+   (aload_0 or aconst_null, and invokestatic), so the alignment of
+   tableswitch and lookupswitch instructions does not change, and only
+   branch offsets, the exception table, and the code attributes
+   StackMapTable, LineNumberTable, LocalVariableTable and
+   LocalVariableTypeTable have to be adjusted. Other code attributes
+   (like RuntimeVisibleTypeAnnotations) are dropped.
+
+   A method is left unchanged (and so not traced) when it cannot be
+   instrumented this way, e. g. when a branch offset would exceed 16
+   bits, or when "this" is overwritten (not done by javac, but
+   possible).
+
+   Constructors are treated specially: "this" cannot be passed before
+   the super constructor is called, so hook_enter fetches it itself.
+   Since "leave" is not printed for constructors, nothing is inserted
+   before return instructions.
+
+   ---------------------------------------------------------------------- */
+
+#define HOOKS_CLASS "rtfl_jvm_ti/Hooks"
+#define HOOK_SIG "(Ljava/lang/Object;)V"
+
+enum {
+   CONSTANT_Utf8 = 1, CONSTANT_Integer = 3, CONSTANT_Float = 4,
+   CONSTANT_Long = 5, CONSTANT_Double = 6, CONSTANT_Class = 7,
+   CONSTANT_String = 8, CONSTANT_Fieldref = 9, CONSTANT_Methodref = 10,
+   CONSTANT_InterfaceMethodref = 11, CONSTANT_NameAndType = 12,
+   CONSTANT_MethodHandle = 15, CONSTANT_MethodType = 16,
+   CONSTANT_Dynamic = 17, CONSTANT_InvokeDynamic = 18,
+   CONSTANT_Module = 19, CONSTANT_Package = 20
+};
+
+enum {
+   ACC_PUBLIC = 0x0001, ACC_STATIC = 0x0008, ACC_FINAL = 0x0010,
+   ACC_SUPER = 0x0020, ACC_NATIVE = 0x0100, ACC_ABSTRACT = 0x0400
+};
+
+enum {
+   OP_ACONST_NULL = 0x01, OP_ISTORE = 0x36, OP_ASTORE = 0x3a,
+   OP_ISTORE_0 = 0x3b, OP_LSTORE_0 = 0x3f, OP_FSTORE_0 = 0x43,
+   OP_DSTORE_0 = 0x47, OP_ASTORE_0 = 0x4b, OP_ALOAD_0 = 0x2a,
+   OP_IFEQ = 0x99, OP_JSR = 0xa8, OP_TABLESWITCH = 0xaa,
+   OP_LOOKUPSWITCH = 0xab, OP_IRETURN = 0xac, OP_RETURN = 0xb1,
+   OP_INVOKESTATIC = 0xb8, OP_ATHROW = 0xbf, OP_WIDE = 0xc4,
+   OP_IINC = 0x84, OP_IFNULL = 0xc6, OP_IFNONNULL = 0xc7,
+   OP_GOTO_W = 0xc8, OP_JSR_W = 0xc9
+};
+
+enum {
+   ITEM_Object = 7, ITEM_Uninitialized = 8
+};
+
+/* Constant pool entries added to each instrumented class, relative to
+   the original size of the constant pool. */
+enum {
+   CP_HOOKS_CLASS_NAME, CP_HOOKS_CLASS, CP_ENTER_NAME, CP_LEAVE_NAME,
+   CP_HOOK_SIG, CP_ENTER_NAME_AND_TYPE, CP_LEAVE_NAME_AND_TYPE, CP_ENTER,
+   CP_LEAVE, CP_THROWABLE_NAME, CP_THROWABLE, CP_STACK_MAP_TABLE,
+   NUM_NEW_CP_ENTRIES
+};
+
+enum {
+   INSERTED_LENGTH = 4,    /* See above. */
+   HANDLER_LENGTH = 5,     /* Load, invokestatic, athrow. */
+   MAX_CODE_LENGTH = 65535
+};
+
+enum {
+   START = 1 << 0,         /* An instruction starts here. */
+   INSERT = 1 << 1         /* Insert a call to leave() before. */
+};
+
+static jvmtiEnv *hooks_jvmti = NULL;
+static bool hooks_defined = FALSE;
+
+/* ---------------------------------------------------------------------- */
+
+typedef struct
+{
+   unsigned char *data;
+   int size, alloc;
+} byte_buf;
+
+static void buf_init (byte_buf *buf)
+{
+   buf->alloc = 1024;
+   buf->data = (unsigned char*)malloc (buf->alloc);
+   buf->size = 0;
+}
+
+static void buf_put (byte_buf *buf, const unsigned char *data, int n)
+{
+   if (buf->size + n > buf->alloc) {
+      while (buf->size + n > buf->alloc)
+         buf->alloc *= 2;
+      buf->data = (unsigned char*)realloc (buf->data, buf->alloc);
+   }
+
+   memcpy (buf->data + buf->size, data, n);
+   buf->size += n;
+}
+
+static void buf_u1 (byte_buf *buf, int v)
+{
+   unsigned char b = v;
+   buf_put (buf, &b, 1);
+}
+
+static void buf_u2 (byte_buf *buf, int v)
+{
+   unsigned char b[2] = { v >> 8, v };
+   buf_put (buf, b, 2);
+}
+
+static void buf_u4 (byte_buf *buf, jint v)
+{
+   unsigned char b[4] = { v >> 24, v >> 16, v >> 8, v };
+   buf_put (buf, b, 4);
+}
+
+static void buf_set_u2 (byte_buf *buf, int pos, int v)
+{
+   buf->data[pos] = v >> 8;
+   buf->data[pos + 1] = v;
+}
+
+static void buf_set_u4 (byte_buf *buf, int pos, jint v)
+{
+   buf->data[pos] = v >> 24;
+   buf->data[pos + 1] = v >> 16;
+   buf->data[pos + 2] = v >> 8;
+   buf->data[pos + 3] = v;
+}
+
+static void buf_utf8 (byte_buf *buf, const char *str)
+{
+   buf_u1 (buf, CONSTANT_Utf8);
+   buf_u2 (buf, strlen (str));
+   buf_put (buf, (const unsigned char*)str, strlen (str));
+}
+
+static inline int get_u2 (const unsigned char *p)
+{
+   return (p[0] << 8) | p[1];
+}
+
+static inline int get_s2 (const unsigned char *p)
+{
+   return (short)((p[0] << 8) | p[1]);
+}
+
+static inline jint get_s4 (const unsigned char *p)
+{
+   return (jint)(((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+/*
+ * Reading class files. Instead of checking each access, "ok" is set
+ * to FALSE when the end is exceeded, and checked later; until then,
+ * zeros are read.
+ */
+typedef struct
+{
+   const unsigned char *data;
+   int pos, len;
+   bool ok;
+} reader;
+
+static void rd_init (reader *r, const unsigned char *data, int len)
+{
+   r->data = data;
+   r->pos = 0;
+   r->len = len;
+   r->ok = TRUE;
+}
+
+static const unsigned char *rd_skip (reader *r, jint n)
+{
+   static const unsigned char zeros[4] = { 0, 0, 0, 0 };
+
+   if (n < 0 || r->pos + n > r->len) {
+      r->ok = FALSE;
+      r->pos = r->len;
+      return zeros;
+   } else {
+      const unsigned char *p = r->data + r->pos;
+      r->pos += n;
+      return p;
+   }
+}
+
+static int rd_u1 (reader *r)
+{
+   return *rd_skip (r, 1);
+}
+
+static int rd_u2 (reader *r)
+{
+   return get_u2 (rd_skip (r, 2));
+}
+
+static jint rd_u4 (reader *r)
+{
+   return get_s4 (rd_skip (r, 4));
+}
+
+/* ---------------------------------------------------------------------- */
+
+typedef struct
+{
+   const unsigned char *data;
+   int len, major_version, cp_count, this_class;
+   int *cp_offsets;        /* Position of each constant pool entry. */
+} class_file;
+
+static bool utf8_equals (class_file *cf, int index, const char *str)
+{
+   int len = strlen (str);
+   const unsigned char *p;
+
+   if (index <= 0 || index >= cf->cp_count || cf->cp_offsets[index] == 0)
+      return FALSE;
+
+   p = cf->data + cf->cp_offsets[index];
+   return p[0] == CONSTANT_Utf8 && get_u2 (p + 1) == len &&
+      memcmp (p + 3, str, len) == 0;
+}
+
+static bool read_constant_pool (class_file *cf, reader *r)
+{
+   int i;
+
+   cf->cp_offsets = (int*)calloc (cf->cp_count, sizeof (int));
+
+   for (i = 1; i < cf->cp_count && r->ok; i++) {
+      cf->cp_offsets[i] = r->pos;
+      switch (rd_u1 (r)) {
+      case CONSTANT_Utf8:
+         rd_skip (r, rd_u2 (r));
+         break;
+
+      case CONSTANT_Class: case CONSTANT_String: case CONSTANT_MethodType:
+      case CONSTANT_Module: case CONSTANT_Package:
+         rd_skip (r, 2);
+         break;
+
+      case CONSTANT_MethodHandle:
+         rd_skip (r, 3);
+         break;
+
+      case CONSTANT_Integer: case CONSTANT_Float: case CONSTANT_Fieldref:
+      case CONSTANT_Methodref: case CONSTANT_InterfaceMethodref:
+      case CONSTANT_NameAndType: case CONSTANT_Dynamic:
+      case CONSTANT_InvokeDynamic:
+         rd_skip (r, 4);
+         break;
+
+      case CONSTANT_Long: case CONSTANT_Double:
+         // These take two entries.
+         rd_skip (r, 8);
+         i++;
+         break;
+
+      default:
+         return FALSE;
+      }
+   }
+
+   return r->ok;
+}
+
+static void write_new_constants (byte_buf *out, int base)
+{
+   buf_utf8 (out, HOOKS_CLASS);
+   buf_u1 (out, CONSTANT_Class);
+   buf_u2 (out, base + CP_HOOKS_CLASS_NAME);
+   buf_utf8 (out, "enter");
+   buf_utf8 (out, "leave");
+   buf_utf8 (out, HOOK_SIG);
+   buf_u1 (out, CONSTANT_NameAndType);
+   buf_u2 (out, base + CP_ENTER_NAME);
+   buf_u2 (out, base + CP_HOOK_SIG);
+   buf_u1 (out, CONSTANT_NameAndType);
+   buf_u2 (out, base + CP_LEAVE_NAME);
+   buf_u2 (out, base + CP_HOOK_SIG);
+   buf_u1 (out, CONSTANT_Methodref);
+   buf_u2 (out, base + CP_HOOKS_CLASS);
+   buf_u2 (out, base + CP_ENTER_NAME_AND_TYPE);
+   buf_u1 (out, CONSTANT_Methodref);
+   buf_u2 (out, base + CP_HOOKS_CLASS);
+   buf_u2 (out, base + CP_LEAVE_NAME_AND_TYPE);
+   buf_utf8 (out, "java/lang/Throwable");
+   buf_u1 (out, CONSTANT_Class);
+   buf_u2 (out, base + CP_THROWABLE_NAME);
+   buf_utf8 (out, "StackMapTable");
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int switch_length (const unsigned char *code, int pos, int code_length)
+{
+   // The operands are aligned to four bytes.
+   int p = (pos + 4) & ~3;
+
+   if (code[pos] == OP_TABLESWITCH) {
+      if (p + 12 > code_length)
+         return -1;
+      jint low = get_s4 (code + p + 4), high = get_s4 (code + p + 8);
+      if (high < low || (jlong)high - low + 1 > code_length / 4)
+         return -1;
+      return p + 12 + 4 * (high - low + 1) - pos;
+   } else {
+      if (p + 8 > code_length)
+         return -1;
+      jint npairs = get_s4 (code + p + 4);
+      if (npairs < 0 || npairs > code_length / 8)
+         return -1;
+      return p + 8 + 8 * npairs - pos;
+   }
+}
+
+/*
+ * Return the length of the instruction at "pos", or -1 if it is
+ * invalid.
+ */
+static int instruction_length (const unsigned char *code, int pos,
+                               int code_length)
+{
+   int op = code[pos];
+
+   if (op == OP_TABLESWITCH || op == OP_LOOKUPSWITCH)
+      return switch_length (code, pos, code_length);
+   else if (op == 0x10 || op == 0x12 || (op >= 0x15 && op <= 0x19) ||
+            (op >= OP_ISTORE && op <= OP_ASTORE) || op == 0xa9 ||
+            op == 0xbc)
+      return 2;
+   else if (op == 0x11 || op == 0x13 || op == 0x14 || op == OP_IINC ||
+            (op >= OP_IFEQ && op <= OP_JSR) || (op >= 0xb2 && op <= 0xb8) ||
+            op == 0xbb || op == 0xbd || op == 0xc0 || op == 0xc1 ||
+            op == OP_IFNULL || op == OP_IFNONNULL)
+      return 3;
+   else if (op == 0xc5)
+      return 4;
+   else if (op == 0xb9 || op == 0xba || op == OP_GOTO_W || op == OP_JSR_W)
+      return 5;
+   else if (op <= 0xbf || op == 0xc2 || op == 0xc3)
+      // All remaining up to athrow (constants, loads, stores,
+      // arithmetic, conversions, comparisons, returns, ...), as well as
+      // monitorenter and monitorexit, have no operands.
+      return 1;
+   else if (op == OP_WIDE) {
+      if (pos + 1 >= code_length)
+         return -1;
+      return code[pos + 1] == OP_IINC ? 6 : 4;
+   } else
+      return -1;
+}
+
+/*
+ * Whether the instruction overwrites local variable 0, which is "this"
+ * in instance methods.
+ */
+static bool stores_local_0 (const unsigned char *code, int pos)
+{
+   int op = code[pos];
+
+   if (op == OP_ISTORE_0 || op == OP_LSTORE_0 || op == OP_FSTORE_0 ||
+       op == OP_DSTORE_0 || op == OP_ASTORE_0)
+      return TRUE;
+   else if (op >= OP_ISTORE && op <= OP_ASTORE)
+      return code[pos + 1] == 0;
+   else if (op == OP_WIDE)
+      return code[pos + 1] >= OP_ISTORE && code[pos + 1] <= OP_ASTORE &&
+         get_u2 (code + pos + 2) == 0;
+   else
+      return FALSE;
+}
+
+typedef struct
+{
+   class_file *cf;
+   int cp_base;            /* Index of the first new constant. */
+   bool is_static, is_init, with_handler;
+   const unsigned char *code;
+   int code_length;
+   unsigned char *flags;   /* START and INSERT, for each position. */
+   int *target_map;        /* New position of branch targets. */
+   int *instr_map;         /* New position of the instructions. */
+   int new_length;         /* Without the handler. */
+} method_code;
+
+static void write_call (byte_buf *out, method_code *mc, int cp_method)
+{
+   buf_u1 (out, mc->is_static || mc->is_init ? OP_ACONST_NULL : OP_ALOAD_0);
+   buf_u1 (out, OP_INVOKESTATIC);
+   buf_u2 (out, mc->cp_base + cp_method);
+}
+
+static bool scan_code (method_code *mc)
+{
+   int pos, len, shift;
+
+   mc->flags = (unsigned char*)calloc (mc->code_length + 1, 1);
+   for (pos = 0; pos < mc->code_length; pos += len) {
+      len = instruction_length (mc->code, pos, mc->code_length);
+      if (len <= 0 || pos + len > mc->code_length)
+         return FALSE;
+
+      if (!mc->is_static && !mc->is_init && stores_local_0 (mc->code, pos))
+         return FALSE;
+
+      mc->flags[pos] = START;
+      if (!mc->is_init &&
+          mc->code[pos] >= OP_IRETURN && mc->code[pos] <= OP_RETURN)
+         mc->flags[pos] |= INSERT;
+   }
+
+   // Branches to a return instruction will execute the inserted call
+   // before; branches to the beginning will not call enter() again.
+   mc->target_map = (int*)malloc ((mc->code_length + 1) * sizeof (int));
+   mc->instr_map = (int*)malloc ((mc->code_length + 1) * sizeof (int));
+   shift = INSERTED_LENGTH;
+   for (pos = 0; pos <= mc->code_length; pos++) {
+      mc->target_map[pos] = pos + shift;
+      if (mc->flags[pos] & INSERT)
+         shift += INSERTED_LENGTH;
+      mc->instr_map[pos] = pos + shift;
+   }
+
+   mc->new_length = mc->target_map[mc->code_length];
+   return mc->new_length + (mc->with_handler ? HANDLER_LENGTH : 0)
+      <= MAX_CODE_LENGTH;
+}
+
+static bool is_target (method_code *mc, jint target)
+{
+   return target >= 0 && target < mc->code_length &&
+      (mc->flags[target] & START);
+}
+
+/* Return the new branch offset, or FALSE if the target is invalid. */
+static bool map_offset (method_code *mc, int pos, jint offset,
+                        jint *new_offset)
+{
+   jint target = pos + offset;
+   if (!is_target (mc, target))
+      return FALSE;
+   *new_offset = mc->target_map[target] - mc->instr_map[pos];
+   return TRUE;
+}
+
+static bool write_code (byte_buf *out, method_code *mc)
+{
+   const unsigned char *code = mc->code;
+   int pos, len, i;
+   jint offset;
+
+   write_call (out, mc, CP_ENTER);
+
+   for (pos = 0; pos < mc->code_length; pos += len) {
+      int op = code[pos];
+      len = instruction_length (code, pos, mc->code_length);
+
+      if (mc->flags[pos] & INSERT)
+         write_call (out, mc, CP_LEAVE);
+
+      if ((op >= OP_IFEQ && op <= OP_JSR) || op == OP_IFNULL ||
+          op == OP_IFNONNULL) {
+         if (!map_offset (mc, pos, get_s2 (code + pos + 1), &offset) ||
+             offset < -32768 || offset > 32767)
+            return FALSE;
+         buf_u1 (out, op);
+         buf_u2 (out, offset);
+      } else if (op == OP_GOTO_W || op == OP_JSR_W) {
+         if (!map_offset (mc, pos, get_s4 (code + pos + 1), &offset))
+            return FALSE;
+         buf_u1 (out, op);
+         buf_u4 (out, offset);
+      } else if (op == OP_TABLESWITCH || op == OP_LOOKUPSWITCH) {
+         // Since the inserted code has a length of a multiple of four,
+         // the padding does not change.
+         int p = (pos + 4) & ~3, n;
+         buf_put (out, code + pos, p - pos);
+
+         if (!map_offset (mc, pos, get_s4 (code + p), &offset))
+            return FALSE;
+         buf_u4 (out, offset);
+
+         if (op == OP_TABLESWITCH) {
+            buf_put (out, code + p + 4, 8);
+            n = get_s4 (code + p + 8) - get_s4 (code + p + 4) + 1;
+            for (i = 0; i < n; i++) {
+               if (!map_offset (mc, pos, get_s4 (code + p + 12 + 4 * i),
+                                &offset))
+                  return FALSE;
+               buf_u4 (out, offset);
+            }
+         } else {
+            buf_put (out, code + p + 4, 4);
+            n = get_s4 (code + p + 4);
+            for (i = 0; i < n; i++) {
+               buf_put (out, code + p + 8 + 8 * i, 4);
+               if (!map_offset (mc, pos, get_s4 (code + p + 12 + 8 * i),
+                                &offset))
+                  return FALSE;
+               buf_u4 (out, offset);
+            }
+         }
+      } else
+         buf_put (out, code + pos, len);
+   }
+
+   if (mc->with_handler) {
+      write_call (out, mc, CP_LEAVE);
+      buf_u1 (out, OP_ATHROW);
+   }
+
+   return TRUE;
+}
+
+static bool copy_verification_types (reader *r, byte_buf *out,
+                                     method_code *mc, int n)
+{
+   int i;
+
+   for (i = 0; i < n && r->ok; i++) {
+      int tag = rd_u1 (r);
+      buf_u1 (out, tag);
+      if (tag == ITEM_Object)
+         buf_u2 (out, rd_u2 (r));
+      else if (tag == ITEM_Uninitialized) {
+         // The position of the "new" instruction.
+         int pos = rd_u2 (r);
+         if (!is_target (mc, pos))
+            return FALSE;
+         buf_u2 (out, mc->instr_map[pos]);
+      } else if (tag > ITEM_Uninitialized)
+         return FALSE;
+   }
+
+   return r->ok;
+}
+
+/*
+ * The frame for the handler added at the end: "this" (unless static)
+ * as only local variable, and the exception on the stack.
+ */
+static void write_handler_frame (byte_buf *out, method_code *mc,
+                                 int offset_delta)
+{
+   buf_u1 (out, 255);
+   buf_u2 (out, offset_delta);
+   if (mc->is_static)
+      buf_u2 (out, 0);
+   else {
+      buf_u2 (out, 1);
+      buf_u1 (out, ITEM_Object);
+      buf_u2 (out, mc->cf->this_class);
+   }
+   buf_u2 (out, 1);
+   buf_u1 (out, ITEM_Object);
+   buf_u2 (out, mc->cp_base + CP_THROWABLE);
+}
+
+/*
+ * Frames are stored with offsets relative to the previous frame, and
+ * in different forms, depending on the size of the offset; so all
+ * frames have to be rewritten.
+ */
+static bool write_stack_map_table (byte_buf *out, reader *r, method_code *mc)
+{
+   int num_frames = rd_u2 (r), i, old_pos = -1, new_pos = -1;
+
+   buf_u2 (out, num_frames + (mc->with_handler ? 1 : 0));
+
+   for (i = 0; i < num_frames && r->ok; i++) {
+      int type = rd_u1 (r), delta, new_delta;
+
+      if (type <= 63)
+         delta = type;
+      else if (type <= 127)
+         delta = type - 64;
+      else if (type >= 247)
+         delta = rd_u2 (r);
+      else
+         return FALSE;
+
+      old_pos += delta + 1;
+      if (!is_target (mc, old_pos))
+         return FALSE;
+      new_delta = mc->target_map[old_pos] - new_pos - 1;
+      new_pos = mc->target_map[old_pos];
+
+      if (type <= 63 || type == 251) {
+         // same_frame or same_frame_extended
+         if (new_delta <= 63)
+            buf_u1 (out, new_delta);
+         else {
+            buf_u1 (out, 251);
+            buf_u2 (out, new_delta);
+         }
+      } else if (type <= 127 || type == 247) {
+         // same_locals_1_stack_item_frame(_extended)
+         if (new_delta <= 63)
+            buf_u1 (out, 64 + new_delta);
+         else {
+            buf_u1 (out, 247);
+            buf_u2 (out, new_delta);
+         }
+         if (!copy_verification_types (r, out, mc, 1))
+            return FALSE;
+      } else {
+         buf_u1 (out, type);
+         buf_u2 (out, new_delta);
+         if (type >= 252 && type <= 254) {
+            // append_frame
+            if (!copy_verification_types (r, out, mc, type - 251))
+               return FALSE;
+         } else if (type == 255) {
+            // full_frame
+            int n = rd_u2 (r);
+            buf_u2 (out, n);
+            if (!copy_verification_types (r, out, mc, n))
+               return FALSE;
+            n = rd_u2 (r);
+            buf_u2 (out, n);
+            if (!copy_verification_types (r, out, mc, n))
+               return FALSE;
+         }
+      }
+   }
+
+   if (mc->with_handler)
+      write_handler_frame (out, mc, mc->new_length - new_pos - 1);
+
+   return r->ok;
+}
+
+static int map_start (method_code *mc, int start)
+{
+   return start == 0 ? 0 : mc->target_map[start];
+}
+
+static bool write_line_number_table (byte_buf *out, reader *r,
+                                     method_code *mc)
+{
+   int n = rd_u2 (r), i;
+
+   buf_u2 (out, n);
+   for (i = 0; i < n && r->ok; i++) {
+      int start = rd_u2 (r);
+      if (!is_target (mc, start))
+         return FALSE;
+      buf_u2 (out, map_start (mc, start));
+      buf_u2 (out, rd_u2 (r));
+   }
+
+   return r->ok;
+}
+
+/* Also used for LocalVariableTypeTable, which has the same format. */
+static bool write_local_variable_table (byte_buf *out, reader *r,
+                                        method_code *mc)
+{
+   int n = rd_u2 (r), i;
+
+   buf_u2 (out, n);
+   for (i = 0; i < n && r->ok; i++) {
+      int start = rd_u2 (r), end = start + rd_u2 (r);
+      if (start > mc->code_length || end > mc->code_length)
+         return FALSE;
+      buf_u2 (out, map_start (mc, start));
+      buf_u2 (out, mc->target_map[end] - map_start (mc, start));
+      buf_put (out, rd_skip (r, 6), 6);
+   }
+
+   return r->ok;
+}
+
+/*
+ * Write an instrumented version of the Code attribute "attr" (of
+ * length "len", including name and length) to "out". Returns FALSE if
+ * this is not possible; "out" has then to be reset.
+ */
+static bool write_code_attribute (byte_buf *out, method_code *mc,
+                                  const unsigned char *attr, int len)
+{
+   reader r;
+   int i, max_stack, max_locals, num_exceptions, num_attrs, attrs_pos;
+   int start_pos = out->size, num_new_attrs = 0;
+   const unsigned char *exceptions;
+   bool has_stack_map_table = FALSE;
+
+   rd_init (&r, attr, len);
+   rd_skip (&r, 6);
+   max_stack = rd_u2 (&r);
+   max_locals = rd_u2 (&r);
+   mc->code_length = rd_u4 (&r);
+   mc->code = rd_skip (&r, mc->code_length);
+   num_exceptions = rd_u2 (&r);
+   exceptions = rd_skip (&r, 8 * num_exceptions);
+   num_attrs = rd_u2 (&r);
+   attrs_pos = r.pos;
+
+   if (!r.ok || mc->code_length <= 0 || max_stack >= 65535 ||
+       !scan_code (mc))
+      return FALSE;
+
+   // The inserted calls need one more stack entry; the handler needs
+   // two.
+   buf_put (out, attr, 2);
+   buf_u4 (out, 0);        // Length, set below.
+   buf_u2 (out, MAX (max_stack + 1, 2));
+   buf_u2 (out, max_locals);
+   buf_u4 (out, mc->new_length + (mc->with_handler ? HANDLER_LENGTH : 0));
+   if (!write_code (out, mc))
+      return FALSE;
+
+   buf_u2 (out, num_exceptions + (mc->with_handler ? 1 : 0));
+   for (i = 0; i < num_exceptions; i++) {
+      const unsigned char *e = exceptions + 8 * i;
+      int start = get_u2 (e), end = get_u2 (e + 2), handler = get_u2 (e + 4);
+      if (!is_target (mc, start) || end > mc->code_length || end <= start ||
+          !is_target (mc, handler))
+         return FALSE;
+      buf_u2 (out, mc->target_map[start]);
+      buf_u2 (out, mc->target_map[end]);
+      buf_u2 (out, mc->target_map[handler]);
+      buf_put (out, e + 6, 2);
+   }
+   if (mc->with_handler) {
+      // After all others, so that it only gets exceptions not handled
+      // otherwise.
+      buf_u2 (out, INSERTED_LENGTH);
+      buf_u2 (out, mc->new_length);
+      buf_u2 (out, mc->new_length);
+      buf_u2 (out, 0);
+   }
+
+   int num_attrs_pos = out->size;
+   buf_u2 (out, 0);        // Number of attributes, set below.
+   r.pos = attrs_pos;
+   for (i = 0; i < num_attrs && r.ok; i++) {
+      int name = rd_u2 (&r), attr_len = rd_u4 (&r);
+      reader r2;
+      bool ok = TRUE;
+
+      rd_init (&r2, rd_skip (&r, attr_len), attr_len);
+      if (!r.ok)
+         return FALSE;
+
+      if (utf8_equals (mc->cf, name, "StackMapTable")) {
+         int len_pos = out->size + 2;
+         buf_u2 (out, name);
+         buf_u4 (out, 0);
+         ok = write_stack_map_table (out, &r2, mc);
+         buf_set_u4 (out, len_pos, out->size - len_pos - 4);
+         has_stack_map_table = TRUE;
+      } else if (utf8_equals (mc->cf, name, "LineNumberTable")) {
+         int len_pos = out->size + 2;
+         buf_u2 (out, name);
+         buf_u4 (out, 0);
+         ok = write_line_number_table (out, &r2, mc);
+         buf_set_u4 (out, len_pos, out->size - len_pos - 4);
+      } else if (utf8_equals (mc->cf, name, "LocalVariableTable") ||
+                 utf8_equals (mc->cf, name, "LocalVariableTypeTable")) {
+         int len_pos = out->size + 2;
+         buf_u2 (out, name);
+         buf_u4 (out, 0);
+         ok = write_local_variable_table (out, &r2, mc);
+         buf_set_u4 (out, len_pos, out->size - len_pos - 4);
+      } else
+         // Dropped; see above.
+         continue;
+
+      if (!ok)
+         return FALSE;
+      num_new_attrs++;
+   }
+
+   // Since version 50, frames are needed by the verifier; here, for the
+   // handler.
+   if (!has_stack_map_table && mc->with_handler &&
+       mc->cf->major_version >= 50) {
+      int len_pos = out->size + 2;
+      buf_u2 (out, mc->cp_base + CP_STACK_MAP_TABLE);
+      buf_u4 (out, 0);
+      buf_u2 (out, 1);
+      write_handler_frame (out, mc, mc->new_length);
+      buf_set_u4 (out, len_pos, out->size - len_pos - 4);
+      num_new_attrs++;
+   }
+
+   buf_set_u2 (out, num_attrs_pos, num_new_attrs);
+   buf_set_u4 (out, start_pos + 2, out->size - start_pos - 6);
+   return r.ok;
+}
+
+static bool instrument_method (byte_buf *out, class_file *cf, reader *r,
+                               int cp_base)
+{
+   int access = rd_u2 (r), name = rd_u2 (r), num_attrs, i;
+   bool instrumented = FALSE;
+
+   buf_u2 (out, access);
+   buf_u2 (out, name);
+   buf_u2 (out, rd_u2 (r));
+   num_attrs = rd_u2 (r);
+   buf_u2 (out, num_attrs);
+
+   for (i = 0; i < num_attrs && r->ok; i++) {
+      int attr_pos = r->pos, attr_name = rd_u2 (r);
+      jint attr_len = rd_u4 (r);
+      const unsigned char *attr;
+
+      rd_skip (r, attr_len);
+      attr = r->data + attr_pos;
+      if (!r->ok)
+         break;
+
+      if (utf8_equals (cf, attr_name, "Code") &&
+          !(access & (ACC_NATIVE | ACC_ABSTRACT))) {
+         method_code mc;
+         int size = out->size;
+
+         memset (&mc, 0, sizeof (mc));
+         mc.cf = cf;
+         mc.cp_base = cp_base;
+         mc.is_static = (access & ACC_STATIC) != 0;
+         mc.is_init = utf8_equals (cf, name, "<init>");
+         mc.with_handler = !mc.is_init;
+
+         if (write_code_attribute (out, &mc, attr, attr_len + 6))
+            instrumented = TRUE;
+         else {
+            out->size = size;
+            buf_put (out, attr, attr_len + 6);
+         }
+
+         simple_free (mc.flags);
+         simple_free (mc.target_map);
+         simple_free (mc.instr_map);
+      } else
+         buf_put (out, attr, attr_len + 6);
+   }
+
+   return instrumented;
+}
+
+/*
+ * Return an instrumented version of the class file (allocated by
+ * malloc), or NULL, if no method has been instrumented.
+ */
+static unsigned char *instrument_class (const unsigned char *data, int len,
+                                        int *new_len)
+{
+   class_file cf;
+   reader r;
+   byte_buf out;
+   int cp_end, methods_pos, num_methods, num_fields, i, j;
+   bool instrumented = FALSE;
+
+   rd_init (&r, data, len);
+   cf.data = data;
+   cf.len = len;
+   cf.cp_offsets = NULL;
+
+   if ((jint)rd_u4 (&r) != (jint)0xcafebabe)
+      return NULL;
+   rd_u2 (&r);
+   cf.major_version = rd_u2 (&r);
+   cf.cp_count = rd_u2 (&r);
+   if (cf.cp_count + NUM_NEW_CP_ENTRIES > 65535 ||
+       !read_constant_pool (&cf, &r)) {
+      simple_free (cf.cp_offsets);
+      return NULL;
+   }
+
+   cp_end = r.pos;
+   rd_u2 (&r);
+   cf.this_class = rd_u2 (&r);
+   rd_u2 (&r);
+   rd_skip (&r, 2 * rd_u2 (&r));
+   num_fields = rd_u2 (&r);
+   for (i = 0; i < num_fields && r.ok; i++) {
+      int num_attrs;
+      rd_skip (&r, 6);
+      num_attrs = rd_u2 (&r);
+      for (j = 0; j < num_attrs && r.ok; j++) {
+         rd_skip (&r, 2);
+         rd_skip (&r, rd_u4 (&r));
+      }
+   }
+   methods_pos = r.pos;
+   num_methods = rd_u2 (&r);
+   if (!r.ok) {
+      free (cf.cp_offsets);
+      return NULL;
+   }
+
+   buf_init (&out);
+   buf_put (&out, data, 8);
+   buf_u2 (&out, cf.cp_count + NUM_NEW_CP_ENTRIES);
+   buf_put (&out, data + 10, cp_end - 10);
+   write_new_constants (&out, cf.cp_count);
+   buf_put (&out, data + cp_end, methods_pos + 2 - cp_end);
+
+   for (i = 0; i < num_methods && r.ok; i++)
+      if (instrument_method (&out, &cf, &r, cf.cp_count))
+         instrumented = TRUE;
+
+   // Remaining class attributes.
+   if (r.ok)
+      buf_put (&out, data + r.pos, len - r.pos);
+
+   free (cf.cp_offsets);
+
+   if (!r.ok || !instrumented) {
+      free (out.data);
+      return NULL;
+   } else {
+      *new_len = out.size;
+      return out.data;
+   }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Called by the inserted code; the caller of the hook is the
+ * instrumented method.
+ */
+static method_info *get_caller_info (jvmtiEnv *jvmti)
+{
+   jvmtiError error;
+   jmethodID method;
+   jlocation location;
+
+   if ((error = (*jvmti)->GetFrameLocation (jvmti, NULL, 1, &method,
+                                            &location))
+       != JVMTI_ERROR_NONE) {
+      jvmti_error (jvmti, error, "GetFrameLocation");
+      return NULL;
+   } else
+      return get_method_info (jvmti, method);
+}
+
+static void JNICALL hook_enter (JNIEnv *jni, jclass klass, jobject object)
+{
+   jvmtiError error;
+   jvmtiEnv *jvmti = hooks_jvmti;
+   method_info *info = get_caller_info (jvmti);
+
+   if (info) {
+      if (info->is_init &&
+          (error = (*jvmti)->GetLocalObject (jvmti, NULL, 1, 0, &object))
+          != JVMTI_ERROR_NONE)
+         jvmti_error (jvmti, error, "GetLocalObject");
+      else
+         print_method_entry (jvmti, info, object);
+   }
+}
+
+static void JNICALL hook_leave (JNIEnv *jni, jclass klass, jobject object)
+{
+   method_info *info = get_caller_info (hooks_jvmti);
+
+   if (info)
+      print_method_exit (hooks_jvmti, info, object);
+}
+
+static void write_hooks_class (byte_buf *out)
+{
+   int i;
+
+   buf_u4 (out, 0xcafebabe);
+   buf_u2 (out, 0);
+   buf_u2 (out, 49);
+   buf_u2 (out, 8);
+   buf_utf8 (out, HOOKS_CLASS);                     // 1
+   buf_u1 (out, CONSTANT_Class);                    // 2
+   buf_u2 (out, 1);
+   buf_utf8 (out, "java/lang/Object");              // 3
+   buf_u1 (out, CONSTANT_Class);                    // 4
+   buf_u2 (out, 3);
+   buf_utf8 (out, "enter");                         // 5
+   buf_utf8 (out, "leave");                         // 6
+   buf_utf8 (out, HOOK_SIG);                        // 7
+
+   buf_u2 (out, ACC_PUBLIC | ACC_FINAL | ACC_SUPER);
+   buf_u2 (out, 2);
+   buf_u2 (out, 4);
+   buf_u2 (out, 0);        // Interfaces.
+   buf_u2 (out, 0);        // Fields.
+   buf_u2 (out, 2);        // Methods.
+   for (i = 0; i < 2; i++) {
+      buf_u2 (out, ACC_PUBLIC | ACC_STATIC | ACC_NATIVE);
+      buf_u2 (out, 5 + i);
+      buf_u2 (out, 7);
+      buf_u2 (out, 0);
+   }
+   buf_u2 (out, 0);        // Attributes.
+}
+
+void JNICALL instrument_vm_init (jvmtiEnv *jvmti, JNIEnv* jni,
+                                 jthread thread)
+{
+   static JNINativeMethod methods[] = {
+      { "enter", HOOK_SIG, (void*)&hook_enter },
+      { "leave", HOOK_SIG, (void*)&hook_leave }
+   };
+   byte_buf buf;
+   jclass klass;
+
+   buf_init (&buf);
+   write_hooks_class (&buf);
+
+   // Defined by the bootstrap class loader, so that it is found from
+   // all classes.
+   if ((klass = (*jni)->DefineClass (jni, HOOKS_CLASS, NULL,
+                                     (const jbyte*)buf.data, buf.size))
+       == NULL) {
+      (*jni)->ExceptionClear (jni);
+      other_error ("cannot define class %s", HOOKS_CLASS);
+   } else if ((*jni)->RegisterNatives (jni, klass, methods, 2) != 0) {
+      (*jni)->ExceptionClear (jni);
+      other_error ("cannot register native methods of %s", HOOKS_CLASS);
+   } else {
+      hooks_jvmti = jvmti;
+      __atomic_store_n (&hooks_defined, TRUE, __ATOMIC_RELEASE);
+   }
+
+   free (buf.data);
+}
+
+void JNICALL class_file_load_hook (jvmtiEnv *jvmti, JNIEnv* jni,
+                                   jclass class_being_redefined,
+                                   jobject loader, const char *name,
+                                   jobject protection_domain,
+                                   jint class_data_len,
+                                   const unsigned char *class_data,
+                                   jint *new_class_data_len,
+                                   unsigned char **new_class_data)
+{
+   // Classes loaded before the hooks are defined are not instrumented;
+   // these are only classes of the JDK.
+   if (name == NULL || class_being_redefined ||
+       !__atomic_load_n (&hooks_defined, __ATOMIC_ACQUIRE))
+      return;
+
+   char *class_name = strdup (name), *p;
+   for (p = class_name; *p; p++)
+      if (*p == '/')
+         *p = '.';
+
+   if (include_class (class_name)) {
+      jvmtiError error;
+      int len;
+      unsigned char *data = instrument_class (class_data, class_data_len,
+                                              &len);
+      if (data) {
+         if ((error = (*jvmti)->Allocate (jvmti, len, new_class_data))
+             != JVMTI_ERROR_NONE)
+            jvmti_error (jvmti, error, "Allocate");
+         else {
+            memcpy (*new_class_data, data, len);
+            *new_class_data_len = len;
+         }
+         free (data);
+      }
+   }
+
+   free (class_name);
+}
@@ -0,0 +1,17 @@
+#ifndef __JAVA_INSTRUMENT_H__
+#define __JAVA_INSTRUMENT_H__
+
+#include <jvmti.h>
+
+void JNICALL instrument_vm_init (jvmtiEnv *jvmti, JNIEnv* jni,
+                                 jthread thread);
+void JNICALL class_file_load_hook (jvmtiEnv *jvmti, JNIEnv* jni,
+                                   jclass class_being_redefined,
+                                   jobject loader, const char *name,
+                                   jobject protection_domain,
+                                   jint class_data_len,
+                                   const unsigned char *class_data,
+                                   jint *new_class_data_len,
+                                   unsigned char **new_class_data);
+
+#endif /* __JAVA_INSTRUMENT_H__ */
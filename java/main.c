@@ -3,24 +3,79 @@
 #include <stdlib.h>
 
 #include "class.h"
+#include "config.h"
+#include "instrument.h"
 #include "method.h"
+#include "method_info.h"
 #include "field.h"
 #include "misc.h"
 
-JNIEXPORT jint JNICALL Agent_OnLoad (JavaVM *jvm, char *options, void *reserved)
+static bool emit_delete = FALSE, instrument = FALSE;
+
+static void JNICALL vm_init (jvmtiEnv *jvmti, JNIEnv* jni, jthread thread)
 {
-   rtfl_print ("obj", RTFL_OBJ_VERSION, "", 0, "s", "noident");
+   start_output_flusher (jvmti, jni);
+   if (instrument)
+      instrument_vm_init (jvmti, jni, thread);
+}
+
+/*
+ * Options are passed as "-agentlib:rtfl-jvm-ti=<option>,<option>,...":
+ *
+ * - "delete": print "obj-delete" when an object is freed by the garbage
+ *   collector.
+ * - "include=<package>": trace classes of this package and its
+ *   sub-packages; may be given multiple times. Default is "rtfl".
+ * - "instrument": insert calls into the methods of included classes,
+ *   instead of using METHOD_ENTRY and METHOD_EXIT events; see
+ *   instrument.c.
+ */
+static void parse_options (char *options)
+{
+   char *option;
+
+   if (options == NULL)
+      return;
 
+   for (option = strtok (options, ","); option; option = strtok (NULL, ",")) {
+      if (strcmp (option, "delete") == 0)
+         emit_delete = TRUE;
+      else if (strcmp (option, "instrument") == 0)
+         instrument = TRUE;
+      else if (str_starts_with (option, "include=") &&
+               option[strlen ("include=")])
+         add_included_package (option + strlen ("include="));
+      else
+         other_error ("unknown option '%s'", option);
+   }
+}
+
+JNIEXPORT jint JNICALL Agent_OnLoad (JavaVM *jvm, char *options, void *reserved)
+{
    jvmtiEnv *jvmti = NULL;
+   jvmtiError error;
 
    (*jvm)->GetEnv (jvm, (void**)&jvmti, JVMTI_VERSION_1_0);
 
+   if ((error = init_output (jvmti)) != JVMTI_ERROR_NONE) {
+      jvmti_error (jvmti, error, "CreateRawMonitor");
+      return JNI_ERR;
+   }
+
+   rtfl_print ("obj", RTFL_OBJ_VERSION, "", 0, "s", "noident");
+   // Before all lines printed by other threads.
+   flush_all_output ();
+
+   parse_options (options);
+
    jvmtiCapabilities capa;
    memset (&capa, 0, sizeof(jvmtiCapabilities));
-   capa.can_generate_method_entry_events = 1;
-   capa.can_generate_method_exit_events = 1;
+   capa.can_generate_method_entry_events = !instrument;
+   capa.can_generate_method_exit_events = !instrument;
    capa.can_access_local_variables = 1;
    capa.can_generate_field_modification_events = 1;
+   capa.can_tag_objects = 1;
+   capa.can_generate_object_free_events = emit_delete;
 
    jvmtiEventCallbacks callbacks;
    (void)memset(&callbacks, 0, sizeof(callbacks));
@@ -28,10 +83,32 @@ JNIEXPORT jint JNICALL Agent_OnLoad (JavaVM *jvm, char *options, void *reserved)
    callbacks.MethodEntry = &method_entry;
    callbacks.MethodExit = &method_exit;
    callbacks.FieldModification = &field_modification;
-   
-   jvmtiError error;  
+   callbacks.ObjectFree = &object_free;
+   callbacks.ThreadEnd = &output_thread_end;
+   callbacks.VMDeath = &output_vm_death;
+   callbacks.VMInit = &vm_init;
+   callbacks.ClassFileLoadHook = &class_file_load_hook;
+
    if ((error = (*jvmti)->AddCapabilities(jvmti, &capa)) != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error, "AddCapabilities");
+   else if ((error = init_object_tags (jvmti)) != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error, "CreateRawMonitor");
+   else if ((error = init_method_infos (jvmti)) != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error, "CreateRawMonitor");
+   else if ((error =
+              (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
+                                                  JVMTI_EVENT_THREAD_END,
+                                                  (jthread)NULL))
+            != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error,
+                   "SetEventNotificationMode (JVMTI_EVENT_THREAD_END)");
+   else if ((error =
+              (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
+                                                  JVMTI_EVENT_VM_DEATH,
+                                                  (jthread)NULL))
+            != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error,
+                   "SetEventNotificationMode (JVMTI_EVENT_VM_DEATH)");
    else if ((error =
               (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
                                                   JVMTI_EVENT_CLASS_PREPARE,
@@ -39,26 +116,51 @@ JNIEXPORT jint JNICALL Agent_OnLoad (JavaVM *jvm, char *options, void *reserved)
             != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error,
                    "SetEventNotificationMode (JVMTI_EVENT_CLASS_PREPARE)");
-   else if ((error =
+   else if (!instrument &&
+            (error =
               (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
                                                   JVMTI_EVENT_METHOD_ENTRY,
                                                   (jthread)NULL))
             != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error,
                    "SetEventNotificationMode (JVMTI_EVENT_METHOD_ENTRY)");
-   else if ((error =
+   else if (!instrument &&
+            (error =
               (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
                                                   JVMTI_EVENT_METHOD_EXIT,
                                                   (jthread)NULL))
             != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error,
                    "SetEventNotificationMode (JVMTI_EVENT_METHOD_EXIT)");
+   else if ((error =
+              (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
+                                                  JVMTI_EVENT_VM_INIT,
+                                                  (jthread)NULL))
+            != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error,
+                   "SetEventNotificationMode (JVMTI_EVENT_VM_INIT)");
+   else if (instrument &&
+            (error =
+              (*jvmti)->SetEventNotificationMode
+                           (jvmti, JVMTI_ENABLE,
+                            JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, (jthread)NULL))
+            != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error, "SetEventNotificationMode "
+                   "(JVMTI_EVENT_CLASS_FILE_LOAD_HOOK)");
    else if ((error =
               (*jvmti)->SetEventNotificationMode
                            (jvmti, JVMTI_ENABLE, JVMTI_EVENT_FIELD_MODIFICATION,
                             (jthread)NULL)) != JVMTI_ERROR_NONE)
       jvmti_error (jvmti, error,
                    "SetEventNotificationMode (JVMTI_EVENT_FIELD_MODIFICATION");
+   else if (emit_delete &&
+            (error =
+              (*jvmti)->SetEventNotificationMode (jvmti, JVMTI_ENABLE,
+                                                  JVMTI_EVENT_OBJECT_FREE,
+                                                  (jthread)NULL))
+            != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error,
+                   "SetEventNotificationMode (JVMTI_EVENT_OBJECT_FREE)");
    else if ((error = (*jvmti)->SetEventCallbacks(jvmti, &callbacks,
                                                  (jint)sizeof(callbacks)))
             != JVMTI_ERROR_NONE)
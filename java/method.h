@@ -3,6 +3,11 @@
 
 #include <jvmti.h>
 
+#include "method_info.h"
+
+void print_method_entry (jvmtiEnv *jvmti, method_info *info, jobject object);
+void print_method_exit (jvmtiEnv *jvmti, method_info *info, jobject object);
+
 void JNICALL method_entry (jvmtiEnv *jvmti, JNIEnv* jni, jthread thread,
                            jmethodID method);
 void JNICALL method_exit (jvmtiEnv *jvmti, JNIEnv* jni, jthread thread,
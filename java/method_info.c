@@ -0,0 +1,252 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "method_info.h"
+#include "config.h"
+
+/* ----------------------------------------------------------------------
+
+   Information about methods (class name, method name, whether the
+   class is included, and the slot of "this") is needed for every
+   METHOD_ENTRY and METHOD_EXIT event, but does not change. It is
+   determined only once per method, either when the class is prepared
+   (see add_class_method_infos), or when the method is used first,
+   and then kept in a hash table, with the jmethodID as key. (Method
+   IDs remain valid while the class is loaded; records are never
+   freed.) So, for methods of excluded classes, an event costs one
+   lookup.
+
+   Events come from all threads, so the hash table is read without
+   locks: entries are only added, and published by an atomic store
+   after they are complete; only the slot of "this" is set later (see
+   find_this_slot), again by an atomic store. Additions are done while
+   holding a raw monitor. When the table is grown, a new one is
+   published the same way; the old one is still valid (if
+   incomplete), so it is not freed. A lookup which fails in an old
+   table is repeated, with the monitor held, in the current one.
+
+   ---------------------------------------------------------------------- */
+
+typedef struct
+{
+   int size, num_entries;
+   method_info *entries[1];
+} method_table;
+
+enum { MIN_TABLE_SIZE = 1024 };
+
+static jrawMonitorID table_monitor;
+static method_table *table = NULL;
+
+static method_table *new_table (int size)
+{
+   method_table *t =
+      (method_table*)calloc (1, sizeof (method_table)
+                                + (size - 1) * sizeof (method_info*));
+   t->size = size;
+   t->num_entries = 0;
+   return t;
+}
+
+static inline int hash_method (jmethodID method, int size)
+{
+   uintptr_t h = (uintptr_t)method;
+   h ^= h >> 16;
+   h *= 0x45d9f3b;
+   h ^= h >> 16;
+   return (int)(h & (size - 1));
+}
+
+static method_info *lookup (method_table *t, jmethodID method)
+{
+   int i;
+   method_info *info;
+   for (i = hash_method (method, t->size);
+        (info = __atomic_load_n (&t->entries[i], __ATOMIC_ACQUIRE));
+        i = (i + 1) & (t->size - 1))
+      if (info->method == method)
+         return info;
+   return NULL;
+}
+
+static void insert (method_table *t, method_info *info)
+{
+   int i = hash_method (info->method, t->size);
+   while (t->entries[i])
+      i = (i + 1) & (t->size - 1);
+   __atomic_store_n (&t->entries[i], info, __ATOMIC_RELEASE);
+   t->num_entries++;
+}
+
+/* Must be called with the monitor held. */
+static void add (method_info *info)
+{
+   method_table *t = table;
+
+   if (2 * (t->num_entries + 1) > t->size) {
+      method_table *t2 = new_table (2 * t->size);
+      int i;
+      for (i = 0; i < t->size; i++)
+         if (t->entries[i])
+            insert (t2, t->entries[i]);
+      __atomic_store_n (&table, t2, __ATOMIC_RELEASE);
+      t = t2;
+   }
+
+   insert (t, info);
+}
+
+jvmtiError init_method_infos (jvmtiEnv *jvmti)
+{
+   table = new_table (MIN_TABLE_SIZE);
+   return (*jvmti)->CreateRawMonitor (jvmti, "rtfl method infos",
+                                      &table_monitor);
+}
+
+static method_info *create_method_info (jvmtiEnv *jvmti, jmethodID method,
+                                        const char *class_name)
+{
+   jvmtiError error;
+   char *method_name;
+
+   if ((error =
+        (*jvmti)->GetMethodName (jvmti, method, &method_name, NULL, NULL))
+       != JVMTI_ERROR_NONE) {
+      jvmti_error (jvmti, error, "GetMethodName");
+      return NULL;
+   }
+
+   method_info *info = (method_info*)malloc (sizeof (method_info));
+   info->method = method;
+   info->class_name = strdup (class_name);
+   info->method_name = strdup (method_name);
+   info->is_init = strcmp (method_name, "<init>") == 0;
+   info->included = include_class (class_name);
+   info->this_slot = THIS_SLOT_UNKNOWN;
+   jvmti_dealloc (jvmti, method_name);
+
+   return info;
+}
+
+/*
+ * The local variables are only read when the method is used first, so
+ * that errors (e. g. for classes compiled without "-g") are only
+ * reported for methods which are actually called. Must be called with
+ * the monitor held.
+ */
+static void find_this_slot (jvmtiEnv *jvmti, method_info *info)
+{
+   jvmtiError error;
+   jint numlocals, j, this_slot = THIS_SLOT_STATIC;
+   jvmtiLocalVariableEntry *locals;
+
+   if ((error = (*jvmti)->GetLocalVariableTable (jvmti, info->method,
+                                                 &numlocals, &locals))
+       != JVMTI_ERROR_NONE) {
+      jvmti_error (jvmti, error, "GetLocalVariableTable");
+      this_slot = THIS_SLOT_ABSENT;
+   } else {
+      for (j = 0; j < numlocals; j++) {
+         if (this_slot == THIS_SLOT_STATIC &&
+             strcmp (locals[j].name, "this") == 0)
+            this_slot = locals[j].slot;
+         jvmti_dealloc (jvmti, locals[j].name);
+         jvmti_dealloc (jvmti, locals[j].signature);
+         jvmti_dealloc (jvmti, locals[j].generic_signature);
+      }
+      jvmti_dealloc (jvmti, locals);
+   }
+
+   __atomic_store_n (&info->this_slot, this_slot, __ATOMIC_RELEASE);
+}
+
+/* Must be called with the monitor held. */
+static method_info *ensure_method_info (jvmtiEnv *jvmti, jmethodID method,
+                                        const char *class_name)
+{
+   method_info *info = lookup (table, method);
+   if (info == NULL && (info = create_method_info (jvmti, method, class_name)))
+      add (info);
+   return info;
+}
+
+/*
+ * Return the information about a method, or NULL in case of an
+ * error. Usually, this is a single lookup in the hash table.
+ */
+method_info *get_method_info (jvmtiEnv *jvmti, jmethodID method)
+{
+   method_info *info =
+      lookup (__atomic_load_n (&table, __ATOMIC_ACQUIRE), method);
+
+   if (info == NULL) {
+      // Not yet known (e. g. when the class has been prepared before
+      // the agent was loaded).
+      jvmtiError error;
+      jclass klass;
+      char *class_sig = NULL, *class_name = NULL;
+
+      if ((error = (*jvmti)->GetMethodDeclaringClass (jvmti, method, &klass))
+          != JVMTI_ERROR_NONE)
+         jvmti_error (jvmti, error, "GetMethodDeclaringClass");
+      else if ((error = (*jvmti)->GetClassSignature (jvmti, klass,
+                                                     &class_sig, NULL))
+               != JVMTI_ERROR_NONE)
+         jvmti_error (jvmti, error, "GetClassSignature");
+      else if ((class_name = get_class_name_from_sig (class_sig, TRUE))) {
+         (*jvmti)->RawMonitorEnter (jvmti, table_monitor);
+         info = ensure_method_info (jvmti, method, class_name);
+         (*jvmti)->RawMonitorExit (jvmti, table_monitor);
+      }
+
+      jvmti_dealloc (jvmti, class_sig);
+      simple_free (class_name);
+   }
+
+   return info;
+}
+
+/*
+ * Return the slot of "this" in the local variables of the method, or
+ * THIS_SLOT_STATIC or THIS_SLOT_ABSENT. Only needed when METHOD_ENTRY
+ * and METHOD_EXIT events are used; see method.c.
+ */
+jint get_this_slot (jvmtiEnv *jvmti, method_info *info)
+{
+   jint this_slot = __atomic_load_n (&info->this_slot, __ATOMIC_ACQUIRE);
+
+   if (this_slot == THIS_SLOT_UNKNOWN) {
+      (*jvmti)->RawMonitorEnter (jvmti, table_monitor);
+      if (info->this_slot == THIS_SLOT_UNKNOWN)
+         find_this_slot (jvmti, info);
+      this_slot = info->this_slot;
+      (*jvmti)->RawMonitorExit (jvmti, table_monitor);
+   }
+
+   return this_slot;
+}
+
+/*
+ * Add the information about all methods of a class; called when the
+ * class is prepared.
+ */
+void add_class_method_infos (jvmtiEnv *jvmti, jclass klass,
+                             const char *class_name)
+{
+   jvmtiError error;
+   jint method_count, i;
+   jmethodID *methods;
+
+   if ((error = (*jvmti)->GetClassMethods (jvmti, klass, &method_count,
+                                           &methods))
+       != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error, "GetClassMethods");
+   else {
+      (*jvmti)->RawMonitorEnter (jvmti, table_monitor);
+      for (i = 0; i < method_count; i++)
+         ensure_method_info (jvmti, methods[i], class_name);
+      (*jvmti)->RawMonitorExit (jvmti, table_monitor);
+      jvmti_dealloc (jvmti, methods);
+   }
+}
@@ -0,0 +1,33 @@
+#ifndef __JAVA_METHOD_INFO_H__
+#define __JAVA_METHOD_INFO_H__
+
+#include <jvmti.h>
+
+#include "misc.h"
+
+/*
+ * What is needed about a method when it is entered or exited; see
+ * get_method_info().
+ */
+typedef struct
+{
+   jmethodID method;
+   char *class_name, *method_name;
+   bool is_init;     /* A constructor ("<init>"). */
+   bool included;    /* See include_class(). */
+   jint this_slot;   /* See get_this_slot(). */
+} method_info;
+
+enum {
+   THIS_SLOT_STATIC = -1,  /* No "this". */
+   THIS_SLOT_ABSENT = -2,  /* Local variables not available. */
+   THIS_SLOT_UNKNOWN = -3  /* Not yet determined (only internally). */
+};
+
+jvmtiError init_method_infos (jvmtiEnv *jvmti);
+method_info *get_method_info (jvmtiEnv *jvmti, jmethodID method);
+jint get_this_slot (jvmtiEnv *jvmti, method_info *info);
+void add_class_method_infos (jvmtiEnv *jvmti, jclass klass,
+                             const char *class_name);
+
+#endif /* __JAVA_METHOD_INFO_H__ */
@@ -1,5 +1,8 @@
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
 #include "misc.h"
 
@@ -76,65 +79,484 @@ char *get_class_name_from_sig (const char *class_sig, bool expect_class)
 
 /* -------------------------------------------------------------------
 
-   The only way to identify objects seems to be the JNI method
-   IsSameObject; although jobject is a pointer, the equality of two
-   jobject's does not imply the identity of the represented Java
-   objects.
+   Objects are identified by JVMTI tags: the first time an object is
+   seen, it gets a new tag (a number counting up from 1), which is then
+   used as identifier in RTFL messages. Looking up the tag is cheap, and
+   tagging does not prevent garbage collection; when a tagged object is
+   freed, an "obj-delete" command may be printed (see object_free).
 
-   Furthermore, since we only have one object at hand to get an
-   identifier needed for RTFL messages, we store all objects in a
-   list, after creating a global reference (NewGlobalRef); the index
-   in the list then identifies the object. This foils the garbage
-   collection, but for short debugging sessions, this should be
-   acceptable.
+   A raw monitor is needed when an object is tagged for the first time,
+   so that two threads do not assign different tags to the same object.
 
    ---------------------------------------------------------------------- */
 
-static size_t reg_objects_size = 0, reg_objects_alloc_size;
-static jobject *reg_objects = NULL;
+static jrawMonitorID tag_monitor;
+static jlong next_tag = 1;
 
-size_t object_index (JNIEnv* jni, jobject object)
+jvmtiError init_object_tags (jvmtiEnv *jvmti)
 {
-   size_t i;
-   for (i = 0; i < reg_objects_size; i++)
-      if ((*jni)->IsSameObject (jni, object, reg_objects[i]))
-         return i;
+   return (*jvmti)->CreateRawMonitor (jvmti, "rtfl object tags", &tag_monitor);
+}
 
-   reg_objects_size++;
-   if (reg_objects == NULL) {
-      reg_objects_alloc_size = 1;
-      reg_objects =
-         (jobject*)malloc (reg_objects_alloc_size * sizeof (jobject));
-   } else {
-      reg_objects_alloc_size <<= 1;
-      reg_objects =
-         (jobject*)realloc (reg_objects,
-                            reg_objects_alloc_size * sizeof (jobject));
+jlong object_tag (jvmtiEnv *jvmti, jobject object)
+{
+   jvmtiError error;
+   jlong tag;
+
+   if ((error = (*jvmti)->GetTag (jvmti, object, &tag)) != JVMTI_ERROR_NONE) {
+      jvmti_error (jvmti, error, "GetTag");
+      return 0;
    }
-   
-   i = reg_objects_size - 1;
-   reg_objects[i] = (*jni)->NewGlobalRef (jni, object);
-   return i;
+
+   if (tag == 0) {
+      (*jvmti)->RawMonitorEnter (jvmti, tag_monitor);
+
+      // Tagged by another thread in the meantime?
+      if ((error = (*jvmti)->GetTag (jvmti, object, &tag))
+          != JVMTI_ERROR_NONE)
+         jvmti_error (jvmti, error, "GetTag");
+      else if (tag == 0) {
+         if ((error = (*jvmti)->SetTag (jvmti, object, next_tag))
+             != JVMTI_ERROR_NONE)
+            jvmti_error (jvmti, error, "SetTag");
+         else
+            tag = next_tag++;
+      }
+
+      (*jvmti)->RawMonitorExit (jvmti, tag_monitor);
+   }
+
+   return tag;
 }
 
-void fill_object_buf (JNIEnv* jni, char *object_buf, jobject object)
+void fill_tag_buf (char *object_buf, jlong tag)
+{
+   snprintf (object_buf, SIZE_OBJECT_BUF, "%lld", (long long)tag);
+}
+
+void fill_object_buf (jvmtiEnv *jvmti, char *object_buf, jobject object)
 {
    if (object)
-      snprintf (object_buf, SIZE_OBJECT_BUF, "%ld", object_index (jni, object));
+      fill_tag_buf (object_buf, object_tag (jvmti, object));
    else
       strcpy (object_buf, "null");
 }
 
-// Copied from "debug_rtfl.hh".
-void rtfl_print (const char *module, const char *version,
-                 const char *file, int line, const char *fmt, ...)
+/*
+ * Objects freed, but for which "obj-delete" has not yet been printed;
+ * the most recently freed first. See object_free and
+ * print_freed_objects.
+ */
+typedef struct freed_object
 {
-   // "\n" at the beginning just in case that the previous line is not
-   // finished yet.
-   printf ("\n[rtfl-%s-%s]%s:%d:pid(todo):", module, version, file, line);
+   jlong tag;
+   struct freed_object *next;
+} freed_object;
+
+static freed_object *freed_objects = NULL;
+
+void JNICALL object_free (jvmtiEnv *jvmti, jlong tag)
+{
+   // Only few JVMTI functions (and no JNI functions) may be called
+   // here. Since this may be called during garbage collection, while a
+   // thread holding the monitor of its output buffer is stopped, no
+   // buffer is touched; the tag is only pushed (without a lock) to
+   // freed_objects, and "obj-delete" is printed later.
+   freed_object *freed;
+   if ((*jvmti)->Allocate (jvmti, sizeof (freed_object),
+                           (unsigned char**)&freed) != JVMTI_ERROR_NONE) {
+      other_error ("cannot allocate memory for \"obj-delete\"");
+      return;
+   }
+
+   freed->tag = tag;
+   freed->next = __atomic_load_n (&freed_objects, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n (&freed_objects, &freed->next, freed,
+                                        TRUE, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+      ;
+}
+
+/* ----------------------------------------------------------------------
+
+   JVMTI callbacks run concurrently in all Java threads, so lines are
+   not printed directly, but first collected in a buffer per thread
+   (kept in the JVMTI thread local storage), which contains only
+   complete lines. Buffers are written in one write(2) call each, while
+   holding the output monitor, so lines of different threads are never
+   mixed. The thread id (counting up from 1) is printed in place of the
+   process id, so that the call stacks of the threads can be separated.
+
+   A buffer is written when it is full, when its oldest line is older
+   than FLUSH_MSECS (checked when a line is added, and periodically by
+   an agent thread, so that the lines of idle or blocked threads are not
+   held back; see flusher_run), when the thread ends, and at VM death.
+
+   So the order of lines of different threads differs from the order in
+   which they were printed, by up to about FLUSH_MSECS: e. g., a command
+   about an object may come before the "obj-create" printed by another
+   thread. The only exception is "obj-delete": all buffers are written
+   before it is printed for the objects freed in the meantime (see
+   print_freed_objects, called before each line and by the agent
+   thread), so that it always comes after all other lines about the
+   object.
+
+   Lines printed outside of Java threads, or before the live phase, go
+   to a shared buffer (with thread id 0).
+
+   Lock order: registry monitor, then the monitor of a buffer, then the
+   output monitor. The flusher monitor is not held while entering
+   others.
+
+   ---------------------------------------------------------------------- */
+
+enum { OUTPUT_BUF_SIZE = 64 * 1024, FLUSH_MSECS = 200 };
+
+typedef struct output_buf
+{
+   jrawMonitorID monitor;
+   int thread_id, size, alloc, line_start;
+   jlong first_time;       /* Of the oldest line in the buffer. */
+   struct output_buf *prev, *next;
+   char *data;
+} output_buf;
+
+static jvmtiEnv *output_jvmti = NULL;
+static jrawMonitorID output_monitor, registry_monitor, flusher_monitor;
+static output_buf shared_output, *outputs = NULL;
+static int next_thread_id = 1;
+static bool flusher_stopped = FALSE;
+
+static jlong current_msecs ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return (jlong)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
+static void write_data (const char *data, int size)
+{
+   (*output_jvmti)->RawMonitorEnter (output_jvmti, output_monitor);
+
+   while (size > 0) {
+      ssize_t n = write (STDOUT_FILENO, data, size);
+      if (n == -1) {
+         if (errno != EINTR) {
+            perror ("write");
+            break;
+         }
+      } else {
+         data += n;
+         size -= n;
+      }
+   }
+
+   (*output_jvmti)->RawMonitorExit (output_jvmti, output_monitor);
+}
+
+/* Must be called with the monitor of the buffer held. */
+static void flush_output_buf (output_buf *out)
+{
+   write_data (out->data, out->size);
+   out->size = out->line_start = 0;
+}
+
+static void add_output_buf (output_buf *out)
+{
+   (*output_jvmti)->RawMonitorEnter (output_jvmti, registry_monitor);
+   out->prev = NULL;
+   out->next = outputs;
+   if (outputs)
+      outputs->prev = out;
+   outputs = out;
+   (*output_jvmti)->RawMonitorExit (output_jvmti, registry_monitor);
+}
+
+static bool init_output_buf (output_buf *out, int thread_id)
+{
+   jvmtiError error;
+
+   if ((error = (*output_jvmti)->CreateRawMonitor (output_jvmti,
+                                                   "rtfl output buffer",
+                                                   &out->monitor))
+       != JVMTI_ERROR_NONE) {
+      jvmti_error (output_jvmti, error, "CreateRawMonitor");
+      return FALSE;
+   }
+
+   out->thread_id = thread_id;
+   out->size = out->line_start = 0;
+   out->alloc = OUTPUT_BUF_SIZE;
+   out->data = (char*)malloc (out->alloc);
+   add_output_buf (out);
+   return TRUE;
+}
+
+jvmtiError init_output (jvmtiEnv *jvmti)
+{
+   jvmtiError error;
+
+   output_jvmti = jvmti;
+   if ((error = (*jvmti)->CreateRawMonitor (jvmti, "rtfl output",
+                                            &output_monitor))
+       != JVMTI_ERROR_NONE ||
+       (error = (*jvmti)->CreateRawMonitor (jvmti, "rtfl output registry",
+                                            &registry_monitor))
+       != JVMTI_ERROR_NONE ||
+       (error = (*jvmti)->CreateRawMonitor (jvmti, "rtfl output flusher",
+                                            &flusher_monitor))
+       != JVMTI_ERROR_NONE)
+      return error;
+
+   return init_output_buf (&shared_output, 0) ?
+      JVMTI_ERROR_NONE : JVMTI_ERROR_OUT_OF_MEMORY;
+}
+
+/*
+ * Return the buffer of the current thread, which is created when
+ * needed.
+ */
+static output_buf *get_output_buf ()
+{
+   output_buf *out = NULL;
+
+   if ((*output_jvmti)->GetThreadLocalStorage (output_jvmti, NULL,
+                                               (void**)&out)
+       != JVMTI_ERROR_NONE)
+      // Not a Java thread, or not yet in the live phase.
+      return &shared_output;
+
+   if (out == NULL) {
+      out = (output_buf*)malloc (sizeof (output_buf));
+      if (!init_output_buf (out, __atomic_fetch_add (&next_thread_id, 1,
+                                                     __ATOMIC_RELAXED))) {
+         free (out);
+         return &shared_output;
+      }
+      (*output_jvmti)->SetThreadLocalStorage (output_jvmti, NULL, out);
+   }
+
+   return out;
+}
+
+/*
+ * Write all buffers. Not to be called while holding the monitor of a
+ * buffer.
+ */
+void flush_all_output ()
+{
+   output_buf *out;
+
+   (*output_jvmti)->RawMonitorEnter (output_jvmti, registry_monitor);
+   for (out = outputs; out; out = out->next) {
+      (*output_jvmti)->RawMonitorEnter (output_jvmti, out->monitor);
+      if (out->size > 0)
+         flush_output_buf (out);
+      (*output_jvmti)->RawMonitorExit (output_jvmti, out->monitor);
+   }
+   (*output_jvmti)->RawMonitorExit (output_jvmti, registry_monitor);
+}
+
+/*
+ * Print "obj-delete" for the objects queued by object_free, after all
+ * buffers have been written. Not to be called while holding the monitor
+ * of a buffer.
+ */
+static void print_freed_objects ()
+{
+   freed_object *freed, *next, *oldest = NULL;
+
+   if (__atomic_load_n (&freed_objects, __ATOMIC_RELAXED) == NULL)
+      return;
+
+   // In the order in which the objects were freed.
+   freed = __atomic_exchange_n (&freed_objects, NULL, __ATOMIC_ACQUIRE);
+   for (; freed; freed = next) {
+      next = freed->next;
+      freed->next = oldest;
+      oldest = freed;
+   }
+
+   flush_all_output ();
+
+   for (freed = oldest; freed; freed = next) {
+      char object_buf[SIZE_OBJECT_BUF];
+      fill_tag_buf (object_buf, freed->tag);
+      rtfl_print_shared ("obj", RTFL_OBJ_VERSION, "", 1, "s:s", "delete",
+                         object_buf);
+      next = freed->next;
+      jvmti_dealloc (output_jvmti, freed);
+   }
+}
+
+void JNICALL output_thread_end (jvmtiEnv *jvmti, JNIEnv* jni, jthread thread)
+{
+   output_buf *out = NULL;
+
+   if ((*jvmti)->GetThreadLocalStorage (jvmti, thread, (void**)&out)
+       == JVMTI_ERROR_NONE && out) {
+      (*jvmti)->SetThreadLocalStorage (jvmti, thread, NULL);
+
+      (*jvmti)->RawMonitorEnter (jvmti, registry_monitor);
+      if (out->prev)
+         out->prev->next = out->next;
+      else
+         outputs = out->next;
+      if (out->next)
+         out->next->prev = out->prev;
+      (*jvmti)->RawMonitorExit (jvmti, registry_monitor);
+
+      // Not referred to anymore by other threads.
+      flush_output_buf (out);
+      (*jvmti)->DestroyRawMonitor (jvmti, out->monitor);
+      free (out->data);
+      free (out);
+   }
+}
+
+/*
+ * Write all buffers whose oldest line is older than FLUSH_MSECS.
+ */
+static void flush_old_output ()
+{
+   jlong now = current_msecs ();
+   output_buf *out;
+
+   (*output_jvmti)->RawMonitorEnter (output_jvmti, registry_monitor);
+   for (out = outputs; out; out = out->next) {
+      (*output_jvmti)->RawMonitorEnter (output_jvmti, out->monitor);
+      if (out->size > 0 && now - out->first_time >= FLUSH_MSECS)
+         flush_output_buf (out);
+      (*output_jvmti)->RawMonitorExit (output_jvmti, out->monitor);
+   }
+   (*output_jvmti)->RawMonitorExit (output_jvmti, registry_monitor);
+}
+
+static void JNICALL flusher_run (jvmtiEnv *jvmti, JNIEnv* jni, void *arg)
+{
+   bool stopped;
+
+   do {
+      (*jvmti)->RawMonitorEnter (jvmti, flusher_monitor);
+      if (!flusher_stopped)
+         (*jvmti)->RawMonitorWait (jvmti, flusher_monitor, FLUSH_MSECS / 2);
+      stopped = flusher_stopped;
+      (*jvmti)->RawMonitorExit (jvmti, flusher_monitor);
+
+      if (!stopped) {
+         print_freed_objects ();
+         flush_old_output ();
+      }
+   } while (!stopped);
+}
+
+/*
+ * Start the agent thread which writes buffers not written for
+ * FLUSH_MSECS. Called at VM initialization.
+ */
+void start_output_flusher (jvmtiEnv *jvmti, JNIEnv* jni)
+{
+   jclass thread_class;
+   jmethodID constructor;
+   jstring name;
+   jthread thread;
+   jvmtiError error;
+
+   if ((thread_class = (*jni)->FindClass (jni, "java/lang/Thread")) == NULL ||
+       (constructor = (*jni)->GetMethodID (jni, thread_class, "<init>",
+                                           "(Ljava/lang/String;)V"))
+       == NULL ||
+       (name = (*jni)->NewStringUTF (jni, "rtfl output flusher")) == NULL ||
+       (thread = (*jni)->NewObject (jni, thread_class, constructor, name))
+       == NULL) {
+      (*jni)->ExceptionClear (jni);
+      other_error ("cannot create the output flusher thread");
+   } else if ((error = (*jvmti)->RunAgentThread (jvmti, thread, flusher_run,
+                                                 NULL,
+                                                 JVMTI_THREAD_NORM_PRIORITY))
+              != JVMTI_ERROR_NONE)
+      jvmti_error (jvmti, error, "RunAgentThread");
+}
+
+void JNICALL output_vm_death (jvmtiEnv *jvmti, JNIEnv* jni)
+{
+   (*jvmti)->RawMonitorEnter (jvmti, flusher_monitor);
+   flusher_stopped = TRUE;
+   (*jvmti)->RawMonitorNotify (jvmti, flusher_monitor);
+   (*jvmti)->RawMonitorExit (jvmti, flusher_monitor);
+
+   print_freed_objects ();
+   flush_all_output ();
+}
+
+/*
+ * Make room for "n" more bytes. Complete lines are written; if the
+ * current line does not fit into the buffer alone, the buffer is
+ * enlarged, so that lines are never split.
+ */
+static void make_room (output_buf *out, int n)
+{
+   if (out->line_start > 0) {
+      write_data (out->data, out->line_start);
+      memmove (out->data, out->data + out->line_start,
+               out->size - out->line_start);
+      out->size -= out->line_start;
+      out->line_start = 0;
+   }
+
+   if (out->size + n > out->alloc) {
+      while (out->size + n > out->alloc)
+         out->alloc *= 2;
+      out->data = (char*)realloc (out->data, out->alloc);
+   }
+}
+
+static void out_put (output_buf *out, const char *data, int n)
+{
+   if (out->size + n > out->alloc)
+      make_room (out, n);
+
+   memcpy (out->data + out->size, data, n);
+   out->size += n;
+}
+
+static void out_char (output_buf *out, char c)
+{
+   if (out->size < out->alloc)
+      out->data[out->size++] = c;
+   else
+      out_put (out, &c, 1);
+}
+
+static void out_printf (output_buf *out, const char *fmt, ...)
+   __attribute__((format(printf, 2, 3)));
+
+static void out_printf (output_buf *out, const char *fmt, ...)
+{
+   char buf[256];
    va_list args;
+
    va_start (args, fmt);
+   int n = vsnprintf (buf, sizeof (buf), fmt, args);
+   va_end (args);
+
+   out_put (out, buf, MIN (n, (int)sizeof (buf) - 1));
+}
+
+// Copied from "debug_rtfl.hh".
+static void rtfl_vprint (output_buf *out, const char *module,
+                         const char *version, const char *file, int line,
+                         const char *fmt, va_list args)
+{
+   (*output_jvmti)->RawMonitorEnter (output_jvmti, out->monitor);
+
+   if (out->size == 0)
+      out->first_time = current_msecs ();
+
+   // "\n" at the beginning just in case that the previous line is not
+   // finished yet (when something else is printed to stdout).
+   out_printf (out, "\n[rtfl-%s-%s]%s:%d:%d:", module, version, file, line,
+               out->thread_id);
 
    int i;
    for (i = 0; fmt[i]; i++) {
@@ -145,20 +567,20 @@ void rtfl_print (const char *module, const char *version,
       switch (fmt[i]) {
       case 'd':
          n = va_arg(args, int);
-         printf ("%d", n);
+         out_printf (out, "%d", n);
          break;
 
       case 'p':
          p = va_arg(args, void*);
-         printf ("%p", p);
+         out_printf (out, "%p", p);
          break;
 
       case 's':
          s = va_arg (args, char*);
          for (j = 0; s[j]; j++) {
             if (s[j] == ':' || s[j] == '\\')
-               putchar ('\\');
-            putchar (s[j]);
+               out_char (out, '\\');
+            out_char (out, s[j]);
          }
          break;
 
@@ -166,26 +588,52 @@ void rtfl_print (const char *module, const char *version,
          s = va_arg (args, char*);
          for (j = 0; s[j]; j++) {
             if (s[j] == ':' || s[j] == '\\')
-               putchar ('\\');
+               out_char (out, '\\');
             else if (s[j] == '\"')
-               printf ("\\\\"); // a quoted quoting character
-            putchar (s[j]);
+               out_put (out, "\\\\", 2); // a quoted quoting character
+            out_char (out, s[j]);
          }
          break;
 
       case 'c':
          n = va_arg(args, int);
-         printf ("#%06x", n);
+         out_printf (out, "#%06x", n);
          break;
 
       default:
-         putchar (fmt[i]);
+         out_char (out, fmt[i]);
          break;
       }
    }
 
+   out_char (out, '\n');
+   out->line_start = out->size;
+
+   if (current_msecs () - out->first_time >= FLUSH_MSECS)
+      flush_output_buf (out);
+
+   (*output_jvmti)->RawMonitorExit (output_jvmti, out->monitor);
+}
+
+void rtfl_print (const char *module, const char *version,
+                 const char *file, int line, const char *fmt, ...)
+{
+   va_list args;
+   print_freed_objects ();
+   va_start (args, fmt);
+   rtfl_vprint (get_output_buf (), module, version, file, line, fmt, args);
    va_end (args);
+}
 
-   putchar ('\n');
-   fflush (stdout);
+/*
+ * Like rtfl_print, but always uses the shared buffer, and does not print
+ * queued "obj-delete" lines.
+ */
+void rtfl_print_shared (const char *module, const char *version,
+                        const char *file, int line, const char *fmt, ...)
+{
+   va_list args;
+   va_start (args, fmt);
+   rtfl_vprint (&shared_output, module, version, file, line, fmt, args);
+   va_end (args);
 }
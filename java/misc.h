@@ -24,11 +24,21 @@ void simple_free (void *mem);
 
 char *get_class_name_from_sig (const char *class_sig, bool expect_class);
 
-size_t object_index (JNIEnv* jni, jobject object);
-void fill_object_buf (JNIEnv* jni, char *object_buf, jobject object);
-
+jvmtiError init_object_tags (jvmtiEnv *jvmti);
+jlong object_tag (jvmtiEnv *jvmti, jobject object);
+void fill_object_buf (jvmtiEnv *jvmti, char *object_buf, jobject object);
+void fill_tag_buf (char *object_buf, jlong tag);
+void JNICALL object_free (jvmtiEnv *jvmti, jlong tag);
+
+jvmtiError init_output (jvmtiEnv *jvmti);
+void flush_all_output ();
+void start_output_flusher (jvmtiEnv *jvmti, JNIEnv* jni);
+void JNICALL output_thread_end (jvmtiEnv *jvmti, JNIEnv* jni, jthread thread);
+void JNICALL output_vm_death (jvmtiEnv *jvmti, JNIEnv* jni);
 void rtfl_print (const char *module, const char *version,
                  const char *file, int line, const char *fmt, ...);
+void rtfl_print_shared (const char *module, const char *version,
+                        const char *file, int line, const char *fmt, ...);
 
 #define RTFL_PRINT(module, version, cmd, fmt, ...) \
    rtfl_print (module, version, "", 1, "s:" fmt, cmd, __VA_ARGS__)
@@ -0,0 +1,756 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+// The functions to test are static.
+#include "instrument.c"
+
+// Test the bytecode rewriter (see instrument.c) without a JVM: a
+// hand-assembled class, and the class files given as arguments, are
+// instrumented, and the result is compared with the original. In each
+// method, "enter" must be called at the beginning, and "leave" before each
+// return and in the handler for all exceptions (except in constructors);
+// all offsets (branch targets, exception table, stack map frames, line
+// numbers and local variables) must refer to the same instructions as in
+// the original. Whether the JVM accepts the result is checked by "make
+// check-instrument".
+
+/* Constant pool of the hand-assembled class. */
+enum {
+   T_CLASS_NAME = 1, T_CLASS, T_OBJECT_NAME, T_OBJECT, T_THROWABLE_NAME,
+   T_THROWABLE, T_CODE, T_STACK_MAP_TABLE, T_LINE_NUMBER_TABLE,
+   T_LOCAL_VARIABLE_TABLE, T_INIT_NAME, T_VOID_SIG, T_INIT_NAME_AND_TYPE,
+   T_OBJECT_INIT, T_F_NAME, T_F_SIG, T_G_NAME, T_THIS_NAME, T_THIS_SIG,
+   T_N_NAME, T_N_SIG, T_LONG, T_CP_COUNT = T_LONG + 2 /* Two entries. */
+};
+
+static const char *check_name;
+static const char *check_method;
+
+static bool failed (const char *fmt, ...)
+{
+   va_list args;
+
+   printf ("%s, method %s: ", check_name, check_method);
+   va_start (args, fmt);
+   vprintf (fmt, args);
+   va_end (args);
+   printf ("\n");
+   return FALSE;
+}
+
+/* Set the length of the attribute written from "start" on. */
+static void write_attr_length (byte_buf *buf, int start)
+{
+   buf_set_u4 (buf, start + 2, buf->size - start - 6);
+}
+
+/*
+ * Method "int f (int n)": a conditional branch, a tableswitch (whose
+ * padding changes if the inserted calls are not four bytes long), a
+ * backward branch to the beginning, an exception handler, and all code
+ * attributes which are adjusted.
+ */
+static void write_method_f (byte_buf *buf)
+{
+   static const unsigned char code[] = {
+      0x1b,                         //  0: iload_1
+      0x99, 0, 33,                  //  1: ifeq 34
+      0x1b,                         //  4: iload_1
+      0xaa, 0, 0,                   //  5: tableswitch, padding
+      0, 0, 0, 23,                  //     default: 28
+      0, 0, 0, 0, 0, 0, 0, 1,       //     0 to 1
+      0, 0, 0, 31, 0, 0, 0, 33,     //     36, 38
+      0x84, 1, 0xff,                // 28: iinc 1, -1
+      0xa7, 0xff, 0xe1,             // 31: goto 0
+      0x03, 0xac,                   // 34: iconst_0, ireturn
+      0x04, 0xac,                   // 36: iconst_1, ireturn
+      0x1b, 0xac,                   // 38: iload_1, ireturn
+      0x57, 0x05, 0xac              // 40: pop, iconst_2, ireturn
+   };
+   int start;
+
+   buf_u2 (buf, ACC_PUBLIC);
+   buf_u2 (buf, T_F_NAME);
+   buf_u2 (buf, T_F_SIG);
+   buf_u2 (buf, 1);
+
+   start = buf->size;
+   buf_u2 (buf, T_CODE);
+   buf_u4 (buf, 0);
+   buf_u2 (buf, 2);
+   buf_u2 (buf, 2);
+   buf_u4 (buf, sizeof (code));
+   buf_put (buf, code, sizeof (code));
+   buf_u2 (buf, 1);
+   buf_u2 (buf, 4);
+   buf_u2 (buf, 28);
+   buf_u2 (buf, 40);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, 3);
+
+   // Frames at 0, 28, 34, 36, 38 (same_frame), and at 40 (with the
+   // exception on the stack).
+   buf_u2 (buf, T_STACK_MAP_TABLE);
+   buf_u4 (buf, 2 + 5 + 4);
+   buf_u2 (buf, 6);
+   buf_u1 (buf, 0);
+   buf_u1 (buf, 27);
+   buf_u1 (buf, 5);
+   buf_u1 (buf, 1);
+   buf_u1 (buf, 1);
+   buf_u1 (buf, 64 + 1);
+   buf_u1 (buf, ITEM_Object);
+   buf_u2 (buf, T_THROWABLE);
+
+   buf_u2 (buf, T_LINE_NUMBER_TABLE);
+   buf_u4 (buf, 2 + 3 * 4);
+   buf_u2 (buf, 3);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, 10);
+   buf_u2 (buf, 28);
+   buf_u2 (buf, 11);
+   buf_u2 (buf, 34);
+   buf_u2 (buf, 12);
+
+   buf_u2 (buf, T_LOCAL_VARIABLE_TABLE);
+   buf_u4 (buf, 2 + 2 * 10);
+   buf_u2 (buf, 2);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, sizeof (code));
+   buf_u2 (buf, T_THIS_NAME);
+   buf_u2 (buf, T_THIS_SIG);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, sizeof (code));
+   buf_u2 (buf, T_N_NAME);
+   buf_u2 (buf, T_N_SIG);
+   buf_u2 (buf, 1);
+
+   write_attr_length (buf, start);
+}
+
+/* A method with "code" only, without other attributes. */
+static void write_simple_method (byte_buf *buf, int access, int name,
+                                 int max_stack, const unsigned char *code,
+                                 int code_length)
+{
+   int start;
+
+   buf_u2 (buf, access);
+   buf_u2 (buf, name);
+   buf_u2 (buf, T_VOID_SIG);
+   buf_u2 (buf, 1);
+
+   start = buf->size;
+   buf_u2 (buf, T_CODE);
+   buf_u4 (buf, 0);
+   buf_u2 (buf, max_stack);
+   buf_u2 (buf, 1);
+   buf_u4 (buf, code_length);
+   buf_put (buf, code, code_length);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, 0);
+   write_attr_length (buf, start);
+}
+
+/*
+ * Class "rtfl.T" with the methods f (see write_method_f), "static void
+ * g ()", and a constructor. The constant pool contains a long constant,
+ * which takes two entries.
+ */
+static void write_test_class (byte_buf *buf)
+{
+   static const unsigned char g_code[] = { OP_RETURN };
+   static const unsigned char init_code[] = {
+      OP_ALOAD_0, 0xb7, 0, T_OBJECT_INIT, OP_RETURN
+   };
+
+   buf_u4 (buf, 0xcafebabe);
+   buf_u2 (buf, 0);
+   buf_u2 (buf, 52);
+   buf_u2 (buf, T_CP_COUNT);
+   buf_utf8 (buf, "rtfl/T");
+   buf_u1 (buf, CONSTANT_Class);
+   buf_u2 (buf, T_CLASS_NAME);
+   buf_utf8 (buf, "java/lang/Object");
+   buf_u1 (buf, CONSTANT_Class);
+   buf_u2 (buf, T_OBJECT_NAME);
+   buf_utf8 (buf, "java/lang/Throwable");
+   buf_u1 (buf, CONSTANT_Class);
+   buf_u2 (buf, T_THROWABLE_NAME);
+   buf_utf8 (buf, "Code");
+   buf_utf8 (buf, "StackMapTable");
+   buf_utf8 (buf, "LineNumberTable");
+   buf_utf8 (buf, "LocalVariableTable");
+   buf_utf8 (buf, "<init>");
+   buf_utf8 (buf, "()V");
+   buf_u1 (buf, CONSTANT_NameAndType);
+   buf_u2 (buf, T_INIT_NAME);
+   buf_u2 (buf, T_VOID_SIG);
+   buf_u1 (buf, CONSTANT_Methodref);
+   buf_u2 (buf, T_OBJECT);
+   buf_u2 (buf, T_INIT_NAME_AND_TYPE);
+   buf_utf8 (buf, "f");
+   buf_utf8 (buf, "(I)I");
+   buf_utf8 (buf, "g");
+   buf_utf8 (buf, "this");
+   buf_utf8 (buf, "Lrtfl/T;");
+   buf_utf8 (buf, "n");
+   buf_utf8 (buf, "I");
+   buf_u1 (buf, CONSTANT_Long);
+   buf_u4 (buf, 0);
+   buf_u4 (buf, 123);
+
+   buf_u2 (buf, ACC_PUBLIC | ACC_SUPER);
+   buf_u2 (buf, T_CLASS);
+   buf_u2 (buf, T_OBJECT);
+   buf_u2 (buf, 0);        // Interfaces.
+   buf_u2 (buf, 0);        // Fields.
+   buf_u2 (buf, 3);        // Methods.
+   write_method_f (buf);
+   write_simple_method (buf, ACC_PUBLIC | ACC_STATIC, T_G_NAME, 0, g_code,
+                        sizeof (g_code));
+   write_simple_method (buf, ACC_PUBLIC, T_INIT_NAME, 1, init_code,
+                        sizeof (init_code));
+   buf_u2 (buf, 0);        // Attributes.
+}
+
+/* ----------------------------------------------------------------------
+
+   All offsets in the instrumented code are mapped back to the original
+   code, which is then rebuilt and compared with the original, as well
+   as the exception table, the stack map frames, the line numbers and
+   the local variables. So offsets referring to the wrong instruction
+   are found, too.
+
+   ---------------------------------------------------------------------- */
+
+typedef struct
+{
+   int *data;
+   int size, alloc;
+} int_list;
+
+static void list_init (int_list *list)
+{
+   list->alloc = 64;
+   list->data = (int*)malloc (list->alloc * sizeof (int));
+   list->size = 0;
+}
+
+static void list_add (int_list *list, int value)
+{
+   if (list->size == list->alloc)
+      list->data = (int*)realloc (list->data,
+                                  (list->alloc *= 2) * sizeof (int));
+   list->data[list->size++] = value;
+}
+
+typedef struct
+{
+   class_file *cf;
+   int cp_base;
+   bool is_init;
+   const unsigned char *code, *exceptions, *attrs;
+   int code_length, num_exceptions, attrs_len;
+   int handler;            /* Position of the added handler. */
+   int *orig;              /* Original position, for each position; NULL
+                              for the original code. */
+} code_attr;
+
+static bool read_code_attr (code_attr *ca, class_file *cf,
+                            const unsigned char *data, int len)
+{
+   reader r;
+
+   rd_init (&r, data, len);
+   rd_skip (&r, 4);
+   ca->cf = cf;
+   ca->code_length = rd_u4 (&r);
+   ca->code = rd_skip (&r, ca->code_length);
+   ca->num_exceptions = rd_u2 (&r);
+   ca->exceptions = rd_skip (&r, 8 * ca->num_exceptions);
+   ca->attrs = data + r.pos;
+   ca->attrs_len = len - r.pos;
+   ca->handler = ca->code_length;
+   ca->orig = NULL;
+   return r.ok && ca->code_length > 0;
+}
+
+/* Original position of "pos", or -1 if it is not an instruction. */
+static int orig_pos (code_attr *ca, jint pos)
+{
+   if (pos < 0 || pos > ca->code_length)
+      return -1;
+   return ca->orig ? ca->orig[pos] : pos;
+}
+
+/* Like orig_pos, but the call of enter () is not a valid target. */
+static int orig_target (code_attr *ca, jint pos)
+{
+   return ca->orig && pos < INSERTED_LENGTH ? -1 : orig_pos (ca, pos);
+}
+
+static bool is_call (code_attr *ca, int pos, int cp_method)
+{
+   return pos >= 0 && pos + INSERTED_LENGTH <= ca->code_length &&
+      (ca->code[pos] == OP_ALOAD_0 || ca->code[pos] == OP_ACONST_NULL) &&
+      ca->code[pos + 1] == OP_INVOKESTATIC &&
+      get_u2 (ca->code + pos + 2) == ca->cp_base + cp_method;
+}
+
+static bool is_return (code_attr *ca, int pos)
+{
+   return pos < ca->code_length &&
+      ca->code[pos] >= OP_IRETURN && ca->code[pos] <= OP_RETURN;
+}
+
+/*
+ * Check the inserted calls, and set the original positions. A call of
+ * leave () gets the original position of the return instruction, and
+ * the handler the original code length.
+ */
+static bool map_positions (code_attr *ca, int orig_length)
+{
+   int pos, len, orig = 0;
+
+   ca->orig = (int*)malloc ((ca->code_length + 1) * sizeof (int));
+   for (pos = 0; pos <= ca->code_length; pos++)
+      ca->orig[pos] = -1;
+
+   if (!is_call (ca, 0, CP_ENTER))
+      return failed ("enter () not called at the beginning");
+   ca->orig[0] = 0;
+
+   if (!ca->is_init) {
+      ca->handler = ca->code_length - HANDLER_LENGTH;
+      if (!is_call (ca, ca->handler, CP_LEAVE) ||
+          ca->code[ca->handler + INSERTED_LENGTH] != OP_ATHROW)
+         return failed ("no handler calling leave () at the end");
+   }
+
+   for (pos = INSERTED_LENGTH; pos < ca->handler; pos += len) {
+      if (is_call (ca, pos, CP_LEAVE)) {
+         len = INSERTED_LENGTH;
+         if (ca->is_init || !is_return (ca, pos + len))
+            return failed ("leave () called at %d, not before a return",
+                           pos);
+         ca->orig[pos] = orig;
+      } else {
+         len = instruction_length (ca->code, pos, ca->handler);
+         if (len <= 0)
+            return failed ("invalid instruction at %d", pos);
+         if (is_return (ca, pos) && !ca->is_init &&
+             !is_call (ca, pos - INSERTED_LENGTH, CP_LEAVE))
+            return failed ("leave () not called before the return at %d",
+                           pos);
+         ca->orig[pos] = orig;
+         orig += len;
+      }
+   }
+
+   if (pos != ca->handler || orig != orig_length)
+      return failed ("code length %d instead of %d", orig, orig_length);
+   ca->orig[ca->handler] = orig;
+   ca->orig[ca->code_length] = orig;
+   return TRUE;
+}
+
+/* Original branch offset; *bad is set if the target is invalid. */
+static jint orig_offset (code_attr *ca, int pos, jint offset, bool *bad)
+{
+   int target = orig_target (ca, pos + offset);
+   if (target == -1 || pos + offset >= ca->handler)
+      *bad = TRUE;
+   return target - ca->orig[pos];
+}
+
+static bool check_code_bytes (code_attr *ca, code_attr *orig)
+{
+   byte_buf buf;
+   int pos, len, i;
+   bool bad = FALSE, ok;
+
+   buf_init (&buf);
+   for (pos = INSERTED_LENGTH; pos < ca->handler && !bad; pos += len) {
+      int op = ca->code[pos], start = buf.size;
+
+      if (is_call (ca, pos, CP_LEAVE)) {
+         len = INSERTED_LENGTH;
+         continue;
+      }
+
+      len = instruction_length (ca->code, pos, ca->handler);
+      buf_put (&buf, ca->code + pos, len);
+
+      if ((op >= OP_IFEQ && op <= OP_JSR) || op == OP_IFNULL ||
+          op == OP_IFNONNULL)
+         buf_set_u2 (&buf, start + 1,
+                     orig_offset (ca, pos, get_s2 (ca->code + pos + 1),
+                                  &bad));
+      else if (op == OP_GOTO_W || op == OP_JSR_W)
+         buf_set_u4 (&buf, start + 1,
+                     orig_offset (ca, pos, get_s4 (ca->code + pos + 1),
+                                  &bad));
+      else if (op == OP_TABLESWITCH || op == OP_LOOKUPSWITCH) {
+         // The padding does not change.
+         int p = (pos + 4) & ~3, q = start + (p - pos);
+         int num = op == OP_TABLESWITCH ?
+            get_s4 (ca->code + p + 8) - get_s4 (ca->code + p + 4) + 1 :
+            get_s4 (ca->code + p + 4);
+         buf_set_u4 (&buf, q,
+                     orig_offset (ca, pos, get_s4 (ca->code + p), &bad));
+         for (i = 0; i < num; i++) {
+            int o = op == OP_TABLESWITCH ? 12 + 4 * i : 12 + 8 * i;
+            buf_set_u4 (&buf, q + o,
+                        orig_offset (ca, pos, get_s4 (ca->code + p + o),
+                                     &bad));
+         }
+      }
+
+      if (bad)
+         failed ("invalid branch target at %d", pos);
+   }
+
+   ok = !bad && buf.size == orig->code_length &&
+      memcmp (buf.data, orig->code, buf.size) == 0;
+   if (!bad && !ok) {
+      for (i = 0; i < buf.size && buf.data[i] == orig->code[i]; i++)
+         ;
+      failed ("code differs from the original at %d", i);
+   }
+
+   free (buf.data);
+   return ok;
+}
+
+static bool check_exceptions (code_attr *ca, code_attr *orig)
+{
+   int i;
+
+   if (ca->num_exceptions != orig->num_exceptions + (ca->is_init ? 0 : 1))
+      return failed ("%d exception table entries instead of %d",
+                     ca->num_exceptions, orig->num_exceptions);
+
+   for (i = 0; i < orig->num_exceptions; i++) {
+      const unsigned char *e = ca->exceptions + 8 * i;
+      const unsigned char *o = orig->exceptions + 8 * i;
+      if (orig_target (ca, get_u2 (e)) != get_u2 (o) ||
+          orig_pos (ca, get_u2 (e + 2)) != get_u2 (o + 2) ||
+          orig_target (ca, get_u2 (e + 4)) != get_u2 (o + 4) ||
+          get_u2 (e + 6) != get_u2 (o + 6))
+         return failed ("exception table entry %d differs", i);
+   }
+
+   // The added handler comes last, and covers the whole original code.
+   if (!ca->is_init) {
+      const unsigned char *e = ca->exceptions + 8 * i;
+      if (get_u2 (e) != INSERTED_LENGTH || get_u2 (e + 2) != ca->handler ||
+          get_u2 (e + 4) != ca->handler || get_u2 (e + 6) != 0)
+         return failed ("invalid exception table entry for the handler");
+   }
+
+   return TRUE;
+}
+
+static void collect_verification_types (code_attr *ca, reader *r, int num,
+                                        int_list *list)
+{
+   int i, tag;
+
+   for (i = 0; i < num && r->ok; i++) {
+      tag = rd_u1 (r);
+      if (tag == ITEM_Object)
+         rd_u2 (r);
+      else if (tag == ITEM_Uninitialized)
+         list_add (list, orig_target (ca, rd_u2 (r)));
+   }
+}
+
+/* Positions of the frames, and of the "new" instructions referred to. */
+static void collect_frames (code_attr *ca, reader *r, int_list *list)
+{
+   int num = rd_u2 (r), i, type, delta, offset = -1;
+
+   for (i = 0; i < num && r->ok; i++) {
+      type = rd_u1 (r);
+      delta = type < 128 ? type % 64 : rd_u2 (r);
+      offset += delta + 1;
+      list_add (list, orig_target (ca, offset));
+
+      if ((type >= 64 && type < 128) || type == 247)
+         collect_verification_types (ca, r, 1, list);
+      else if (type >= 252 && type <= 254)
+         collect_verification_types (ca, r, type - 251, list);
+      else if (type == 255) {
+         collect_verification_types (ca, r, rd_u2 (r), list);
+         collect_verification_types (ca, r, rd_u2 (r), list);
+      } else if (type >= 128 && type < 247) {
+         // Reserved.
+         list_add (list, -2);
+         break;
+      }
+   }
+}
+
+/*
+ * Collect the entries of all code attributes named "name", with the
+ * original positions.
+ */
+static bool collect_entries (code_attr *ca, const char *name, int_list *list)
+{
+   reader r;
+   int num, i, j, n;
+
+   rd_init (&r, ca->attrs, ca->attrs_len);
+   num = rd_u2 (&r);
+   for (i = 0; i < num && r.ok; i++) {
+      int attr_name = rd_u2 (&r), len = rd_u4 (&r);
+      reader r2;
+
+      rd_init (&r2, rd_skip (&r, len), len);
+      if (!r.ok || !utf8_equals (ca->cf, attr_name, name))
+         continue;
+
+      if (strcmp (name, "StackMapTable") == 0)
+         collect_frames (ca, &r2, list);
+      else if (strcmp (name, "LineNumberTable") == 0) {
+         n = rd_u2 (&r2);
+         for (j = 0; j < n && r2.ok; j++) {
+            list_add (list, orig_pos (ca, rd_u2 (&r2)));
+            list_add (list, rd_u2 (&r2));
+         }
+      } else {
+         n = rd_u2 (&r2);
+         for (j = 0; j < n && r2.ok; j++) {
+            int start = rd_u2 (&r2), length = rd_u2 (&r2);
+            list_add (list, orig_pos (ca, start));
+            list_add (list, orig_pos (ca, start + length));
+            list_add (list, rd_u2 (&r2));
+            list_add (list, rd_u2 (&r2));
+            list_add (list, rd_u2 (&r2));
+         }
+      }
+
+      if (!r2.ok)
+         return FALSE;
+   }
+
+   return r.ok;
+}
+
+static bool check_entries (code_attr *ca, code_attr *orig, const char *name)
+{
+   int_list list, orig_list;
+   bool ok;
+
+   list_init (&list);
+   list_init (&orig_list);
+   ok = collect_entries (ca, name, &list) &&
+      collect_entries (orig, name, &orig_list);
+
+   // The frame added for the handler.
+   if (ok && strcmp (name, "StackMapTable") == 0 && !ca->is_init &&
+       list.size > 0 && list.data[list.size - 1] == orig->code_length)
+      list.size--;
+
+   if (!ok)
+      failed ("%s truncated", name);
+   else if (list.size != orig_list.size ||
+            memcmp (list.data, orig_list.data, list.size * sizeof (int)))
+      ok = failed ("%s differs from the original", name);
+
+   free (list.data);
+   free (orig_list.data);
+   return ok;
+}
+
+static bool check_code (code_attr *ca, code_attr *orig)
+{
+   return map_positions (ca, orig->code_length) &&
+      check_code_bytes (ca, orig) && check_exceptions (ca, orig) &&
+      check_entries (ca, orig, "StackMapTable") &&
+      check_entries (ca, orig, "LineNumberTable") &&
+      check_entries (ca, orig, "LocalVariableTable") &&
+      check_entries (ca, orig, "LocalVariableTypeTable");
+}
+
+/*
+ * Read the class file up to the methods; returns FALSE if it is
+ * invalid.
+ */
+static bool read_class (class_file *cf, reader *r, const unsigned char *data,
+                        int len)
+{
+   int num_fields, i, j;
+
+   rd_init (r, data, len);
+   cf->cp_offsets = NULL;
+   cf->data = data;
+   cf->len = len;
+   rd_skip (r, 6);
+   cf->major_version = rd_u2 (r);
+   cf->cp_count = rd_u2 (r);
+   if (!read_constant_pool (cf, r))
+      return FALSE;
+
+   rd_skip (r, 6);
+   rd_skip (r, 2 * rd_u2 (r));
+   num_fields = rd_u2 (r);
+   for (i = 0; i < num_fields && r->ok; i++) {
+      int num_attrs;
+      rd_skip (r, 6);
+      num_attrs = rd_u2 (r);
+      for (j = 0; j < num_attrs && r->ok; j++) {
+         rd_skip (r, 2);
+         rd_skip (r, rd_u4 (r));
+      }
+   }
+
+   return r->ok;
+}
+
+/*
+ * Check the instrumented version of a class file. Returns the number of
+ * instrumented methods, or -1 on errors.
+ */
+static int check_class (const char *name, const unsigned char *orig_data,
+                        int orig_len, const unsigned char *data, int len)
+{
+   class_file cf, orig_cf;
+   reader r, orig_r;
+   int num_methods, num_instrumented = 0, i, j;
+   bool ok;
+
+   check_name = name;
+   check_method = "-";
+   cf.cp_offsets = orig_cf.cp_offsets = NULL;
+   ok = read_class (&orig_cf, &orig_r, orig_data, orig_len) &&
+      read_class (&cf, &r, data, len) &&
+      cf.cp_count == orig_cf.cp_count + NUM_NEW_CP_ENTRIES;
+   if (!ok)
+      failed ("invalid class file");
+
+   num_methods = rd_u2 (&r);
+   if (ok && rd_u2 (&orig_r) != num_methods)
+      ok = failed ("number of methods differs");
+
+   for (i = 0; i < num_methods && ok && r.ok; i++) {
+      int access = rd_u2 (&r), method_name = rd_u2 (&r), num_attrs;
+      const unsigned char *p = cf.data + cf.cp_offsets[method_name];
+      char name_buf[256];
+
+      snprintf (name_buf, sizeof (name_buf), "%.*s", get_u2 (p + 1), p + 3);
+      check_method = name_buf;
+
+      rd_u2 (&r);
+      num_attrs = rd_u2 (&r);
+      rd_skip (&orig_r, 8);
+
+      for (j = 0; j < num_attrs && ok && r.ok; j++) {
+         int attr_name = rd_u2 (&r), attr_len = rd_u4 (&r);
+         const unsigned char *attr = rd_skip (&r, attr_len);
+         int orig_attr_len;
+         const unsigned char *orig_attr;
+         code_attr ca, orig;
+
+         rd_u2 (&orig_r);
+         orig_attr_len = rd_u4 (&orig_r);
+         orig_attr = rd_skip (&orig_r, orig_attr_len);
+
+         if (!r.ok || !orig_r.ok || !utf8_equals (&cf, attr_name, "Code") ||
+             (access & (ACC_NATIVE | ACC_ABSTRACT)))
+            continue;
+
+         // Methods which cannot be instrumented are left unchanged.
+         if (attr_len == orig_attr_len &&
+             memcmp (attr, orig_attr, attr_len) == 0)
+            continue;
+
+         if (!read_code_attr (&ca, &cf, attr, attr_len) ||
+             !read_code_attr (&orig, &orig_cf, orig_attr, orig_attr_len))
+            ok = failed ("invalid code attribute");
+         else {
+            ca.cp_base = orig.cp_base = orig_cf.cp_count;
+            ca.is_init = orig.is_init =
+               utf8_equals (&cf, method_name, "<init>");
+            ok = check_code (&ca, &orig);
+            simple_free (ca.orig);
+            num_instrumented++;
+         }
+      }
+
+      check_method = "-";
+   }
+
+   if (ok && (!r.ok || !orig_r.ok))
+      ok = failed ("class file truncated");
+
+   simple_free (cf.cp_offsets);
+   simple_free (orig_cf.cp_offsets);
+   return ok ? num_instrumented : -1;
+}
+
+static unsigned char *read_file (const char *file_name, int *len)
+{
+   FILE *file = fopen (file_name, "rb");
+   int alloc = 65536;
+   unsigned char *data;
+   size_t n;
+
+   if (file == NULL) {
+      perror (file_name);
+      return NULL;
+   }
+
+   data = (unsigned char*)malloc (alloc);
+   *len = 0;
+   while ((n = fread (data + *len, 1, alloc - *len, file)) > 0) {
+      *len += n;
+      if (*len == alloc)
+         data = (unsigned char*)realloc (data, alloc *= 2);
+   }
+
+   fclose (file);
+   return data;
+}
+
+int main (int argc, char *argv[])
+{
+   byte_buf buf;
+   unsigned char *data, *instrumented;
+   int len, new_len, num, i;
+
+   buf_init (&buf);
+   write_test_class (&buf);
+   instrumented = instrument_class (buf.data, buf.size, &new_len);
+   num = instrumented ?
+      check_class ("hand-assembled class", buf.data, buf.size, instrumented,
+                   new_len) : 0;
+   free (buf.data);
+   free (instrumented);
+
+   if (num == -1)
+      return 1;
+   else if (num != 3) {
+      printf ("hand-assembled class: %d of 3 methods instrumented\n", num);
+      return 1;
+   }
+
+   for (i = 1; i < argc; i++) {
+      if ((data = read_file (argv[i], &len)) == NULL)
+         return 1;
+      instrumented = instrument_class (data, len, &new_len);
+      num = instrumented ?
+         check_class (argv[i], data, len, instrumented, new_len) : 0;
+      free (data);
+      free (instrumented);
+
+      if (num == -1)
+         return 1;
+      printf ("%s: %d methods instrumented\n", argv[i], num);
+   }
+
+   printf ("instrumented classes are consistent\n");
+   return 0;
+}
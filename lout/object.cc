@@ -284,10 +284,12 @@ int ConstString::compareTo(Comparable *other)
 int ConstString::hashValue(const char *str)
 {
    if (str) {
-      int h = 0;
+      // All characters are considered (not only the last four), since many
+      // strings (like object addresses) differ only in the middle.
+      unsigned int h = 0;
       for (int i = 0; str[i]; i++)
-         h = (h * 256 + str[i]);
-      return h;
+         h = h * 31 + (unsigned char)str[i];
+      return (int)h;
    } else
       return 0;
 }
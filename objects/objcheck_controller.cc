@@ -0,0 +1,190 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objcheck_controller.hh"
+
+using namespace lout::object;
+using namespace lout::container::typed;
+using namespace rtfl::tools;
+
+namespace rtfl {
+
+namespace objects {
+
+ObjCheckController::ObjCheckController ()
+{
+   objStates =
+      new HashTable<String, ObjState> (true, true, OBJ_STATES_TABLE_SIZE);
+   numAccesses = numCreated = numDeleted = numNeverCreated =
+      numUsedAfterDelete = 0;
+}
+
+ObjCheckController::~ObjCheckController ()
+{
+   delete objStates;
+}
+
+ObjCheckController::ObjState *ObjCheckController::getObjState (const char *id)
+{
+   String key (id);
+   return objStates->get (&key);
+}
+
+ObjCheckController::ObjState *ObjCheckController::ensureObjState (const char
+                                                                  *id)
+{
+   ObjState *objState = getObjState (id);
+   if (objState == NULL) {
+      objState = new ObjState ();
+      objStates->put (new String (id), objState);
+   }
+   return objState;
+}
+
+void ObjCheckController::check (CommonLineInfo *info, const char *id)
+{
+   numAccesses++;
+
+   ObjState *objState = getObjState (id);
+   if (objState == NULL || !objState->lifecycle.exists ()) {
+      if (objState && objState->lifecycle.everExisted ()) {
+         numUsedAfterDelete++;
+         printf ("%s:%d: object %s has been deleted:\n%s\n", info->fileName,
+                 info->lineNo, id, info->completeLine);
+      } else {
+         numNeverCreated++;
+         printf ("%s:%d: object %s has never existed:\n%s\n", info->fileName,
+                 info->lineNo, id, info->completeLine);
+      }
+   }
+}
+
+void ObjCheckController::ownFinish ()
+{
+   printf ("%ld accesses to objects checked, %ld objects created, "
+           "%ld deleted.\n", numAccesses, numCreated, numDeleted);
+   printf ("%ld accesses to deleted objects, %ld accesses to objects which "
+           "have never existed.\n", numUsedAfterDelete, numNeverCreated);
+   fflush (stdout);
+}
+
+void ObjCheckController::objMsg (CommonLineInfo *info, const char *id,
+                                 const char *aspect, int prio,
+                                 const char *message)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objMark (CommonLineInfo *info, const char *id,
+                                  const char *aspect, int prio,
+                                  const char *message)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objEnter (CommonLineInfo *info, const char *id,
+                                   const char *aspect, int prio,
+                                   const char *funname, const char *args)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objLeave (CommonLineInfo *info, const char *id,
+                                   const char *vals)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objCreate (CommonLineInfo *info, const char *id,
+                                    const char *klass)
+{
+   ObjLifecycle *lifecycle = &ensureObjState(id)->lifecycle;
+   if (!lifecycle->exists ())
+      numCreated++;
+   lifecycle->objCreate ();
+}
+
+void ObjCheckController::objIdent (CommonLineInfo *info, const char *id1,
+                                   const char *id2)
+{
+   // Already handled by ObjIdentController.
+}
+
+void ObjCheckController::objNoIdent (CommonLineInfo *info)
+{
+   // Already handled by ObjIdentController.
+}
+
+void ObjCheckController::objAssoc (CommonLineInfo *info, const char *parent,
+                                   const char *child)
+{
+   check (info, parent);
+   check (info, child);
+}
+
+void ObjCheckController::objSet (CommonLineInfo *info, const char *id,
+                                 const char *var, const char *val)
+{
+   check (info, id);
+}
+
+void ObjCheckController::objClassColor (CommonLineInfo *info,
+                                        const char *klass, const char *color)
+{
+}
+
+void ObjCheckController::objObjectColor (CommonLineInfo *info, const char *id,
+                                         const char *color)
+{
+}
+
+void ObjCheckController::objDelete (CommonLineInfo *info, const char *id)
+{
+   ObjState *objState = getObjState (id);
+   if (objState && objState->lifecycle.exists ()) {
+      if (objState->lifecycle.objDelete ())
+         numDeleted++;
+   } else
+      // Deleting an object is also an access.
+      check (info, id);
+}
+
+} // namespace objects
+
+} // namespace rtfl
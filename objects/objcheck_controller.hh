@@ -0,0 +1,84 @@
+#ifndef __OBJECTS_OBJCHECK_CONTROLLER_HH__
+#define __OBJECTS_OBJCHECK_CONTROLLER_HH__
+
+#include "objects_parser.hh"
+#include "objdelete_controller.hh"
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief Checks for invalid object access: uses of objects which have been
+ *    deleted, or which have never been created.
+ *
+ * This is the implementation of `rtfl-check-objects`. It should be used after
+ * ObjIdentController, so that identical objects are already mapped to one
+ * id. The life cycle of each object is tracked by ObjLifecycle (as in
+ * ObjDeleteController); only a small struct is kept per id.
+ *
+ * Each invalid access is printed, with file name and line number. A summary
+ * is printed at the end of the stream.
+ */
+class ObjCheckController: public ObjectsControllerBase
+{
+private:
+   class ObjState: public lout::object::Object
+   {
+   public:
+      ObjLifecycle lifecycle;
+   };
+
+   enum { OBJ_STATES_TABLE_SIZE = 16381 };
+
+   lout::container::typed::HashTable<lout::object::String, ObjState>
+      *objStates;
+   long numAccesses, numCreated, numDeleted, numNeverCreated,
+      numUsedAfterDelete;
+
+   ObjState *getObjState (const char *id);
+   ObjState *ensureObjState (const char *id);
+   void check (tools::CommonLineInfo *info, const char *id);
+
+protected:
+   void ownFinish ();
+
+public:
+   ObjCheckController ();
+   ~ObjCheckController ();
+
+   inline long getNumInvalidAccesses ()
+   { return numNeverCreated + numUsedAfterDelete; }
+
+   void objMsg (tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+   void objEnter (tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (tools::CommonLineInfo *info);
+   void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
+                const char *val);
+   void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (tools::CommonLineInfo *info, const char *id);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJCHECK_CONTROLLER_HH__
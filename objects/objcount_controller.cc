@@ -18,6 +18,12 @@
  */
 
 #include "objcount_controller.hh"
+#include "common/lines.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
 
 using namespace rtfl::tools;
 
@@ -25,54 +31,186 @@ namespace rtfl {
 
 namespace objects {
 
+const double ObjCountController::CSV_CHECK_SECS = 0.2;
+
+volatile sig_atomic_t ObjCountController::snapshotRequested = 0;
+
+ObjCountController::ObjCountController (ObjCounter *counter)
+{
+   this->counter = counter;
+   csvFile = NULL;
+   snapshotInterval = 0;
+}
+
+/**
+ * \brief Print snapshots of the counts as CSV to \em file, instead of
+ *    showing them.
+ *
+ * A snapshot is printed every \em interval seconds (never, if 0), when
+ * requestSnapshot() has been called, and at the end of the input. Timeouts
+ * are used, so the lines source must already be set.
+ */
+void ObjCountController::setCsvOutput (FILE *file, double interval)
+{
+   csvFile = file;
+   csvInterval = interval;
+   csvStartTime = getCurrentMicros ();
+   csvNextTime = csvStartTime + (long)(interval * 1000000);
+   numCsvSnapshots = 0;
+
+   counter->printCsvHeader (csvFile);
+   fflush (csvFile);
+   addOwnTimeout (interval > 0 && interval < CSV_CHECK_SECS ?
+                  interval : CSV_CHECK_SECS, CSV_TIMEOUT);
+}
+
+/**
+ * \brief Make a new snapshot (see ObjCounter::newSnapshot()) every
+ *    \em interval seconds.
+ *
+ * As for setCsvOutput(), the lines source must already be set.
+ */
+void ObjCountController::setSnapshotInterval (double interval)
+{
+   snapshotInterval = interval;
+   addOwnTimeout (interval, SNAPSHOT_TIMEOUT);
+}
+
+/**
+ * \brief Count the objects created by the commands read from ".rtfl" and
+ *    standard input, without a display, and print snapshots as CSV to
+ *    standard output (see setCsvOutput()); used by rtfl-objcount-csv and
+ *    "rtfl-objcount --stdout".
+ *
+ * A snapshot is also printed on SIGUSR1. Returns the exit status.
+ */
+int ObjCountController::runCsv (double interval, int growthSnapshots,
+                                double snapshotInterval)
+{
+   LinesSourceSequence source (true);
+   int fd = open (".rtfl", O_RDONLY);
+   if (fd != -1)
+      source.add (new BlockingLinesSource (fd));
+   source.add (new BlockingLinesSource (0));
+
+   ObjCounter counter;
+   counter.setGrowthSnapshots (growthSnapshots);
+   ObjCountController controller (&counter);
+   ObjectsParser parser (&controller);
+
+   // Print a snapshot on SIGUSR1. (No SA_RESTART, so that select(2) is
+   // interrupted.)
+   struct sigaction sa;
+   memset (&sa, 0, sizeof (sa));
+   sa.sa_handler = requestSnapshot;
+   sigaction (SIGUSR1, &sa, NULL);
+
+   // The timeouts for CSV output are passed to the source.
+   parser.setLinesSource (&source);
+   controller.setCsvOutput (stdout, interval);
+   if (snapshotInterval > 0)
+      controller.setSnapshotInterval (snapshotInterval);
+   source.setup (&parser);
+
+   return 0;
+}
+
+/**
+ * \brief Request a snapshot for CSV output; may be used as a signal handler.
+ */
+void ObjCountController::requestSnapshot (int sig)
+{
+   snapshotRequested = 1;
+}
+
+void ObjCountController::printCsvSnapshot ()
+{
+   numCsvSnapshots++;
+   counter->printCsv (csvFile, numCsvSnapshots,
+                      (getCurrentMicros () - csvStartTime) / 1e6);
+   fflush (csvFile);
+}
+
+void ObjCountController::ownTimeout (int type)
+{
+   if (type == CSV_TIMEOUT) {
+      long now = getCurrentMicros ();
+      bool due = csvInterval > 0 && now >= csvNextTime;
+
+      if (snapshotRequested || due) {
+         snapshotRequested = 0;
+         printCsvSnapshot ();
+      }
+
+      if (due) {
+         // Skip intervals which have been missed, e. g. while a long
+         // sequence of lines has been processed.
+         while (csvNextTime <= now)
+            csvNextTime += (long)(csvInterval * 1000000);
+      }
+
+      addOwnTimeout (csvInterval > 0 && csvInterval < CSV_CHECK_SECS ?
+                     csvInterval : CSV_CHECK_SECS, CSV_TIMEOUT);
+   } else if (type == SNAPSHOT_TIMEOUT) {
+      counter->newSnapshot ();
+      addOwnTimeout (snapshotInterval, SNAPSHOT_TIMEOUT);
+   }
+}
+
+void ObjCountController::ownFinish ()
+{
+   if (csvFile)
+      printCsvSnapshot ();
+}
+
 void ObjCountController::objMsg (CommonLineInfo *info, const char *id,
                                  const char *aspect, int prio,
                                  const char *message)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objMark (CommonLineInfo *info, const char *id,
                                   const char *aspect, int prio,
                                   const char *message)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
    void ObjCountController::objMsgStart (CommonLineInfo *info, const char *id)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objMsgEnd (CommonLineInfo *info, const char *id)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objEnter (CommonLineInfo *info, const char *id,
                                    const char *aspect, int prio,
                                    const char *funname, const char *args)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objLeave (CommonLineInfo *info, const char *id,
                                    const char *vals)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objCreate (CommonLineInfo *info, const char *id,
                                     const char *klass)
 {
-   table->createObject (id, klass);
+   counter->createObject (id, klass);
 }
 
 void ObjCountController::objIdent (CommonLineInfo *info, const char *id1,
                                    const char *id2)
 {
    // TODO Is this not done by ObjdentController?
-   table->addIdentity (id1, id2);
+   counter->addIdentity (id1, id2);
 }
 
 void ObjCountController::objNoIdent (CommonLineInfo *info)
@@ -82,31 +220,31 @@ void ObjCountController::objNoIdent (CommonLineInfo *info)
 void ObjCountController::objAssoc (CommonLineInfo *info, const char *parent,
                                    const char *child)
 {
-   table->registerObject (parent);
-   table->registerObject (child);
+   counter->registerObject (parent);
+   counter->registerObject (child);
 }
 
 void ObjCountController::objSet (CommonLineInfo *info, const char *id,
                                  const char *var, const char *val)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
 
 void ObjCountController::objClassColor (CommonLineInfo *info, const char *klass,
                                         const char *color)
 {
-   table->setClassColor (klass, color);
+   // Class colors are not used.
 }
 
 void ObjCountController::objObjectColor (CommonLineInfo *info, const char *id,
                                          const char *color)
 {
-   table->registerObject (id);
+   counter->registerObject (id);
 }
    
 void ObjCountController::objDelete (CommonLineInfo *info, const char *id)
 {
-   table->deleteObject (id);
+   counter->deleteObject (id);
 }
 
 } // namespace objects
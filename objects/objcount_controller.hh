@@ -2,7 +2,9 @@
 #define __OBJECTS_OBJCOUNT_CONTROLLER_HH__
 
 #include "objects_parser.hh"
-#include "objcount_window.hh"
+#include "objcount_counter.hh"
+
+#include <signal.h>
 
 namespace rtfl {
 
@@ -11,10 +13,34 @@ namespace objects {
 class ObjCountController: public ObjectsControllerBase
 {
 private:
-   ObjCountTable *table;
+   // For CSV output (see setCsvOutput()): how often to check whether a
+   // snapshot is due.
+   enum { CSV_TIMEOUT = 0, SNAPSHOT_TIMEOUT = 1 };
+   static const double CSV_CHECK_SECS;
+
+   static volatile sig_atomic_t snapshotRequested;
+
+   ObjCounter *counter;
+   FILE *csvFile;
+   double csvInterval;
+   long csvStartTime, csvNextTime;
+   int numCsvSnapshots;
+   double snapshotInterval;
+
+   void printCsvSnapshot ();
+
+protected:
+   void ownTimeout (int type);
+   void ownFinish ();
 
 public:
-   ObjCountController (ObjCountTable *table) { this->table = table; }
+   ObjCountController (ObjCounter *counter);
+
+   void setCsvOutput (FILE *file, double interval);
+   void setSnapshotInterval (double interval);
+   static void requestSnapshot (int sig);
+   static int runCsv (double interval, int growthSnapshots,
+                      double snapshotInterval);
 
    void objMsg (tools::CommonLineInfo *info, const char *id,
                 const char *aspect, int prio, const char *message);
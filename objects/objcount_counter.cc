@@ -0,0 +1,341 @@
+/*
+ * RTFL
+ *
+ * Copyright 2013-2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objcount_counter.hh"
+
+#include <string.h>
+
+using namespace lout::container::typed;
+using namespace lout::object;
+using namespace lout::misc;
+
+namespace rtfl {
+
+namespace objects {
+
+ObjCounter::Class::Class (const char *name, int serial)
+{
+   this->name = strdup (name);
+   this->serial = serial;
+   count = 0;
+   growing = false;
+}
+
+
+ObjCounter::Class::~Class ()
+{
+   free (name);
+}
+
+
+int ObjCounter::Class::compareTo(Comparable *other)
+{
+   return strcmp (name, ((Class*)other)->name);
+}
+
+
+// ----------------------------------------------------------------------
+
+
+int ObjCounter::Object::classSernoGlobal = 0;
+
+
+ObjCounter::Object::Object (Class *klass)
+{
+   setClass (klass);
+   refCount = 0;
+}
+
+
+ObjCounter::Object::~Object ()
+{
+}
+
+
+void ObjCounter::Object::setClass (Class *klass)
+{
+   this->klass = klass;
+   classSerno = classSernoGlobal++;
+}
+
+
+// ----------------------------------------------------------------------
+
+
+ObjCounter::ObjectRef::ObjectRef (rtfl::objects::ObjCounter::Object *object)
+{
+   this->object = object;
+   object->ref ();
+}
+
+
+ObjCounter::ObjectRef::~ObjectRef ()
+{
+   object->unref ();
+}
+
+
+// ----------------------------------------------------------------------
+
+
+ObjCounter::ObjCounter ()
+{
+   listener = NULL;
+   growthSnapshots = 0;
+
+   objects = new HashTable<String, ObjectRef> (true, true);
+   identities = new HashTable<String, String> (true, true);
+   identitiesRev = new HashTable<String, String> (false, false);
+   classes = new HashTable<String, Class> (true, false);
+   classesList = new Vector<Class> (1, true);
+
+   ensureClass ("<unknown>");
+}
+
+
+ObjCounter::~ObjCounter ()
+{
+   delete objects;
+   delete identitiesRev;
+   delete identities;
+   delete classes;
+   delete classesList;
+}
+
+
+ObjCounter::Class *ObjCounter::ensureClass (const char *className)
+{
+   String key (className);
+   Class *klass = classes->get (&key);
+
+   if (klass == NULL) {
+      klass = new Class (className, classesBySerial.size ());
+      classesBySerial.increase ();
+      classesBySerial.setLast (klass);
+      classes->put (new String (className), klass);
+      classesList->insert (klass, classesList->bsearch (klass, false));
+   }
+
+   return klass;
+}
+
+void ObjCounter::createObject (const char *id, const char *className)
+{
+   Class *klass = ensureClass (className);
+
+   String key (id);
+   ObjectRef *objectRef = objects->get (&key);
+
+   if (objectRef != NULL) {
+      objectRef->object->getClass()->remove ();
+      objectRef->object->setClass (klass);
+   } else {
+      rtfl::objects::ObjCounter::Object *object;
+      String *id2 = identities->get (&key);
+      if (id2) {
+         ObjectRef *objRef2 = objects->get (id2);
+         assert (objRef2 != NULL);
+         object = objRef2->object;
+      } else
+         object = new rtfl::objects::ObjCounter::Object (klass);
+         
+      objectRef = new ObjectRef (object);
+      objects->put (new String (id), objectRef);
+   }
+
+   klass->create ();
+   changed ();
+}
+
+
+void ObjCounter::deleteObject (const char *id)
+{
+   String key (id);
+   ObjectRef *objectRef = objects->get (&key);
+   if (objectRef != NULL) {
+      objectRef->object->getClass()->remove ();
+      changed ();
+
+      objects->remove (&key);
+
+      String *key2 = identities->get (&key);
+      if (key2) {
+         identitiesRev->remove (key2);
+         identities->remove (&key);
+      } else {
+         key2 = identitiesRev->get (&key);
+         if (key2) {
+            identitiesRev->remove (&key);
+            identities->remove (key2);
+         }
+      }
+   }
+}
+
+
+void ObjCounter::registerObject (const char *id)
+{
+   String key (id);
+   if (!objects->contains (&key))
+      createObject (id, "<unknown>");
+}
+
+
+void ObjCounter::addIdentity (const char *id1, const char *id2)
+{
+   if (strcmp (id1, id2) != 0) {
+      // Note: An ObjectRef (which is != NULL) points always to an Object.
+      String key1 (id1), key2 (id2);
+      ObjectRef *objRef1 = objects->get (&key1),
+         *objRef2 = objects->get (&key2);
+
+      if (objRef1 == NULL && objRef2 == NULL) {
+         // Neither defined: create both.
+         registerObject (id1);
+         insertIdentity (id2, id1);
+         registerObject (id2);
+      } else if (objRef1 == NULL) {
+         // First not defined, but second: create from second.
+         insertIdentity (id2, id1);
+         registerObject (id2);
+      } else if (objRef2 == NULL) {
+         // Vice versa.
+         insertIdentity (id1, id2);
+         registerObject (id1);
+      } else {
+         // Both already defined ...
+         if (objRef1->object == objRef2->object)
+            // ... for same object: caller's fault.
+            fprintf (stderr, "WARNING: Identity of '%s' and '%s' added twice.",
+                     id1, id2);
+         else {
+            // ... for different objects.
+            if (objRef1->object->getClassSerno () >
+                objRef2->object->getClassSerno ()) {
+               // Class definition of first object more recent, so assign it to
+               // second.
+               objRef2->object->getClass()->remove ();
+               objRef2->object->unref ();
+               objRef2->object = objRef1->object;
+               objRef2->object->ref ();
+            } else {
+               // Vice versa.
+               objRef1->object->getClass()->remove ();
+               objRef1->object->unref ();
+               objRef1->object = objRef2->object;
+               objRef1->object->ref ();
+            }
+            changed ();
+         }
+      }
+   }
+}
+
+
+void ObjCounter::insertIdentity (const char *id1, const char *id2)
+{
+   String *s1 = new String (id1), *s2 = new String (id2);
+   identities->put (s1, s2);
+   identitiesRev->put (s2, s1);  
+}
+
+
+void ObjCounter::newSnapshot ()
+{
+   SimpleVector<int> counts (classesBySerial.size ());
+   counts.setSize (classesBySerial.size ());
+   for (int i = 0; i < classesBySerial.size (); i++)
+      counts.set (i, classesBySerial.get(i)->count);
+   snapshots.add (counts.getArray (), counts.size ());
+
+   if (growthSnapshots > 0)
+      findGrowingClasses ();
+   changed ();
+}
+
+
+/**
+ * \brief Mark classes as growing (see isGrowing()) when their counts grew
+ *    over the last \em numSnapshots snapshots (only those which are not the
+ *    current state); 0 means never.
+ *
+ * See SnapshotStore::findGrowing() for details. Updated with each new
+ * snapshot.
+ */
+void ObjCounter::setGrowthSnapshots (int numSnapshots)
+{
+   growthSnapshots = numSnapshots;
+   findGrowingClasses ();
+   changed ();
+}
+
+
+void ObjCounter::findGrowingClasses ()
+{
+   SimpleVector<bool> growing (classesBySerial.size ());
+   if (growthSnapshots > 0)
+      snapshots.findGrowing (growthSnapshots, &growing);
+
+   for (int i = 0; i < classesBySerial.size (); i++)
+      classesBySerial.get(i)->growing = i < growing.size () && growing.get (i);
+}
+
+
+void ObjCounter::printCsvHeader (FILE *file)
+{
+   fprintf (file, "snapshot,time,class,count%s\n",
+            growthSnapshots > 0 ? ",growing" : "");
+}
+
+
+/**
+ * \brief Print the current counts of all classes, one line per class.
+ *
+ * Each line starts with \em number and \em secs (the time of the snapshot).
+ * With setGrowthSnapshots(), a column "growing" (0 or 1) is added.
+ * Class names containing commas or quotes (like template instances) are
+ * quoted as defined by RFC 4180.
+ */
+void ObjCounter::printCsv (FILE *file, int number, double secs)
+{
+   for (int i = 0; i < classesList->size (); i++) {
+      Class *klass = classesList->get (i);
+      fprintf (file, "%d,%.3f,", number, secs);
+
+      if (strpbrk (klass->name, ",\"\n")) {
+         fputc ('"', file);
+         for (const char *s = klass->name; *s; s++) {
+            if (*s == '"')
+               fputc ('"', file);
+            fputc (*s, file);
+         }
+         fputc ('"', file);
+      } else
+         fputs (klass->name, file);
+
+      if (growthSnapshots > 0)
+         fprintf (file, ",%d,%d\n", klass->count, klass->growing ? 1 : 0);
+      else
+         fprintf (file, ",%d\n", klass->count);
+   }
+}
+
+} // namespace objects
+
+} // namespace rtfl
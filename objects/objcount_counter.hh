@@ -0,0 +1,141 @@
+#ifndef __OBJECTS_OBJCOUNT_COUNTER_HH__
+#define __OBJECTS_OBJCOUNT_COUNTER_HH__
+
+#include <stdio.h>
+
+#include "lout/object.hh"
+#include "lout/container.hh"
+#include "lout/misc.hh"
+#include "objcount_snapshots.hh"
+
+namespace rtfl {
+
+namespace objects {
+
+class ObjCounterListener
+{
+public:
+   /**
+    * \brief Called after any change of the counts, or when a class has been
+    *    added.
+    *
+    * Called very often; implementations should only remember that something
+    * has changed.
+    */
+   virtual void countsChanged () = 0;
+};
+
+/**
+ * \brief Counts the instances of each class, as shown by rtfl-objcount.
+ *
+ * Independent of any display, so that it can also be used without one (see
+ * printCsv()). Past snapshots are kept in a SnapshotStore; the last snapshot
+ * is the current state.
+ */
+class ObjCounter
+{
+private:
+   class Class: public lout::object::Comparable
+   {
+   public:
+      char *name;
+      // Number in the order of creation, used in the SnapshotStore.
+      int serial;
+      int count;
+      bool growing;
+
+      Class (const char *name, int serial);
+      ~Class ();
+
+      int compareTo(Comparable *other);
+      
+      inline void create () { count++; }
+      inline void remove () { count--; }
+   };
+
+   class Object: public lout::object::Object
+   {
+   private:
+      static int classSernoGlobal;
+
+      Class *klass;
+      int classSerno;
+      int refCount;
+
+      ~Object ();
+
+   public:
+      Object (Class *klass);
+      
+      inline void ref () { refCount++; }
+      inline void unref () { if (--refCount == 0) delete this; }
+
+      inline Class *getClass () { return klass; }
+      void setClass (Class *klass);
+      inline int getClassSerno () { return classSerno; }
+   };
+
+   class ObjectRef: public lout::object::Object
+   {
+   public:
+      rtfl::objects::ObjCounter::Object *object;
+
+      ObjectRef (rtfl::objects::ObjCounter::Object *object);
+      ~ObjectRef ();
+   };
+
+   ObjCounterListener *listener;
+   SnapshotStore snapshots;
+   int growthSnapshots;
+
+   lout::container::typed::HashTable<lout::object::String, ObjectRef> *objects;
+   lout::container::typed::HashTable<lout::object::String, lout::object::String>
+      *identities, *identitiesRev;
+   lout::container::typed::HashTable<lout::object::String, Class> *classes;
+   // Sorted by name. Positions are not stored in the classes, so adding a
+   // class is a binary search and one insertion.
+   lout::container::typed::Vector<Class> *classesList;
+   lout::misc::SimpleVector<Class*> classesBySerial;
+
+   Class *ensureClass (const char *className);
+   void insertIdentity (const char *id1, const char *id2);
+   void findGrowingClasses ();
+   inline void changed () { if (listener) listener->countsChanged (); }
+
+public:
+   ObjCounter ();
+   ~ObjCounter ();
+
+   inline void setListener (ObjCounterListener *listener)
+   { this->listener = listener; }
+
+   void createObject (const char *id, const char *className);
+   void deleteObject (const char *id);
+   void registerObject (const char *id);
+   void addIdentity (const char *id1, const char *id2);
+   void newSnapshot ();
+   void setGrowthSnapshots (int numSnapshots);
+
+   inline int getNumClasses () { return classesList->size (); }
+   inline int getNumSnapshots () { return snapshots.size () + 1; }
+   inline const char *getClassName (int index)
+   { return classesList->get(index)->name; }
+   inline bool isGrowing (int index)
+   { return classesList->get(index)->growing; }
+
+   inline int getCount (int index, int snapshot)
+   {
+      Class *klass = classesList->get(index);
+      return snapshot == snapshots.size () ?
+         klass->count : snapshots.getCount (snapshot, klass->serial);
+   }
+
+   void printCsvHeader (FILE *file);
+   void printCsv (FILE *file, int number, double secs);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJCOUNT_COUNTER_HH__
@@ -0,0 +1,182 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objcount_snapshots.hh"
+
+using namespace lout::misc;
+
+namespace rtfl {
+
+namespace objects {
+
+SnapshotStore::SnapshotStore (): data (1024), offsets (64), numClasses (64)
+{
+   for (int i = 0; i < CACHE_SIZE; i++) {
+      cache[i].column = -1;
+      cache[i].counts = new SimpleVector<int> (64);
+   }
+   nextCached = 0;
+}
+
+SnapshotStore::~SnapshotStore ()
+{
+   for (int i = 0; i < CACHE_SIZE; i++)
+      delete cache[i].counts;
+}
+
+/**
+ * \brief Add a column with the counts of classes 0 to \em numClasses - 1.
+ *
+ * \em numClasses must not be less than for the last column.
+ */
+void SnapshotStore::add (const int *counts, int numClasses)
+{
+   int column = size ();
+   offsets.increase ();
+   offsets.setLast (data.size ());
+   this->numClasses.increase ();
+   this->numClasses.setLast (numClasses);
+
+   if (column % KEY_INTERVAL == 0) {
+      for (int i = 0; i < numClasses; i++)
+         putVarint (zigzag (counts[i]));
+   } else {
+      for (int i = 0; i < numClasses; i++) {
+         int last = i < lastCounts.size () ? lastCounts.get (i) : 0;
+         putVarint (zigzag (counts[i] - last));
+      }
+   }
+
+   lastCounts.setSize (numClasses);
+   for (int i = 0; i < numClasses; i++)
+      lastCounts.set (i, counts[i]);
+}
+
+SimpleVector<int> *SnapshotStore::findCached (int column)
+{
+   for (int i = 0; i < CACHE_SIZE; i++)
+      if (cache[i].column == column)
+         return cache[i].counts;
+   return NULL;
+}
+
+/**
+ * \brief Return the counts of one column, decoded.
+ *
+ * The result is only valid until the next call of getColumn(); copy it if
+ * it is needed longer.
+ */
+SimpleVector<int> *SnapshotStore::getColumn (int column)
+{
+   SimpleVector<int> *counts = findCached (column);
+   if (counts)
+      return counts;
+
+   // Start from the previous column, if cached, otherwise from the last key
+   // column.
+   SimpleVector<int> *previous =
+      column % KEY_INTERVAL == 0 ? NULL : findCached (column - 1);
+   int start = previous ? column : column - column % KEY_INTERVAL;
+
+   // Never evict the column decoded from.
+   if (previous && cache[nextCached].counts == previous)
+      nextCached = (nextCached + 1) % CACHE_SIZE;
+   CachedColumn *entry = &cache[nextCached];
+   nextCached = (nextCached + 1) % CACHE_SIZE;
+   entry->column = column;
+   counts = entry->counts;
+
+   if (previous) {
+      counts->setSize (previous->size ());
+      for (int i = 0; i < previous->size (); i++)
+         counts->set (i, previous->get (i));
+   } else
+      counts->setSize (0);
+
+   for (int c = start; c <= column; c++) {
+      const unsigned char *p = data.getArray () + offsets.get (c);
+      int n = numClasses.get (c);
+      counts->setSize (n, 0);
+
+      if (c % KEY_INTERVAL == 0) {
+         for (int i = 0; i < n; i++)
+            counts->set (i, unzigzag (getVarint (&p)));
+      } else {
+         for (int i = 0; i < n; i++)
+            *(counts->getRef (i)) += unzigzag (getVarint (&p));
+      }
+   }
+
+   return counts;
+}
+
+int SnapshotStore::getCount (int column, int klass)
+{
+   SimpleVector<int> *counts = getColumn (column);
+   return klass < counts->size () ? counts->get (klass) : 0;
+}
+
+/**
+ * \brief Find the classes whose counts grew over the last \em numColumns
+ *    columns: never decreased, and are larger in the last column than in the
+ *    first one.
+ *
+ * This is the typical sign of a leak. \em growing is set to one flag per
+ * class (of the last column).
+ */
+void SnapshotStore::findGrowing (int numColumns, SimpleVector<bool> *growing)
+{
+   int last = size () - 1;
+   int first = last - numColumns + 1;
+   if (first < 0)
+      first = 0;
+
+   growing->setSize (0);
+   if (last < 1 || first == last)
+      return;
+
+   growing->setSize (numClasses.get (last), true);
+
+   // Copies, since the results of getColumn() are overwritten by later
+   // calls.
+   SimpleVector<int> firstCounts (*getColumn (first));
+   SimpleVector<int> previous (firstCounts);
+   for (int c = first + 1; c <= last; c++) {
+      SimpleVector<int> *counts = getColumn (c);
+      for (int i = 0; i < counts->size (); i++) {
+         int prev = i < previous.size () ? previous.get (i) : 0;
+         if (counts->get (i) < prev)
+            growing->set (i, false);
+      }
+
+      previous.setSize (counts->size ());
+      for (int i = 0; i < counts->size (); i++)
+         previous.set (i, counts->get (i));
+   }
+
+   for (int i = 0; i < growing->size (); i++) {
+      int firstCount = i < firstCounts.size () ? firstCounts.get (i) : 0;
+      if (growing->get (i) && previous.get (i) <= firstCount)
+         growing->set (i, false);
+   }
+}
+
+} // namespace objects
+
+} // namespace rtfl
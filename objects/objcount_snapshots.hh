@@ -0,0 +1,90 @@
+#ifndef __OBJECTS_OBJCOUNT_SNAPSHOTS_HH__
+#define __OBJECTS_OBJCOUNT_SNAPSHOTS_HH__
+
+#include "lout/misc.hh"
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief The counts of all classes at all snapshots, stored by column.
+ *
+ * Each snapshot (column) contains one count per class; classes are
+ * identified by numbers, in the order in which they have been added, so a
+ * column does not change when classes are added later (and classes not yet
+ * contained in a column have the count 0 there).
+ *
+ * Counts are stored as variable length integers. Every KEY_INTERVAL-th
+ * column contains the counts themselves, the others the differences to the
+ * previous column (zigzag encoded), so that, for unchanged counts, one byte
+ * per class is needed. Decoded columns are cached, so that reading adjacent
+ * columns, or many counts of one column, is cheap.
+ */
+class SnapshotStore
+{
+private:
+   enum { KEY_INTERVAL = 64, CACHE_SIZE = 16 };
+
+   struct CachedColumn
+   {
+      int column;
+      lout::misc::SimpleVector<int> *counts;
+   };
+
+   lout::misc::SimpleVector<unsigned char> data;
+   // Offset in data and number of classes, for each column.
+   lout::misc::SimpleVector<int> offsets, numClasses;
+   // Counts of the last column, to calculate the differences.
+   lout::misc::SimpleVector<int> lastCounts;
+
+   CachedColumn cache[CACHE_SIZE];
+   int nextCached;
+
+   inline void putVarint (unsigned int value)
+   {
+      while (value >= 0x80) {
+         data.increase ();
+         data.setLast ((value & 0x7f) | 0x80);
+         value >>= 7;
+      }
+      data.increase ();
+      data.setLast (value);
+   }
+
+   static inline unsigned int getVarint (const unsigned char **p)
+   {
+      unsigned int value = 0;
+      for (int shift = 0; ; shift += 7) {
+         unsigned char c = *((*p)++);
+         value |= (unsigned int)(c & 0x7f) << shift;
+         if ((c & 0x80) == 0)
+            return value;
+      }
+   }
+
+   static inline unsigned int zigzag (int n)
+   { return ((unsigned int)n << 1) ^ (unsigned int)(n >> 31); }
+   static inline int unzigzag (unsigned int n)
+   { return (int)(n >> 1) ^ -(int)(n & 1); }
+
+   lout::misc::SimpleVector<int> *findCached (int column);
+
+public:
+   SnapshotStore ();
+   ~SnapshotStore ();
+
+   void add (const int *counts, int numClasses);
+   inline int size () { return offsets.size (); }
+   inline long getDataSize () { return data.size (); }
+
+   lout::misc::SimpleVector<int> *getColumn (int column);
+   int getCount (int column, int klass);
+   void findGrowing (int numColumns, lout::misc::SimpleVector<bool> *growing);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJCOUNT_SNAPSHOTS_HH__
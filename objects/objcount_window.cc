@@ -32,93 +32,6 @@ namespace rtfl {
 
 namespace objects {
 
-ObjCountTable::Class::Class (const char *name)
-{
-   this->name = strdup (name);
-   count = new lout::misc::SimpleVector<int> (1);
-   count->increase ();
-   *(count->getLastRef()) = 0;
-}
-
-
-ObjCountTable::Class::~Class ()
-{
-   free (name);
-   delete count;
-}
-
-
-int ObjCountTable::Class::compareTo(Comparable *other)
-{
-   return strcmp (name, ((Class*)other)->name);
-}
-
-
-void ObjCountTable::Class::create ()
-{
-   (*(count->getLastRef()))++;
-}
-
-
-void ObjCountTable::Class::remove ()
-{
-   (*(count->getLastRef()))--;
-}
-
-
-void ObjCountTable::Class::newSnapshot ()
-{
-   int c = *(count->getLastRef());
-   count->increase ();
-   *(count->getLastRef()) = c;
-}
-
-
-// ----------------------------------------------------------------------
-
-
-int ObjCountTable::Object::classSernoGlobal = 0;
-
-
-ObjCountTable::Object::Object (Class *klass)
-{
-   setClass (klass);
-   refCount = 0;
-}
-
-
-ObjCountTable::Object::~Object ()
-{
-}
-
-
-void ObjCountTable::Object::setClass (Class *klass)
-{
-   this->klass = klass;
-   classSerno = classSernoGlobal++;
-}
-
-
-// ----------------------------------------------------------------------
-
-
-ObjCountTable::ObjectRef::ObjectRef (rtfl::objects::ObjCountTable::Object
-                                     *object)
-{
-   this->object = object;
-   object->ref ();
-}
-
-
-ObjCountTable::ObjectRef::~ObjectRef ()
-{
-   object->unref ();
-}
-
-
-// ----------------------------------------------------------------------
-
-
 ObjCountTable::ObjCountTable (int x, int y, int width, int height,
                               const char *label) :
    Fl_Table (x, y, width, height, label)
@@ -136,23 +49,19 @@ ObjCountTable::ObjCountTable (int x, int y, int width, int height,
 
    end();
 
-   objects = new HashTable<String, ObjectRef> (true, true);
-   identities = new HashTable<String, String> (true, true);
-   identitiesRev = new HashTable<String, String> (false, false);
-   classes = new HashTable<String, Class> (true, false);
-   classesList = new Vector<Class> (1, true);
+   counter = new ObjCounter ();
+   counter->setListener (this);
+   redrawPending = false;
 
-   ensureClass ("<unknown>");
+   rows (counter->getNumClasses ());
 }
 
 
 ObjCountTable::~ObjCountTable()
 {
-   delete objects;
-   delete identitiesRev;
-   delete identities;
-   delete classes;
-   delete classesList;
+   if (redrawPending)
+      Fl::remove_timeout (redrawTimeout, this);
+   delete counter;
 }
 
 
@@ -165,9 +74,14 @@ void ObjCountTable::draw_cell (TableContext context, int row, int col, int x,
 
    case CONTEXT_ROW_HEADER:
       fl_push_clip (x, y, width, height);
-      fl_draw_box (FL_THIN_UP_BOX, x, y, width, height, row_header_color ());
+      // Classes which may leak (see ObjCounter::setGrowthSnapshots) are
+      // highlighted.
+      fl_draw_box (FL_THIN_UP_BOX, x, y, width, height,
+                   counter->isGrowing (row) ?
+                   fl_rgb_color (0xff, 0xa0, 0xa0) : row_header_color ());
       fl_color (FL_BLACK);
-      fl_draw (classesList->get(row)->name, x, y, width, height, FL_ALIGN_LEFT);
+      fl_draw (counter->getClassName (row), x, y, width, height,
+               FL_ALIGN_LEFT);
       fl_pop_clip ();
       break;
 
@@ -177,7 +91,7 @@ void ObjCountTable::draw_cell (TableContext context, int row, int col, int x,
       fl_rectf (x, y, width, height);
       fl_color (FL_BLACK);
       char buf[6];
-      snprintf (buf, 6, "%d", classesList->get(row)->count->get (col));
+      snprintf (buf, 6, "%d", counter->getCount (row, col));
       fl_draw (buf, x, y, width, height, FL_ALIGN_RIGHT);
       fl_pop_clip ();
       break;
@@ -189,162 +103,35 @@ void ObjCountTable::draw_cell (TableContext context, int row, int col, int x,
 }
 
 
-ObjCountTable::Class *ObjCountTable::ensureClass (const char *className)
+void ObjCountTable::countsChanged ()
 {
-   String key (className);
-   Class *klass = classes->get (&key);
-
-   if (klass == NULL) {
-      klass = new Class (className);
-      classes->put (new String (className), klass);
-
-      int i = classesList->bsearch (klass, false);
-      classesList->insert (klass, i);
-      for (int j = i; j < classesList->size (); j++)
-         classesList->get(j)->index = j;
-
-      rows (rows () + 1);
+   if (!redrawPending) {
+      redrawPending = true;
+      Fl::add_timeout (1.0 / FRAME_RATE, redrawTimeout, this);
    }
-
-   return klass;
 }
 
-void ObjCountTable::createObject (const char *id, const char *className)
-{
-   Class *klass = ensureClass (className);
-
-   String key (id);
-   ObjectRef *objectRef = objects->get (&key);
-
-   if (objectRef != NULL) {
-      objectRef->object->getClass()->remove ();
-      objectRef->object->setClass (klass);
-   } else {
-      rtfl::objects::ObjCountTable::Object *object;
-      String *id2 = identities->get (&key);
-      if (id2) {
-         ObjectRef *objRef2 = objects->get (id2);
-         assert (objRef2 != NULL);
-         object = objRef2->object;
-      } else
-         object = new rtfl::objects::ObjCountTable::Object (klass);
-         
-      objectRef = new ObjectRef (object);
-      objects->put (new String (id), objectRef);
-   }
 
-   klass->create ();
-   damage_zone(klass->index, cols () - 1, klass->index, cols () - 1);
-}
-
-
-void ObjCountTable::deleteObject (const char *id)
-{
-   String key (id);
-   ObjectRef *objectRef = objects->get (&key);
-   if (objectRef != NULL) {
-      objectRef->object->getClass()->remove ();
-      damage_zone(objectRef->object->getClass()->index,cols () - 1,
-                  objectRef->object->getClass()->index, cols () - 1);
-
-      objects->remove (&key);
-
-      String *key2 = identities->get (&key);
-      if (key2) {
-         identitiesRev->remove (key2);
-         identities->remove (&key);
-      } else {
-         key2 = identitiesRev->get (&key);
-         if (key2) {
-            identitiesRev->remove (&key);
-            identities->remove (key2);
-         }
-      }
-   }
-}
-
-
-void ObjCountTable::registerObject (const char *id)
-{
-   String key (id);
-   if (!objects->contains (&key))
-      createObject (id, "<unknown>");
-}
-
-
-void ObjCountTable::addIdentity (const char *id1, const char *id2)
-{
-   if (strcmp (id1, id2) != 0) {
-      // Note: An ObjectRef (which is != NULL) points always to an Object.
-      String key1 (id1), key2 (id2);
-      ObjectRef *objRef1 = objects->get (&key1),
-         *objRef2 = objects->get (&key2);
-
-      if (objRef1 == NULL && objRef2 == NULL) {
-         // Neither defined: create both.
-         registerObject (id1);
-         insertIdentity (id2, id1);
-         registerObject (id2);
-      } else if (objRef1 == NULL) {
-         // First not defined, but second: create from second.
-         insertIdentity (id2, id1);
-         registerObject (id2);
-      } else if (objRef2 == NULL) {
-         // Vice versa.
-         insertIdentity (id1, id2);
-         registerObject (id1);
-      } else {
-         // Both already defined ...
-         if (objRef1->object == objRef2->object)
-            // ... for same object: caller's fault.
-            fprintf (stderr, "WARNING: Identity of '%s' and '%s' added twice.",
-                     id1, id2);
-         else {
-            // ... for different objects.
-            if (objRef1->object->getClassSerno () >
-                objRef2->object->getClassSerno ()) {
-               // Class definition of first object more recent, so assign it to
-               // second.
-               objRef2->object->getClass()->remove ();
-               damage_zone(objRef2->object->getClass()->index,cols () - 1,
-                           objRef2->object->getClass()->index, cols () - 1);
-               objRef2->object->unref ();
-               objRef2->object = objRef1->object;
-               objRef2->object->ref ();
-            } else {
-               // Vice versa.
-               objRef1->object->getClass()->remove ();
-               damage_zone(objRef1->object->getClass()->index,cols () - 1,
-                           objRef1->object->getClass()->index, cols () - 1);
-               objRef1->object->unref ();
-               objRef1->object = objRef2->object;
-               objRef1->object->ref ();
-            }
-         }
-      }
-   }
-}
-
-
-void ObjCountTable::insertIdentity (const char *id1, const char *id2)
+void ObjCountTable::redrawTimeout (void *data)
 {
-   String *s1 = new String (id1), *s2 = new String (id2);
-   identities->put (s1, s2);
-   identitiesRev->put (s2, s1);  
-}
-
+   ObjCountTable *table = (ObjCountTable*)data;
+   table->redrawPending = false;
 
-void ObjCountTable::setClassColor (const char *klass, const char *color)
-{
+   if (table->rows () != table->counter->getNumClasses () ||
+       table->cols () != table->counter->getNumSnapshots ()) {
+      // New rows or columns: everything visible is redrawn anyway.
+      table->rows (table->counter->getNumClasses ());
+      table->cols (table->counter->getNumSnapshots ());
+   } else
+      // Otherwise, only the counts of the last snapshot change.
+      table->damage_zone (table->toprow, table->cols () - 1, table->botrow,
+                          table->cols () - 1);
 }
 
 
 void ObjCountTable::newSnapshot ()
 {
-   for (int i = 0; i < classesList->size (); i++)
-      classesList->get(i)->newSnapshot ();
-
-   cols (cols () + 1);
+   counter->newSnapshot ();
 }
 
 
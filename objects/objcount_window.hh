@@ -4,87 +4,35 @@
 #include <FL/Fl_Window.H>
 #include <FL/Fl_Table.H>
 
-#include "lout/object.hh"
-#include "lout/container.hh"
-#include "lout/misc.hh"
+#include "objcount_counter.hh"
 
 namespace rtfl {
 
 namespace objects {
 
-class ObjCountTable : public Fl_Table
+class ObjCountTable : public Fl_Table, public ObjCounterListener
 {
 private:
-   class Class: public lout::object::Comparable
-   {
-   public:
-      char *name;
-      int index;
-      lout::misc::SimpleVector<int> *count;
-
-      Class (const char *name);
-      ~Class ();
-
-      int compareTo(Comparable *other);
-      
-      void create ();
-      void remove ();
-      void newSnapshot ();
-   };
-
-   class Object: public lout::object::Object
-   {
-   private:
-      static int classSernoGlobal;
-
-      Class *klass;
-      int classSerno;
-      int refCount;
-
-      ~Object ();
-
-   public:
-      Object (Class *klass);
-      
-      inline void ref () { refCount++; }
-      inline void unref () { if (--refCount == 0) delete this; }
-
-      inline Class *getClass () { return klass; }
-      void setClass (Class *klass);
-      inline int getClassSerno () { return classSerno; }
-   };
-
-   class ObjectRef: public lout::object::Object
-   {
-   public:
-      rtfl::objects::ObjCountTable::Object *object;
-
-      ObjectRef (rtfl::objects::ObjCountTable::Object *object);
-      ~ObjectRef ();
-   };
-
-   lout::container::typed::HashTable<lout::object::String, ObjectRef> *objects;
-   lout::container::typed::HashTable<lout::object::String, lout::object::String>
-      *identities, *identitiesRev;
-   lout::container::typed::HashTable<lout::object::String, Class> *classes;
-   lout::container::typed::Vector<Class> *classesList;
-
-   Class *ensureClass (const char *className);
-   void insertIdentity (const char *id1, const char *id2);
+   // Changes are shown at most this often per second, so that a fast input
+   // stream does not cause continuous repainting.
+   enum { FRAME_RATE = 25 };
+
+   ObjCounter *counter;
+   bool redrawPending;
+
+   static void redrawTimeout (void *data);
 
 public:
    ObjCountTable (int x, int y, int width, int height,
                   const char *label = NULL);
    ~ObjCountTable();
 
+   inline ObjCounter *getCounter () { return counter; }
+
    void draw_cell (TableContext context, int row, int col, int x, int y,
                    int width, int height);
 
-   void createObject (const char *id, const char *className);
-   void deleteObject (const char *id);
-   void registerObject (const char *id);
-   void addIdentity (const char *id1, const char *id2);
-   void setClassColor (const char *klass, const char *color);
+   void countsChanged ();
    void newSnapshot ();
    void removeOldestSnapshot ();
 };
@@ -38,165 +38,296 @@ namespace rtfl {
 
 namespace objects {
 
-ObjDeleteController::ObjInfo::ObjInfo (const char *id)
-{
-   numCreated = 0;
-   numDeleted = 0;
-   origId = strdup (id);
-   mappedId = strdup (id);
-}
-
-ObjDeleteController::ObjInfo::~ObjInfo ()
-{
-   free (origId);
-   free (mappedId);
-}
-
-void ObjDeleteController::ObjInfo::use ()
-{
-   numCreated = max (numCreated, 1);
-}
-
-void ObjDeleteController::ObjInfo::objCreate ()
-{
-   numCreated++;
-}
-
-void ObjDeleteController::ObjInfo::objDelete ()
+/**
+ * \brief Returns whether the object is actually deleted (and not only one of
+ *    multiple creations).
+ */
+bool ObjLifecycle::objDelete ()
 {
    numCreated--;
    if (numCreated <= 0) {
       numCreated = 0;
       numDeleted++;
-
-      free (mappedId);
-      mappedId = (char*) malloc ((strlen (origId) + 10 + 1) * sizeof (char));
-      sprintf (mappedId, "%s-%d", origId, numDeleted);
-   }
+      return true;
+   } else
+      return false;
 }
 
-ObjDeleteController::ObjDeleteController (ObjectsController *successor)
-{
-   this->successor = successor;
-   successor->setObjectsSource (this);
-   setObjectsSink (successor);
+// ----------------------------------------------------------------------
 
-   objInfos = new HashTable<String, ObjInfo> (true, true);
-}
-
-ObjDeleteController::~ObjDeleteController ()
+ObjDeleteStageBase::ObjDeleteStageBase ()
 {
-   delete objInfos;
+   hashTable.setSize (MIN_HASH_SIZE, -1);
+   numEntries = 0;
+   firstFree = -1;
+   deadHead = numDead = horizon = 0;
+   deleteSeq = 0;
 }
 
-void ObjDeleteController::objMsg (CommonLineInfo *info, const char *id,
-                                  const char *aspect, int prio,
-                                  const char *message)
+ObjDeleteStageBase::~ObjDeleteStageBase ()
 {
-   successor->objMsg (info, mapId (id), aspect, prio, message);
-}
+   for (int i = 0; i < entries.size (); i++) {
+      Entry *entry = entries.getRef (i);
+      if (entry->id) {
+         free (entry->id);
+         if (entry->longMappedId)
+            free (entry->longMappedId);
+      }
+   }
 
-void ObjDeleteController::objMark (CommonLineInfo *info, const char *id,
-                                   const char *aspect, int prio,
-                                   const char *message)
-{
-   successor->objMark (info, mapId (id), aspect, prio, message);
+   freeBatchIds ();
 }
 
-void ObjDeleteController::objMsgStart (CommonLineInfo *info, const char *id)
+/**
+ * \brief Keep at most `horizon` entries of deleted objects; 0 (the default)
+ *    means no limit.
+ */
+void ObjDeleteStageBase::setHorizon (int horizon)
 {
-   successor->objMsgStart (info, mapId (id));
+   this->horizon = horizon;
+   reclaim ();
 }
 
-void ObjDeleteController::objMsgEnd (CommonLineInfo *info, const char *id)
+/**
+ * \brief Return the id to be passed to the successor for `id`.
+ *
+ * `buf` (with a size of ID_BUF_SIZE) is supplied by the caller; the result
+ * may refer to it, so it is only valid as long as `buf` is.
+ */
+const char *ObjDeleteStageBase::mapId (const char *id, unsigned int h,
+                                       char *buf)
 {
-   successor->objMsgEnd (info, mapId (id));
+   Entry *entry = ensureEntry (id, h);
+   if (isDead (entry))
+      revive (entry);
+   entry->lifecycle.use ();
+
+   int gen = entry->lifecycle.getNumDeleted ();
+   if (gen == 0)
+      return id;
+   else if (snprintf (buf, ID_BUF_SIZE, "%s-%d", id, gen) < ID_BUF_SIZE)
+      return buf;
+   else {
+      // Rare: formatted once per generation, and kept in the entry.
+      if (entry->longMappedId == NULL) {
+         entry->longMappedId =
+            (char*) malloc ((strlen (id) + 10 + 1 + 1) * sizeof (char));
+         sprintf (entry->longMappedId, "%s-%d", id, gen);
+      }
+      return entry->longMappedId;
+   }
 }
 
-void ObjDeleteController::objEnter (CommonLineInfo *info, const char *id,
-                                    const char *aspect, int prio,
-                                    const char *funname, const char *args)
+void ObjDeleteStageBase::createId (const char *id, unsigned int h)
 {
-   successor->objEnter (info, mapId (id), aspect, prio, funname, args);
+   Entry *entry = ensureEntry (id, h);
+   if (isDead (entry))
+      revive (entry);
+   entry->lifecycle.objCreate ();
 }
 
-void ObjDeleteController::objLeave (CommonLineInfo *info, const char *id,
-                                    const char *vals)
+void ObjDeleteStageBase::deleteId (const char *id, unsigned int h)
 {
-   successor->objLeave (info, mapId (id), vals);
+   // (The object has been used before, by mapId(), so it is not dead.)
+   Entry *entry = ensureEntry (id, h);
+   if (entry->lifecycle.objDelete ()) {
+      if (entry->longMappedId) {
+         free (entry->longMappedId);
+         entry->longMappedId = NULL;
+      }
+
+      numDead++;
+      if (horizon > 0) {
+         entry->deleteSeq = ++deleteSeq;
+         dead.increase ();
+         dead.getLastRef()->entry = entry - entries.getArray ();
+         dead.getLastRef()->deleteSeq = deleteSeq;
+         reclaim ();
+      }
+   }
 }
 
-void ObjDeleteController::objCreate (CommonLineInfo *info, const char *id,
-                                     const char *klass)
+/**
+ * \brief Map the ids of all commands of a batch, in place.
+ *
+ * This has the same effect as passing the commands one by one, but the hash
+ * buckets and entries are prefetched for the whole batch before. The mapped
+ * ids are valid until the next call.
+ */
+void ObjDeleteStageBase::mapIds (ObjectsBatch *batch)
 {
-   ensureObjInfo(id)->objCreate ();
-   successor->objCreate (info, mapId (id), klass);
+   int n = batch->size ();
+   freeBatchIds ();
+   batchHashes.setSize (2 * n);
+
+   for (int i = 0; i < n; i++)
+      for (int j = 0; j < 2; j++) {
+         const char *id = batch->getId (batch->get (i), j);
+         if (id) {
+            unsigned int h = hash (id);
+            batchHashes.set (2 * i + j, h);
+            __builtin_prefetch (hashTable.getRef (bucket (h)));
+         }
+      }
+
+   for (int i = 0; i < n; i++)
+      for (int j = 0; j < 2; j++)
+         if (batch->getId (batch->get (i), j)) {
+            int e = hashTable.get (bucket (batchHashes.get (2 * i + j)));
+            if (e != -1)
+               __builtin_prefetch (entries.getRef (e));
+         }
+
+   batchIds.setSize (2 * n * ID_BUF_SIZE);
+   for (int i = 0; i < n; i++) {
+      ObjectsBatch::Command *command = batch->get (i);
+      const char *id0 = batch->getId (command, 0);
+
+      if (command->type == ObjectCommand::CREATE)
+         createId (id0, batchHashes.get (2 * i));
+
+      for (int j = 0; j < 2; j++) {
+         const char *id = batch->getId (command, j);
+         if (id) {
+            char *buf = batchIds.getRef ((2 * i + j) * ID_BUF_SIZE);
+            const char *mapped = mapId (id, batchHashes.get (2 * i + j), buf);
+            if (mapped != id && mapped != buf) {
+               // A long mapped id is freed by deleteId(), so copy it.
+               batchLongIds.increase ();
+               *batchLongIds.getLastRef () = strdup (mapped);
+               mapped = batchLongIds.getLast ();
+            }
+            batch->setId (command, j, mapped);
+         }
+      }
+
+      if (command->type == ObjectCommand::DELETE)
+         deleteId (id0, batchHashes.get (2 * i));
+   }
 }
 
-void ObjDeleteController::objIdent (CommonLineInfo *info, const char *id1,
-                                    const char *id2)
+void ObjDeleteStageBase::freeBatchIds ()
 {
-   successor->objIdent (info, mapId (id1), mapId (id2));
+   for (int i = 0; i < batchLongIds.size (); i++)
+      free (batchLongIds.get (i));
+   batchLongIds.setSize (0);
 }
 
-void ObjDeleteController::objNoIdent (CommonLineInfo *info)
+int ObjDeleteStageBase::lookup (const char *id, unsigned int h)
 {
-   successor->objNoIdent (info);
+   for (int i = hashTable.get (bucket (h)); i != -1;
+        i = entries.getRef(i)->hashNext) {
+      Entry *entry = entries.getRef (i);
+      if (entry->hash == h && strcmp (entry->id, id) == 0)
+         return i;
+   }
+   return -1;
 }
 
-void ObjDeleteController::objAssoc (CommonLineInfo *info, const char *parent,
-                                    const char *child)
+ObjDeleteStageBase::Entry *ObjDeleteStageBase::ensureEntry (const char *id,
+                                                            unsigned int h)
 {
-   successor->objAssoc (info, mapId (parent), mapId (child));
-}
+   int i = lookup (id, h);
+   if (i == -1) {
+      if (firstFree != -1) {
+         i = firstFree;
+         firstFree = entries.getRef(i)->hashNext;
+      } else {
+         i = entries.size ();
+         entries.increase ();
+      }
+
+      Entry *entry = entries.getRef (i);
+      entry->id = strdup (id);
+      entry->longMappedId = NULL;
+      entry->hash = h;
+      entry->lifecycle = ObjLifecycle ();
+      entry->deleteSeq = 0;
+
+      int b = bucket (h);
+      entry->hashNext = hashTable.get (b);
+      hashTable.set (b, i);
+
+      if (++numEntries > hashTable.size ())
+         rehash ();
+   }
 
-void ObjDeleteController::objSet (CommonLineInfo *info, const char *id,
-                                  const char *var, const char *val)
-{
-   successor->objSet (info, mapId (id), var, val);
+   return entries.getRef (i);
 }
 
-void ObjDeleteController::objClassColor (CommonLineInfo *info,
-                                         const char *klass, const char *color)
+/**
+ * \brief Called when a deleted object is used again; its entry in `dead`
+ *    is then outdated.
+ */
+void ObjDeleteStageBase::revive (Entry *entry)
 {
-   successor->objClassColor (info, klass, color);
+   entry->deleteSeq = 0;
+   numDead--;
 }
 
-void ObjDeleteController::objObjectColor (CommonLineInfo *info, const char *id,
-                                          const char *color)
+/**
+ * \brief Free the entries of the oldest deleted objects, as long as there are
+ *    more than allowed by the horizon.
+ */
+void ObjDeleteStageBase::reclaim ()
 {
-   successor->objObjectColor (info, mapId (id), color);
-}
+   while (horizon > 0 && numDead > horizon && deadHead < dead.size ()) {
+      Dead d = dead.get (deadHead++);
+      Entry *entry = entries.getRef (d.entry);
+      if (entry->deleteSeq == d.deleteSeq) {
+         int *link = hashTable.getRef (bucket (entry->hash));
+         while (*link != d.entry)
+            link = &entries.getRef(*link)->hashNext;
+         *link = entry->hashNext;
+
+         free (entry->id);
+         entry->id = NULL;
+         entry->deleteSeq = 0;
+         entry->hashNext = firstFree;
+         firstFree = d.entry;
+         numEntries--;
+         numDead--;
+      }
+   }
 
-void ObjDeleteController::objDelete (CommonLineInfo *info, const char *id)
-{
-   successor->objDelete (info, mapId (id));
-   ensureObjInfo(id)->objDelete ();
+   // Outdated elements of "dead" (objects used again) are skipped above, or
+   // removed here, when they make up the larger part.
+   if (deadHead > dead.size () / 2 ||
+       dead.size () - deadHead > 2 * numDead + 1024) {
+      int n = 0;
+      for (int i = deadHead; i < dead.size (); i++) {
+         Dead d = dead.get (i);
+         if (entries.getRef(d.entry)->deleteSeq == d.deleteSeq)
+            dead.set (n++, d);
+      }
+      dead.setSize (n);
+      deadHead = 0;
+   }
 }
 
-const char *ObjDeleteController::mapId (const char *id)
+void ObjDeleteStageBase::rehash ()
 {
-   ObjInfo *objInfo = ensureObjInfo (id);
-   objInfo->use ();
-   return objInfo->getMappedId ();
+   hashTable.setSize (2 * hashTable.size ());
+   for (int i = 0; i < hashTable.size (); i++)
+      hashTable.set (i, -1);
+
+   for (int i = 0; i < entries.size (); i++) {
+      Entry *entry = entries.getRef (i);
+      if (entry->id) {
+         int b = bucket (entry->hash);
+         entry->hashNext = hashTable.get (b);
+         hashTable.set (b, i);
+      }
+   }
 }
 
-ObjDeleteController::ObjInfo *ObjDeleteController::getObjInfo (const char *id)
-{
-   String key (id);
-   return objInfos->get (&key);
-}
+// ----------------------------------------------------------------------
 
-ObjDeleteController::ObjInfo *ObjDeleteController::ensureObjInfo (const char
-                                                                  *id)
+ObjDeleteController::ObjDeleteController (ObjectsController *successor):
+   ObjDeleteStage<ObjectsController> (successor)
 {
-   ObjInfo *objInfo = getObjInfo (id);
-   if (objInfo == NULL) {
-      objInfo = new ObjInfo (id);
-      objInfos->put (new String (id), objInfo);
-   }
-   return objInfo;
 }
+
  
 } // namespace objects
 
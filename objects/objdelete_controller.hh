@@ -1,7 +1,7 @@
 #ifndef __OBJECTS_OBJDELETE_CONTROLLER_HH__
 #define __OBJECTS_OBJDELETE_CONTROLLER_HH__
 
-#include "objects_parser.hh"
+#include "objects_buffer.hh"
 #include "common/tools.hh"
 
 namespace rtfl {
@@ -9,66 +9,238 @@ namespace rtfl {
 namespace objects {
 
 /**
- * \brief Processes `obj-delete` specially and maps ids of deleted objects to
- *    new ones, if they are reused.
+ * \brief The life cycle of one object id, as defined by `obj-create` and
+ *    `obj-delete`.
+ *
+ * An object may be created multiple times (e. g. by constructors of the
+ * super classes); it is deleted when it has been deleted as often as created.
+ * Used by ObjDeleteController and ObjCheckController.
  */
-class ObjDeleteController: public ObjectsControllerBase
+class ObjLifecycle
 {
 private:
-   class ObjInfo: public lout::object::Object
-   {
-   private:
-      int numCreated, numDeleted;
-      char *origId, *mappedId;
+   int numCreated, numDeleted;
+
+public:
+   inline ObjLifecycle () { numCreated = numDeleted = 0; }
 
-   public:
-      ObjInfo (const char *id);
-      ~ObjInfo ();
+   /** \brief Object is used; if not created, it is implicitly created. */
+   inline void use () { numCreated = lout::misc::max (numCreated, 1); }
+   inline void objCreate () { numCreated++; }
+   bool objDelete ();
 
-      void use ();
-      void objCreate ();
-      void objDelete ();
+   inline bool exists () { return numCreated > 0; }
+   inline bool everExisted () { return numCreated > 0 || numDeleted > 0; }
+   inline int getNumDeleted () { return numDeleted; }
+};
+
+/**
+ * \brief The part of ObjDeleteStage which does not depend on the successor:
+ *    the life cycles of all object ids, and the mapping of ids.
+ *
+ * For each id, a fixed-size entry with the life cycle is kept; the number of
+ * deletions is the generation, which is appended to the id ("<id>-<n>") when
+ * an id is mapped. Mapped ids are formatted on demand into a buffer supplied
+ * by the caller (see mapId()), so no strings are allocated per deletion.
+ *
+ * The ids of a batch of commands (see mapIds()) are mapped together: the hash
+ * values of all ids are calculated first, so that the hash buckets, and then
+ * the entries, can be prefetched, before the ids are looked up in order.
+ *
+ * Entries of deleted objects are needed only when the id is used again. With
+ * a horizon (see setHorizon()), only that many of them are kept; the oldest
+ * are reclaimed. An id used again after its entry has been reclaimed starts
+ * again with generation 0, so it may be confused with an object deleted long
+ * before.
+ */
+class ObjDeleteStageBase: public ObjectsControllerBase
+{
+private:
+   struct Entry
+   {
+      char *id;            // NULL for free entries.
+      char *longMappedId;  // Mapped id, when not fitting into the buffer.
+      unsigned int hash;   // Hash value of the id.
+      ObjLifecycle lifecycle;
+      int hashNext;        // Hash chain, or list of free entries.
+      long deleteSeq;      // When the object has been deleted last.
+   };
 
-      inline const char *getMappedId () { return mappedId; }
+   struct Dead
+   {
+      int entry;
+      long deleteSeq;
    };
-   
-   ObjectsController *successor;
-   lout::container::typed::HashTable<lout::object::String, ObjInfo> *objInfos;
 
-   const char *mapId (const char *id);
-   bool objInfoCreated (const char *id);
-   ObjInfo *getObjInfo (const char *id);
-   ObjInfo *ensureObjInfo (const char *id);
+   enum { MIN_HASH_SIZE = 1024 };
 
-public:   
-   ObjDeleteController (ObjectsController *successor);
-   ~ObjDeleteController ();
+   lout::misc::SimpleVector<Entry> entries;
+   lout::misc::SimpleVector<int> hashTable;
+   int numEntries, firstFree;
+
+   // Deleted objects, oldest first, starting at deadHead; some may be
+   // outdated (used again since).
+   lout::misc::SimpleVector<Dead> dead;
+   int deadHead, numDead, horizon;
+   long deleteSeq;
+
+   // Used by mapIds(): hash values of the ids of the batch, buffers for the
+   // mapped ids, and copies of mapped ids not fitting into the buffers.
+   lout::misc::SimpleVector<unsigned int> batchHashes;
+   lout::misc::SimpleVector<char> batchIds;
+   lout::misc::SimpleVector<char*> batchLongIds;
+
+   inline static unsigned int hash (const char *id)
+   { return lout::object::ConstString::hashValue (id); }
+
+   inline int bucket (unsigned int h)
+   { return (h ^ (h >> 16)) & (hashTable.size () - 1); }
+
+   inline bool isDead (Entry *entry)
+   { return !entry->lifecycle.exists () && entry->lifecycle.everExisted (); }
+
+   int lookup (const char *id, unsigned int h);
+   Entry *ensureEntry (const char *id, unsigned int h);
+   void revive (Entry *entry);
+   void reclaim ();
+   void rehash ();
+
+protected:
+   enum { ID_BUF_SIZE = 64 };
+
+   ObjDeleteStageBase ();
+   ~ObjDeleteStageBase ();
+
+   const char *mapId (const char *id, unsigned int h, char *buf);
+   void createId (const char *id, unsigned int h);
+   void deleteId (const char *id, unsigned int h);
+   void freeBatchIds ();
+
+   inline const char *mapId (const char *id, char *buf)
+   { return mapId (id, hash (id), buf); }
+   inline void createId (const char *id) { createId (id, hash (id)); }
+   inline void deleteId (const char *id) { deleteId (id, hash (id)); }
+
+   void mapIds (ObjectsBatch *batch);
+
+public:
+   void setHorizon (int horizon);
+};
+
+/**
+ * \brief Processes `obj-delete` specially and maps ids of deleted objects to
+ *    new ones, if they are reused.
+ *
+ * The successor is called via `Successor`, so that the calls are not virtual
+ * when `Successor` is a final class (see FinalController). Use
+ * ObjDeleteController for any successor.
+ */
+template <class Successor> class ObjDeleteStage: public ObjDeleteStageBase
+{
+private:
+   Successor *successor;
+
+public:
+   ObjDeleteStage (Successor *successor) {
+      this->successor = successor;
+      successor->setObjectsSource (this);
+      setObjectsSink (successor);
+   }
 
    void objMsg (tools::CommonLineInfo *info, const char *id,
-                const char *aspect, int prio, const char *message);
+                const char *aspect, int prio, const char *message)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objMsg (info, mapId (id, buf), aspect, prio, message);
+   }
    void objMark (tools::CommonLineInfo *info, const char *id,
-                 const char *aspect, int prio, const char *message);
-   void objMsgStart (tools::CommonLineInfo *info, const char *id);
-   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+                 const char *aspect, int prio, const char *message)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objMark (info, mapId (id, buf), aspect, prio, message);
+   }
+   void objMsgStart (tools::CommonLineInfo *info, const char *id)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objMsgStart (info, mapId (id, buf));
+   }
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objMsgEnd (info, mapId (id, buf));
+   }
    void objEnter (tools::CommonLineInfo *info, const char *id,
                   const char *aspect, int prio, const char *funname,
-                  const char *args);
+                  const char *args)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objEnter (info, mapId (id, buf), aspect, prio, funname,
+                           args);
+   }
    void objLeave (tools::CommonLineInfo *info, const char *id,
-                  const char *vals);
+                  const char *vals)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objLeave (info, mapId (id, buf), vals);
+   }
    void objCreate (tools::CommonLineInfo *info, const char *id,
-                   const char *klass);
+                   const char *klass)
+   {
+      char buf[ID_BUF_SIZE];
+      createId (id);
+      successor->objCreate (info, mapId (id, buf), klass);
+   }
    void objIdent (tools::CommonLineInfo *info, const char *id1,
-                  const char *id2);
-   void objNoIdent (tools::CommonLineInfo *info);
+                  const char *id2)
+   {
+      char buf1[ID_BUF_SIZE], buf2[ID_BUF_SIZE];
+      successor->objIdent (info, mapId (id1, buf1), mapId (id2, buf2));
+   }
+   void objNoIdent (tools::CommonLineInfo *info)
+   { successor->objNoIdent (info); }
    void objAssoc (tools::CommonLineInfo *info, const char *parent,
-                  const char *child);
+                  const char *child)
+   {
+      char buf1[ID_BUF_SIZE], buf2[ID_BUF_SIZE];
+      successor->objAssoc (info, mapId (parent, buf1), mapId (child, buf2));
+   }
    void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
-                const char *val);
+                const char *val)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objSet (info, mapId (id, buf), var, val);
+   }
    void objClassColor (tools::CommonLineInfo *info, const char *klass,
-                       const char *color);
+                       const char *color)
+   { successor->objClassColor (info, klass, color); }
    void objObjectColor (tools::CommonLineInfo *info, const char *id,
-                        const char *color);
-   void objDelete (tools::CommonLineInfo *info, const char *id);
+                        const char *color)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objObjectColor (info, mapId (id, buf), color);
+   }
+   void objDelete (tools::CommonLineInfo *info, const char *id)
+   {
+      char buf[ID_BUF_SIZE];
+      successor->objDelete (info, mapId (id, buf));
+      deleteId (id);
+   }
+
+   void objCommands (ObjectsBatch *batch)
+   {
+      mapIds (batch);
+      successor->objCommands (batch);
+   }
+};
+
+/**
+ * \brief ObjDeleteStage for any successor, which is called via virtual
+ *    methods.
+ */
+class ObjDeleteController: public ObjDeleteStage<ObjectsController>
+{
+public:
+   ObjDeleteController (ObjectsController *successor);
 };
 
 } // namespace objects
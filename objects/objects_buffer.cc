@@ -37,9 +37,8 @@ namespace rtfl {
 
 namespace objects {
 
-ObjectsBuffer::ObjectCommand::ObjectCommand (CommandType type,
-                                             CommonLineInfo *info,
-                                             const char *fmt, ...)
+ObjectCommand::ObjectCommand (CommandType type, CommonLineInfo *info,
+                              const char *fmt, ...)
 {
    this->type = type;
    this->info.fileName = strdup (info->fileName);
@@ -69,7 +68,27 @@ ObjectsBuffer::ObjectCommand::ObjectCommand (CommandType type,
    }
 }
 
-ObjectsBuffer::ObjectCommand::~ObjectCommand ()
+ObjectCommand::ObjectCommand (ObjectCommand *other)
+{
+   type = other->type;
+   info.fileName = strdup (other->info.fileName);
+   info.lineNo = other->info.lineNo;
+   info.processId = other->info.processId;
+   info.completeLine = strdup (other->info.completeLine);
+
+   numArgs = other->numArgs;
+   args = new Arg[numArgs];
+
+   for (int i = 0; i < numArgs; i++) {
+      args[i].type = other->args[i].type;
+      if (args[i].type == 's')
+         args[i].s = other->args[i].s ? strdup (other->args[i].s) : NULL;
+      else
+         args[i].d = other->args[i].d;
+   }
+}
+
+ObjectCommand::~ObjectCommand ()
 {
    free (info.fileName);
    free (info.completeLine);
@@ -81,6 +100,127 @@ ObjectsBuffer::ObjectCommand::~ObjectCommand ()
    delete[] args;
 }
 
+// ----------------------------------------------------------------------
+
+ObjectsBatch::Command *ObjectsBatch::add (ObjectCommand::CommandType type,
+                                          CommonLineInfo *info)
+{
+   commands.increase ();
+   Command *command = commands.getLastRef ();
+   command->type = type;
+   command->info = *info;
+   return command;
+}
+
+void ObjectsBatch::objMsg (CommonLineInfo *info, const char *id,
+                           const char *aspect, int prio, const char *message)
+{
+   Command *command = add (ObjectCommand::MSG, info);
+   setS (command, 0, id);
+   setS (command, 1, aspect);
+   setD (command, 2, prio);
+   setS (command, 3, message);
+}
+
+void ObjectsBatch::objMark (CommonLineInfo *info, const char *id,
+                            const char *aspect, int prio, const char *message)
+{
+   Command *command = add (ObjectCommand::MARK, info);
+   setS (command, 0, id);
+   setS (command, 1, aspect);
+   setD (command, 2, prio);
+   setS (command, 3, message);
+}
+
+void ObjectsBatch::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   setS (add (ObjectCommand::MSG_START, info), 0, id);
+}
+
+void ObjectsBatch::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   setS (add (ObjectCommand::MSG_END, info), 0, id);
+}
+
+void ObjectsBatch::objEnter (CommonLineInfo *info, const char *id,
+                             const char *aspect, int prio, const char *funname,
+                             const char *args)
+{
+   Command *command = add (ObjectCommand::ENTER, info);
+   setS (command, 0, id);
+   setS (command, 1, aspect);
+   setD (command, 2, prio);
+   setS (command, 3, funname);
+   setS (command, 4, args);
+}
+
+void ObjectsBatch::objLeave (CommonLineInfo *info, const char *id,
+                             const char *vals)
+{
+   Command *command = add (ObjectCommand::LEAVE, info);
+   setS (command, 0, id);
+   setS (command, 1, vals);
+}
+
+void ObjectsBatch::objCreate (CommonLineInfo *info, const char *id,
+                              const char *klass)
+{
+   Command *command = add (ObjectCommand::CREATE, info);
+   setS (command, 0, id);
+   setS (command, 1, klass);
+}
+
+void ObjectsBatch::objIdent (CommonLineInfo *info, const char *id1,
+                             const char *id2)
+{
+   Command *command = add (ObjectCommand::IDENT, info);
+   setS (command, 0, id1);
+   setS (command, 1, id2);
+}
+
+void ObjectsBatch::objNoIdent (CommonLineInfo *info)
+{
+   add (ObjectCommand::NOIDENT, info);
+}
+
+void ObjectsBatch::objAssoc (CommonLineInfo *info, const char *parent,
+                             const char *child)
+{
+   Command *command = add (ObjectCommand::ASSOC, info);
+   setS (command, 0, parent);
+   setS (command, 1, child);
+}
+
+void ObjectsBatch::objSet (CommonLineInfo *info, const char *id,
+                           const char *var, const char *val)
+{
+   Command *command = add (ObjectCommand::SET, info);
+   setS (command, 0, id);
+   setS (command, 1, var);
+   setS (command, 2, val);
+}
+
+void ObjectsBatch::objClassColor (CommonLineInfo *info, const char *klass,
+                                  const char *color)
+{
+   Command *command = add (ObjectCommand::CLASS_COLOR, info);
+   setS (command, 0, klass);
+   setS (command, 1, color);
+}
+
+void ObjectsBatch::objObjectColor (CommonLineInfo *info, const char *id,
+                                   const char *color)
+{
+   Command *command = add (ObjectCommand::OBJECT_COLOR, info);
+   setS (command, 0, id);
+   setS (command, 1, color);
+}
+
+void ObjectsBatch::objDelete (CommonLineInfo *info, const char *id)
+{
+   setS (add (ObjectCommand::DELETE, info), 0, id);
+}
+
 // ----------------------------------------------------------------------
    
 ObjectsBuffer::ObjectsBuffer (ObjectsController *successor)
@@ -88,7 +228,8 @@ ObjectsBuffer::ObjectsBuffer (ObjectsController *successor)
    this->successor = successor;
    successor->setObjectsSource (this);
 
-   commandsQueue = new Vector<ObjectCommand> (1, true);
+   // Not the owner, so that commands can be moved by pass (Release*).
+   commandsQueue = new Vector<ObjectCommand> (1, false);
    queued = false;
 
    setObjectsSink (successor);
@@ -96,89 +237,96 @@ ObjectsBuffer::ObjectsBuffer (ObjectsController *successor)
 
 ObjectsBuffer::~ObjectsBuffer ()
 {
+   for (int i = 0; i < commandsQueue->size (); i++)
+      delete commandsQueue->get (i);
    delete commandsQueue;
 }
 
 void ObjectsBuffer::objMsg (CommonLineInfo *info, const char *id,
                             const char *aspect, int prio, const char *message)
 {
-   process (new ObjectCommand (MSG, info, "ssds", id, aspect, prio, message));
+   process (new ObjectCommand (ObjectCommand::MSG, info, "ssds", id, aspect,
+                               prio, message));
 }
 
 void ObjectsBuffer::objMark (CommonLineInfo *info, const char *id,
                              const char *aspect, int prio, const char *message)
 {
-   process (new ObjectCommand (MARK, info, "ssds", id, aspect, prio, message));
+   process (new ObjectCommand (ObjectCommand::MARK, info, "ssds", id, aspect,
+                               prio, message));
 }
 
 void ObjectsBuffer::objMsgStart (CommonLineInfo *info, const char *id)
 {
-   process (new ObjectCommand (MSG_START, info, "s", id));
+   process (new ObjectCommand (ObjectCommand::MSG_START, info, "s", id));
 }
 
 void ObjectsBuffer::objMsgEnd (CommonLineInfo *info, const char *id)
 {
-   process (new ObjectCommand (MSG_END, info, "s", id));
+   process (new ObjectCommand (ObjectCommand::MSG_END, info, "s", id));
 }
 
 void ObjectsBuffer::objEnter (CommonLineInfo *info, const char *id,
                               const char *aspect, int prio, const char *funname,
                               const char *args)
 {
-   process (new ObjectCommand (ENTER, info, "ssdss", id, aspect, prio, funname,
-                               args));
+   process (new ObjectCommand (ObjectCommand::ENTER, info, "ssdss", id,
+                               aspect, prio, funname, args));
 }
 
 void ObjectsBuffer::objLeave (CommonLineInfo *info, const char *id,
                               const char *vals)
 {
-   process (new ObjectCommand (LEAVE, info, "ss", id, vals));
+   process (new ObjectCommand (ObjectCommand::LEAVE, info, "ss", id, vals));
 }
 
 void ObjectsBuffer::objCreate (CommonLineInfo *info, const char *id,
                                const char *klass)
 {
-   process (new ObjectCommand (CREATE, info, "ss", id, klass));
+   process (new ObjectCommand (ObjectCommand::CREATE, info, "ss", id, klass));
 }
 
 void ObjectsBuffer::objIdent (CommonLineInfo *info, const char *id1,
                               const char *id2)
 {
-   process (new ObjectCommand (IDENT, info, "ss", id1, id2));
+   process (new ObjectCommand (ObjectCommand::IDENT, info, "ss", id1, id2));
 }
 
 void ObjectsBuffer::objNoIdent (CommonLineInfo *info)
 {
-   process (new ObjectCommand (NOIDENT, info, ""));
+   process (new ObjectCommand (ObjectCommand::NOIDENT, info, ""));
 }
 
 void ObjectsBuffer::objAssoc (CommonLineInfo *info, const char *parent,
                               const char *child)
 {
-   process (new ObjectCommand (ASSOC, info, "ss", parent, child));
+   process (new ObjectCommand (ObjectCommand::ASSOC, info, "ss", parent,
+                               child));
 }
 
 void ObjectsBuffer::objSet (CommonLineInfo *info, const char *id,
                             const char *var, const char *val)
 {
-   process (new ObjectCommand (SET, info, "sss", id, var, val));
+   process (new ObjectCommand (ObjectCommand::SET, info, "sss", id, var, val));
 }
 
 void ObjectsBuffer::objClassColor (CommonLineInfo *info, const char *klass,
                                    const char *color)
 {
-   process (new ObjectCommand (CLASS_COLOR, info, "ss", klass, color));
+   process (new ObjectCommand (ObjectCommand::CLASS_COLOR, info, "ss", klass,
+                               color));
 }
 
 void ObjectsBuffer::objObjectColor (CommonLineInfo *info, const char *id,
                                     const char *color)
 {
-   process (new ObjectCommand (OBJECT_COLOR, info, "ss", id, color));
+   process (new ObjectCommand (ObjectCommand::OBJECT_COLOR, info, "ss", id,
+                               color));
 }
 
 void ObjectsBuffer::objDelete (CommonLineInfo *info, const char *id)
 {
-   process (new ObjectCommand (DELETE, info, "s", id));
+   process (new ObjectCommand (ObjectCommand::DELETE, info, "s", id));
 }
 
 void ObjectsBuffer::queue ()
@@ -188,13 +336,39 @@ void ObjectsBuffer::queue ()
 
 void ObjectsBuffer::pass ()
 {
-   for (int i = 0; i < commandsQueue->size (); i++)
+   for (int i = 0; i < commandsQueue->size (); i++) {
       pass (commandsQueue->get (i));
+      delete commandsQueue->get (i);
+   }
    
    commandsQueue->clear ();
    queued = false;
 }
 
+/**
+ * \brief Pass those queued commands for which `release->isReleased()`
+ *    returns true; the others stay queued, in the same order.
+ *
+ * `release->isReleased()` is called once for each queued command, in order.
+ * Queueing is not ended, even if no commands are left.
+ */
+void ObjectsBuffer::pass (Release *release)
+{
+   Vector<ObjectCommand> *held = new Vector<ObjectCommand> (1, false);
+
+   for (int i = 0; i < commandsQueue->size (); i++) {
+      ObjectCommand *command = commandsQueue->get (i);
+      if (release->isReleased (command)) {
+         pass (command);
+         delete command;
+      } else
+         held->put (command);
+   }
+
+   delete commandsQueue;
+   commandsQueue = held;
+}
+
 void ObjectsBuffer::process (ObjectCommand *command)
 {
    if (queued)
@@ -212,66 +386,98 @@ void ObjectsBuffer::queue (ObjectCommand *command)
 
 void ObjectsBuffer::pass (ObjectCommand *command)
 {
-   CommonLineInfo info = { command->info.fileName, command->info.lineNo,
-                           command->info.processId,
-                           command->info.completeLine };
-   ObjectCommand::Arg *a = command->args;
+   command->pass (successor);
+}
 
-   switch (command->type) {
+/**
+ * \brief Return the index of the argument which is the `i`-th object id a
+ *    command of this type refers to (`i` is 0 or 1), or -1.
+ */
+int ObjectCommand::getIdIndex (CommandType type, int i)
+{
+   switch (type) {
+   case CLASS_COLOR:
+   case NOIDENT:
+      return -1;
+
+   case IDENT:
+   case ASSOC:
+      return i < 2 ? i : -1;
+
+   default:
+      return i == 0 ? 0 : -1;
+   }
+}
+
+void ObjectCommand::pass (ObjectsController *successor)
+{
+   CommonLineInfo info = { this->info.fileName, this->info.lineNo,
+                           this->info.processId, this->info.completeLine };
+   pass (successor, type, &info, args);
+}
+
+/**
+ * \brief Pass a command, which is not necessarily stored as ObjectCommand,
+ *    to the respective method of `successor`.
+ */
+void ObjectCommand::pass (ObjectsController *successor, CommandType type,
+                          CommonLineInfo *info, Arg *a)
+{
+   switch (type) {
    case MSG:
-      successor->objMsg (&info, a[0].s, a[1].s, a[2].d, a[3].s);
+      successor->objMsg (info, a[0].s, a[1].s, a[2].d, a[3].s);
       break;
 
    case MARK:
-      successor->objMark (&info, a[0].s, a[1].s, a[2].d, a[3].s);
+      successor->objMark (info, a[0].s, a[1].s, a[2].d, a[3].s);
       break;
 
    case MSG_START:
-      successor->objMsgStart (&info, a[0].s);
+      successor->objMsgStart (info, a[0].s);
       break;
 
    case MSG_END:
-      successor->objMsgEnd (&info, a[0].s);
+      successor->objMsgEnd (info, a[0].s);
       break;
 
    case ENTER:
-      successor->objEnter (&info, a[0].s, a[1].s, a[2].d, a[3].s, a[4].s);
+      successor->objEnter (info, a[0].s, a[1].s, a[2].d, a[3].s, a[4].s);
       break;
 
    case LEAVE:
-      successor->objLeave (&info, a[0].s, a[1].s);
+      successor->objLeave (info, a[0].s, a[1].s);
       break;
 
    case CREATE:
-      successor->objCreate (&info, a[0].s, a[1].s);
+      successor->objCreate (info, a[0].s, a[1].s);
       break;
 
    case IDENT:
-      successor->objIdent (&info, a[0].s, a[1].s);
+      successor->objIdent (info, a[0].s, a[1].s);
       break;
 
    case NOIDENT:
-      successor->objNoIdent (&info);
+      successor->objNoIdent (info);
       break;
 
    case ASSOC:
-      successor->objAssoc (&info, a[0].s, a[1].s);
+      successor->objAssoc (info, a[0].s, a[1].s);
       break;
 
    case SET:
-      successor->objSet (&info, a[0].s, a[1].s, a[2].s);
+      successor->objSet (info, a[0].s, a[1].s, a[2].s);
       break;
 
    case CLASS_COLOR:
-      successor->objClassColor (&info, a[0].s, a[1].s);
+      successor->objClassColor (info, a[0].s, a[1].s);
       break;
 
    case OBJECT_COLOR:
-      successor->objObjectColor (&info, a[0].s, a[1].s);
+      successor->objObjectColor (info, a[0].s, a[1].s);
       break;
 
    case DELETE:
-      successor->objDelete (&info, a[0].s);
+      successor->objDelete (info, a[0].s);
       break;
    }
 }
@@ -3,42 +3,163 @@
 
 #include "objects_parser.hh"
 #include "common/tools.hh"
+#include "lout/misc.hh"
 
 namespace rtfl {
 
 namespace objects {
 
-class ObjectsBuffer: public ObjectsControllerBase
+/**
+ * \brief A copy of one command, which can be passed to a controller
+ *    later.
+ *
+ * Used by ObjectsBuffer, and by controllers which have to keep some
+ * commands (see e. g. ObjTailController).
+ */
+class ObjectCommand: public lout::object::Object
 {
-private:
+public:
    enum CommandType {
       MSG, MARK, MSG_START, MSG_END, ENTER, LEAVE, CREATE, IDENT, NOIDENT,
       ASSOC, SET, CLASS_COLOR, OBJECT_COLOR, DELETE
    };
 
-   class ObjectCommand: public lout::object::Object
-   {
-      friend class ObjectsBuffer;
+   struct Arg {
+      char type;
+      union {
+         int d;
+         char *s;
+      };
+   };
+
+private:
+   CommandType type;
+   tools::CommonLineInfo info;
+
+   int numArgs;
+   Arg *args;
+   
+public:
+   ObjectCommand (CommandType type, tools::CommonLineInfo *info,
+                  const char *fmt, ...);
+   ObjectCommand (ObjectCommand *other);
+   ~ObjectCommand ();
+
+   inline CommandType getType () { return type; }
+   inline int getNumArgs () { return numArgs; }
+   inline const char *getArgS (int i) { return args[i].s; }
+   inline int getArgD (int i) { return args[i].d; }
+   inline const char *getId (int i)
+   { int j = getIdIndex (type, i); return j == -1 ? NULL : args[j].s; }
+
+   static int getIdIndex (CommandType type, int i);
+
+   void pass (ObjectsController *successor);
+   static void pass (ObjectsController *successor, CommandType type,
+                     tools::CommonLineInfo *info, Arg *args);
+};
+
+
+/**
+ * \brief A batch of commands, which is passed at once down the chain of
+ *    controllers (see ObjectsController::objCommands()).
+ *
+ * Unlike ObjectCommand, nothing is copied: the strings refer to the data of
+ * the caller (e. g. the lines being parsed), and are only valid during the
+ * call of objCommands(). Commands are added by the methods named like those
+ * of ObjectsController. A controller may replace the ids of the commands
+ * (see setId()) before passing the batch on.
+ */
+class ObjectsBatch
+{
+public:
+   enum { MAX_ARGS = 5 };
 
-   private:
-      CommandType type;
+   struct Command
+   {
+      ObjectCommand::CommandType type;
       tools::CommonLineInfo info;
+      ObjectCommand::Arg args[MAX_ARGS];
+   };
+
+private:
+   lout::misc::SimpleVector<Command> commands;
+
+   inline void setS (Command *command, int i, const char *s)
+   { command->args[i].type = 's'; command->args[i].s = (char*) s; }
+   inline void setD (Command *command, int i, int d)
+   { command->args[i].type = 'd'; command->args[i].d = d; }
+
+public:
+   inline int size () { return commands.size (); }
+   inline Command *get (int i) { return commands.getRef (i); }
+   inline void clear () { commands.setSize (0); }
+
+   /**
+    * \brief Add a command; the arguments are then set by the caller.
+    */
+   Command *add (ObjectCommand::CommandType type, tools::CommonLineInfo *info);
+
+   /**
+    * \brief Return the `i`-th object id (`i` is 0 or 1) the command refers
+    *    to, or NULL.
+    */
+   inline const char *getId (Command *command, int i)
+   {
+      int j = ObjectCommand::getIdIndex (command->type, i);
+      return j == -1 ? NULL : command->args[j].s;
+   }
+
+   /** \brief Replace an id, which must exist (see getId()). */
+   inline void setId (Command *command, int i, const char *id)
+   { setS (command, ObjectCommand::getIdIndex (command->type, i), id); }
+
+   inline static void pass (ObjectsController *successor, Command *command)
+   { ObjectCommand::pass (successor, command->type, &command->info,
+                          command->args); }
+
+   void objMsg (tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+   void objEnter (tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (tools::CommonLineInfo *info);
+   void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
+                const char *val);
+   void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (tools::CommonLineInfo *info, const char *id);
+};
 
-      int numArgs;
-      struct Arg {
-         char type;
-         union {
-            int d;
-            char *s;
-         };
-      } *args;
-      
+
+class ObjectsBuffer: public ObjectsControllerBase
+{
+public:
+   /**
+    * \brief Decides which commands are passed by ObjectsBuffer::pass
+    *    (Release*).
+    */
+   class Release
+   {
    public:
-      ObjectCommand (CommandType type, tools::CommonLineInfo *info,
-                     const char *fmt, ...);
-      ~ObjectCommand ();
+      virtual bool isReleased (ObjectCommand *command) = 0;
    };
-   
+
+private:
    ObjectsController *successor;
    lout::container::typed::Vector<ObjectCommand> *commandsQueue;
    bool queued;
@@ -79,6 +200,9 @@ public:
 
    void queue ();
    void pass ();
+   void pass (Release *release);
+   inline bool isQueued () { return queued; }
+   inline bool isEmpty () { return commandsQueue->size () == 0; }
 };
 
 } // namespace objects
@@ -0,0 +1,546 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objects_chunked.hh"
+#include "objects_buffer.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+using namespace lout::object;
+using namespace rtfl::tools;
+
+namespace rtfl {
+
+namespace objects {
+
+// Argument formats, as for ObjectCommand, indexed by
+// ObjectCommand::CommandType.
+static const char *const argFormats[] = {
+   "ssds", "ssds", "s", "s", "ssdss", "ss", "ss", "ss", "", "ss", "sss", "ss",
+   "ss", "s"
+};
+
+ChunkedObjectsSource::Recording::Recording ()
+{
+   alloc = 4096;
+   data = (char*) malloc (alloc);
+   size = 0;
+}
+
+ChunkedObjectsSource::Recording::~Recording ()
+{
+   free (data);
+}
+
+void ChunkedObjectsSource::Recording::ensure (int n)
+{
+   if (size + n > alloc) {
+      while (size + n > alloc)
+         alloc *= 2;
+      data = (char*) realloc (data, alloc);
+   }
+}
+
+void ChunkedObjectsSource::Recording::putInt (int i)
+{
+   ensure (sizeof (int));
+   memcpy (data + size, &i, sizeof (int));
+   size += sizeof (int);
+}
+
+/**
+ * \brief Store a string, preceded by a flag byte, so that NULL can be
+ *    distinguished from "".
+ */
+void ChunkedObjectsSource::Recording::putString (const char *s)
+{
+   int len = s ? strlen (s) + 1 : 0;
+   ensure (1 + len);
+   data[size++] = s ? 1 : 0;
+   if (s) {
+      memcpy (data + size, s, len);
+      size += len;
+   }
+}
+
+int ChunkedObjectsSource::Recording::getInt (int *pos)
+{
+   int i;
+   memcpy (&i, data + *pos, sizeof (int));
+   *pos += sizeof (int);
+   return i;
+}
+
+char *ChunkedObjectsSource::Recording::getString (int *pos)
+{
+   if (data[(*pos)++]) {
+      char *s = data + *pos;
+      *pos += strlen (s) + 1;
+      return s;
+   } else
+      return NULL;
+}
+
+void ChunkedObjectsSource::Recording::record (int type, CommonLineInfo *info,
+                                              const char *fmt, ...)
+{
+   putInt (type);
+   putString (info->fileName);
+   putInt (info->lineNo);
+   putInt (info->processId);
+   putString (info->completeLine);
+
+   va_list vargs;
+   va_start (vargs, fmt);
+   for (int i = 0; fmt[i]; i++) {
+      if (fmt[i] == 'd')
+         putInt (va_arg (vargs, int));
+      else
+         putString (va_arg (vargs, char*));
+   }
+   va_end (vargs);
+}
+
+/**
+ * \brief Pass all recorded commands to `successor`, as batches (see
+ *    ObjectsController::objCommands) of up to BATCH_COMMANDS commands.
+ *
+ * The strings passed point into the recording; as usual, they are only valid
+ * during the call.
+ */
+void ChunkedObjectsSource::Recording::replay (ObjectsController *successor)
+{
+   ObjectsBatch batch;
+   int pos = 0;
+   while (pos < size) {
+      int type = getInt (&pos);
+      CommonLineInfo info;
+      info.fileName = getString (&pos);
+      info.lineNo = getInt (&pos);
+      info.processId = getInt (&pos);
+      info.completeLine = getString (&pos);
+
+      ObjectCommand::Arg *args =
+         batch.add ((ObjectCommand::CommandType) type, &info)->args;
+      const char *fmt = argFormats[type];
+      for (int i = 0; fmt[i]; i++) {
+         args[i].type = fmt[i];
+         if (fmt[i] == 'd')
+            args[i].d = getInt (&pos);
+         else
+            args[i].s = getString (&pos);
+      }
+
+      if (batch.size () == BATCH_COMMANDS || pos >= size) {
+         successor->objCommands (&batch);
+         batch.clear ();
+      }
+   }
+}
+
+void ChunkedObjectsSource::Recording::objMsg (CommonLineInfo *info,
+                                              const char *id,
+                                              const char *aspect, int prio,
+                                              const char *message)
+{
+   record (ObjectCommand::MSG, info, "ssds", id, aspect, prio, message);
+}
+
+void ChunkedObjectsSource::Recording::objMark (CommonLineInfo *info,
+                                               const char *id,
+                                               const char *aspect, int prio,
+                                               const char *message)
+{
+   record (ObjectCommand::MARK, info, "ssds", id, aspect, prio, message);
+}
+
+void ChunkedObjectsSource::Recording::objMsgStart (CommonLineInfo *info,
+                                                   const char *id)
+{
+   record (ObjectCommand::MSG_START, info, "s", id);
+}
+
+void ChunkedObjectsSource::Recording::objMsgEnd (CommonLineInfo *info,
+                                                 const char *id)
+{
+   record (ObjectCommand::MSG_END, info, "s", id);
+}
+
+void ChunkedObjectsSource::Recording::objEnter (CommonLineInfo *info,
+                                                const char *id,
+                                                const char *aspect, int prio,
+                                                const char *funname,
+                                                const char *args)
+{
+   record (ObjectCommand::ENTER, info, "ssdss", id, aspect, prio, funname,
+           args);
+}
+
+void ChunkedObjectsSource::Recording::objLeave (CommonLineInfo *info,
+                                                const char *id,
+                                                const char *vals)
+{
+   record (ObjectCommand::LEAVE, info, "ss", id, vals);
+}
+
+void ChunkedObjectsSource::Recording::objCreate (CommonLineInfo *info,
+                                                 const char *id,
+                                                 const char *klass)
+{
+   record (ObjectCommand::CREATE, info, "ss", id, klass);
+}
+
+void ChunkedObjectsSource::Recording::objIdent (CommonLineInfo *info,
+                                                const char *id1,
+                                                const char *id2)
+{
+   record (ObjectCommand::IDENT, info, "ss", id1, id2);
+}
+
+void ChunkedObjectsSource::Recording::objNoIdent (CommonLineInfo *info)
+{
+   record (ObjectCommand::NOIDENT, info, "");
+}
+
+void ChunkedObjectsSource::Recording::objAssoc (CommonLineInfo *info,
+                                                const char *parent,
+                                                const char *child)
+{
+   record (ObjectCommand::ASSOC, info, "ss", parent, child);
+}
+
+void ChunkedObjectsSource::Recording::objSet (CommonLineInfo *info,
+                                              const char *id, const char *var,
+                                              const char *val)
+{
+   record (ObjectCommand::SET, info, "sss", id, var, val);
+}
+
+void ChunkedObjectsSource::Recording::objClassColor (CommonLineInfo *info,
+                                                     const char *klass,
+                                                     const char *color)
+{
+   record (ObjectCommand::CLASS_COLOR, info, "ss", klass, color);
+}
+
+void ChunkedObjectsSource::Recording::objObjectColor (CommonLineInfo *info,
+                                                      const char *id,
+                                                      const char *color)
+{
+   record (ObjectCommand::OBJECT_COLOR, info, "ss", id, color);
+}
+
+void ChunkedObjectsSource::Recording::objDelete (CommonLineInfo *info,
+                                                 const char *id)
+{
+   record (ObjectCommand::DELETE, info, "s", id);
+}
+
+// ----------------------------------------------------------------------
+
+ChunkedObjectsSource::ChunkedObjectsSource (ObjectsController *successor,
+                                            int numThreads)
+{
+   this->successor = successor;
+   successor->setObjectsSource (this);
+
+   this->numThreads = numThreads;
+   threads = new pthread_t[numThreads];
+
+   pthread_mutex_init (&mutex, NULL);
+   // Deadlines (see step()) refer to the monotonic clock.
+   pthread_condattr_t attr;
+   pthread_condattr_init (&attr);
+   pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+   pthread_cond_init (&chunkParsed, &attr);
+   pthread_condattr_destroy (&attr);
+   pthread_cond_init (&chunkPassed, NULL);
+   nextToParse = nextToPass = 0;
+   started = finished = stopping = false;
+}
+
+ChunkedObjectsSource::~ChunkedObjectsSource ()
+{
+   // Destroyed before all chunks have been passed (e. g. when the user
+   // closes the window before).
+   if (started && !finished) {
+      pthread_mutex_lock (&mutex);
+      stopping = true;
+      pthread_cond_broadcast (&chunkPassed);
+      pthread_mutex_unlock (&mutex);
+      joinWorkers ();
+   }
+
+   for (int i = 0; i < chunks.size (); i++)
+      if (chunks.getRef(i)->recording)
+         delete chunks.getRef(i)->recording;
+
+   for (int i = 0; i < fds.size (); i++)
+      close (fds.get (i));
+
+   delete[] threads;
+   pthread_mutex_destroy (&mutex);
+   pthread_cond_destroy (&chunkParsed);
+   pthread_cond_destroy (&chunkPassed);
+}
+
+/**
+ * \brief Return whether `fd` can be read by this class: it must be a regular
+ *    file, and not be compressed.
+ */
+bool ChunkedObjectsSource::isSuitableFile (int fd)
+{
+   struct stat st;
+   return fstat (fd, &st) == 0 && S_ISREG (st.st_mode) &&
+      !Decompressor::isCompressedFile (fd);
+}
+
+/**
+ * \brief Add a regular file; the source takes ownership of `fd`.
+ *
+ * The file is split into chunks of about CHUNK_SIZE bytes, each ending
+ * after a newline (or at the end of the file).
+ */
+void ChunkedObjectsSource::add (int fd)
+{
+   assert (!started);
+
+   fds.increase ();
+   fds.setLast (fd);
+
+   struct stat st;
+   if (fstat (fd, &st) != 0)
+      syserr ("fstat failed");
+
+   off_t start = 0;
+   while (start < st.st_size) {
+      off_t end = start + CHUNK_SIZE;
+      if (end >= st.st_size)
+         end = st.st_size;
+      else {
+         // Search the end of the line.
+         char buf[1024];
+         bool found = false;
+         while (!found && end < st.st_size) {
+            ssize_t n = pread (fd, buf, sizeof (buf), end);
+            if (n <= 0)
+               syserr ("pread failed");
+            for (ssize_t i = 0; !found && i < n; i++)
+               if (buf[i] == '\n') {
+                  end += i + 1;
+                  found = true;
+               }
+            if (!found)
+               end += n;
+         }
+      }
+
+      chunks.increase ();
+      Chunk *chunk = chunks.getLastRef ();
+      chunk->fd = fd;
+      chunk->start = start;
+      chunk->end = end;
+      chunk->recording = NULL;
+
+      start = end;
+   }
+}
+
+void *ChunkedObjectsSource::runWorker (void *data)
+{
+   ((ChunkedObjectsSource*) data)->work ();
+   return NULL;
+}
+
+void ChunkedObjectsSource::work ()
+{
+   int maxAhead = CHUNKS_PER_THREAD * numThreads;
+
+   pthread_mutex_lock (&mutex);
+   while (!stopping && nextToParse < chunks.size ()) {
+      int i = nextToParse++;
+      // Do not get too far ahead of the consumer.
+      while (!stopping && i >= nextToPass + maxAhead)
+         pthread_cond_wait (&chunkPassed, &mutex);
+      if (stopping)
+         break;
+      pthread_mutex_unlock (&mutex);
+
+      Recording *recording = parseChunk (chunks.getRef (i));
+
+      pthread_mutex_lock (&mutex);
+      chunks.getRef(i)->recording = recording;
+      pthread_cond_broadcast (&chunkParsed);
+   }
+   pthread_mutex_unlock (&mutex);
+}
+
+ChunkedObjectsSource::Recording *ChunkedObjectsSource::parseChunk (Chunk
+                                                                   *chunk)
+{
+   size_t size = chunk->end - chunk->start;
+   char *buf = (char*) malloc (size + 1);
+   size_t done = 0;
+   while (done < size) {
+      ssize_t n = pread (chunk->fd, buf + done, size - done,
+                         chunk->start + done);
+      if (n <= 0)
+         break;
+      done += n;
+   }
+
+   Recording *recording = new Recording ();
+   ObjectsParser parser (recording);
+
+   // Like FileLinesSource: lines too long, and an unterminated last line,
+   // are not processed.
+   size_t startOfLine = 0;
+   for (size_t i = 0; i < done; i++)
+      if (buf[i] == '\n') {
+         buf[i] = 0;
+         if (i - startOfLine < FileLinesSource::MAX_LINE_SIZE)
+            parser.processLine (buf + startOfLine);
+         startOfLine = i + 1;
+      }
+
+   free (buf);
+   return recording;
+}
+
+void ChunkedObjectsSource::start ()
+{
+   assert (!started);
+   started = true;
+
+   for (int i = 0; i < numThreads; i++)
+      if (pthread_create (&threads[i], NULL, runWorker, this) != 0)
+         syserr ("pthread_create failed");
+}
+
+/**
+ * \brief Process expired timeouts, and pass the next chunk to the successor,
+ *    waiting at most until `deadline` (see tools::TimeoutQueue; -1 means no
+ *    limit) for it to be parsed.
+ *
+ * Returns false when all chunks have been passed; in this case, the
+ * successor has been finished.
+ */
+bool ChunkedObjectsSource::step (long deadline)
+{
+   if (finished)
+      return false;
+
+   int type;
+   while (timeouts.popExpired (&type))
+      successor->timeout (type);
+
+   long nextTime = timeouts.getNextTime ();
+   if (nextTime != -1 && (deadline == -1 || nextTime < deadline))
+      deadline = nextTime;
+
+   Recording *recording = NULL;
+
+   pthread_mutex_lock (&mutex);
+   if (nextToPass < chunks.size ()) {
+      bool timedOut = false;
+      while (!timedOut &&
+             (recording = chunks.getRef(nextToPass)->recording) == NULL) {
+         if (deadline == -1)
+            pthread_cond_wait (&chunkParsed, &mutex);
+         else {
+            struct timespec ts;
+            ts.tv_sec = deadline / 1000;
+            ts.tv_nsec = (deadline % 1000) * 1000000;
+            timedOut =
+               pthread_cond_timedwait (&chunkParsed, &mutex, &ts) != 0;
+         }
+      }
+
+      if (recording)
+         chunks.getRef(nextToPass)->recording = NULL;
+   }
+   pthread_mutex_unlock (&mutex);
+
+   if (recording) {
+      recording->replay (successor);
+      delete recording;
+
+      pthread_mutex_lock (&mutex);
+      nextToPass++;
+      pthread_cond_broadcast (&chunkPassed);
+      pthread_mutex_unlock (&mutex);
+   }
+
+   if (nextToPass == chunks.size ()) {
+      joinWorkers ();
+      finished = true;
+      successor->finish ();
+   }
+
+   return !finished;
+}
+
+void ChunkedObjectsSource::joinWorkers ()
+{
+   for (int i = 0; i < numThreads; i++)
+      pthread_join (threads[i], NULL);
+}
+
+/**
+ * \brief Start the worker threads, and pass all commands to the successor.
+ */
+void ChunkedObjectsSource::run ()
+{
+   start ();
+   while (step (-1))
+      ;
+}
+
+void ChunkedObjectsSource::setObjectsSink (ObjectsSink *sink)
+{
+}
+
+void ChunkedObjectsSource::addTimeout (double secs, int type)
+{
+   timeouts.add (secs, type);
+}
+
+void ChunkedObjectsSource::removeTimeout (int type)
+{
+   timeouts.remove (type);
+}
+
+} // namespace objects
+
+} // namespace rtfl
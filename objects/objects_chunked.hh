@@ -0,0 +1,137 @@
+#ifndef __OBJECTS_OBJECTS_CHUNKED_HH__
+#define __OBJECTS_OBJECTS_CHUNKED_HH__
+
+#include "objects_parser.hh"
+#include "common/lines.hh"
+#include "lout/misc.hh"
+
+#include <pthread.h>
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief Parses regular files in parallel, and passes the commands to a
+ *    controller, in file order.
+ *
+ * The files are split into chunks (at line boundaries), which are parsed by
+ * a number of worker threads, each into a compact buffer of commands (see
+ * Recording). The thread calling run() (or step()) passes these buffers to
+ * the successor, in the order of the files and chunks. This is possible,
+ * since parsing a line does not depend on other lines. The number of chunks
+ * parsed in advance is limited, so memory usage does not depend on the size
+ * of the files.
+ *
+ * As in ObjectsPipe, timeouts added by the successor are processed by the
+ * thread calling run() or step(), between chunks.
+ *
+ * Only the size of the files at the time add() is called is considered;
+ * this is meant for offline files, not for files still being written. Lines
+ * are treated as rtfl::tools::FileLinesSource does.
+ */
+class ChunkedObjectsSource: public ObjectsSource
+{
+private:
+   /**
+    * \brief Commands in a compact form: type, line info and arguments are
+    *    stored, one command after another, in one block of memory.
+    */
+   class Recording: public ObjectsControllerBase
+   {
+   private:
+      enum { BATCH_COMMANDS = 1024 };
+
+      char *data;
+      int size, alloc;
+
+      void ensure (int n);
+      void putInt (int i);
+      void putString (const char *s);
+      void record (int type, tools::CommonLineInfo *info, const char *fmt,
+                   ...);
+      int getInt (int *pos);
+      char *getString (int *pos);
+
+   public:
+      Recording ();
+      ~Recording ();
+
+      void replay (ObjectsController *successor);
+
+      void objMsg (tools::CommonLineInfo *info, const char *id,
+                   const char *aspect, int prio, const char *message);
+      void objMark (tools::CommonLineInfo *info, const char *id,
+                    const char *aspect, int prio, const char *message);
+      void objMsgStart (tools::CommonLineInfo *info, const char *id);
+      void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+      void objEnter (tools::CommonLineInfo *info, const char *id,
+                     const char *aspect, int prio, const char *funname,
+                     const char *args);
+      void objLeave (tools::CommonLineInfo *info, const char *id,
+                     const char *vals);
+      void objCreate (tools::CommonLineInfo *info, const char *id,
+                      const char *klass);
+      void objIdent (tools::CommonLineInfo *info, const char *id1,
+                     const char *id2);
+      void objNoIdent (tools::CommonLineInfo *info);
+      void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                     const char *child);
+      void objSet (tools::CommonLineInfo *info, const char *id,
+                   const char *var, const char *val);
+      void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                          const char *color);
+      void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                           const char *color);
+      void objDelete (tools::CommonLineInfo *info, const char *id);
+   };
+
+   struct Chunk
+   {
+      int fd;
+      off_t start, end;
+      Recording *recording; // NULL as long as not parsed
+   };
+
+   enum { CHUNK_SIZE = 4 * 1024 * 1024, CHUNKS_PER_THREAD = 4 };
+
+   ObjectsController *successor;
+   tools::TimeoutQueue timeouts;
+   lout::misc::SimpleVector<int> fds;
+   lout::misc::SimpleVector<Chunk> chunks;
+   int numThreads;
+   pthread_t *threads;
+
+   // Protected by mutex: the next chunk to be parsed, and the next chunk to
+   // be passed to the successor.
+   pthread_mutex_t mutex;
+   pthread_cond_t chunkParsed, chunkPassed;
+   int nextToParse, nextToPass;
+   bool started, finished, stopping;
+
+   static void *runWorker (void *data);
+   void work ();
+   Recording *parseChunk (Chunk *chunk);
+   void joinWorkers ();
+
+public:
+   ChunkedObjectsSource (ObjectsController *successor, int numThreads);
+   ~ChunkedObjectsSource ();
+
+   static bool isSuitableFile (int fd);
+
+   void add (int fd);
+   void start ();
+   bool step (long deadline);
+   void run ();
+
+   void setObjectsSink (ObjectsSink *sink);
+   void addTimeout (double secs, int type);
+   void removeTimeout (int type);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJECTS_CHUNKED_HH__
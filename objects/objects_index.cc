@@ -0,0 +1,656 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objects_index.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+using namespace lout::object;
+using namespace lout::misc;
+using namespace lout::container::typed;
+using namespace rtfl::tools;
+
+#define INDEX_MAGIC "RTFLIDX1"
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief The part of an index for one chunk of the file, with line numbers
+ *    relative to the chunk.
+ */
+class ObjectsIndex::ChunkIndex
+{
+private:
+   static bool nextField (const char **p, const char *end, char *buf);
+   void addObject (const char *id, off_t offset);
+   void scanLine (const char *line, const char *end, off_t offset);
+
+public:
+   enum { TABLE_SIZE = 4093 };
+
+   off_t start, end;
+   long numLines;
+   SimpleVector<Checkpoint> checkpoints;
+   SimpleVector<off_t> structural;
+   HashTable<String, ObjectPositions> *objects;
+
+   ChunkIndex (off_t start, off_t end);
+   ~ChunkIndex ();
+
+   void scan (int fd);
+};
+
+ObjectsIndex::ChunkIndex::ChunkIndex (off_t start, off_t end)
+{
+   this->start = start;
+   this->end = end;
+   numLines = 0;
+   objects = new HashTable<String, ObjectPositions> (true, true, TABLE_SIZE);
+}
+
+ObjectsIndex::ChunkIndex::~ChunkIndex ()
+{
+   delete objects;
+}
+
+/**
+ * \brief Copy the next field (separated by ':', which may be escaped by
+ *    '\\') into `buf` (unescaped, at most FileLinesSource::MAX_LINE_SIZE
+ *    characters), and advance `*p`.
+ */
+bool ObjectsIndex::ChunkIndex::nextField (const char **p, const char *end,
+                                          char *buf)
+{
+   if (*p > end)
+      return false;
+
+   int n = 0;
+   const char *s = *p;
+   while (s < end && *s != ':') {
+      if (*s == '\\' && s + 1 < end)
+         s++;
+      if (n < FileLinesSource::MAX_LINE_SIZE)
+         buf[n++] = *s;
+      s++;
+   }
+   buf[n] = 0;
+
+   // Skip the ':'; at the end, *p is end + 1, so that no more fields are
+   // found.
+   *p = s + 1;
+   return true;
+}
+
+void ObjectsIndex::ChunkIndex::addObject (const char *id, off_t offset)
+{
+   ConstString key (id);
+   ObjectPositions *positions = objects->get ((String*)&key);
+   if (positions == NULL) {
+      positions = new ObjectPositions ();
+      positions->first = offset;
+      objects->put (new String (id), positions);
+   }
+   positions->last = offset;
+}
+
+/**
+ * \brief Add a line (without the newline) to the index; only commands of
+ *    the objects module are considered.
+ */
+void ObjectsIndex::ChunkIndex::scanLine (const char *line, const char *end,
+                                         off_t offset)
+{
+   if (end - line < 10 || strncmp (line, "[rtfl-obj-", 10) != 0)
+      return;
+
+   const char *p = (const char*) memchr (line, ']', end - line);
+   if (p == NULL)
+      return;
+   p++;
+
+   char buf[FileLinesSource::MAX_LINE_SIZE + 1];
+   // File name, line number, process id.
+   for (int i = 0; i < 3; i++)
+      if (!nextField (&p, end, buf))
+         return;
+
+   char cmd[FileLinesSource::MAX_LINE_SIZE + 1];
+   if (!nextField (&p, end, cmd))
+      return;
+
+   if (strcmp (cmd, "create") == 0 || strcmp (cmd, "ident") == 0 ||
+       strcmp (cmd, "noident") == 0 || strcmp (cmd, "assoc") == 0 ||
+       strcmp (cmd, "class-color") == 0 || strcmp (cmd, "object-color") == 0 ||
+       strcmp (cmd, "delete") == 0) {
+      structural.increase ();
+      structural.setLast (offset);
+   }
+
+   // All commands except these refer to an object as first argument;
+   // "ident" and "assoc" also as second one.
+   if (strcmp (cmd, "noident") != 0 && strcmp (cmd, "class-color") != 0 &&
+       nextField (&p, end, buf)) {
+      addObject (buf, offset);
+      if ((strcmp (cmd, "ident") == 0 || strcmp (cmd, "assoc") == 0) &&
+          nextField (&p, end, buf))
+         addObject (buf, offset);
+   }
+}
+
+void ObjectsIndex::ChunkIndex::scan (int fd)
+{
+   size_t size = end - start;
+   char *buf = (char*) malloc (size);
+   size_t done = 0;
+   while (done < size) {
+      ssize_t n = pread (fd, buf + done, size - done, start + done);
+      if (n <= 0)
+         break;
+      done += n;
+   }
+
+   // Like FileLinesSource, an unterminated last line is not considered.
+   const char *line = buf, *bufEnd = buf + done;
+   const char *nl;
+   while ((nl = (const char*) memchr (line, '\n', bufEnd - line))) {
+      off_t offset = start + (line - buf);
+      if (numLines % DEFAULT_K == 0) {
+         checkpoints.increase ();
+         checkpoints.getLastRef()->line = numLines;
+         checkpoints.getLastRef()->offset = offset;
+      }
+
+      scanLine (line, nl, offset);
+      numLines++;
+      line = nl + 1;
+   }
+
+   free (buf);
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * \brief Scans chunks in worker threads, and merges them in order, in the
+ *    calling thread.
+ */
+class ObjectsIndex::Builder
+{
+private:
+   enum { CHUNK_SIZE = 16 * 1024 * 1024, CHUNKS_PER_THREAD = 2 };
+
+   int fd, numThreads;
+   SimpleVector<ChunkIndex*> chunks;
+   SimpleVector<bool> scanned;
+
+   // See ChunkedObjectsSource.
+   pthread_mutex_t mutex;
+   pthread_cond_t chunkScanned, chunkMerged;
+   int nextToScan, nextToMerge;
+
+   static void *runWorker (void *data);
+   void work ();
+
+public:
+   Builder (int fd, int numThreads);
+   ~Builder ();
+
+   void run (ObjectsIndex *index);
+};
+
+ObjectsIndex::Builder::Builder (int fd, int numThreads)
+{
+   this->fd = fd;
+   this->numThreads = numThreads;
+
+   // Split into chunks, each ending after a newline.
+   off_t size = 0;
+   time_t time;
+   getFileInfo (fd, &size, &time);
+
+   off_t start = 0;
+   while (start < size) {
+      off_t end = start + CHUNK_SIZE;
+      if (end >= size)
+         end = size;
+      else {
+         char buf[1024];
+         bool found = false;
+         while (!found && end < size) {
+            ssize_t n = pread (fd, buf, sizeof (buf), end);
+            if (n <= 0)
+               syserr ("pread failed");
+            const char *nl = (const char*) memchr (buf, '\n', n);
+            if (nl) {
+               end += nl - buf + 1;
+               found = true;
+            } else
+               end += n;
+         }
+      }
+
+      chunks.increase ();
+      chunks.setLast (new ChunkIndex (start, end));
+      scanned.increase ();
+      scanned.setLast (false);
+      start = end;
+   }
+
+   pthread_mutex_init (&mutex, NULL);
+   pthread_cond_init (&chunkScanned, NULL);
+   pthread_cond_init (&chunkMerged, NULL);
+   nextToScan = nextToMerge = 0;
+}
+
+ObjectsIndex::Builder::~Builder ()
+{
+   pthread_mutex_destroy (&mutex);
+   pthread_cond_destroy (&chunkScanned);
+   pthread_cond_destroy (&chunkMerged);
+}
+
+void *ObjectsIndex::Builder::runWorker (void *data)
+{
+   ((Builder*) data)->work ();
+   return NULL;
+}
+
+void ObjectsIndex::Builder::work ()
+{
+   int maxAhead = CHUNKS_PER_THREAD * numThreads;
+
+   pthread_mutex_lock (&mutex);
+   while (nextToScan < chunks.size ()) {
+      int i = nextToScan++;
+      while (i >= nextToMerge + maxAhead)
+         pthread_cond_wait (&chunkMerged, &mutex);
+      pthread_mutex_unlock (&mutex);
+
+      chunks.get(i)->scan (fd);
+
+      pthread_mutex_lock (&mutex);
+      scanned.set (i, true);
+      pthread_cond_broadcast (&chunkScanned);
+   }
+   pthread_mutex_unlock (&mutex);
+}
+
+void ObjectsIndex::Builder::run (ObjectsIndex *index)
+{
+   pthread_t *threads = new pthread_t[numThreads];
+   for (int i = 0; i < numThreads; i++)
+      if (pthread_create (&threads[i], NULL, runWorker, this) != 0)
+         syserr ("pthread_create failed");
+
+   for (int i = 0; i < chunks.size (); i++) {
+      pthread_mutex_lock (&mutex);
+      while (!scanned.get (i))
+         pthread_cond_wait (&chunkScanned, &mutex);
+      pthread_mutex_unlock (&mutex);
+
+      index->merge (chunks.get (i));
+      delete chunks.get (i);
+
+      pthread_mutex_lock (&mutex);
+      nextToMerge++;
+      pthread_cond_broadcast (&chunkMerged);
+      pthread_mutex_unlock (&mutex);
+   }
+
+   for (int i = 0; i < numThreads; i++)
+      pthread_join (threads[i], NULL);
+   delete[] threads;
+}
+
+// ----------------------------------------------------------------------
+
+ObjectsIndex::ObjectsIndex ()
+{
+   fileSize = 0;
+   fileTime = 0;
+   numLines = 0;
+   objects = new HashTable<String, ObjectPositions> (true, true, 65521);
+}
+
+ObjectsIndex::~ObjectsIndex ()
+{
+   delete objects;
+}
+
+bool ObjectsIndex::getFileInfo (int fd, off_t *size, time_t *time)
+{
+   struct stat st;
+   if (fstat (fd, &st) != 0)
+      return false;
+   *size = st.st_size;
+   *time = st.st_mtime;
+   return true;
+}
+
+void ObjectsIndex::merge (ChunkIndex *chunk)
+{
+   for (int i = 0; i < chunk->checkpoints.size (); i++) {
+      checkpoints.increase ();
+      checkpoints.getLastRef()->line =
+         numLines + chunk->checkpoints.getRef(i)->line;
+      checkpoints.getLastRef()->offset = chunk->checkpoints.getRef(i)->offset;
+   }
+
+   for (int i = 0; i < chunk->structural.size (); i++) {
+      structural.increase ();
+      structural.setLast (chunk->structural.get (i));
+   }
+
+   // Chunks are merged in order, so the first position is kept, and the last
+   // one is replaced.
+   for (Iterator<String> it = chunk->objects->iterator (); it.hasNext (); ) {
+      String *key = it.getNext ();
+      ObjectPositions *chunkPositions = chunk->objects->get (key);
+      ObjectPositions *positions = objects->get (key);
+      if (positions == NULL) {
+         positions = new ObjectPositions ();
+         positions->first = chunkPositions->first;
+         objects->put (new String (key->chars ()), positions);
+      }
+      positions->last = chunkPositions->last;
+   }
+
+   numLines += chunk->numLines;
+}
+
+/**
+ * \brief Build the index of a regular (uncompressed) file, with
+ *    `numThreads` threads.
+ */
+ObjectsIndex *ObjectsIndex::build (int fd, int numThreads)
+{
+   ObjectsIndex *index = new ObjectsIndex ();
+   getFileInfo (fd, &index->fileSize, &index->fileTime);
+   Builder builder (fd, numThreads);
+   builder.run (index);
+   return index;
+}
+
+/**
+ * \brief Read the index from `fileName` (if not NULL), or build it (and
+ *    write it to `fileName`, if not NULL).
+ */
+ObjectsIndex *ObjectsIndex::readOrBuild (const char *fileName, int fd,
+                                         int numThreads)
+{
+   ObjectsIndex *index = fileName ? read (fileName, fd) : NULL;
+   if (index == NULL) {
+      index = build (fd, numThreads);
+      if (fileName && !index->write (fileName))
+         fprintf (stderr, "Cannot write index file \"%s\".\n", fileName);
+   }
+   return index;
+}
+
+/**
+ * \brief Read an index written by write(); returns NULL if this is not
+ *    possible, or when the index does not fit to the file `fd` (size or
+ *    modification time have changed).
+ *
+ * Numbers are stored in native byte order; so index files are not portable
+ * (but can be built again at any time).
+ */
+ObjectsIndex *ObjectsIndex::read (const char *fileName, int fd)
+{
+   FILE *file = fopen (fileName, "rb");
+   if (file == NULL)
+      return NULL;
+
+   off_t size;
+   time_t time;
+   char magic[8];
+   int64_t header[5];
+   if (!getFileInfo (fd, &size, &time) ||
+       fread (magic, 8, 1, file) != 1 || memcmp (magic, INDEX_MAGIC, 8) != 0 ||
+       fread (header, sizeof (header), 1, file) != 1 ||
+       header[0] != size || header[1] != time) {
+      fclose (file);
+      return NULL;
+   }
+
+   ObjectsIndex *index = new ObjectsIndex ();
+   index->fileSize = size;
+   index->fileTime = time;
+   index->numLines = header[2];
+
+   bool ok = true;
+   int64_t v[2];
+   for (int64_t i = 0; ok && i < header[3]; i++) {
+      ok = fread (v, sizeof (v), 1, file) == 1;
+      index->checkpoints.increase ();
+      index->checkpoints.getLastRef()->line = v[0];
+      index->checkpoints.getLastRef()->offset = v[1];
+   }
+
+   int64_t numStructural = 0, numObjects = 0;
+   ok = ok && fread (&numStructural, sizeof (int64_t), 1, file) == 1;
+   index->structural.setSize (numStructural);
+   for (int64_t i = 0; ok && i < numStructural; i++) {
+      ok = fread (v, sizeof (int64_t), 1, file) == 1;
+      index->structural.set (i, v[0]);
+   }
+
+   ok = ok && fread (&numObjects, sizeof (int64_t), 1, file) == 1;
+   char id[FileLinesSource::MAX_LINE_SIZE + 1];
+   for (int64_t i = 0; ok && i < numObjects; i++) {
+      int32_t len;
+      ok = fread (&len, sizeof (int32_t), 1, file) == 1 &&
+         len >= 0 && len <= FileLinesSource::MAX_LINE_SIZE &&
+         fread (id, len, 1, file) == 1 && fread (v, sizeof (v), 1, file) == 1;
+      if (ok) {
+         id[len] = 0;
+         ObjectPositions *positions = new ObjectPositions ();
+         positions->first = v[0];
+         positions->last = v[1];
+         index->objects->put (new String (id), positions);
+      }
+   }
+
+   fclose (file);
+
+   if (!ok) {
+      delete index;
+      return NULL;
+   } else
+      return index;
+}
+
+bool ObjectsIndex::write (const char *fileName)
+{
+   FILE *file = fopen (fileName, "wb");
+   if (file == NULL)
+      return false;
+
+   // The last value is reserved.
+   int64_t header[5] = { fileSize, fileTime, numLines, checkpoints.size (),
+                         0 };
+   fwrite (INDEX_MAGIC, 8, 1, file);
+   fwrite (header, sizeof (header), 1, file);
+
+   for (int i = 0; i < checkpoints.size (); i++) {
+      int64_t v[2] = { checkpoints.getRef(i)->line,
+                       checkpoints.getRef(i)->offset };
+      fwrite (v, sizeof (v), 1, file);
+   }
+
+   int64_t n = structural.size ();
+   fwrite (&n, sizeof (int64_t), 1, file);
+   for (int i = 0; i < structural.size (); i++) {
+      int64_t v = structural.get (i);
+      fwrite (&v, sizeof (int64_t), 1, file);
+   }
+
+   n = 0;
+   for (Iterator<String> it = objects->iterator (); it.hasNext (); it.getNext ())
+      n++;
+   fwrite (&n, sizeof (int64_t), 1, file);
+   for (Iterator<String> it = objects->iterator (); it.hasNext (); ) {
+      String *key = it.getNext ();
+      ObjectPositions *positions = objects->get (key);
+      int32_t len = strlen (key->chars ());
+      int64_t v[2] = { positions->first, positions->last };
+      fwrite (&len, sizeof (int32_t), 1, file);
+      fwrite (key->chars (), len, 1, file);
+      fwrite (v, sizeof (v), 1, file);
+   }
+
+   return fclose (file) == 0;
+}
+
+/**
+ * \brief Return the offset of line `line` (starting with 0) in the file
+ *    `fd`, or -1, if the file has not as many lines.
+ */
+off_t ObjectsIndex::getLineOffset (int fd, long line)
+{
+   if (line < 0 || line >= numLines)
+      return -1;
+
+   // Binary search for the last checkpoint not after the line.
+   int low = 0, high = checkpoints.size () - 1;
+   while (low < high) {
+      int mid = (low + high + 1) / 2;
+      if (checkpoints.getRef(mid)->line <= line)
+         low = mid;
+      else
+         high = mid - 1;
+   }
+
+   long l = checkpoints.getRef(low)->line;
+   off_t offset = checkpoints.getRef(low)->offset;
+   char buf[8192];
+   while (l < line) {
+      ssize_t n = pread (fd, buf, sizeof (buf), offset);
+      if (n <= 0)
+         return -1;
+
+      const char *p = buf, *nl;
+      while (l < line && (nl = (const char*) memchr (p, '\n', buf + n - p))) {
+         p = nl + 1;
+         l++;
+      }
+      offset += l < line ? n : p - buf;
+   }
+
+   return offset;
+}
+
+/**
+ * \brief Return the offset of the first command referring to the object
+ *    `id`, or -1, if there is none.
+ */
+off_t ObjectsIndex::getObjectOffset (const char *id)
+{
+   ConstString key (id);
+   ObjectPositions *positions = objects->get ((String*)&key);
+   return positions ? positions->first : -1;
+}
+
+// ----------------------------------------------------------------------
+
+ObjectsIndexSource::ObjectsIndexSource (ObjectsIndex *index, int fd,
+                                        off_t offset)
+{
+   this->index = index;
+   this->fd = fd;
+   this->offset = offset;
+}
+
+void ObjectsIndexSource::setup (LinesSink *sink)
+{
+   sink->setLinesSource (this);
+
+   // Structural commands are often close to each other, so the file is read
+   // in blocks, not by one pread(2) per line.
+   char *buf = new char[BLOCK_SIZE];
+   off_t blockStart = 0;
+   ssize_t blockSize = 0;
+
+   for (int i = 0;
+        i < index->getNumStructural () && index->getStructural (i) < offset;
+        i++) {
+      off_t lineStart = index->getStructural (i);
+      char *line = NULL, *nl = NULL;
+
+      if (lineStart >= blockStart && lineStart < blockStart + blockSize) {
+         line = buf + (lineStart - blockStart);
+         nl = (char*) memchr (line, '\n', blockStart + blockSize - lineStart);
+      }
+
+      if (nl == NULL) {
+         // Not (completely) in the current block: read the next one, starting
+         // with this line.
+         blockStart = lineStart;
+         blockSize = pread (fd, buf, BLOCK_SIZE, blockStart);
+         if (blockSize < 0)
+            blockSize = 0;
+         line = buf;
+         nl = (char*) memchr (buf, '\n', blockSize);
+      }
+
+      // Lines too long are not processed, as by FileLinesSource.
+      if (nl && nl - line < FileLinesSource::MAX_LINE_SIZE) {
+         *nl = 0;
+         sink->processLine (line);
+      }
+   }
+
+   delete[] buf;
+
+   if (lseek (fd, offset, SEEK_SET) == -1)
+      syserr ("lseek failed");
+   sink->finish ();
+}
+
+void ObjectsIndexSource::addTimeout (double secs, int type)
+{
+   // Lines are passed synchronously in setup(); no timeouts.
+}
+
+void ObjectsIndexSource::removeTimeout (int type)
+{
+}
+
+} // namespace objects
+
+} // namespace rtfl
@@ -0,0 +1,110 @@
+#ifndef __OBJECTS_OBJECTS_INDEX_HH__
+#define __OBJECTS_OBJECTS_INDEX_HH__
+
+#include "common/lines.hh"
+#include "lout/misc.hh"
+
+#include <sys/types.h>
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief An index of a (regular) trace file, allowing to start somewhere in
+ *    the middle.
+ *
+ * Contains
+ *
+ * - the byte offset of every K-th line (more exactly, of the first line of
+ *   each chunk, and of every K-th line after it; see build()),
+ * - the offsets of all structural commands, i. e. those needed to
+ *   reconstruct the objects and their relations (`create`, `ident`,
+ *   `noident`, `assoc`, `class-color`, `object-color`, `delete`), and
+ * - for each object (identity, as written), the offsets of the first and the
+ *   last command referring to it.
+ *
+ * The index is built in one pass, in parallel for chunks of the file, and can
+ * be written to (and read from) a sidecar file. Offsets refer to the start of
+ * a line.
+ */
+class ObjectsIndex
+{
+private:
+   class ChunkIndex;
+   class Builder;
+
+   class ObjectPositions: public lout::object::Object
+   {
+   public:
+      off_t first, last;
+   };
+
+   struct Checkpoint
+   {
+      long line;
+      off_t offset;
+   };
+
+   enum { DEFAULT_K = 10000 };
+
+   off_t fileSize;
+   time_t fileTime;
+   long numLines;
+   lout::misc::SimpleVector<Checkpoint> checkpoints;
+   lout::misc::SimpleVector<off_t> structural;
+   lout::container::typed::HashTable<lout::object::String, ObjectPositions>
+      *objects;
+
+   ObjectsIndex ();
+   void merge (ChunkIndex *chunk);
+   static bool getFileInfo (int fd, off_t *size, time_t *time);
+
+public:
+   ~ObjectsIndex ();
+
+   static ObjectsIndex *build (int fd, int numThreads);
+   static ObjectsIndex *read (const char *fileName, int fd);
+   static ObjectsIndex *readOrBuild (const char *fileName, int fd,
+                                     int numThreads);
+   bool write (const char *fileName);
+
+   inline long getNumLines () { return numLines; }
+   inline int getNumStructural () { return structural.size (); }
+   inline off_t getStructural (int i) { return structural.get (i); }
+
+   off_t getLineOffset (int fd, long line);
+   off_t getObjectOffset (const char *id);
+};
+
+
+/**
+ * \brief Passes the structural commands (see ObjectsIndex) before a given
+ *    offset, and then sets the file position to this offset.
+ *
+ * Typically used in a rtfl::tools::LinesSourceSequence, before a source
+ * reading the same file descriptor from the current position.
+ */
+class ObjectsIndexSource: public tools::LinesSource
+{
+private:
+   /// Read at once. Must be larger than FileLinesSource::MAX_LINE_SIZE.
+   enum { BLOCK_SIZE = 256 * 1024 };
+
+   ObjectsIndex *index;
+   int fd;
+   off_t offset;
+
+public:
+   ObjectsIndexSource (ObjectsIndex *index, int fd, off_t offset);
+
+   void setup (tools::LinesSink *sink);
+   void addTimeout (double secs, int type);
+   void removeTimeout (int type);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJECTS_INDEX_HH__
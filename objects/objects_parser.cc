@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "objects_parser.hh"
+#include "objects_buffer.hh"
 
 #if 0
 #   define PRINT(fmt) printf ("---- [%p] " fmt "\n", this)
@@ -75,6 +76,21 @@ inline int decType (int type)
 
 } // namespace timeout
 
+/**
+ * \brief Process a batch of commands, in this order.
+ *
+ * The default implementation passes each command to the respective method
+ * (objMsg() etc.); controllers may override it to process a batch more
+ * efficiently, e. g. by looking up the ids of all commands together.
+ */
+void ObjectsController::objCommands (ObjectsBatch *batch)
+{
+   for (int i = 0; i < batch->size (); i++)
+      ObjectsBatch::pass (this, batch->get (i));
+}
+
+// ----------------------------------------------------------------------
+
 ObjectsControllerBase::ObjectsControllerBase()
 {
    predessor = NULL;
@@ -136,12 +152,12 @@ void ObjectsControllerBase::setObjectsSink (ObjectsSink *sink)
 void ObjectsControllerBase::addOwnTimeout (double secs, int type)
 {
    PRINTF ("ObjectsControllerBase::addOwnTimeout (%g, %d)", secs, type);
-   addTimeout (secs, timeout::makeType (0, type));
+   addTimeout (secs, timeout::makeType (type, 0));
 }
 
 void ObjectsControllerBase::removeOwnTimeout (int type)
 {
-   removeTimeout (timeout::makeType (0, type));
+   removeTimeout (timeout::makeType (type, 0));
 }
    
 void ObjectsControllerBase::ownTimeout (int type)
@@ -160,12 +176,14 @@ ObjectsParser::ObjectsParser (ObjectsController *controller)
 {
    this->controller = controller;
    source = NULL;
+   batch = new ObjectsBatch ();
    controller->setObjectsSource (this);
 }
 
 ObjectsParser::~ObjectsParser ()
 {
    controller->setObjectsSource (NULL);
+   delete batch;
 }
 
 void ObjectsParser::processCommand (CommonLineInfo *info, char *cmd, char *args)
@@ -178,59 +196,57 @@ void ObjectsParser::processCommand (CommonLineInfo *info, char *cmd, char *args)
    else if (strcmp (cmd, "obj-msg") == 0) {
       parts = split (args, 4);
       if (parts[1] && parts[2] && parts[3])
-         controller->objMsg (info, parts[0], parts[1], atoi(parts[2]),
-                             parts[3]);
+         batch->objMsg (info, parts[0], parts[1], atoi(parts[2]), parts[3]);
       else
          fprintf (stderr, "Incomplete line (obj-msg):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-mark") == 0) {
       parts = split (args, 4);
       if (parts[1] && parts[2] && parts[3])
-         controller->objMark (info, parts[0], parts[1], atoi(parts[2]),
-                              parts[3]);
+         batch->objMark (info, parts[0], parts[1], atoi(parts[2]), parts[3]);
       else
          fprintf (stderr, "Incomplete line (obj-mark):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-msg-start") == 0)
-      controller->objMsgStart (info, args);
+      batch->objMsgStart (info, args);
    else if (strcmp (cmd, "obj-msg-end") == 0)
-      controller->objMsgEnd (info, args);
+      batch->objMsgEnd (info, args);
    else if (strcmp (cmd, "obj-enter") == 0) {
       parts = split (args, 5);
       if (parts[1] && parts[2] && parts[3] && parts[4])
-         controller->objEnter (info, parts[0], parts[1], atoi(parts[2]),
-                               parts[3], parts[4]);
+         batch->objEnter (info, parts[0], parts[1], atoi(parts[2]),
+                          parts[3], parts[4]);
       else
          fprintf (stderr, "Incomplete line (obj-enter):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-leave") == 0)
       // Pre-version "obj-leave" does not support values.
-      controller->objLeave (info, args, NULL);
+      batch->objLeave (info, args, NULL);
    else if (strcmp (cmd, "obj-create") == 0) {
       parts = split (args, 2);
       if (parts[1])
-         controller->objCreate (info, parts[0], parts[1]);
+         batch->objCreate (info, parts[0], parts[1]);
       else
          fprintf (stderr, "Incomplete line (obj-create):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-ident") == 0) {
       parts = split (args, 2);
       if (parts[1])
-         controller->objIdent (info, parts[0], parts[1]);
+         batch->objIdent (info, parts[0], parts[1]);
       else
          fprintf (stderr, "Incomplete line (obj-ident):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-assoc") == 0) {
       parts = split (args, 2);
       if (parts[1])
-         controller->objAssoc (info, parts[0], parts[1]);
+         batch->objAssoc (info, parts[0], parts[1]);
       else
          fprintf (stderr, "Incomplete line (obj-assoc):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-set") == 0) {
       parts = split (args, 3);
       if (parts[1] && parts[2])
-         controller->objSet (info, parts[0], parts[1], parts[2]);
+         batch->objSet (info, parts[0], parts[1], parts[2]);
       else
          fprintf (stderr, "Incomplete line (obj-set):\n%s\n",
                   info->completeLine);
@@ -239,32 +255,32 @@ void ObjectsParser::processCommand (CommonLineInfo *info, char *cmd, char *args)
       if (parts[1]) {
          fprintf (stderr, "Warning: obj-color is deprecated; use "
                   "obj-class-color instead:\n%s\n", info->completeLine);
-         controller->objClassColor (info, parts[1], parts[0]);
+         batch->objClassColor (info, parts[1], parts[0]);
       } else
          fprintf (stderr, "Incomplete line (obj-color):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-class-color") == 0) {
       parts = split (args, 2);
       if (parts[1])
-         controller->objClassColor (info, parts[1], parts[0]);
+         batch->objClassColor (info, parts[1], parts[0]);
       else
          fprintf (stderr, "Incomplete line (obj-class-color):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-object-color") == 0) {
       parts = split (args, 2);
       if (parts[1])
-         controller->objObjectColor (info, parts[0], parts[1]);
+         batch->objObjectColor (info, parts[0], parts[1]);
       else
          fprintf (stderr, "Incomplete line (obj-object-color):\n%s\n",
                   info->completeLine);
    } else if (strcmp (cmd, "obj-delete") == 0)
-      controller->objDelete (info, args);
+      batch->objDelete (info, args);
    else
       fprintf (stderr, "Unknown command identifier '%s':\n%s\n", cmd,
                info->completeLine);
 
    if (parts)
-      freeSplit (parts);
+      freeSplitLater (parts);
 }
 
 void ObjectsParser::processVCommand (CommonLineInfo *info, const char *module,
@@ -277,82 +293,93 @@ void ObjectsParser::processVCommand (CommonLineInfo *info, const char *module,
                   info->completeLine);
       if (args[0] == NULL) {
          if (strcmp (cmd, "noident") == 0)
-            controller->objNoIdent (info);
+            batch->objNoIdent (info);
          else
             // All other commands need arguments.
             fprintf (stderr, "Missing arguments:%s\n", info->completeLine);
       } else if (strcmp (cmd, "msg") == 0) {
          if (args[1] && args[2] && args[3])
-            controller->objMsg (info, args[0], args[1], atoi(args[2]), args[3]);
+            batch->objMsg (info, args[0], args[1], atoi(args[2]), args[3]);
          else
             fprintf (stderr, "Incomplete line (msg):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "mark") == 0) {
          if (args[1] && args[2] && args[3])
-            controller->objMark (info, args[0], args[1], atoi(args[2]),
-                                 args[3]);
+            batch->objMark (info, args[0], args[1], atoi(args[2]), args[3]);
          else
             fprintf (stderr, "Incomplete line (mark):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "msg-start") == 0)
-         controller->objMsgStart (info, args[0]);
+         batch->objMsgStart (info, args[0]);
       else if (strcmp (cmd, "msg-end") == 0)
-         controller->objMsgEnd (info, args[0]);
+         batch->objMsgEnd (info, args[0]);
       else if (strcmp (cmd, "enter") == 0) {
          if (args[1] && args[2] && args[3] && args[4])
-            controller->objEnter (info, args[0], args[1], atoi(args[2]),
-                                  args[3], args[4]);
+            batch->objEnter (info, args[0], args[1], atoi(args[2]),
+                             args[3], args[4]);
          else
             fprintf (stderr, "Incomplete line (enter):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "leave") == 0)
          // Args[1] may be NULL.
-         controller->objLeave (info, args[0], args[1]);
+         batch->objLeave (info, args[0], args[1]);
       else if (strcmp (cmd, "create") == 0) {
          if (args[1])
-            controller->objCreate (info, args[0], args[1]);
+            batch->objCreate (info, args[0], args[1]);
          else
             fprintf (stderr, "Incomplete line (create):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "ident") == 0) {
          if (args[1])
-            controller->objIdent (info, args[0], args[1]);
+            batch->objIdent (info, args[0], args[1]);
          else
             fprintf (stderr, "Incomplete line (ident):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "assoc") == 0) {
          if (args[1])
-            controller->objAssoc (info, args[0], args[1]);
+            batch->objAssoc (info, args[0], args[1]);
          else
             fprintf (stderr, "Incomplete line (assoc):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "set") == 0) {
          if (args[1] && args[2])
-            controller->objSet (info, args[0], args[1], args[2]);
+            batch->objSet (info, args[0], args[1], args[2]);
          else
             fprintf (stderr, "Incomplete line (set):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "class-color") == 0) {
          if (args[1])
             // Notice the changed order.
-            controller->objClassColor (info, args[0], args[1]);
+            batch->objClassColor (info, args[0], args[1]);
          else
             fprintf (stderr, "Incomplete line (class-color):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "object-color") == 0) {
          if (args[1])
-            controller->objObjectColor (info, args[0], args[1]);
+            batch->objObjectColor (info, args[0], args[1]);
          else
             fprintf (stderr, "Incomplete line (object-color):\n%s\n",
                      info->completeLine);
       } else if (strcmp (cmd, "delete") == 0)
-         controller->objDelete (info, args[0]);
+         batch->objDelete (info, args[0]);
       else
          fprintf (stderr, "Unknown command identifier '%s':\n%s\n", cmd,
                   info->completeLine);
    }      
 }
 
+/**
+ * \brief The commands of all lines passed at once to processLines() are
+ *    passed as one batch to the controller.
+ */
+void ObjectsParser::processBatch ()
+{
+   if (batch->size () > 0) {
+      controller->objCommands (batch);
+      batch->clear ();
+   }
+}
+
 void ObjectsParser::setLinesSource (LinesSource *source)
 {
    this->source = source;
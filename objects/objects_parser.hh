@@ -9,6 +9,7 @@ namespace rtfl {
 namespace objects {
 
 class ObjectsSink;
+class ObjectsBatch;
 
 class ObjectsSource
 {
@@ -57,6 +58,8 @@ public:
    virtual void objObjectColor (tools::CommonLineInfo *info, const char *id,
                                 const char *color) = 0;
    virtual void objDelete (tools::CommonLineInfo *info, const char *id) = 0;
+
+   virtual void objCommands (ObjectsBatch *batch);
 };
 
 
@@ -82,18 +85,34 @@ public:
    void finish ();
 };
 
+/**
+ * \brief A controller class which cannot be subclassed.
+ *
+ * Used to compose controllers at compile time, when the types of all stages
+ * are known (see e. g. ObjDeleteStage): since the successor of a stage is
+ * final, the calls to it are not virtual and can be inlined. Only the
+ * constructors with one argument are available.
+ */
+template <class T> class FinalController final: public T
+{
+public:
+   template <class A> FinalController (A arg): T (arg) { }
+};
+
 
 class ObjectsParser: public tools::Parser, public ObjectsSource
 {
 private:
    ObjectsController *controller;
    tools::LinesSource *source;
+   ObjectsBatch *batch;
    
 protected:
    void processCommand (tools::CommonLineInfo *info, char *cmd, char *args);
    void processVCommand (tools::CommonLineInfo *info, const char *module,
                          int majorVersion, int minorVersion, const char *cmd,
                          char **args);
+   void processBatch ();
 
 public:
    ObjectsParser (ObjectsController *controller);
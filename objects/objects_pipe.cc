@@ -0,0 +1,339 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objects_pipe.hh"
+
+#include <pthread.h>
+
+using namespace lout::object;
+using namespace rtfl::tools;
+
+#define FLUSH_SECS 0.01
+
+namespace rtfl {
+
+namespace objects {
+
+ObjectsPipe::CommandsBatch::CommandsBatch ()
+{
+   dataAlloc = 8192;
+   data = (char*) malloc (dataAlloc);
+   dataSize = 0;
+   eos = false;
+}
+
+ObjectsPipe::CommandsBatch::~CommandsBatch ()
+{
+   free (data);
+}
+
+int ObjectsPipe::CommandsBatch::addString (const char *s)
+{
+   if (s == NULL)
+      return -1;
+
+   int len = strlen (s) + 1;
+   if (dataSize + len > dataAlloc) {
+      while (dataSize + len > dataAlloc)
+         dataAlloc *= 2;
+      data = (char*) realloc (data, dataAlloc);
+   }
+
+   int offset = dataSize;
+   memcpy (data + offset, s, len);
+   dataSize += len;
+   return offset;
+}
+
+void ObjectsPipe::CommandsBatch::add (ObjectCommand::CommandType type,
+                                      CommonLineInfo *info, const char *fmt,
+                                      va_list vargs)
+{
+   commands.increase ();
+   Command *command = commands.getRef (commands.size () - 1);
+   command->type = type;
+   command->fileName = addString (info->fileName);
+   command->lineNo = info->lineNo;
+   command->processId = info->processId;
+   command->completeLine = addString (info->completeLine);
+   command->firstArg = args.size ();
+
+   for (int i = 0; fmt[i]; i++) {
+      args.increase ();
+      Arg *arg = args.getRef (args.size () - 1);
+      arg->type = fmt[i];
+      if (fmt[i] == 'd')
+         arg->value = va_arg (vargs, int);
+      else
+         arg->value = addString (va_arg (vargs, char*));
+   }
+}
+
+/**
+ * \brief Pass all commands to `successor`, in the same order, as one
+ *    ObjectsBatch.
+ */
+void ObjectsPipe::CommandsBatch::pass (ObjectsController *successor)
+{
+   ObjectsBatch batch;
+
+   for (int i = 0; i < commands.size (); i++) {
+      Command *command = commands.getRef (i);
+      int numArgs = (i + 1 < commands.size () ?
+                     commands.getRef(i + 1)->firstArg : args.size ())
+         - command->firstArg;
+      assert (numArgs <= ObjectsBatch::MAX_ARGS);
+
+      CommonLineInfo info = {
+         command->fileName == -1 ? NULL : data + command->fileName,
+         command->lineNo, command->processId,
+         command->completeLine == -1 ? NULL : data + command->completeLine };
+      ObjectCommand::Arg *a = batch.add (command->type, &info)->args;
+
+      for (int j = 0; j < numArgs; j++) {
+         Arg *arg = args.getRef (command->firstArg + j);
+         a[j].type = arg->type;
+         if (arg->type == 'd')
+            a[j].d = arg->value;
+         else
+            a[j].s = arg->value == -1 ? NULL : data + arg->value;
+      }
+   }
+
+   successor->objCommands (&batch);
+}
+
+// ----------------------------------------------------------------------
+
+void ObjectsPipe::Receiver::setObjectsSink (ObjectsSink *sink)
+{
+}
+
+void ObjectsPipe::Receiver::addTimeout (double secs, int type)
+{
+   timeouts.add (secs, type);
+}
+
+void ObjectsPipe::Receiver::removeTimeout (int type)
+{
+   timeouts.remove (type);
+}
+
+// ----------------------------------------------------------------------
+
+ObjectsPipe::ObjectsPipe (ObjectsController *successor)
+{
+   // Notice that setObjectsSink() is not called: successor->timeout() and
+   // successor->finish() are called by run(), in the receiving thread.
+   this->successor = successor;
+   successor->setObjectsSource (&receiver);
+
+   ring = new SpscRing (RING_CAPACITY);
+   batch = new CommandsBatch ();
+   flushPending = false;
+}
+
+ObjectsPipe::~ObjectsPipe ()
+{
+   if (batch)
+      delete batch;
+   delete ring;
+}
+
+void *ObjectsPipe::runSource (void *data)
+{
+   SourceThreadData *threadData = (SourceThreadData*) data;
+   threadData->source->setup (threadData->sink);
+   return NULL;
+}
+
+/**
+ * \brief Start a new thread, in which `source` is set up with `sink`
+ *    (typically a parser using this pipe), and process all commands in the
+ *    current thread, until the end of the stream.
+ */
+void ObjectsPipe::run (LinesSource *source, LinesSink *sink)
+{
+   SourceThreadData threadData = { source, sink };
+   pthread_t sourceThread;
+   if (pthread_create (&sourceThread, NULL, runSource, &threadData) != 0)
+      syserr ("pthread_create failed");
+
+   bool eos = false;
+   while (!eos) {
+      int type;
+      while (receiver.timeouts.popExpired (&type))
+         successor->timeout (type);
+
+      CommandsBatch *received =
+         (CommandsBatch*) ring->pop (receiver.timeouts.getNextTime ());
+      if (received) {
+         received->pass (successor);
+         eos = received->eos;
+         delete received;
+      }
+   }
+
+   pthread_join (sourceThread, NULL);
+   successor->finish ();
+}
+
+void ObjectsPipe::add (ObjectCommand::CommandType type, CommonLineInfo *info,
+                       const char *fmt, ...)
+{
+   va_list vargs;
+   va_start (vargs, fmt);
+   batch->add (type, info, fmt, vargs);
+   va_end (vargs);
+
+   if (batch->getNumCommands () >= BATCH_COMMANDS)
+      flush ();
+   else if (!flushPending) {
+      addOwnTimeout (FLUSH_SECS, FLUSH);
+      flushPending = true;
+   }
+}
+
+void ObjectsPipe::flush ()
+{
+   if (flushPending) {
+      removeOwnTimeout (FLUSH);
+      flushPending = false;
+   }
+
+   if (batch->getNumCommands () > 0) {
+      ring->push (batch);
+      batch = new CommandsBatch ();
+   }
+}
+
+void ObjectsPipe::ownTimeout (int type)
+{
+   if (type == FLUSH) {
+      flushPending = false;
+      flush ();
+   }
+}
+
+void ObjectsPipe::ownFinish ()
+{
+   if (flushPending) {
+      removeOwnTimeout (FLUSH);
+      flushPending = false;
+   }
+
+   batch->eos = true;
+   ring->push (batch);
+   batch = NULL;
+}
+
+void ObjectsPipe::objMsg (CommonLineInfo *info, const char *id,
+                          const char *aspect, int prio, const char *message)
+{
+   add (ObjectCommand::MSG, info, "ssds", id, aspect, prio, message);
+}
+
+void ObjectsPipe::objMark (CommonLineInfo *info, const char *id,
+                           const char *aspect, int prio, const char *message)
+{
+   add (ObjectCommand::MARK, info, "ssds", id, aspect, prio, message);
+}
+
+void ObjectsPipe::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   add (ObjectCommand::MSG_START, info, "s", id);
+}
+
+void ObjectsPipe::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   add (ObjectCommand::MSG_END, info, "s", id);
+}
+
+void ObjectsPipe::objEnter (CommonLineInfo *info, const char *id,
+                            const char *aspect, int prio, const char *funname,
+                            const char *args)
+{
+   add (ObjectCommand::ENTER, info, "ssdss", id, aspect, prio, funname, args);
+}
+
+void ObjectsPipe::objLeave (CommonLineInfo *info, const char *id,
+                            const char *vals)
+{
+   add (ObjectCommand::LEAVE, info, "ss", id, vals);
+}
+
+void ObjectsPipe::objCreate (CommonLineInfo *info, const char *id,
+                             const char *klass)
+{
+   add (ObjectCommand::CREATE, info, "ss", id, klass);
+}
+
+void ObjectsPipe::objIdent (CommonLineInfo *info, const char *id1,
+                            const char *id2)
+{
+   add (ObjectCommand::IDENT, info, "ss", id1, id2);
+}
+
+void ObjectsPipe::objNoIdent (CommonLineInfo *info)
+{
+   add (ObjectCommand::NOIDENT, info, "");
+}
+
+void ObjectsPipe::objAssoc (CommonLineInfo *info, const char *parent,
+                            const char *child)
+{
+   add (ObjectCommand::ASSOC, info, "ss", parent, child);
+}
+
+void ObjectsPipe::objSet (CommonLineInfo *info, const char *id,
+                          const char *var, const char *val)
+{
+   add (ObjectCommand::SET, info, "sss", id, var, val);
+}
+
+void ObjectsPipe::objClassColor (CommonLineInfo *info, const char *klass,
+                                 const char *color)
+{
+   add (ObjectCommand::CLASS_COLOR, info, "ss", klass, color);
+}
+
+void ObjectsPipe::objObjectColor (CommonLineInfo *info, const char *id,
+                                  const char *color)
+{
+   add (ObjectCommand::OBJECT_COLOR, info, "ss", id, color);
+}
+
+void ObjectsPipe::objDelete (CommonLineInfo *info, const char *id)
+{
+   add (ObjectCommand::DELETE, info, "s", id);
+}
+
+} // namespace objects
+
+} // namespace rtfl
@@ -0,0 +1,147 @@
+#ifndef __OBJECTS_OBJECTS_PIPE_HH__
+#define __OBJECTS_OBJECTS_PIPE_HH__
+
+#include "objects_buffer.hh"
+#include "common/spsc_ring.hh"
+#include "lout/misc.hh"
+
+#include <stdarg.h>
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief Passes commands from one thread (typically running the parser) to
+ *    the controllers running in another thread.
+ *
+ * ObjectsPipe itself is the controller passed to the parser. Commands are
+ * copied into batches, which are passed via an rtfl::tools::SpscRing; run()
+ * then passes them to the successor, in the same order. A batch keeps all
+ * strings in one buffer, so that copying a command needs no allocation of
+ * its own. A batch is passed when it is full, or, at the latest, after a
+ * short timeout (so that latency is bounded for slow input).
+ *
+ * The successor adds timeouts to this pipe (more exactly, to an inner
+ * object); these are processed by run(), in the receiving thread, between
+ * batches. So, all calls to the successor come from one thread, and the
+ * successor needs no changes.
+ *
+ * Usage:
+ *
+ * \code
+ * ObjectsPipe pipe (&firstController);
+ * ObjectsParser parser (&pipe);
+ * pipe.run (&source, &parser);
+ * \endcode
+ */
+class ObjectsPipe: public ObjectsControllerBase
+{
+private:
+
+   class CommandsBatch: public lout::object::Object
+   {
+   private:
+      // Strings are stored as offsets into `data` (-1 for NULL), since
+      // `data` may be moved when it grows.
+      struct Arg {
+         char type;
+         int value;
+      };
+
+      struct Command {
+         ObjectCommand::CommandType type;
+         int fileName, lineNo, processId, completeLine, firstArg;
+      };
+
+      char *data;
+      int dataSize, dataAlloc;
+      lout::misc::SimpleVector<Command> commands;
+      lout::misc::SimpleVector<Arg> args;
+
+      int addString (const char *s);
+
+   public:
+      bool eos;
+
+      CommandsBatch ();
+      ~CommandsBatch ();
+
+      void add (ObjectCommand::CommandType type, tools::CommonLineInfo *info,
+                const char *fmt, va_list vargs);
+      inline int getNumCommands () { return commands.size (); }
+      void pass (ObjectsController *successor);
+   };
+
+   class Receiver: public ObjectsSource
+   {
+   public:
+      tools::TimeoutQueue timeouts;
+
+      void setObjectsSink (ObjectsSink *sink);
+      void addTimeout (double secs, int type);
+      void removeTimeout (int type);
+   };
+
+   struct SourceThreadData
+   {
+      tools::LinesSource *source;
+      tools::LinesSink *sink;
+   };
+
+   enum { RING_CAPACITY = 64, BATCH_COMMANDS = 512 };
+   enum { FLUSH = 0 };
+
+   ObjectsController *successor;
+   Receiver receiver;
+   tools::SpscRing *ring;
+   CommandsBatch *batch;
+   bool flushPending;
+
+   void add (ObjectCommand::CommandType type, tools::CommonLineInfo *info,
+             const char *fmt, ...);
+   void flush ();
+   static void *runSource (void *data);
+
+protected:
+   void ownTimeout (int type);
+   void ownFinish ();
+
+public:
+   ObjectsPipe (ObjectsController *successor);
+   ~ObjectsPipe ();
+
+   void run (tools::LinesSource *source, tools::LinesSink *sink);
+
+   void objMsg (tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+   void objEnter (tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (tools::CommonLineInfo *info);
+   void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
+                const char *val);
+   void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (tools::CommonLineInfo *info, const char *id);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJECTS_PIPE_HH__
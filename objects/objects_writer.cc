@@ -29,6 +29,8 @@
 
 #include "objects_writer.hh"
 
+#include <stdarg.h>
+
 #define DBG_RTFL
 
 #include "debug_rtfl.hh"
@@ -38,24 +40,118 @@ using namespace rtfl::tools;
 // If foreign messages ("F" stands for "foreign") are passed, the original
 // filename, line number and process id must be printed.
 
-#define F_RTFL_PRINT(module, version, cmd, fmt, ...) \
-   rtfl_print (module, version, info->fileName, info->lineNo, info->processId, \
-               "s:" fmt, cmd, __VA_ARGS__)
-
-#define F_RTFL_PRINT0(module, version, cmd) \
-   rtfl_print (module, version, info->fileName, info->lineNo, info->processId, \
-               "s", cmd)
+#define F_RTFL_OBJ_PRINT(cmd, fmt, ...) print (info, cmd, fmt, __VA_ARGS__)
+#define F_RTFL_OBJ_PRINT0(cmd) print (info, cmd, "")
 
-#define F_RTFL_OBJ_PRINT(cmd, fmt, ...) \
-   F_RTFL_PRINT ("obj", RTFL_OBJ_VERSION, cmd, fmt, __VA_ARGS__)
-
-#define F_RTFL_OBJ_PRINT0(cmd) \
-   F_RTFL_PRINT0 ("obj", RTFL_OBJ_VERSION, cmd)
+// Maximal delay for output not written in line-flushed mode.
+#define FLUSH_SECS 1
 
 namespace rtfl {
 
 namespace objects {
 
+/**
+ * \brief Write to standard output, line-flushed, as rtfl_print() does.
+ */
+ObjectsWriter::ObjectsWriter ()
+{
+   output = new OutputBuffer (1, OutputBuffer::NONE);
+   output->setLineFlushed (true);
+   flushPending = false;
+}
+
+/**
+ * \brief Write to `output`, which is then owned by the writer.
+ *
+ * If `output` is not line-flushed, it is flushed at the latest after
+ * FLUSH_SECS seconds.
+ */
+ObjectsWriter::ObjectsWriter (OutputBuffer *output)
+{
+   this->output = output;
+   flushPending = false;
+}
+
+ObjectsWriter::~ObjectsWriter ()
+{
+   delete output;
+}
+
+/**
+ * \brief Print a command in the same format as rtfl_print(); `fmt` may
+ *    contain 's' and 'd'.
+ */
+void ObjectsWriter::print (CommonLineInfo *info, const char *cmd,
+                           const char *fmt, ...)
+{
+   // "\n" at the beginning just in case that the previous line is not
+   // finished yet.
+   output->put ("\n[rtfl-obj-" RTFL_OBJ_VERSION "]");
+   output->put (info->fileName);
+   output->put (':');
+   output->putInt (info->lineNo);
+   output->put (':');
+   output->putInt (info->processId);
+   output->put (':');
+   output->put (cmd);
+   if (fmt[0])
+      output->put (':');
+
+   va_list args;
+   va_start (args, fmt);
+
+   for (int i = 0; fmt[i]; i++) {
+      const char *s;
+
+      switch (fmt[i]) {
+      case 'd':
+         output->putInt (va_arg (args, int));
+         break;
+
+      case 's':
+         s = va_arg (args, const char*);
+         for (int j = 0; s[j]; j++) {
+            if (s[j] == ':' || s[j] == '\\')
+               output->put ('\\');
+            output->put (s[j]);
+         }
+         break;
+
+      default:
+         output->put (fmt[i]);
+         break;
+      }
+   }
+
+   va_end (args);
+
+   output->put ('\n');
+   output->endLine ();
+
+   if (!output->isLineFlushed () && !flushPending) {
+      addOwnTimeout (FLUSH_SECS, FLUSH);
+      flushPending = true;
+   }
+}
+
+void ObjectsWriter::ownTimeout (int type)
+{
+   if (type == FLUSH) {
+      flushPending = false;
+      output->flush ();
+   }
+}
+
+void ObjectsWriter::ownFinish ()
+{
+   if (flushPending) {
+      removeOwnTimeout (FLUSH);
+      flushPending = false;
+   }
+
+   output->close ();
+}
+
 void ObjectsWriter::objMsg (CommonLineInfo *info, const char *id,
                             const char *aspect, int prio, const char *message)
 {
@@ -2,14 +2,36 @@
 #define __OBJECTS_OBJECTS_WRITER_HH__
 
 #include "objects_parser.hh"
+#include "common/output_buffer.hh"
 
 namespace rtfl {
 
 namespace objects {
 
+/**
+ * \brief Writes all commands, in the format of rtfl_print(), to a
+ *    tools::OutputBuffer.
+ */
 class ObjectsWriter: public ObjectsControllerBase
 {
+private:
+   enum { FLUSH = 0 };
+
+   tools::OutputBuffer *output;
+   bool flushPending;
+
+   void print (tools::CommonLineInfo *info, const char *cmd, const char *fmt,
+               ...);
+
+protected:
+   void ownTimeout (int type);
+   void ownFinish ();
+
 public:
+   ObjectsWriter ();
+   ObjectsWriter (tools::OutputBuffer *output);
+   ~ObjectsWriter ();
+
    void objMsg (tools::CommonLineInfo *info, const char *id,
                 const char *aspect, int prio, const char *message);
    void objMark (tools::CommonLineInfo *info, const char *id,
@@ -41,127 +41,26 @@ namespace rtfl {
 
 namespace objects {
 
-ObjIdentController::PostController::PostController (ObjectsController
-                                                    *successor)
+ObjIdentStageBase::PostStageBase::PostStageBase ()
 {
-   this->successor = successor;
-   successor->setObjectsSource (this);
-   setObjectsSink (successor);
-
    // The "canonocal" identity is stored both as key and as value. For
    // this reason, the second argument could be "false". Check whether
    // this is possible (order of delete etc.).
    identities = new EquivalenceRelation (true, true);
+   collecting = false;
 }
 
-ObjIdentController::PostController::~PostController ()
+ObjIdentStageBase::PostStageBase::~PostStageBase ()
 {
    delete identities;
 }
 
-void ObjIdentController::PostController::objMsg (CommonLineInfo *info,
-                                                 const char *id,
-                                                 const char *aspect, int prio,
-                                                 const char *message)
-{
-   successor->objMsg (info, mapId (id), aspect, prio, message);
-}
-
-void ObjIdentController::PostController::objMark (CommonLineInfo *info,
-                                                  const char *id,
-                                                  const char *aspect, int prio,
-                                                  const char *message)
-{
-   successor->objMark (info, mapId (id), aspect, prio, message);
-}
-
-void ObjIdentController::PostController::objMsgStart (CommonLineInfo *info,
-                                                      const char *id)
-{
-   successor->objMsgStart (info, mapId (id));
-}
-
-void ObjIdentController::PostController::objMsgEnd (CommonLineInfo *info,
-                                                    const char *id)
-{
-   successor->objMsgEnd (info, mapId (id));
-}
-
-void ObjIdentController::PostController::objEnter (CommonLineInfo *info,
-                                                   const char *id,
-                                                   const char *aspect, int prio,
-                                                   const char *funname,
-                                                   const char *args)
-{
-   successor->objEnter (info, mapId (id), aspect, prio, funname, args);
-}
-
-void ObjIdentController::PostController::objLeave (CommonLineInfo *info,
-                                                   const char *id,
-                                                   const char *vals)
-{
-   successor->objLeave (info, mapId (id), vals);
-}
-
-void ObjIdentController::PostController::objCreate (CommonLineInfo *info,
-                                                    const char *id,
-                                                    const char *klass)
-{
-   successor->objCreate (info, mapId (id), klass);
-}
-
-void ObjIdentController::PostController::objIdent (CommonLineInfo *info,
-                                                   const char *id1,
-                                                   const char *id2)
-{
-   // "obj-ident" is not delegated.
-}
-
-void ObjIdentController::PostController::objNoIdent (CommonLineInfo *info)
-{
-   // "obj-noident" is not delegated.
-}
-
-void ObjIdentController::PostController::objAssoc (CommonLineInfo *info,
-                                                   const char *parent,
-                                                   const char *child)
-{
-   successor->objAssoc (info, mapId (parent), mapId (child));
-}
-
-void ObjIdentController::PostController::objSet (CommonLineInfo *info,
-                                                 const char *id,
-                                                 const char *var,
-                                                 const char *val)
-{
-   successor->objSet (info, mapId (id), var, val);
-}
-
-void ObjIdentController::PostController::objClassColor (CommonLineInfo *info,
-                                                        const char *klass,
-                                                        const char *color)
+void ObjIdentStageBase::PostStageBase::addIdentity (const char *id1,
+                                                    const char *id2)
 {
-   successor->objClassColor (info, klass, color);
-}
+   // The collected commands refer to the identities before.
+   flush ();
 
-void ObjIdentController::PostController::objObjectColor (CommonLineInfo *info,
-                                                         const char *id,
-                                                         const char *color)
-{
-   successor->objObjectColor (info, mapId (id), color);
-}
-
-void ObjIdentController::PostController::objDelete (CommonLineInfo *info,
-                                                    const char *id)
-{
-   successor->objDelete (info, mapId (id));
-
-   // TODO Remove from identities.
-}
-
-void ObjIdentController::PostController::addIdentity (const char *id1,
-                                                      const char *id2)
-{
    String key1 (id1), key2 (id2);
    
    if (!identities->contains (&key1))
@@ -173,68 +72,111 @@ void ObjIdentController::PostController::addIdentity (const char *id1,
    identities->relate (&key1, &key2);
 }
 
-const char *ObjIdentController::PostController::mapId (const char *id)
+const char *ObjIdentStageBase::PostStageBase::mapId (const char *id,
+                                                     unsigned int hashValue)
 {
-   String key (id);
-   if (!identities->contains (&key))
-       identities->put (new String (id), new String (id));
+   ConstString key (id);
+   String *value = (String*) identities->get (&key, hashValue);
+   if (value == NULL) {
+      value = new String (id);
+      identities->put (new String (id), value);
+   }
+
+   return value->chars ();
+}
+
+/**
+ * \brief Map the ids of all collected commands, in place.
+ */
+void ObjIdentStageBase::PostStageBase::mapIds ()
+{
+   int n = collected.size ();
+   hashes.setSize (2 * n);
+
+   for (int i = 0; i < n; i++)
+      for (int j = 0; j < 2; j++) {
+         const char *id = collected.getId (collected.get (i), j);
+         if (id) {
+            unsigned int h = ConstString::hashValue (id);
+            hashes.set (2 * i + j, h);
+            identities->prefetch (h);
+         }
+      }
 
-   return ((String*)identities->get(&key))->chars ();
+   for (int i = 0; i < n; i++) {
+      ObjectsBatch::Command *command = collected.get (i);
+      for (int j = 0; j < 2; j++) {
+         const char *id = collected.getId (command, j);
+         if (id)
+            collected.setId (command, j, mapId (id, hashes.get (2 * i + j)));
+      }
+   }
 }
 
 // ----------------------------------------------------------------------
 
-ObjIdentController::ObjIdentController (ObjectsController *successor)
+ObjIdentStageBase::ObjIdentStageBase ()
 {
    noIdent = false;
    stackDepth = 0;
    createPending = false;
-
-   postController = new PostController (successor);
-   buffer = new ObjectsBuffer (postController);
-   buffer->setObjectsSource (this);
-   setObjectsSink (buffer);
+   buffer = NULL;
+   postBase = NULL;
+   selective = false;
+   pendingIds = new lout::container::typed::HashSet<String> (true);
+   firstPending = 0;
+   numHeldInOrder = 0;
+   latencies = NULL;
 }
 
-ObjIdentController::~ObjIdentController ()
+ObjIdentStageBase::~ObjIdentStageBase ()
 {
-}
-
-void ObjIdentController::objMsg (CommonLineInfo *info, const char *id,
-                                 const char *aspect, int prio,
-                                 const char *message)
-{
-   buffer->objMsg (info, id, aspect, prio, message);
-}
+   if (latencies) {
+      latencies->print (stderr, "Commands held back by ObjIdentController");
+      delete latencies;
+   }
 
-void ObjIdentController::objMark (CommonLineInfo *info, const char *id,
-                                  const char *aspect, int prio,
-                                  const char *message)
-{
-   buffer->objMark (info, id, aspect, prio, message);
+   delete pendingIds;
+   delete buffer;
 }
 
-void ObjIdentController::objMsgStart (CommonLineInfo *info, const char *id)
+/**
+ * \brief In selective mode, only commands referring to new ids are held back.
+ *
+ * See ObjIdentStage for details.
+ */
+void ObjIdentStageBase::setSelective (bool selective)
 {
-   buffer->objMsgStart (info, id);
+   this->selective = selective;
 }
 
-void ObjIdentController::objMsgEnd (CommonLineInfo *info, const char *id)
+/**
+ * \brief Measure how long commands are held back; the histogram is printed
+ *    to standard error at the end.
+ */
+void ObjIdentStageBase::setLatencyHistogram (bool enabled)
 {
-   buffer->objMsgEnd (info, id);
+   if (enabled && latencies == NULL)
+      latencies = new LatencyHistogram ();
+   else if (!enabled && latencies) {
+      delete latencies;
+      latencies = NULL;
+   }
 }
 
-void ObjIdentController::objEnter (CommonLineInfo *info, const char *id,
-                                   const char *aspect, int prio,
-                                   const char *funname, const char *args)
+/**
+ * \brief Called by the constructor of ObjIdentStage, when the post stage is
+ *    constructed.
+ */
+void ObjIdentStageBase::init (PostStageBase *post)
 {
-   stackDepth++;
-
-   buffer->objEnter (info, id, aspect, prio, funname, args);
+   postBase = post;
+   buffer = new ObjectsBuffer (post);
+   buffer->setObjectsSource (this);
+   setObjectsSink (buffer);
 }
 
-void ObjIdentController::objLeave (CommonLineInfo *info, const char *id,
-                                   const char *vals)
+void ObjIdentStageBase::leave ()
 {
    stackDepth = max (stackDepth - 1, 0);
 
@@ -242,96 +184,190 @@ void ObjIdentController::objLeave (CommonLineInfo *info, const char *id,
       pass ();
       removeOwnTimeout (PASS);
    }
-
-   buffer->objLeave (info, id, vals);
 }
 
-void ObjIdentController::objCreate (CommonLineInfo *info, const char *id,
-                                    const char *klass)
+void ObjIdentStageBase::ownTimeout (int type)
 {
-   queue ();
-   buffer->objCreate (info, id, klass);
-}
+   if (type == PASS) {
+      if (selective)
+         release ();
+      else
+         pass ();
+   }
+}      
 
-void ObjIdentController::objIdent (CommonLineInfo *info, const char *id1,
-                                   const char *id2)
+void ObjIdentStageBase::ownFinish ()
 {
-   postController->addIdentity (id1, id2);
-
-   // TODO: Possibly end queueing? Probably not.
-   
-   // "obj-ident" is not delegated.
+   pass ();
 }
 
-void ObjIdentController::objNoIdent (CommonLineInfo *info)
+void ObjIdentStageBase::queue ()
 {
-   noIdent = true;
-   pass ();
+   if (!noIdent) {
+      if (createPending)
+         minCreateStackDepth = min (minCreateStackDepth, stackDepth);
+      else {
+         buffer->queue ();
+         createPending = true;
+         minCreateStackDepth = stackDepth;
+      }
 
-   // "obj-noident" is not delegated.
-}
+      // In selective mode, each pending id has its own deadline (see
+      // addPending()).
+      if (!selective) {
+         removeOwnTimeout (PASS);
+         addOwnTimeout (TIMEOUT_SECS, PASS);
+      }
+   }
+}      
 
-void ObjIdentController::objAssoc (CommonLineInfo *info, const char *parent,
-                                   const char *child)
+void ObjIdentStageBase::pass ()
 {
-   buffer->objAssoc (info, parent, child);
-}
+   postBase->flush ();
+   buffer->pass ();
+   createPending = false;
 
-void ObjIdentController::objSet (CommonLineInfo *info, const char *id,
-                                 const char *var, const char *val)
-{
-   buffer->objSet (info, id, var, val);
-}
+   if (latencies) {
+      long now = getCurrentMicros ();
+      for (int i = 0; i < heldSince.size (); i++)
+         latencies->add (now - heldSince.get (i));
+      heldSince.setSize (0);
+   }
 
-void ObjIdentController::objClassColor (CommonLineInfo *info, const char *klass,
-                                        const char *color)
-{
-   buffer->objClassColor (info, klass, color);
-}
+   if (pendingIds->size () > 0) {
+      delete pendingIds;
+      pendingIds = new lout::container::typed::HashSet<String> (true);
+   }
 
-void ObjIdentController::objObjectColor (CommonLineInfo *info, const char *id,
-                                         const char *color)
-{
-   buffer->objObjectColor (info, id, color);
+   pendingOrder.setSize (0);
+   firstPending = 0;
+   numHeldInOrder = 0;
+}      
+
+/**
+ * \brief In selective mode, hold back all following commands referring to
+ *    `id`, until TIMEOUT_SECS have passed (or until all commands are passed).
+ */
+void ObjIdentStageBase::addPending (const char *id)
+{
+   if (selective && buffer->isQueued () && id && !isPending (id)) {
+      String *key = new String (id);
+      pendingIds->put (key);
+      pendingOrder.increase ();
+      pendingOrder.getLastRef()->id = key;
+      pendingOrder.getLastRef()->deadline =
+         getCurrentMicros () + TIMEOUT_SECS * 1000000L;
+
+      // The deadlines are in increasing order, so the timeout is only needed
+      // for the first one.
+      if (firstPending == pendingOrder.size () - 1)
+         addReleaseTimeout ();
+   }
 }
 
-void ObjIdentController::objDelete (CommonLineInfo *info, const char *id)
+void ObjIdentStageBase::addReleaseTimeout ()
 {
-   buffer->objDelete (info, id);
+   long micros = pendingOrder.getRef(firstPending)->deadline
+      - getCurrentMicros ();
+   removeOwnTimeout (PASS);
+   addOwnTimeout (max (micros, 0L) / 1e6, PASS);
 }
 
-void ObjIdentController::ownTimeout (int type)
+/**
+ * \brief In selective mode, called when the timeout for the first pending
+ *    id has expired: all ids whose deadline has passed are not pending
+ *    anymore, and the commands which refer to none of the remaining pending
+ *    ids are passed.
+ */
+void ObjIdentStageBase::release ()
 {
-   if (type == PASS)
+   long now = getCurrentMicros ();
+   while (firstPending < pendingOrder.size () &&
+          pendingOrder.getRef(firstPending)->deadline <= now) {
+      pendingIds->remove (pendingOrder.getRef(firstPending)->id);
+      firstPending++;
+   }
+
+   if (firstPending == pendingOrder.size ())
       pass ();
-}      
+   else {
+      numChecked = numHeld = numHeldInOrder = 0;
+      releaseTime = now;
+      postBase->flush ();
+      buffer->pass (this);
+      if (latencies)
+         heldSince.setSize (numHeld);
+
+      // Entries before firstPending are not used anymore.
+      if (firstPending > pendingOrder.size () / 2) {
+         int n = pendingOrder.size () - firstPending;
+         for (int i = 0; i < n; i++)
+            pendingOrder.set (i, pendingOrder.get (firstPending + i));
+         pendingOrder.setSize (n);
+         firstPending = 0;
+      }
 
-void ObjIdentController::ownFinish ()
-{
-   pass ();
+      addReleaseTimeout ();
+   }
 }
 
-void ObjIdentController::queue ()
+/**
+ * \brief Called by ObjectsBuffer::pass (Release*) for each held command, in
+ *    order, see release().
+ */
+bool ObjIdentStageBase::isReleased (ObjectCommand *command)
+{
+   // Nothing passes a command held back which keeps its order, and such a
+   // command passes nothing held back.
+   bool keepOrder = keepsOrder (command->getType ());
+   bool released = numHeldInOrder == 0 && (!keepOrder || numHeld == 0) &&
+      !isPending (command->getId (0)) && !isPending (command->getId (1));
+   if (!released && keepOrder)
+      numHeldInOrder++;
+
+   // heldSince corresponds to the held commands; only the entries of the
+   // commands still held are kept.
+   if (latencies) {
+      long since = heldSince.get (numChecked);
+      if (released)
+         latencies->add (releaseTime - since);
+      else
+         heldSince.set (numHeld, since);
+   }
+
+   numChecked++;
+   if (!released)
+      numHeld++;
+
+   return released;
+}
+
+/**
+ * \brief Return whether commands of this type are never reordered in
+ *    selective mode (see ObjIdentStage).
+ */
+bool ObjIdentStageBase::keepsOrder (ObjectCommand::CommandType type)
 {
-   if (!noIdent) {
-      if (createPending)
-         minCreateStackDepth = min (minCreateStackDepth, stackDepth);
-      else {
-         buffer->queue ();
-         createPending = true;
-         minCreateStackDepth = stackDepth;
-      }
+   return type == ObjectCommand::ENTER || type == ObjectCommand::LEAVE ||
+      type == ObjectCommand::MSG_START || type == ObjectCommand::MSG_END;
+}
 
-      removeOwnTimeout (PASS);
-      addOwnTimeout (TIMEOUT_SECS, PASS);
+bool ObjIdentStageBase::isPending (const char *id)
+{
+   if (id == NULL || pendingIds->size () == 0)
+      return false;
+   else {
+      String key (id);
+      return pendingIds->contains (&key);
    }
-}      
+}
+
+// ----------------------------------------------------------------------
 
-void ObjIdentController::pass ()
+ObjIdentController::ObjIdentController (ObjectsController *successor):
+   ObjIdentStage<ObjectsController> (successor)
 {
-   buffer->pass ();
-   createPending = false;
-}      
+}
   
 } // namespace objects
 
@@ -9,6 +9,249 @@ namespace rtfl {
 
 namespace objects {
 
+/**
+ * \brief The part of ObjIdentStage which does not depend on the successor.
+ */
+class ObjIdentStageBase: public ObjectsControllerBase,
+                         private ObjectsBuffer::Release
+{
+protected:
+   class PostStageBase: public ObjectsControllerBase
+   {
+   private:
+      tools::EquivalenceRelation *identities;
+      lout::misc::SimpleVector<unsigned int> hashes;
+
+   protected:
+      // While collecting (see collect()), the commands are added to
+      // `collected`, and their ids are mapped together by flush().
+      bool collecting;
+      ObjectsBatch collected;
+
+      PostStageBase ();
+      ~PostStageBase ();
+
+      inline const char *mapId (const char *id)
+      { return mapId (id, lout::object::ConstString::hashValue (id)); }
+      const char *mapId (const char *id, unsigned int hashValue);
+      void mapIds ();
+
+   public:
+      void addIdentity (const char *id1, const char *id2);
+
+      /**
+       * \brief Collect the following commands, until flush() is called.
+       *
+       * The arguments have to be valid until then.
+       */
+      inline void collect () { collecting = true; }
+
+      /**
+       * \brief Pass the collected commands, and stop collecting.
+       */
+      virtual void flush () = 0;
+   };
+
+   template <class Successor> class PostStage: public PostStageBase
+   {
+   private:
+      Successor *successor;
+
+   public:
+      PostStage (Successor *successor) {
+         this->successor = successor;
+         successor->setObjectsSource (this);
+         setObjectsSink (successor);
+      }
+
+      void flush ()
+      {
+         collecting = false;
+         if (collected.size () > 0) {
+            mapIds ();
+            successor->objCommands (&collected);
+            collected.clear ();
+         }
+      }
+
+      void objMsg (tools::CommonLineInfo *info, const char *id,
+                   const char *aspect, int prio, const char *message)
+      {
+         if (collecting)
+            collected.objMsg (info, id, aspect, prio, message);
+         else
+            successor->objMsg (info, mapId (id), aspect, prio, message);
+      }
+      void objMark (tools::CommonLineInfo *info, const char *id,
+                    const char *aspect, int prio, const char *message)
+      {
+         if (collecting)
+            collected.objMark (info, id, aspect, prio, message);
+         else
+            successor->objMark (info, mapId (id), aspect, prio, message);
+      }
+      void objMsgStart (tools::CommonLineInfo *info, const char *id)
+      {
+         if (collecting)
+            collected.objMsgStart (info, id);
+         else
+            successor->objMsgStart (info, mapId (id));
+      }
+      void objMsgEnd (tools::CommonLineInfo *info, const char *id)
+      {
+         if (collecting)
+            collected.objMsgEnd (info, id);
+         else
+            successor->objMsgEnd (info, mapId (id));
+      }
+      void objEnter (tools::CommonLineInfo *info, const char *id,
+                     const char *aspect, int prio, const char *funname,
+                     const char *args)
+      {
+         if (collecting)
+            collected.objEnter (info, id, aspect, prio, funname, args);
+         else
+            successor->objEnter (info, mapId (id), aspect, prio, funname,
+                                 args);
+      }
+      void objLeave (tools::CommonLineInfo *info, const char *id,
+                     const char *vals)
+      {
+         if (collecting)
+            collected.objLeave (info, id, vals);
+         else
+            successor->objLeave (info, mapId (id), vals);
+      }
+      void objCreate (tools::CommonLineInfo *info, const char *id,
+                      const char *klass)
+      {
+         if (collecting)
+            collected.objCreate (info, id, klass);
+         else
+            successor->objCreate (info, mapId (id), klass);
+      }
+      // "obj-ident" and "obj-noident" are not delegated.
+      void objIdent (tools::CommonLineInfo *info, const char *id1,
+                     const char *id2) { }
+      void objNoIdent (tools::CommonLineInfo *info) { }
+      void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                     const char *child)
+      {
+         if (collecting)
+            collected.objAssoc (info, parent, child);
+         else
+            successor->objAssoc (info, mapId (parent), mapId (child));
+      }
+      void objSet (tools::CommonLineInfo *info, const char *id,
+                   const char *var, const char *val)
+      {
+         if (collecting)
+            collected.objSet (info, id, var, val);
+         else
+            successor->objSet (info, mapId (id), var, val);
+      }
+      void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                          const char *color)
+      {
+         if (collecting)
+            collected.objClassColor (info, klass, color);
+         else
+            successor->objClassColor (info, klass, color);
+      }
+      void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                           const char *color)
+      {
+         if (collecting)
+            collected.objObjectColor (info, id, color);
+         else
+            successor->objObjectColor (info, mapId (id), color);
+      }
+      // TODO Remove from identities.
+      void objDelete (tools::CommonLineInfo *info, const char *id)
+      {
+         if (collecting)
+            collected.objDelete (info, id);
+         else
+            successor->objDelete (info, mapId (id));
+      }
+   };
+
+   ObjectsBuffer *buffer;
+   bool noIdent;
+
+   ObjIdentStageBase ();
+   ~ObjIdentStageBase ();
+
+   void init (PostStageBase *post);
+   inline void enter () { stackDepth++; }
+   void leave ();
+   void queue ();
+   void pass ();
+   void addPending (const char *id);
+
+   /**
+    * \brief Return whether a command referring to the ids `id1` and `id2`
+    *    (both may be NULL) has to be held back.
+    *
+    * `keepOrder` is set for the commands which are never reordered in
+    * selective mode (see keepsOrder()).
+    */
+   inline bool hold (const char *id1, const char *id2 = NULL,
+                     bool keepOrder = false)
+   {
+      if (buffer->isQueued () &&
+          (!selective || numHeldInOrder > 0 || isPending (id1) ||
+           isPending (id2) || (keepOrder && !buffer->isEmpty ()))) {
+         if (selective && keepOrder)
+            numHeldInOrder++;
+         if (latencies) {
+            heldSince.increase ();
+            heldSince.setLast (tools::getCurrentMicros ());
+         }
+         return true;
+      } else {
+         if (latencies)
+            latencies->add (0);
+         return false;
+      }
+   }
+
+   void ownTimeout (int type);
+   void ownFinish ();
+
+private:
+   enum { PASS = 0 };
+
+   struct Pending
+   {
+      lout::object::String *id; // Owned by pendingIds.
+      long deadline;            // In microseconds, see getCurrentMicros().
+   };
+   
+   PostStageBase *postBase;
+   int stackDepth;
+   bool createPending;
+   int minCreateStackDepth;
+
+   bool selective;
+   lout::container::typed::HashSet<lout::object::String> *pendingIds;
+   lout::misc::SimpleVector<Pending> pendingOrder;
+   int firstPending, numChecked, numHeld, numHeldInOrder;
+   tools::LatencyHistogram *latencies;
+   lout::misc::SimpleVector<long> heldSince;
+   long releaseTime;
+
+   bool isPending (const char *id);
+   static bool keepsOrder (ObjectCommand::CommandType type);
+   void release ();
+   void addReleaseTimeout ();
+   bool isReleased (ObjectCommand *command);
+
+public:
+   void setSelective (bool selective);
+   void setLatencyHistogram (bool enabled);
+};
+
 /**
  * \ident Filter Controller for handling `obj-ident`
  * 
@@ -50,9 +293,9 @@ namespace objects {
  * General Approach
  * ----------------
  * Handling `obj-ident` is kept out of the specific implementations of
- * `ObjectsController` and implemented in a filter, `ObjIdentController`, which
+ * `ObjectsController` and implemented in a filter, `ObjIdentStage`, which
  * will translate all identities to actually identical identities; the output of
- * `ObjIdentController` would, in the example above, be:
+ * `ObjIdentStage` would, in the example above, be:
  * 
  *     [rtfl-obj-1.0]...:create:0x1000:A
  *     [rtfl-obj-1.0]...:create:0x1000:B
@@ -84,9 +327,43 @@ namespace objects {
  *    seconds; after some time, it can be assumed that the construction of
  *    objects is over.
  *
- * (May be extended. See rtfl::objects::ObjIdentController::objLeave,
- * rtfl::objects::ObjIdentController::ownTimeout, and
- * rtfl::objects::ObjIdentController::ownFinish.
+ * (May be extended. See rtfl::objects::ObjIdentStage::objLeave,
+ * rtfl::objects::ObjIdentStageBase::ownTimeout, and
+ * rtfl::objects::ObjIdentStageBase::ownFinish.
+ *
+ * As long as nothing is held back, commands are passed directly to the post
+ * stage (which maps the ids), without being copied into the buffer. A batch
+ * of commands (see ObjectsController::objCommands) is collected by the post
+ * stage, whose ids are then mapped together, and which is passed as a batch
+ * to the successor; the post stage passes the collected commands before the
+ * identities change, and before commands are passed from the buffer.
+ *
+ * Selective mode
+ * --------------
+ * Holding back the whole stream delays live viewing, by up to the timeout
+ * after the last `obj-create`. In selective mode (see
+ * ObjIdentStageBase::setSelective), only commands referring to ids which
+ * have been created (or named in `obj-ident`) since the first pending
+ * `obj-create` are held back; all other commands are passed immediately.
+ * Commands referring to the same id keep their order, but commands referring
+ * to different ids may be reordered. The exception are `obj-enter`,
+ * `obj-leave`, `obj-msg-start` and `obj-msg-end`, which form one global
+ * stack (see e. g. ObjViewController): they are held back as long as any
+ * command before them is, and, while one of them is held back, all
+ * following commands are as well. Instead of one timeout for all
+ * commands, each id is pending until the timeout after its own `obj-create`
+ * (or `obj-ident`); then, the commands referring to no pending id anymore
+ * are passed. So, bursts of creations cannot hold back commands of other
+ * objects indefinitely, and an object created late still gets the full
+ * timeout for its `obj-ident`.
+ *
+ * How long commands are held back can be measured with a
+ * tools::LatencyHistogram (see ObjIdentStageBase::setLatencyHistogram), which
+ * is printed to standard error when the controller is destroyed.
+ *
+ * The successor is called via `Successor`, so that the calls are not virtual
+ * when `Successor` is a final class (see FinalController). Use
+ * ObjIdentController for any successor.
  *
  * Nice to have
  * ------------
@@ -94,95 +371,149 @@ namespace objects {
  *   certain time after "obj-create" or a certain time after no commands (latter
  *   is currently implemented).
  */
-class ObjIdentController: public ObjectsControllerBase
+template <class Successor> class ObjIdentStage: public ObjIdentStageBase
 {
 private:
-   class PostController: public ObjectsControllerBase
-   {
-      tools::EquivalenceRelation *identities;
-      ObjectsController *successor;
-
-      const char *mapId (const char *id);
-
-   public:
-      PostController (ObjectsController *successor);
-      ~PostController ();
-      
-      void objMsg (tools::CommonLineInfo *info, const char *id,
-                   const char *aspect, int prio, const char *message);
-      void objMark (tools::CommonLineInfo *info, const char *id,
-                    const char *aspect, int prio, const char *message);
-      void objMsgStart (tools::CommonLineInfo *info, const char *id);
-      void objMsgEnd (tools::CommonLineInfo *info, const char *id);
-      void objEnter (tools::CommonLineInfo *info, const char *id,
-                     const char *aspect, int prio, const char *funname,
-                     const char *args);
-      void objLeave (tools::CommonLineInfo *info, const char *id,
-                     const char *vals);
-      void objCreate (tools::CommonLineInfo *info, const char *id,
-                      const char *klass);
-      void objIdent (tools::CommonLineInfo *info, const char *id1,
-                     const char *id2);
-      void objNoIdent (tools::CommonLineInfo *info);
-      void objAssoc (tools::CommonLineInfo *info, const char *parent,
-                     const char *child);
-      void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
-                   const char *val);
-      void objClassColor (tools::CommonLineInfo *info, const char *klass,
-                          const char *color);
-      void objObjectColor (tools::CommonLineInfo *info, const char *id,
-                           const char *color);
-      void objDelete (tools::CommonLineInfo *info, const char *id);
-
-      void addIdentity (const char *id1, const char *id2);
-   };
+   PostStage<Successor> post;
 
-   enum { PASS = 0 };
-   
-   ObjectsBuffer *buffer;
-   PostController *postController;
-   bool noIdent;
-
-   int stackDepth;
-   bool createPending;
-   int minCreateStackDepth;
-
-   void queue ();
-   void pass ();
-   
-protected:
-   void ownTimeout (int type);
-   void ownFinish ();
+public:
+   ObjIdentStage (Successor *successor): post (successor) { init (&post); }
 
-public:   
-   ObjIdentController (ObjectsController *successor);
-   ~ObjIdentController ();
+   void objCommands (ObjectsBatch *batch)
+   {
+      for (int i = 0; i < batch->size (); i++) {
+         post.collect ();
+         ObjectsBatch::pass (this, batch->get (i));
+      }
+      post.flush ();
+   }
 
    void objMsg (tools::CommonLineInfo *info, const char *id,
-                const char *aspect, int prio, const char *message);
+                const char *aspect, int prio, const char *message)
+   {
+      if (hold (id))
+         buffer->objMsg (info, id, aspect, prio, message);
+      else
+         post.objMsg (info, id, aspect, prio, message);
+   }
    void objMark (tools::CommonLineInfo *info, const char *id,
-                 const char *aspect, int prio, const char *message);
-   void objMsgStart (tools::CommonLineInfo *info, const char *id);
-   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+                 const char *aspect, int prio, const char *message)
+   {
+      if (hold (id))
+         buffer->objMark (info, id, aspect, prio, message);
+      else
+         post.objMark (info, id, aspect, prio, message);
+   }
+   void objMsgStart (tools::CommonLineInfo *info, const char *id)
+   {
+      if (hold (id, NULL, true))
+         buffer->objMsgStart (info, id);
+      else
+         post.objMsgStart (info, id);
+   }
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id)
+   {
+      if (hold (id, NULL, true))
+         buffer->objMsgEnd (info, id);
+      else
+         post.objMsgEnd (info, id);
+   }
    void objEnter (tools::CommonLineInfo *info, const char *id,
                   const char *aspect, int prio, const char *funname,
-                  const char *args);
+                  const char *args)
+   {
+      enter ();
+      if (hold (id, NULL, true))
+         buffer->objEnter (info, id, aspect, prio, funname, args);
+      else
+         post.objEnter (info, id, aspect, prio, funname, args);
+   }
    void objLeave (tools::CommonLineInfo *info, const char *id,
-                  const char *vals);
+                  const char *vals)
+   {
+      leave ();
+      if (hold (id, NULL, true))
+         buffer->objLeave (info, id, vals);
+      else
+         post.objLeave (info, id, vals);
+   }
    void objCreate (tools::CommonLineInfo *info, const char *id,
-                   const char *klass);
+                   const char *klass)
+   {
+      queue ();
+      addPending (id);
+      if (hold (id))
+         buffer->objCreate (info, id, klass);
+      else
+         post.objCreate (info, id, klass);
+   }
    void objIdent (tools::CommonLineInfo *info, const char *id1,
-                  const char *id2);
-   void objNoIdent (tools::CommonLineInfo *info);
+                  const char *id2)
+   {
+      post.addIdentity (id1, id2);
+      addPending (id1);
+      addPending (id2);
+
+      // TODO: Possibly end queueing? Probably not.
+   
+      // "obj-ident" is not delegated.
+   }
+   void objNoIdent (tools::CommonLineInfo *info)
+   {
+      noIdent = true;
+      pass ();
+
+      // "obj-noident" is not delegated.
+   }
    void objAssoc (tools::CommonLineInfo *info, const char *parent,
-                  const char *child);
+                  const char *child)
+   {
+      if (hold (parent, child))
+         buffer->objAssoc (info, parent, child);
+      else
+         post.objAssoc (info, parent, child);
+   }
    void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
-                const char *val);
+                const char *val)
+   {
+      if (hold (id))
+         buffer->objSet (info, id, var, val);
+      else
+         post.objSet (info, id, var, val);
+   }
    void objClassColor (tools::CommonLineInfo *info, const char *klass,
-                       const char *color);
+                       const char *color)
+   {
+      if (hold (NULL))
+         buffer->objClassColor (info, klass, color);
+      else
+         post.objClassColor (info, klass, color);
+   }
    void objObjectColor (tools::CommonLineInfo *info, const char *id,
-                        const char *color);
-   void objDelete (tools::CommonLineInfo *info, const char *id);
+                        const char *color)
+   {
+      if (hold (id))
+         buffer->objObjectColor (info, id, color);
+      else
+         post.objObjectColor (info, id, color);
+   }
+   void objDelete (tools::CommonLineInfo *info, const char *id)
+   {
+      if (hold (id))
+         buffer->objDelete (info, id);
+      else
+         post.objDelete (info, id);
+   }
+};
+
+/**
+ * \brief ObjIdentStage for any successor, which is called via virtual
+ *    methods.
+ */
+class ObjIdentController: public ObjIdentStage<ObjectsController>
+{
+public:
+   ObjIdentController (ObjectsController *successor);
 };
 
 } // namespace objects
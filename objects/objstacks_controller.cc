@@ -0,0 +1,361 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objstacks_controller.hh"
+
+#include <stdlib.h>
+
+#define DBG_RTFL
+
+#include "debug_rtfl.hh"
+
+using namespace lout::object;
+using namespace lout::container::typed;
+using namespace rtfl::tools;
+
+namespace rtfl {
+
+namespace objects {
+
+ObjStacksController::ObjStacksController (const char *method, Format format,
+                                          int minNumCalls)
+{
+   this->method = method;
+   this->format = format;
+   this->minNumCalls = minNumCalls;
+   numCalls = 0;
+   passThrough = endSoon = false;
+   endCount = -1;
+   mark = NULL;
+   first = true;
+
+   funIds = new HashTable<ConstString, Integer> (true, true, 1021);
+   methodId = method ? internFunction (method) : -1;
+
+   // Node 0 is the root, i. e. the empty stack.
+   nodes.increase ();
+   Node *root = nodes.getLastRef ();
+   root->parent = root->funId = root->hashNext = -1;
+   root->count = 0;
+
+   hashTable.setSize (256, -1);
+}
+
+ObjStacksController::~ObjStacksController ()
+{
+   for (int i = 0; i < stack.size (); i++)
+      if (stack.getRef(i)->line)
+         free (stack.getRef(i)->line);
+
+   delete funIds;
+}
+
+/**
+ * \brief Do not print stack traces, but all commands (as options `-e` and
+ *    `-m`).
+ *
+ * If a stack trace would have been printed, exit after `endCount` further
+ * commands (unless `endCount` is negative), and add an `obj-mark` with the
+ * message `mark` (unless `mark` is NULL).
+ */
+void ObjStacksController::setPassThrough (int endCount, const char *mark)
+{
+   passThrough = true;
+   this->endCount = endCount;
+   this->mark = mark;
+}
+
+int ObjStacksController::internFunction (const char *funname)
+{
+   ConstString key (funname);
+   Integer *id = funIds->get (&key);
+   if (id)
+      return id->getValue ();
+   else {
+      int newId = funNames.size ();
+      String *newKey = new String (funname);
+      funIds->put (newKey, new Integer (newId));
+      // The string is owned by funIds.
+      funNames.increase ();
+      funNames.setLast (newKey->chars ());
+      return newId;
+   }
+}
+
+int ObjStacksController::findOrAddNode (int parent, int funId)
+{
+   unsigned int hash = (unsigned int)parent * 31 + (unsigned int)funId;
+   int bucket = hash & (hashTable.size () - 1);
+
+   for (int i = hashTable.get (bucket); i != -1;
+        i = nodes.getRef(i)->hashNext) {
+      Node *node = nodes.getRef (i);
+      if (node->parent == parent && node->funId == funId)
+         return i;
+   }
+
+   int newNode = nodes.size ();
+   nodes.increase ();
+   Node *node = nodes.getLastRef ();
+   node->parent = parent;
+   node->funId = funId;
+   node->count = 0;
+   node->hashNext = hashTable.get (bucket);
+   hashTable.set (bucket, newNode);
+
+   if (nodes.size () > hashTable.size ())
+      rehash ();
+
+   return newNode;
+}
+
+void ObjStacksController::rehash ()
+{
+   hashTable.setSize (2 * hashTable.size ());
+   for (int i = 0; i < hashTable.size (); i++)
+      hashTable.set (i, -1);
+
+   // Node 0 (root) is never searched for.
+   for (int i = 1; i < nodes.size (); i++) {
+      Node *node = nodes.getRef (i);
+      unsigned int hash =
+         (unsigned int)node->parent * 31 + (unsigned int)node->funId;
+      int bucket = hash & (hashTable.size () - 1);
+      node->hashNext = hashTable.get (bucket);
+      hashTable.set (bucket, i);
+   }
+}
+
+void ObjStacksController::echo (CommonLineInfo *info)
+{
+   if (passThrough && (!endSoon || endCount > 0)) {
+      printf ("%s\n", info->completeLine);
+      if (endSoon) {
+         endCount--;
+         if (endCount == 0) {
+            // Nothing will be printed anymore, so there is no need to read
+            // the rest of the stream.
+            fflush (stdout);
+            exit (0);
+         }
+      }
+   }
+}
+
+void ObjStacksController::found (CommonLineInfo *info, const char *id,
+                                 const char *aspect, int prio)
+{
+   int node = stack.getLastRef()->node;
+   nodes.getRef(node)->count++;
+
+   if (passThrough) {
+      if (mark)
+         rtfl_print ("obj", RTFL_OBJ_VERSION, info->fileName, info->lineNo,
+                     info->processId, "s:s:s:d:s", "mark", id, aspect, prio,
+                     mark);
+
+      if (endCount >= 0 && !endSoon) {
+         endSoon = true;
+         if (endCount == 0) {
+            fflush (stdout);
+            exit (0);
+         }
+      }
+   } else {
+      switch (format) {
+      case FULL:
+         if (!first)
+            printf ("----------------------------------------"
+                    "---------------------------------------\n");
+         for (int i = 0; i < stack.size (); i++)
+            printf ("%s\n", stack.getRef(i)->line);
+         break;
+
+      case SHORT:
+         printPath (node, " > ");
+         putchar ('\n');
+         break;
+
+      default:
+         // Printed at the end.
+         break;
+      }
+
+      first = false;
+   }
+}
+
+void ObjStacksController::printPath (int node, const char *separator)
+{
+   lout::misc::SimpleVector<int> path;
+   for (int i = node; i > 0; i = nodes.getRef(i)->parent) {
+      path.increase ();
+      path.setLast (i);
+   }
+
+   for (int i = path.size () - 1; i >= 0; i--) {
+      fputs (funNames.get (nodes.getRef(path.get(i))->funId), stdout);
+      if (i > 0)
+         fputs (separator, stdout);
+   }
+}
+
+void ObjStacksController::ownFinish ()
+{
+   if (!passThrough && (format == COUNTED || format == FOLDED)) {
+      for (int i = 1; i < nodes.size (); i++) {
+         Node *node = nodes.getRef (i);
+         if (node->count > 0) {
+            if (format == COUNTED) {
+               printf ("%ld: ", node->count);
+               printPath (i, " > ");
+               putchar ('\n');
+            } else {
+               printPath (i, ";");
+               printf (" %ld\n", node->count);
+            }
+         }
+      }
+   }
+
+   fflush (stdout);
+}
+
+void ObjStacksController::objMsg (CommonLineInfo *info, const char *id,
+                                  const char *aspect, int prio,
+                                  const char *message)
+{
+   echo (info);
+}
+
+void ObjStacksController::objMark (CommonLineInfo *info, const char *id,
+                                   const char *aspect, int prio,
+                                   const char *message)
+{
+   echo (info);
+}
+
+void ObjStacksController::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   echo (info);
+}
+
+void ObjStacksController::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   echo (info);
+}
+
+void ObjStacksController::objEnter (CommonLineInfo *info, const char *id,
+                                    const char *aspect, int prio,
+                                    const char *funname, const char *args)
+{
+   echo (info);
+
+   int funId = internFunction (funname);
+   int parent = stack.size () > 0 ? stack.getLastRef()->node : 0;
+
+   stack.increase ();
+   Frame *frame = stack.getLastRef ();
+   frame->node = findOrAddNode (parent, funId);
+   frame->line = (!passThrough && format == FULL) ?
+      strdup (info->completeLine) : NULL;
+
+   if (method == NULL)
+      found (info, id, aspect, prio);
+   else if (funId == methodId) {
+      numCalls++;
+      if (numCalls >= minNumCalls)
+         found (info, id, aspect, prio);
+   }
+}
+
+void ObjStacksController::objLeave (CommonLineInfo *info, const char *id,
+                                    const char *vals)
+{
+   echo (info);
+
+   if (stack.size () > 0) {
+      Frame *frame = stack.getLastRef ();
+      if (nodes.getRef(frame->node)->funId == methodId)
+         numCalls--;
+      if (frame->line)
+         free (frame->line);
+      stack.setSize (stack.size () - 1);
+   }
+}
+
+void ObjStacksController::objCreate (CommonLineInfo *info, const char *id,
+                                     const char *klass)
+{
+   echo (info);
+}
+
+void ObjStacksController::objIdent (CommonLineInfo *info, const char *id1,
+                                    const char *id2)
+{
+   echo (info);
+}
+
+void ObjStacksController::objNoIdent (CommonLineInfo *info)
+{
+   echo (info);
+}
+
+void ObjStacksController::objAssoc (CommonLineInfo *info, const char *parent,
+                                    const char *child)
+{
+   echo (info);
+}
+
+void ObjStacksController::objSet (CommonLineInfo *info, const char *id,
+                                  const char *var, const char *val)
+{
+   echo (info);
+}
+
+void ObjStacksController::objClassColor (CommonLineInfo *info,
+                                         const char *klass, const char *color)
+{
+   echo (info);
+}
+
+void ObjStacksController::objObjectColor (CommonLineInfo *info,
+                                          const char *id, const char *color)
+{
+   echo (info);
+}
+
+void ObjStacksController::objDelete (CommonLineInfo *info, const char *id)
+{
+   echo (info);
+}
+
+} // namespace objects
+
+} // namespace rtfl
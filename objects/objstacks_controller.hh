@@ -0,0 +1,113 @@
+#ifndef __OBJECTS_OBJSTACKS_CONTROLLER_HH__
+#define __OBJECTS_OBJSTACKS_CONTROLLER_HH__
+
+#include "objects_parser.hh"
+#include "lout/misc.hh"
+#include "lout/container.hh"
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief Reconstructs call stacks from `obj-enter` and `obj-leave`, and
+ *    prints (or aggregates) those stack traces leading to a specific method.
+ *
+ * This is the implementation of `rtfl-stacktraces`. Function names are
+ * interned, and the call stack is a vector of nodes of a trie (a node
+ * represents a stack trace, and is identified by the node of the caller and
+ * the function id; children are found via a hash table). So, an `obj-enter`
+ * costs one lookup of the function name and one hash table lookup, and memory
+ * usage depends only on the number of different stack traces, not on the
+ * length of the stream.
+ *
+ * Each node counts how often its stack trace has been seen; for the formats
+ * COUNTED and FOLDED, the counts are printed at the end of the stream.
+ */
+class ObjStacksController: public ObjectsControllerBase
+{
+public:
+   enum Format {
+      FULL,    ///< All lines of the stack, separated by a line.
+      SHORT,   ///< One line per stack, function names separated by " > ".
+      COUNTED, ///< Like SHORT, but each stack once, with counts, at the end.
+      FOLDED   ///< Folded stacks ("a;b;c count"), as used by flame graphs.
+   };
+
+private:
+   struct Node
+   {
+      int parent, funId, hashNext;
+      long count;
+   };
+
+   struct Frame
+   {
+      int node;
+      char *line; // Only for FULL.
+   };
+
+   const char *method;
+   int methodId;
+   Format format;
+   int minNumCalls, numCalls;
+   bool passThrough, endSoon, first;
+   int endCount;
+   const char *mark;
+
+   lout::container::typed::HashTable<lout::object::ConstString,
+                                     lout::object::Integer> *funIds;
+   lout::misc::SimpleVector<const char*> funNames;
+   lout::misc::SimpleVector<Node> nodes;
+   lout::misc::SimpleVector<int> hashTable;
+   lout::misc::SimpleVector<Frame> stack;
+
+   int internFunction (const char *funname);
+   int findOrAddNode (int parent, int funId);
+   void rehash ();
+   void echo (tools::CommonLineInfo *info);
+   void found (tools::CommonLineInfo *info, const char *id,
+               const char *aspect, int prio);
+   void printPath (int node, const char *separator);
+
+protected:
+   void ownFinish ();
+
+public:
+   ObjStacksController (const char *method, Format format, int minNumCalls);
+   ~ObjStacksController ();
+
+   void setPassThrough (int endCount, const char *mark);
+
+   void objMsg (tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+   void objEnter (tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (tools::CommonLineInfo *info);
+   void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
+                const char *val);
+   void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (tools::CommonLineInfo *info, const char *id);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJSTACKS_CONTROLLER_HH__
@@ -0,0 +1,427 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version; with the following exception:
+ *
+ * The copyright holders of RTFL give you permission to link this file
+ * statically or dynamically against all versions of the graphviz
+ * library, which are published by AT&T Corp. under one of the following
+ * licenses:
+ *
+ * - Common Public License version 1.0 as published by International
+ *   Business Machines Corporation (IBM), or
+ * - Eclipse Public License version 1.0 as published by the Eclipse
+ *   Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fnmatch.h>
+#include "objtail_controller.hh"
+
+using namespace lout::object;
+using namespace lout::container::typed;
+using namespace rtfl::tools;
+
+namespace rtfl {
+
+namespace objects {
+
+ObjTailController::Command::Command (long serial, ObjectCommand *command)
+{
+   this->serial = serial;
+   this->command = command;
+}
+
+ObjTailController::Command::~Command ()
+{
+   delete command;
+}
+
+int ObjTailController::Command::compareTo (Comparable *other)
+{
+   long otherSerial = ((Command*)other)->serial;
+   return serial < otherSerial ? -1 : (serial > otherSerial ? 1 : 0);
+}
+
+// ----------------------------------------------------------------------
+
+ObjTailController::ObjInfo::ObjInfo ()
+{
+   create = NULL;
+   deleteSerial = -1;
+   attrs = NULL;
+   assocs = NULL;
+   parents = NULL;
+}
+
+ObjTailController::ObjInfo::~ObjInfo ()
+{
+   if (create)
+      delete create;
+   if (attrs)
+      delete attrs;
+   if (assocs)
+      delete assocs;
+   if (parents)
+      delete parents;
+}
+
+// ----------------------------------------------------------------------
+
+ObjTailController::ObjTailController (ObjectsController *successor,
+                                      int tailLength)
+{
+   assert (tailLength > 0);
+
+   this->successor = successor;
+   successor->setObjectsSource (this);
+   setObjectsSink (successor);
+
+   this->tailLength = tailLength;
+   tail = new Command*[tailLength];
+   tailStart = tailSize = 0;
+   serial = 0;
+
+   objInfos = new HashTable<String, ObjInfo> (true, true, OBJ_INFOS_TABLE_SIZE);
+   colorCommands = new Vector<Command> (1, true);
+   attrPatterns = new Vector<String> (1, true);
+   negAttrPatterns = new Vector<String> (1, true);
+}
+
+ObjTailController::~ObjTailController ()
+{
+   for (int i = 0; i < tailSize; i++)
+      delete tail[(tailStart + i) % tailLength];
+   delete[] tail;
+
+   delete objInfos;
+   delete colorCommands;
+   delete attrPatterns;
+   delete negAttrPatterns;
+}
+
+/**
+ * \brief Select (`selected` is true, option `-a`) or deselect (option `-A`)
+ *    attributes for which the last value before the tail is shown.
+ *
+ * `pattern` is passed to fnmatch(3). Deselecting has precedence.
+ */
+void ObjTailController::addAttrPattern (const char *pattern, bool selected)
+{
+   (selected ? attrPatterns : negAttrPatterns)->put (new String (pattern));
+}
+
+void ObjTailController::objMsg (CommonLineInfo *info, const char *id,
+                                const char *aspect, int prio,
+                                const char *message)
+{
+   add (new ObjectCommand (ObjectCommand::MSG, info, "ssds", id, aspect, prio,
+                           message));
+}
+
+void ObjTailController::objMark (CommonLineInfo *info, const char *id,
+                                 const char *aspect, int prio,
+                                 const char *message)
+{
+   add (new ObjectCommand (ObjectCommand::MARK, info, "ssds", id, aspect, prio,
+                           message));
+}
+
+void ObjTailController::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   add (new ObjectCommand (ObjectCommand::MSG_START, info, "s", id));
+}
+
+void ObjTailController::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   add (new ObjectCommand (ObjectCommand::MSG_END, info, "s", id));
+}
+
+void ObjTailController::objEnter (CommonLineInfo *info, const char *id,
+                                  const char *aspect, int prio,
+                                  const char *funname, const char *args)
+{
+   add (new ObjectCommand (ObjectCommand::ENTER, info, "ssdss", id, aspect,
+                           prio, funname, args));
+}
+
+void ObjTailController::objLeave (CommonLineInfo *info, const char *id,
+                                  const char *vals)
+{
+   add (new ObjectCommand (ObjectCommand::LEAVE, info, "ss", id, vals));
+}
+
+void ObjTailController::objCreate (CommonLineInfo *info, const char *id,
+                                   const char *klass)
+{
+   ObjectCommand *command =
+      new ObjectCommand (ObjectCommand::CREATE, info, "ss", id, klass);
+   add (command);
+
+   ObjInfo *objInfo = ensureObjInfo (id);
+   if (objInfo->create)
+      delete objInfo->create;
+   objInfo->create = new Command (serial, new ObjectCommand (command));
+}
+
+void ObjTailController::objIdent (CommonLineInfo *info, const char *id1,
+                                  const char *id2)
+{
+   // Already handled by ObjIdentController.
+}
+
+void ObjTailController::objNoIdent (CommonLineInfo *info)
+{
+   // Already handled by ObjIdentController.
+}
+
+void ObjTailController::objAssoc (CommonLineInfo *info, const char *parent,
+                                  const char *child)
+{
+   ObjectCommand *command =
+      new ObjectCommand (ObjectCommand::ASSOC, info, "ss", parent, child);
+   add (command);
+
+   ObjInfo *parentInfo = ensureObjInfo (parent);
+   if (parentInfo->assocs == NULL)
+      parentInfo->assocs =
+         new HashTable<String, Command> (true, true, SMALL_TABLE_SIZE);
+   parentInfo->assocs->put (new String (child),
+                            new Command (serial, new ObjectCommand (command)));
+
+   ObjInfo *childInfo = ensureObjInfo (child);
+   if (childInfo->parents == NULL)
+      childInfo->parents = new HashSet<String> (true, SMALL_TABLE_SIZE);
+   childInfo->parents->put (new String (parent));
+}
+
+void ObjTailController::objSet (CommonLineInfo *info, const char *id,
+                                const char *var, const char *val)
+{
+   ObjectCommand *command =
+      new ObjectCommand (ObjectCommand::SET, info, "sss", id, var, val);
+   add (command);
+
+   if (isAttrSelected (var)) {
+      ObjInfo *objInfo = ensureObjInfo (id);
+      if (objInfo->attrs == NULL)
+         objInfo->attrs =
+            new HashTable<String, Command> (true, true, SMALL_TABLE_SIZE);
+      objInfo->attrs->put (new String (var),
+                           new Command (serial, new ObjectCommand (command)));
+   }
+}
+
+void ObjTailController::objClassColor (CommonLineInfo *info,
+                                       const char *klass, const char *color)
+{
+   ObjectCommand *command =
+      new ObjectCommand (ObjectCommand::CLASS_COLOR, info, "ss", klass, color);
+   add (command);
+   colorCommands->put (new Command (serial, new ObjectCommand (command)));
+}
+
+void ObjTailController::objObjectColor (CommonLineInfo *info, const char *id,
+                                        const char *color)
+{
+   ObjectCommand *command =
+      new ObjectCommand (ObjectCommand::OBJECT_COLOR, info, "ss", id, color);
+   add (command);
+   colorCommands->put (new Command (serial, new ObjectCommand (command)));
+}
+
+void ObjTailController::objDelete (CommonLineInfo *info, const char *id)
+{
+   add (new ObjectCommand (ObjectCommand::DELETE, info, "s", id));
+
+   ObjInfo *objInfo = getObjInfo (id);
+   if (objInfo)
+      objInfo->deleteSerial = serial;
+}
+
+void ObjTailController::add (ObjectCommand *command)
+{
+   serial++;
+
+   if (tailSize == tailLength) {
+      evict (tail[tailStart]);
+      tail[tailStart] = new Command (serial, command);
+      tailStart = (tailStart + 1) % tailLength;
+   } else {
+      tail[(tailStart + tailSize) % tailLength] = new Command (serial, command);
+      tailSize++;
+   }
+}
+
+void ObjTailController::evict (Command *command)
+{
+   // When the "obj-delete" command leaves the tail, the object cannot become
+   // relevant anymore. Ids may be reused (e.g. for memory addresses), so keep
+   // the information when the id has been created again after the deletion.
+   if (command->command->getType () == ObjectCommand::DELETE) {
+      const char *id = command->command->getArgS (0);
+      ObjInfo *objInfo = getObjInfo (id);
+      if (objInfo && objInfo->deleteSerial == command->serial &&
+          (objInfo->create == NULL ||
+           objInfo->create->serial < objInfo->deleteSerial))
+         removeObjInfo (id);
+   }
+
+   delete command;
+}
+
+bool ObjTailController::isAttrSelected (const char *var)
+{
+   bool selected = false;
+
+   for (int i = 0; !selected && i < attrPatterns->size (); i++)
+      if (fnmatch (attrPatterns->get(i)->chars (), var, 0) == 0)
+         selected = true;
+
+   for (int i = 0; selected && i < negAttrPatterns->size (); i++)
+      if (fnmatch (negAttrPatterns->get(i)->chars (), var, 0) == 0)
+         selected = false;
+
+   return selected;
+}
+
+ObjTailController::ObjInfo *ObjTailController::getObjInfo (const char *id)
+{
+   String key (id);
+   return objInfos->get (&key);
+}
+
+ObjTailController::ObjInfo *ObjTailController::ensureObjInfo (const char *id)
+{
+   ObjInfo *objInfo = getObjInfo (id);
+   if (objInfo == NULL) {
+      objInfo = new ObjInfo ();
+      objInfos->put (new String (id), objInfo);
+   }
+   return objInfo;
+}
+
+void ObjTailController::removeObjInfo (const char *id)
+{
+   String key (id);
+   ObjInfo *objInfo = objInfos->get (&key);
+
+   // Remove the associations in both directions, so that no references to
+   // removed objects are kept.
+
+   if (objInfo->assocs)
+      for (Iterator<String> it = objInfo->assocs->iterator (); it.hasNext (); ) {
+         String *child = it.getNext ();
+         ObjInfo *childInfo = objInfos->get (child);
+         if (childInfo && childInfo != objInfo && childInfo->parents)
+            childInfo->parents->remove (&key);
+      }
+
+   if (objInfo->parents)
+      for (Iterator<String> it = objInfo->parents->iterator ();
+           it.hasNext (); ) {
+         String *parent = it.getNext ();
+         ObjInfo *parentInfo = objInfos->get (parent);
+         if (parentInfo && parentInfo != objInfo && parentInfo->assocs)
+            parentInfo->assocs->remove (&key);
+      }
+
+   objInfos->remove (&key);
+}
+
+void ObjTailController::addRelevant (HashSet<String> *relevant, const char *id)
+{
+   String key (id);
+   if (!relevant->contains (&key))
+      relevant->put (new String (id));
+}
+
+void ObjTailController::ownFinish ()
+{
+   // Objects referred to in the tail.
+   HashSet<String> relevant (true, OBJ_INFOS_TABLE_SIZE);
+   for (int i = 0; i < tailSize; i++) {
+      ObjectCommand *command = tail[(tailStart + i) % tailLength]->command;
+      switch (command->getType ()) {
+      case ObjectCommand::MSG:
+      case ObjectCommand::MARK:
+      case ObjectCommand::MSG_START:
+      case ObjectCommand::MSG_END:
+      case ObjectCommand::ENTER:
+      case ObjectCommand::LEAVE:
+      case ObjectCommand::CREATE:
+      case ObjectCommand::SET:
+      case ObjectCommand::DELETE:
+         addRelevant (&relevant, command->getArgS (0));
+         break;
+
+      case ObjectCommand::ASSOC:
+         addRelevant (&relevant, command->getArgS (0));
+         addRelevant (&relevant, command->getArgS (1));
+         break;
+
+      default:
+         break;
+      }
+   }
+
+   long firstTailSerial = tailSize > 0 ? tail[tailStart]->serial : serial + 1;
+
+   // Relevant commands before the tail, sorted by their original order.
+   Vector<Command> before (1, false);
+
+   for (int i = 0; i < colorCommands->size (); i++)
+      if (colorCommands->get(i)->serial < firstTailSerial)
+         before.put (colorCommands->get (i));
+
+   for (Iterator<String> it = relevant.iterator (); it.hasNext (); ) {
+      String *id = it.getNext ();
+      ObjInfo *objInfo = objInfos->get (id);
+      if (objInfo) {
+         if (objInfo->create && objInfo->create->serial < firstTailSerial)
+            before.put (objInfo->create);
+
+         if (objInfo->attrs)
+            for (Iterator<String> it2 = objInfo->attrs->iterator ();
+                 it2.hasNext (); ) {
+               Command *command = objInfo->attrs->get (it2.getNext ());
+               if (command->serial < firstTailSerial)
+                  before.put (command);
+            }
+
+         if (objInfo->assocs)
+            for (Iterator<String> it2 = objInfo->assocs->iterator ();
+                 it2.hasNext (); ) {
+               String *child = it2.getNext ();
+               Command *command = objInfo->assocs->get (child);
+               if (command->serial < firstTailSerial &&
+                   relevant.contains (child))
+                  before.put (command);
+            }
+      }
+   }
+
+   before.sort ();
+
+   for (int i = 0; i < before.size (); i++)
+      before.get(i)->command->pass (successor);
+
+   for (int i = 0; i < tailSize; i++)
+      tail[(tailStart + i) % tailLength]->command->pass (successor);
+}
+
+} // namespace objects
+
+} // namespace rtfl
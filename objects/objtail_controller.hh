@@ -0,0 +1,120 @@
+#ifndef __OBJECTS_OBJTAIL_CONTROLLER_HH__
+#define __OBJECTS_OBJTAIL_CONTROLLER_HH__
+
+#include "objects_parser.hh"
+#include "objects_buffer.hh"
+
+namespace rtfl {
+
+namespace objects {
+
+/**
+ * \brief Passes only the last commands of a stream, but also those commands
+ *    before which are necessary to understand the last ones.
+ *
+ * This is the implementation of `rtfl-objtail`. The last commands are kept in
+ * a ring buffer of fixed size. Furthermore, for each object, the last
+ * `obj-create`, the `obj-assoc` commands, and the last `obj-set` commands
+ * for each attribute (only when the attribute is selected, see
+ * addAttrPattern()) are kept; an object is forgotten when its `obj-delete`
+ * has left the ring buffer, unless the same id has been created again in
+ * the meantime. So, memory usage depends only on the length of the tail and
+ * the number of living objects, not on the length of the stream.
+ *
+ * At the end of the stream, all relevant commands before the tail (those
+ * referring to objects which are referred to in the tail, as well as all
+ * `obj-class-color` and `obj-object-color` commands) are passed to the
+ * successor, in the original order, followed by the tail itself.
+ */
+class ObjTailController: public ObjectsControllerBase
+{
+private:
+
+   class Command: public lout::object::Comparable
+   {
+   public:
+      long serial;
+      ObjectCommand *command;
+
+      Command (long serial, ObjectCommand *command);
+      ~Command ();
+
+      int compareTo (Comparable *other);
+   };
+
+   class ObjInfo: public lout::object::Object
+   {
+   public:
+      Command *create;
+      long deleteSerial;
+      lout::container::typed::HashTable<lout::object::String, Command> *attrs;
+      lout::container::typed::HashTable<lout::object::String, Command>
+         *assocs;
+      lout::container::typed::HashSet<lout::object::String> *parents;
+
+      ObjInfo ();
+      ~ObjInfo ();
+   };
+
+   enum { OBJ_INFOS_TABLE_SIZE = 4093, SMALL_TABLE_SIZE = 7 };
+
+   ObjectsController *successor;
+   int tailLength, tailStart, tailSize;
+   Command **tail;
+   long serial;
+
+   lout::container::typed::HashTable<lout::object::String, ObjInfo> *objInfos;
+   lout::container::typed::Vector<Command> *colorCommands;
+   lout::container::typed::Vector<lout::object::String> *attrPatterns,
+      *negAttrPatterns;
+
+   void add (ObjectCommand *command);
+   void evict (Command *command);
+   bool isAttrSelected (const char *var);
+   ObjInfo *getObjInfo (const char *id);
+   ObjInfo *ensureObjInfo (const char *id);
+   void removeObjInfo (const char *id);
+   void addRelevant (lout::container::typed::HashSet<lout::object::String>
+                     *relevant, const char *id);
+
+protected:
+   void ownFinish ();
+
+public:
+   ObjTailController (ObjectsController *successor, int tailLength);
+   ~ObjTailController ();
+
+   void addAttrPattern (const char *pattern, bool selected);
+
+   void objMsg (tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (tools::CommonLineInfo *info, const char *id);
+   void objEnter (tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (tools::CommonLineInfo *info);
+   void objAssoc (tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (tools::CommonLineInfo *info, const char *id, const char *var,
+                const char *val);
+   void objClassColor (tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (tools::CommonLineInfo *info, const char *id);
+};
+
+} // namespace objects
+
+} // namespace rtfl
+
+#endif // __OBJECTS_OBJTAIL_CONTROLLER_HH__
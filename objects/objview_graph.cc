@@ -227,6 +227,7 @@ ObjViewGraph::GraphObject::GraphObject (ObjViewGraph *graph, const char *id)
    this->id = strdup (id);
 
    className = NULL;
+   color = NULL;
    node = NULL;
    attributes = NULL;
    messageStyle = graph->noBorderStyle;
@@ -266,8 +267,7 @@ int ObjViewGraph::ColorComparator::specifity (const char *pattern)
 
 int ObjViewGraph::ColorComparator::compare (Object *o1, Object *o2)
 {
-   return specifity (((Color*)o2)->identifier)
-      - specifity (((Color*)o1)->identifier);
+   return ((Color*)o2)->specifity - ((Color*)o1)->specifity;
 }
 
 // ----------------------------------------------------------------------
@@ -276,6 +276,18 @@ ObjViewGraph::Color::Color (const char *identifier, const char *color,
                             Layout *layout)
 {
    this->identifier = strdup (identifier);
+   specifity = ColorComparator::specifity (identifier);
+
+   // Most patterns are class names or prefixes ("ns::*"); these are
+   // compared without fnmatch(3).
+   int len = strlen (identifier);
+   prefixLen = strcspn (identifier, "*?[\\");
+   if (prefixLen == len)
+      kind = LITERAL;
+   else if (prefixLen == len - 1 && identifier[prefixLen] == '*')
+      kind = PREFIX;
+   else
+      kind = PATTERN;
 
    this->color = NULL;
    if (*color == '#') {
@@ -305,6 +317,18 @@ ObjViewGraph::Color::~Color ()
       this->color->unref ();
 }
 
+bool ObjViewGraph::Color::matches (const char *name)
+{
+   switch (kind) {
+   case LITERAL:
+      return strcmp (identifier, name) == 0;
+   case PREFIX:
+      return strncmp (identifier, name, prefixLen) == 0;
+   default:
+      return fnmatch (identifier, name, 0) == 0;
+   }
+}
+
 // ----------------------------------------------------------------------
 
 ObjViewGraph::ObjViewGraph (ObjViewFilterTool *filterTool)
@@ -318,8 +342,11 @@ ObjViewGraph::ObjViewGraph (ObjViewFilterTool *filterTool)
 
    objectsById = new HashTable<String, GraphObject> (true, false);
    allObjects = new Vector<GraphObject> (1, true);
+   objectsByClass = new HashTable<String, Vector<GraphObject> > (true, true);
    classColors = new Vector<Color> (1, true);
-   objectColors = new Vector<Color> (1, true);
+   objectColors = new HashTable<String, Color> (true, true);
+   classColorCache = new HashTable<String, Pointer> (true, true);
+   colorStyles = new HashTable<Pointer, Style> (true, false);
    enterCommands = new Stack<OVGEnterCommand> (false);      
    startCommands = new Stack<OVGIncIndentCommand> (false);
 
@@ -345,8 +372,15 @@ ObjViewGraph::~ObjViewGraph ()
 
    delete objectsById;
    delete allObjects;
+   delete objectsByClass;
    delete classColors;
    delete objectColors;
+   delete classColorCache;
+
+   for (typed::Iterator<Pointer> it = colorStyles->iterator ();
+        it.hasNext (); )
+      colorStyles->get(it.getNext ())->unref ();
+   delete colorStyles;
    delete enterCommands;
    delete startCommands;
 
@@ -616,6 +650,16 @@ void ObjViewGraph::setClassName (const char *id, const char *className)
 {
    GraphObject *obj = ensureObject (id);
 
+   if (obj->className == NULL || strcmp (obj->className, className) != 0) {
+      String key (className);
+      Vector<GraphObject> *objects = objectsByClass->get (&key);
+      if (objects == NULL) {
+         objects = new Vector<GraphObject> (1, false);
+         objectsByClass->put (new String (className), objects);
+      }
+      objects->put (obj);
+   }
+
    if (obj->className)
       free (obj->className);
    obj->className = strdup (className);
@@ -629,57 +673,73 @@ void ObjViewGraph::setClassName (const char *id, const char *className)
 
    delete[] buf;
 
-   applyClassOrObjectStyle (obj);
+   updateClassOrObjectStyle (obj);
 }
 
-style::Color *ObjViewGraph::getObjectColor (GraphObject *obj)
+style::Color *ObjViewGraph::getClassColor (const char *className)
 {
-   style::Color *objectColor = NULL;   
-
-   // TODO Identities are currently not considered
-   for (int i = 0; objectColor == NULL && i < objectColors->size (); i++) {
-      Color *color = objectColors->get (i);
-      if (color->color && strcmp (color->identifier, obj->id) == 0)
-         objectColor = color->color;
-   }
+   String key (className);
+   Pointer *cached = classColorCache->get (&key);
 
-   if (obj->className) {
-      for (int i = 0; objectColor == NULL && i < classColors->size (); i++) {
+   if (cached == NULL) {
+      style::Color *classColor = NULL;
+      for (int i = 0; classColor == NULL && i < classColors->size (); i++) {
          Color *color = classColors->get (i);
-         if (color->color &&
-             fnmatch (color->identifier, obj->className, 0) == 0)
-            objectColor = color->color;
+         if (color->matches (className))
+            classColor = color->color;
       }
+
+      cached = new Pointer (classColor);
+      classColorCache->put (new String (className), cached);
    }
 
-   return objectColor;
+   return (style::Color*) cached->getValue ();
 }
 
-void ObjViewGraph::applyClassOrObjectStyle (GraphObject *obj)
+style::Color *ObjViewGraph::getObjectColor (GraphObject *obj)
 {
-   style::Color *usedColor = getObjectColor (obj);
-  
-   if (usedColor) {
-      // TODO Perhaps it is better to create styles initially (and
-      // change them when setStyle is called?). Should especially
-      // reduce memory usage.
+   // TODO Identities are currently not considered
+   String key (obj->id);
+   Color *objectColor = objectColors->get (&key);
+
+   if (objectColor)
+      return objectColor->color;
+   else if (obj->className)
+      return getClassColor (obj->className);
+   else
+      return NULL;
+}
+
+Style *ObjViewGraph::getColorStyle (style::Color *color)
+{
+   if (color == NULL)
+      return nodeStyle;
+
+   Pointer key (color);
+   Style *style = colorStyles->get (&key);
+   if (style == NULL) {
       StyleAttrs attrs = *nodeStyle;
-      attrs.backgroundColor = usedColor;
-      Style *newStyle = Style::create (&attrs);
-      obj->node->setStyle (newStyle);
-      newStyle->unref ();
-   } else
-      obj->node->setStyle (nodeStyle);
+      attrs.backgroundColor = color;
+      style = Style::create (&attrs);
+      colorStyles->put (new Pointer (color), style);
+   }
+
+   return style;
 }
 
+void ObjViewGraph::applyClassOrObjectStyle (GraphObject *obj)
+{
+   obj->color = getObjectColor (obj);
+   obj->node->setStyle (getColorStyle (obj->color));
+}
 
-void ObjViewGraph::applyClassOrObjectStyles ()
+void ObjViewGraph::updateClassOrObjectStyle (GraphObject *obj)
 {
-   for (typed::Iterator<String> it = objectsById->iterator ();
-        it.hasNext (); ) {
-      String *key = it.getNext ();
-      GraphObject *obj = (GraphObject*) objectsById->get(key);
-      applyClassOrObjectStyle (obj);
+   style::Color *usedColor = getObjectColor (obj);
+
+   if (usedColor != obj->color) {
+      obj->color = usedColor;
+      obj->node->setStyle (getColorStyle (usedColor));
    }
 }
 
@@ -709,15 +769,61 @@ void ObjViewGraph::addAssoc (const char *id1, const char *id2)
 
 void ObjViewGraph::setClassColor (const char *klass, const char *color)
 {
+   Color *classColor = new Color (klass, color, layout);
+   if (classColor->color == NULL) {
+      // Invalid colors are never used.
+      delete classColor;
+      return;
+   }
+
    ColorComparator cmp;
-   classColors->insertSorted (new Color (klass, color, layout), &cmp);
-   applyClassOrObjectStyles ();
+   classColors->insertSorted (classColor, &cmp);
+
+   // Only classes matching the new pattern may change. (Colors are only
+   // cached for class names of objects, which are all in objectsByClass.)
+   if (classColor->isLiteral ())
+      updateClassStyle (classColor->identifier);
+   else
+      for (typed::Iterator<String> it = objectsByClass->iterator ();
+           it.hasNext (); ) {
+         String *className = it.getNext ();
+         if (classColor->matches (className->chars ()))
+            updateClassStyle (className->chars ());
+      }
+}
+
+/**
+ * \brief Called when the color of a class may have changed: the cached color
+ *    is discarded, and the objects of this class are styled again.
+ */
+void ObjViewGraph::updateClassStyle (const char *className)
+{
+   String key (className);
+   classColorCache->remove (&key);
+
+   Vector<GraphObject> *objects = objectsByClass->get (&key);
+   if (objects)
+      for (int i = 0; i < objects->size (); i++) {
+         GraphObject *obj = objects->get (i);
+         if (strcmp (obj->className, className) == 0)
+            updateClassOrObjectStyle (obj);
+      }
 }
 
 void ObjViewGraph::setObjectColor (const char *id, const char *color)
 {
-   objectColors->put (new Color (id, color, layout));
-   applyClassOrObjectStyles ();
+   String key (id);
+   Color *objectColor = new Color (id, color, layout);
+
+   // The first valid color defined for an object is used.
+   if (objectColor->color == NULL || objectColors->contains (&key))
+      delete objectColor;
+   else {
+      objectColors->put (new String (id), objectColor);
+      GraphObject *obj = (GraphObject*) objectsById->get (&key);
+      if (obj)
+         updateClassOrObjectStyle (obj);
+   }
 }
 
 void ObjViewGraph::addCommand (OVGCommand *command, bool navigable)
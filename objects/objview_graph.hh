@@ -158,6 +158,9 @@ private:
    public:
       char *id, *className;
       ::dw::core::style::Style *messageStyle;
+      // The background color currently applied to node, or NULL for the
+      // default style.
+      ::dw::core::style::Color *color;
       dw::Toggle *node;
       dw::Label *id1, *id2;
       OVGTopAttributes *attributes;
@@ -182,21 +185,29 @@ private:
 
    class Color: public lout::object::Object
    {
+   private:
+      // How the identifier is matched: literally, as a prefix (a pattern
+      // whose only wildcard is a trailing '*'), or via fnmatch(3).
+      enum { LITERAL, PREFIX, PATTERN } kind;
+      int prefixLen;
+
    public:
       char *identifier;
+      int specifity;
       ::dw::core::style::Color *color;
       
       Color (const char *classPattern, const char *color,
                   ::dw::core::Layout *layout);
       ~Color ();
+
+      bool matches (const char *name);
+      inline bool isLiteral () { return kind == LITERAL; }
    };
 
    class ColorComparator: public lout::object::Comparator
    {
-   private:
-      int specifity (const char *pattern);
-
    public:
+      static int specifity (const char *pattern);
       int compare(Object *o1, Object *o2);
    };
 
@@ -207,8 +218,22 @@ private:
    lout::container::typed::HashTable<lout::object::String,
                                      GraphObject> *objectsById;
    lout::container::typed::Vector<GraphObject> *allObjects;  
+   // Class name -> all objects which have got this class name. Since the
+   // class name of an object may change (see setClassName()), an object may
+   // still be listed under a previous one; GraphObject::className decides.
+   lout::container::typed::HashTable<lout::object::String,
+                                     lout::container::typed::Vector
+                                     <GraphObject> > *objectsByClass;
    lout::container::typed::Vector<Color> *classColors;
-   lout::container::typed::Vector<Color> *objectColors;
+   lout::container::typed::HashTable<lout::object::String,
+                                     Color> *objectColors;
+   // Class name -> color (a lout::object::Pointer to a
+   // ::dw::core::style::Color, or to NULL), as found in classColors.
+   lout::container::typed::HashTable<lout::object::String,
+                                     lout::object::Pointer> *classColorCache;
+   // Color -> style, shared by all nodes with this background color.
+   lout::container::typed::HashTable<lout::object::Pointer,
+                                     ::dw::core::style::Style> *colorStyles;
 
    lout::container::typed::Stack<OVGEnterCommand> *enterCommands;
    lout::container::typed::Stack<OVGIncIndentCommand> *startCommands;
@@ -230,9 +255,12 @@ private:
                                dw::HBox **histBox, dw::Label **indexLabel,
                                dw::Label **histLabel);
 
+   ::dw::core::style::Color *getClassColor (const char *className);
    ::dw::core::style::Color *getObjectColor (GraphObject *obj);
+   ::dw::core::style::Style *getColorStyle (::dw::core::style::Color *color);
    void applyClassOrObjectStyle (GraphObject *obj);
-   void applyClassOrObjectStyles ();
+   void updateClassOrObjectStyle (GraphObject *obj);
+   void updateClassStyle (const char *className);
 
    void addMessage (const char *id, const char *message, dw::HBox **mainBox,
                     dw::Label **indexLabel, dw::Label **mainLabel);
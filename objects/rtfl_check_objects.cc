@@ -0,0 +1,54 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Uses RTFL messages to check for invalid object access. See
+ * ObjCheckController for details. The exit status is 1 if any invalid
+ * access has been found, 0 otherwise.
+ */
+
+#include "objects_parser.hh"
+#include "objident_controller.hh"
+#include "objcheck_controller.hh"
+
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+int main(int argc, char **argv)
+{
+   if (argc != 1) {
+      fprintf (stderr, "Usage: %s\n", argv[0]);
+      return 2;
+   }
+
+   LinesSourceSequence source (true);
+   int fd = open (".rtfl", O_RDONLY);
+   if (fd != -1)
+      source.add (new BlockingLinesSource (fd));
+   source.add (new BlockingLinesSource (0));
+
+   ObjCheckController checkController;
+   ObjIdentController identController (&checkController);
+   ObjectsParser parser (&identController);
+   source.setup (&parser);
+
+   return checkController.getNumInvalidAccesses () > 0 ? 1 : 0;
+}
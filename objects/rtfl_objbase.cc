@@ -21,25 +21,342 @@
 #include "objects_writer.hh"
 #include "objdelete_controller.hh"
 #include "objident_controller.hh"
+#include "objects_pipe.hh"
+#include "objects_chunked.hh"
+#include "objects_index.hh"
+#include "common/threaded_lines.hh"
+#include "common/multi_lines.hh"
+#include "common/shm_ring.hh"
+#include "common/tools.hh"
 
+#include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
 
 using namespace rtfl::tools;
 using namespace rtfl::objects;
 
+// The controllers are composed at compile time, so that the calls between
+// them are not virtual (see FinalController).
+typedef FinalController<ObjectsWriter> WriterStage;
+typedef FinalController<ObjIdentStage<WriterStage> > IdentStage;
+typedef FinalController<ObjDeleteStage<IdentStage> > DeleteStage;
+
+// Stopped on SIGINT and SIGTERM (when listening on a socket, see -u, or
+// reading a shared memory ring, see -r), so that all output is written.
+static MultiLinesSource *stoppableSource = NULL;
+static ShmLinesSource *stoppableShmSource = NULL;
+
+static void stopSource (int sig)
+{
+   if (stoppableSource)
+      stoppableSource->stop ();
+   if (stoppableShmSource)
+      stoppableShmSource->stop ();
+}
+
+static void printHelp (const char *argv0)
+{
+   fprintf
+      (stderr, "Usage: %s [-H <objects>] [-i <input> ...] [-I]\n"
+       "          [-j <threads>] [-l] [-L] [-p] [-r <segment>[:<policy>]]\n"
+       "          [-s <line> | -S <object>] [-u <socket>] [-x <index>]\n"
+       "          [-z <compression>]\n"
+       "\n"
+       "Options:\n"
+       "   -H <objects>     Remember at most <objects> deleted objects (to "
+       "map their\n"
+       "                    ids when reused); older ones are forgotten. "
+       "Without\n"
+       "                    this option, all are remembered.\n"
+       "   -i <input>       Read from the file or FIFO <input> instead of "
+       "standard\n"
+       "                    input. If given multiple times, lines of all "
+       "inputs\n"
+       "                    are merged in the order of arrival.\n"
+       "   -I               Hold back only commands of objects which may "
+       "still be\n"
+       "                    declared identical (\"obj-ident\"), not all "
+       "commands.\n"
+       "                    Commands of different objects may be "
+       "reordered.\n"
+       "   -j <threads>     If the input is a regular file: parse it in\n"
+       "                    parallel, with <threads> threads.\n"
+       "   -l               Flush output after each line (for live "
+       "piping).\n"
+       "   -L               Print a histogram of how long commands are held "
+       "back\n"
+       "                    for \"obj-ident\" to standard error at the "
+       "end.\n"
+       "   -p               Pipelined: read, parse and process commands in\n"
+       "                    three threads. Ignored when only one CPU is "
+       "online.\n"
+       "   -r <segment>[:<policy>]\n"
+       "                    Read from a shared memory ring buffer, created "
+       "as the\n"
+       "                    file <segment> (see RTFL_SHM), instead of "
+       "standard\n"
+       "                    input. <policy> (\"block\", \"drop\" or "
+       "\"spill\")\n"
+       "                    defines what producers do when the ring is full; "
+       "the\n"
+       "                    default is \"block\". Stop on SIGINT or "
+       "SIGTERM.\n"
+       "   -s <line>        Start at line <line>,\n"
+       "   -S <object>      start at the first command referring to "
+       "<object>, but\n"
+       "                    pass structural commands before. Standard input "
+       "must\n"
+       "                    be a regular file.\n"
+       "   -u <socket>      Accept connections of traced programs on the Unix\n"
+       "                    domain socket <socket> (see RTFL_SOCKET), instead "
+       "of\n"
+       "                    reading standard input. Stop on SIGINT or "
+       "SIGTERM.\n"
+       "   -x <index>       Read the index needed for -s and -S from the file\n"
+       "                    <index>, or write it there.\n"
+       "   -z <compression> Compress output; <compression> is \"gzip\" or\n"
+       "                    \"zstd\".\n",
+       argv0);
+}
+
 int main(int argc, char **argv)
 {
-   LinesSourceSequence source (true);
+   bool pipelined = false, lineFlushed = false, selectiveIdent = false;
+   bool latencyHistogram = false;
+   int horizon = 0;
+   int numThreads = 0;
+   long startLine = 0;
+   const char *startObject = NULL, *indexFile = NULL;
+   lout::misc::SimpleVector<int> inputFds;
+   const char *socketPath = NULL;
+   ShmRing *shmRing = NULL;
+   OutputBuffer::Compression compression = OutputBuffer::NONE;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "H:i:Ij:lLpr:s:S:u:x:z:")) != -1) {
+      switch (opt) {
+      case 'H':
+         horizon = atoi (optarg);
+         if (horizon <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 'i':
+         {
+            // Notice that this blocks for a FIFO until a writer has opened
+            // it.
+            int fd = open (optarg, O_RDONLY);
+            if (fd == -1) {
+               perror (optarg);
+               return 1;
+            }
+            inputFds.increase ();
+            inputFds.setLast (fd);
+         }
+         break;
+
+      case 'I':
+         selectiveIdent = true;
+         break;
+
+      case 'j':
+         numThreads = atoi (optarg);
+         if (numThreads <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 'l':
+         lineFlushed = true;
+         break;
+
+      case 'L':
+         latencyHistogram = true;
+         break;
+
+      case 'p':
+         pipelined = true;
+         break;
+
+      case 'r':
+         {
+            ShmRing::Policy policy = ShmRing::BLOCK;
+            char *colon = strrchr (optarg, ':');
+            if (colon) {
+               *colon = 0;
+               if (!ShmRing::parsePolicy (colon + 1, &policy)) {
+                  printHelp (argv[0]);
+                  return 1;
+               }
+            }
+
+            if (shmRing)
+               delete shmRing;
+            if ((shmRing = ShmRing::create (optarg, policy)) == NULL) {
+               perror (optarg);
+               return 1;
+            }
+         }
+         break;
+
+      case 's':
+         startLine = atol (optarg);
+         if (startLine <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 'S':
+         startObject = optarg;
+         break;
+
+      case 'u':
+         // The socket is created below, after all options have been checked.
+         socketPath = optarg;
+         break;
+
+      case 'x':
+         indexFile = optarg;
+         break;
+
+      case 'z':
+         if (strcmp (optarg, "gzip") == 0)
+            compression = OutputBuffer::GZIP;
+         else if (strcmp (optarg, "zstd") == 0)
+            compression = OutputBuffer::ZSTD;
+         else {
+            printHelp (argv[0]);
+            return 1;
+         }
+
+         if (!OutputBuffer::isSupported (compression)) {
+            fprintf (stderr, "%s: compression with %s is not supported.\n",
+                     argv[0], optarg);
+            return 1;
+         }
+         break;
+
+      default:
+         printHelp (argv[0]);
+         return 1;
+      }
+   }
+
+   // With only one CPU, the threads would only add the costs of passing
+   // lines and commands between them.
+   if (pipelined && sysconf (_SC_NPROCESSORS_ONLN) < 2)
+      pipelined = false;
+
+   // Large writes instead of one per line, unless -l is given.
+   OutputBuffer *output = new OutputBuffer (1, compression);
+   output->setLineFlushed (lineFlushed);
+   WriterStage writer (output);
+   IdentStage identStage (&writer);
+   identStage.setSelective (selectiveIdent);
+   identStage.setLatencyHistogram (latencyHistogram);
+   DeleteStage deleteStage (&identStage);
+   deleteStage.setHorizon (horizon);
+
+   ObjectsIndex *index = NULL;
+   off_t startOffset = 0;
+   bool multiInput = inputFds.size () > 0 || socketPath != NULL;
+   if ((multiInput || shmRing) &&
+       (startLine > 0 || startObject || indexFile)) {
+      fprintf (stderr, "%s: -s, -S and -x cannot be used with -i, -r or "
+               "-u.\n", argv[0]);
+      return 1;
+   } else if (multiInput && shmRing) {
+      fprintf (stderr, "%s: -r cannot be used with -i or -u.\n", argv[0]);
+      return 1;
+   } else if (startLine > 0 || startObject || indexFile) {
+      if (!ChunkedObjectsSource::isSuitableFile (0)) {
+         fprintf (stderr, "%s: standard input must be a regular, "
+                  "uncompressed file.\n", argv[0]);
+         return 1;
+      }
+
+      index = ObjectsIndex::readOrBuild (indexFile, 0, numThreads > 0 ?
+                                         numThreads :
+                                         sysconf (_SC_NPROCESSORS_ONLN));
+      if (startObject)
+         startOffset = index->getObjectOffset (startObject);
+      else if (startLine > 0)
+         startOffset = index->getLineOffset (0, startLine - 1);
+
+      if (startOffset == -1) {
+         fprintf (stderr, "%s: %s not found.\n", argv[0],
+                  startObject ? "object" : "line");
+         delete index;
+         return 1;
+      }
+   }
+
    int fd = open (".rtfl", O_RDONLY);
+
+   if (numThreads > 0 && startOffset == 0 && !multiInput && !shmRing &&
+       ChunkedObjectsSource::isSuitableFile (0) &&
+       (fd == -1 || ChunkedObjectsSource::isSuitableFile (fd))) {
+      ChunkedObjectsSource source (&deleteStage, numThreads);
+      if (fd != -1)
+         source.add (fd);
+      source.add (0);
+      source.run ();
+      if (index)
+         delete index;
+      return 0;
+   }
+
+   LinesSourceSequence source (true);
    if (fd != -1)
-      source.add (new BlockingLinesSource (fd));
-   source.add (new BlockingLinesSource (0));
-
-   ObjectsWriter writer;
-   ObjIdentController identController (&writer);
-   ObjDeleteController deleteController (&identController);
-   ObjectsParser parser (&deleteController);
-   source.setup (&parser);
+      source.add (pipelined ? (LinesSource*) new ThreadedLinesSource (fd) :
+                  new BlockingLinesSource (fd));
+   if (startOffset > 0)
+      source.add (new ObjectsIndexSource (index, 0, startOffset));
+   if (multiInput) {
+      MultiLinesSource *multiSource = new MultiLinesSource ();
+      for (int i = 0; i < inputFds.size (); i++)
+         multiSource->add (inputFds.get (i));
+      if (socketPath) {
+         int listenFd = listenUnixSocket (socketPath);
+         if (listenFd == -1) {
+            perror (socketPath);
+            delete multiSource;
+            if (index)
+               delete index;
+            return 1;
+         }
+         multiSource->addListener (listenFd, socketPath);
+         stoppableSource = multiSource;
+         signal (SIGINT, stopSource);
+         signal (SIGTERM, stopSource);
+      }
+      source.add (multiSource);
+   } else if (shmRing) {
+      ShmLinesSource *shmSource = new ShmLinesSource (shmRing);
+      stoppableShmSource = shmSource;
+      signal (SIGINT, stopSource);
+      signal (SIGTERM, stopSource);
+      source.add (shmSource);
+   } else
+      source.add (pipelined ? (LinesSource*) new ThreadedLinesSource (0) :
+                  new BlockingLinesSource (0));
+
+   if (pipelined) {
+      ObjectsPipe pipe (&deleteStage);
+      ObjectsParser parser (&pipe);
+      pipe.run (&source, &parser);
+   } else {
+      ObjectsParser parser (&deleteStage);
+      source.setup (&parser);
+   }
+
+   if (index)
+      delete index;
 
    return 0;
 }
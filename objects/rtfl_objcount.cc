@@ -21,17 +21,106 @@
 #include "objcount_window.hh"
 #include "objcount_controller.hh"
 
+#include <unistd.h>
+#include <getopt.h>
+
 using namespace rtfl::objects;
 using namespace rtfl::common;
 
+static void printHelp (const char *argv0)
+{
+   fprintf
+      (stderr, "Usage: %s [--stdout [-i <seconds>]] [-g <snapshots>]\n"
+       "          [-s <seconds>]\n"
+       "\n"
+       "Options:\n"
+       "   -g <snapshots>   Highlight the classes whose counts grew over the "
+       "last\n"
+       "                    <snapshots> snapshots (with --stdout: add a "
+       "column\n"
+       "                    \"growing\").\n"
+       "   --stdout         Do not open a window, but print snapshots of the "
+       "counts\n"
+       "                    to standard output, as CSV: on SIGUSR1, and at "
+       "the end\n"
+       "                    of the input (like rtfl-objcount-csv).\n"
+       "   -i <seconds>     With --stdout: also print a snapshot every "
+       "<seconds>\n"
+       "                    seconds.\n"
+       "   -s <seconds>     Make a new snapshot every <seconds> seconds.\n",
+       argv0);
+}
+
 int main(int argc, char **argv)
 {
+   static const struct option longOptions[] = {
+      { "stdout", no_argument, NULL, 'o' },
+      { NULL, 0, NULL, 0 }
+   };
+   bool headless = false;
+   double interval = 0, snapshotInterval = 0;
+   int growthSnapshots = 0;
+   int opt;
+
+   while ((opt = getopt_long (argc, argv, "g:i:s:", longOptions, NULL))
+          != -1) {
+      switch (opt) {
+      case 'o':
+         headless = true;
+         break;
+
+      case 'g':
+         growthSnapshots = atoi (optarg);
+         if (growthSnapshots < 2) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 'i':
+         interval = atof (optarg);
+         if (interval <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 's':
+         snapshotInterval = atof (optarg);
+         if (snapshotInterval <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      default:
+         printHelp (argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind != argc || (interval > 0 && !headless)) {
+      printHelp (argv[0]);
+      return 1;
+   }
+
+   if (headless)
+      return ObjCountController::runCsv (interval, growthSnapshots,
+                                         snapshotInterval);
+
    ObjCountWindow *window = new ObjCountWindow(800, 600, "RTFL: Objects count");
    window->show();
 
    FltkDefaultSource source;
-   ObjCountController controller (window->getTable ());
+   ObjCounter *counter = window->getTable()->getCounter ();
+   counter->setGrowthSnapshots (growthSnapshots);
+   ObjCountController controller (counter);
    ObjectsParser parser (&controller);
+   if (snapshotInterval > 0) {
+      // The timeouts for snapshots are passed to the source.
+      parser.setLinesSource (&source);
+      controller.setSnapshotInterval (snapshotInterval);
+   }
    source.setup (&parser);
 
    int errorCode = Fl::run();
@@ -0,0 +1,92 @@
+/*
+ * RTFL
+ *
+ * Copyright 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "objcount_controller.hh"
+
+#include <unistd.h>
+
+using namespace rtfl::objects;
+
+// Like "rtfl-objcount --stdout", but without FLTK, so that it can be built
+// and run on hosts without a display.
+
+static void printHelp (const char *argv0)
+{
+   fprintf
+      (stderr, "Usage: %s [-g <snapshots>] [-i <seconds>] [-s <seconds>]\n"
+       "\n"
+       "Print snapshots of the object counts to standard output, as CSV: on "
+       "SIGUSR1,\n"
+       "and at the end of the input.\n"
+       "\n"
+       "Options:\n"
+       "   -g <snapshots>   Add a column \"growing\" for the classes whose "
+       "counts grew\n"
+       "                    over the last <snapshots> snapshots.\n"
+       "   -i <seconds>     Also print a snapshot every <seconds> seconds.\n"
+       "   -s <seconds>     Make a new snapshot every <seconds> seconds.\n",
+       argv0);
+}
+
+int main(int argc, char **argv)
+{
+   double interval = 0, snapshotInterval = 0;
+   int growthSnapshots = 0;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "g:i:s:")) != -1) {
+      switch (opt) {
+      case 'g':
+         growthSnapshots = atoi (optarg);
+         if (growthSnapshots < 2) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 'i':
+         interval = atof (optarg);
+         if (interval <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      case 's':
+         snapshotInterval = atof (optarg);
+         if (snapshotInterval <= 0) {
+            printHelp (argv[0]);
+            return 1;
+         }
+         break;
+
+      default:
+         printHelp (argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind != argc) {
+      printHelp (argv[0]);
+      return 1;
+   }
+
+   return ObjCountController::runCsv (interval, growthSnapshots,
+                                      snapshotInterval);
+}
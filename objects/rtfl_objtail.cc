@@ -0,0 +1,116 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Print only the last lines of a stream of RTFL messages, but include
+ * those RTFL messages which are necessary to understand the last ones,
+ * like "obj-create", "obj-assoc" etc., when they refer to objects in
+ * the last lines. See ObjTailController for details.
+ *
+ * Any number of options "-a" and "-A" may be added with fnmatch(3)
+ * like patterns; for those attributes specified by "-a", but not
+ * excluded by "-A", the last attribute definitions before the actual
+ * tail is shown for relevant objects.
+ *
+ * Example: "-a 'foo.*' -A '*.bar'" will show attribute values for
+ * 'foo.qix', but not for, say, 'foo.bar', since "-A '*.bar'" overrides
+ * "-a 'foo.*'".
+ *
+ * The opposite, "rtfl-objhead", is not needed; simply use "head" to
+ * get the first lines.
+ */
+
+#include "objects_parser.hh"
+#include "objects_writer.hh"
+#include "objdelete_controller.hh"
+#include "objident_controller.hh"
+#include "objtail_controller.hh"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace lout::container::typed;
+using namespace lout::object;
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+static void printHelp (const char *argv0)
+{
+   fprintf
+      (stderr, "Usage: %s [-a <attributes> ...] [-A <attributes> ...] "
+       "<number of lines>\n"
+       "\n"
+       "Options:\n"
+       "   -a <pattern>     Show the last values before the tail of the\n"
+       "                    attributes matching <pattern>.\n"
+       "   -A <pattern>     Do not show attributes matching <pattern>,\n"
+       "                    even if selected by '-a'.\n"
+       "\n"
+       "Patterns are passed to fnmatch(3).\n",
+       argv0);
+}
+
+int main(int argc, char **argv)
+{
+   Vector<String> attrs (1, true), negAttrs (1, true);
+   int opt;
+
+   while ((opt = getopt(argc, argv, "a:A:")) != -1) {
+      switch (opt) {
+      case 'a':
+         attrs.put (new String (optarg));
+         break;
+
+      case 'A':
+         negAttrs.put (new String (optarg));
+         break;
+
+      default:
+         printHelp (argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind != argc - 1 || atoi (argv[optind]) <= 0) {
+      printHelp (argv[0]);
+      return 1;
+   }
+
+   LinesSourceSequence source (true);
+   int fd = open (".rtfl", O_RDONLY);
+   if (fd != -1)
+      source.add (new BlockingLinesSource (fd));
+   source.add (new BlockingLinesSource (0));
+
+   ObjectsWriter writer;
+   ObjTailController tailController (&writer, atoi (argv[optind]));
+   ObjIdentController identController (&tailController);
+   ObjDeleteController deleteController (&identController);
+   ObjectsParser parser (&deleteController);
+
+   for (int i = 0; i < attrs.size (); i++)
+      tailController.addAttrPattern (attrs.get(i)->chars (), true);
+   for (int i = 0; i < negAttrs.size (); i++)
+      tailController.addAttrPattern (negAttrs.get(i)->chars (), false);
+
+   source.setup (&parser);
+
+   return 0;
+}
@@ -28,15 +28,24 @@
  */
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <FL/Fl.H>
 #include "common/fltk_lines.hh"
 #include "objview_window.hh"
 #include "objview_controller.hh"
 #include "objdelete_controller.hh"
 #include "objident_controller.hh"
+#include "objects_chunked.hh"
+#include "objects_index.hh"
+#include "common/tools.hh"
 
 using namespace rtfl::objects;
 using namespace rtfl::common;
+using namespace rtfl::tools;
+
+// Chunks are passed in a timeout, which waits at most this time for the next
+// chunk, so that the user interface is still responsive.
+#define CHUNK_STEP_MILLIS 20
 
 static void printHelp (const char *argv0)
 {
@@ -50,11 +59,36 @@ static void printHelp (const char *argv0)
        "   -B               do not apply \".rtfl\" and filtering identities "
        "(what \n"
        "                    \"rtfl-objbase\" does).\n"
+       "   -I               Hold back only commands of objects which may "
+       "still be\n"
+       "                    declared identical (\"obj-ident\"), so that "
+       "other objects\n"
+       "                    are shown without delay.\n"
+       "   -j <threads>     If the input is a regular file: parse it in "
+       "parallel,\n"
+       "                    with <threads> threads.\n"
+       "   -L               Print a histogram of how long commands are held "
+       "back\n"
+       "                    for \"obj-ident\" to standard error at the "
+       "end.\n"
        "   -m               Show,\n"
        "   -M               hide the messages of all object boxes.\n"
        "   -o               Show,\n"
        "   -O               hide the contents of all object boxes.\n"
        "   -p <prio>        Set priority. <prio> is a number or '*'.\n"
+       "   -r <segment>[:<policy>]\n"
+       "                    Read from a shared memory ring buffer, created "
+       "as the\n"
+       "                    file <segment> (see RTFL_SHM), instead of "
+       "standard\n"
+       "                    input. <policy> is \"block\", \"drop\" or "
+       "\"spill\".\n"
+       "   -s <line>        Start at line <line>,\n"
+       "   -S <object>      start at the first command referring to "
+       "<object>, but\n"
+       "                    pass structural commands before. Standard input "
+       "must\n"
+       "                    be a regular file.\n"
        "   -t <types>       Show,\n"
        "   -T <types>       hide command types. <types> is a sequence of any "
        "of the\n"
@@ -63,6 +97,12 @@ static void printHelp (const char *argv0)
        "   -v <viewer>      Use <viewer> to view code. Contains '%%p' as "
        "variable for\n"
        "                    the path, and '%%n' for the line number.\n"
+       "   -u <socket>      Accept connections of traced programs on the Unix\n"
+       "                    domain socket <socket> (see RTFL_SOCKET), instead "
+       "of\n"
+       "                    reading standard input.\n"
+       "   -x <index>       Read the index needed for -s and -S from the file\n"
+       "                    <index>, or write it there.\n"
        "\n"
        "See RTFL documentation for more details.\n",
        argv0);  
@@ -113,14 +153,29 @@ static bool toggleCommandTypes (ObjViewWindow *window, const char *arg,
    return true;
 }
 
+static void chunkedSourceStep (void *data)
+{
+   ChunkedObjectsSource *source = (ChunkedObjectsSource*)data;
+   if (source->step (TimeoutQueue::getCurrentTime () + CHUNK_STEP_MILLIS))
+      Fl::repeat_timeout (0, chunkedSourceStep, source);
+}
+
 int main(int argc, char **argv)
 {
    ObjViewWindow *window = new ObjViewWindow(800, 600, "RTFL: Objects view");
 
    int opt;
-   bool baseFiltering = true;
+   bool baseFiltering = true, selectiveIdent = false;
+   bool latencyHistogram = false;
+   int numThreads = 0;
+   long startLine = 0;
+   const char *startObject = NULL, *indexFile = NULL;
+   int listenFd = -1;
+   const char *socketPath = NULL;
+   ShmRing *shmRing = NULL;
 
-   while ((opt = getopt(argc, argv, "a:A:bBMmOop:t:T:v:")) != -1) {
+   while ((opt = getopt(argc, argv, "a:A:bBIj:LMmOop:r:s:S:t:T:u:v:x:"))
+          != -1) {
       switch (opt) {
       case 'a':
          if (strcmp (optarg, "*") == 0)
@@ -144,6 +199,23 @@ int main(int argc, char **argv)
          baseFiltering = false;
          break;
 
+      case 'I':
+         selectiveIdent = true;
+         break;
+
+      case 'j':
+         numThreads = atoi (optarg);
+         if (numThreads <= 0) {
+            printHelp (argv[0]);
+            delete window;
+            return 1;
+         }
+         break;
+
+      case 'L':
+         latencyHistogram = true;
+         break;
+
       case 'm':
          window->showObjectMessages (true);
          break;
@@ -167,6 +239,42 @@ int main(int argc, char **argv)
             window->setPriority (atoi (optarg));
          break;
 
+      case 's':
+         startLine = atol (optarg);
+         if (startLine <= 0) {
+            printHelp (argv[0]);
+            delete window;
+            return 1;
+         }
+         break;
+
+      case 'S':
+         startObject = optarg;
+         break;
+
+      case 'r':
+         {
+            ShmRing::Policy policy = ShmRing::BLOCK;
+            char *colon = strrchr (optarg, ':');
+            if (colon) {
+               *colon = 0;
+               if (!ShmRing::parsePolicy (colon + 1, &policy)) {
+                  printHelp (argv[0]);
+                  delete window;
+                  return 1;
+               }
+            }
+
+            if (shmRing)
+               delete shmRing;
+            if ((shmRing = ShmRing::create (optarg, policy)) == NULL) {
+               perror (optarg);
+               delete window;
+               return 1;
+            }
+         }
+         break;
+
       case 't':
          if (!toggleCommandTypes (window, optarg, true)) {
             printHelp (argv[0]);
@@ -183,10 +291,25 @@ int main(int argc, char **argv)
          }
          break;
 
+      case 'u':
+         if (listenFd != -1)
+            close (listenFd);
+         if ((listenFd = listenUnixSocket (optarg)) == -1) {
+            perror (optarg);
+            delete window;
+            return 1;
+         }
+         socketPath = optarg;
+         break;
+
       case 'v':
          window->setCodeViewer (optarg);
          break;
 
+      case 'x':
+         indexFile = optarg;
+         break;
+
       default:
          printHelp (argv[0]);
          delete window;
@@ -194,12 +317,109 @@ int main(int argc, char **argv)
       }
    }
 
+   ObjectsIndex *index = NULL;
+   off_t startOffset = 0;
+   if ((listenFd != -1 || shmRing) &&
+       (startLine > 0 || startObject || indexFile)) {
+      fprintf (stderr, "%s: -s, -S and -x cannot be used with -r or -u.\n",
+               argv[0]);
+      delete window;
+      return 1;
+   } else if (listenFd != -1 && shmRing) {
+      fprintf (stderr, "%s: -r and -u cannot be used together.\n", argv[0]);
+      delete window;
+      return 1;
+   } else if (startLine > 0 || startObject || indexFile) {
+      if (!ChunkedObjectsSource::isSuitableFile (0)) {
+         fprintf (stderr, "%s: standard input must be a regular, "
+                  "uncompressed file.\n", argv[0]);
+         delete window;
+         return 1;
+      }
+
+      index = ObjectsIndex::readOrBuild (indexFile, 0, numThreads > 0 ?
+                                         numThreads :
+                                         sysconf (_SC_NPROCESSORS_ONLN));
+      if (startObject)
+         startOffset = index->getObjectOffset (startObject);
+      else if (startLine > 0)
+         startOffset = index->getLineOffset (0, startLine - 1);
+
+      if (startOffset == -1) {
+         fprintf (stderr, "%s: %s not found.\n", argv[0],
+                  startObject ? "object" : "line");
+         delete index;
+         delete window;
+         return 1;
+      }
+   }
+
    int errorCode;
    ObjViewController viewController (window->getObjViewGraph ());
-   
-   if (baseFiltering)  {
+   int fd = baseFiltering ? open (".rtfl", O_RDONLY) : -1;
+
+   if (startOffset > 0 || listenFd != -1 || shmRing) {
+      // Like FltkDefaultSource, but structural commands are passed before,
+      // or connections are accepted (or a ring is read) instead of reading
+      // standard input.
+      LinesSourceSequence source (true);
+      if (fd != -1)
+         source.add (new BlockingLinesSource (fd));
+      if (startOffset > 0)
+         source.add (new ObjectsIndexSource (index, 0, startOffset));
+      if (listenFd != -1)
+         source.add (new FltkSocketSource (listenFd, socketPath));
+      else if (shmRing)
+         source.add (new FltkShmSource (shmRing));
+      else
+         source.add (new FltkLinesSource ());
+
+      ObjIdentController identController (&viewController);
+      identController.setSelective (selectiveIdent);
+      identController.setLatencyHistogram (latencyHistogram);
+      ObjDeleteController deleteController (&identController);
+      ObjectsParser parser (baseFiltering ?
+                            (ObjectsController*)&deleteController :
+                            &viewController);
+      source.setup (&parser);
+      window->show();
+      errorCode = Fl::run();
+   } else if (numThreads > 0 && ChunkedObjectsSource::isSuitableFile (0) &&
+       (fd == -1 || ChunkedObjectsSource::isSuitableFile (fd))) {
+      ObjIdentController *identController = NULL;
+      ObjDeleteController *deleteController = NULL;
+      if (baseFiltering) {
+         identController = new ObjIdentController (&viewController);
+         identController->setSelective (selectiveIdent);
+         identController->setLatencyHistogram (latencyHistogram);
+         deleteController = new ObjDeleteController (identController);
+      }
+
+      ChunkedObjectsSource *source =
+         new ChunkedObjectsSource (baseFiltering ?
+                                   (ObjectsController*)deleteController :
+                                   &viewController, numThreads);
+      if (fd != -1)
+         source->add (fd);
+      source->add (0);
+      source->start ();
+      Fl::add_timeout (0, chunkedSourceStep, source);
+      window->show();
+      errorCode = Fl::run();
+
+      delete source;
+      if (baseFiltering) {
+         delete deleteController;
+         delete identController;
+      }
+   } else if (baseFiltering)  {
+      if (fd != -1)
+         close (fd);
+
       FltkDefaultSource source;
       ObjIdentController identController (&viewController);
+      identController.setSelective (selectiveIdent);
+      identController.setLatencyHistogram (latencyHistogram);
       ObjDeleteController deleteController (&identController);
       ObjectsParser parser (&deleteController);
       source.setup (&parser);
@@ -213,6 +433,8 @@ int main(int argc, char **argv)
       errorCode = Fl::run();
    }
    
+   if (index)
+      delete index;
    delete window;
    return errorCode;
 }
@@ -0,0 +1,127 @@
+/*
+ * RTFL
+ *
+ * Copyright 2014, 2015 Sebastian Geerken <sgeerken@dillo.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Prints stacktraces which lead to a specific method given as command line
+ * argument (based on "obj-enter" and "obj-leave"), or, with "-c" or "-f",
+ * aggregates them. For options, see printHelp(); for details, see
+ * ObjStacksController.
+ */
+
+#include "objects_parser.hh"
+#include "objstacks_controller.hh"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+static void printHelp (const char *argv0)
+{
+   fprintf
+      (stderr, "Usage: %s <options> <method name>\n"
+       "\n"
+       "Options:\n"
+       "   -s               Short format.\n"
+       "   -c               Print each stack trace once, with the number of\n"
+       "                    occurences, at the end.\n"
+       "   -f               Print folded stack traces (as used by flame\n"
+       "                    graph tools) at the end.\n"
+       "   -n <n>           Regard only stack traces with at least <n>\n"
+       "                    occurences of the method.\n"
+       "   -e <n>           Do not print stack traces, but all messages; if\n"
+       "                    a stack trace would have been printed, exit after\n"
+       "                    <n> further messages. Can be used together with\n"
+       "                    -m.\n"
+       "   -m <mark>        Do not print stack traces, but all messages; if\n"
+       "                    a stack trace would have been printed, add an\n"
+       "                    obj-mark with all parameters taken from the last\n"
+       "                    obj-enter command. Can be used together with -e.\n"
+       "\n"
+       "With -c or -f, the method name is optional; if it is missing, all\n"
+       "stack traces are regarded.\n",
+       argv0);
+}
+
+int main(int argc, char **argv)
+{
+   ObjStacksController::Format format = ObjStacksController::FULL;
+   int minNumCalls = 1, endCount = -1;
+   const char *mark = NULL;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "cfn:e:m:s")) != -1) {
+      switch (opt) {
+      case 'c':
+         format = ObjStacksController::COUNTED;
+         break;
+
+      case 'f':
+         format = ObjStacksController::FOLDED;
+         break;
+
+      case 'n':
+         minNumCalls = atoi (optarg);
+         break;
+
+      case 'e':
+         endCount = atoi (optarg);
+         break;
+
+      case 'm':
+         mark = optarg;
+         break;
+
+      case 's':
+         format = ObjStacksController::SHORT;
+         break;
+
+      default:
+         printHelp (argv[0]);
+         return 1;
+      }
+   }
+
+   const char *method;
+   if (optind == argc - 1)
+      method = argv[optind];
+   else if (optind == argc && (format == ObjStacksController::COUNTED ||
+                               format == ObjStacksController::FOLDED))
+      method = NULL;
+   else {
+      printHelp (argv[0]);
+      return 1;
+   }
+
+   LinesSourceSequence source (true);
+   int fd = open (".rtfl", O_RDONLY);
+   if (fd != -1)
+      source.add (new BlockingLinesSource (fd));
+   source.add (new BlockingLinesSource (0));
+
+   ObjStacksController stacksController (method, format, minNumCalls);
+   if (endCount >= 0 || mark)
+      stacksController.setPassThrough (endCount, mark);
+   ObjectsParser parser (&stacksController);
+   source.setup (&parser);
+
+   return 0;
+}
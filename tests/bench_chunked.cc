@@ -0,0 +1,66 @@
+#include "benchtools.hh"
+#include "objects/objects_chunked.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+using namespace rtfl::tests;
+
+// Benchmark for ChunkedObjectsSource: lines per second for parsing a trace
+// file sequentially, and in parallel with 1, 2, 4, ... threads (up to the
+// number of processors). Arguments: number of lines (use some 10 millions
+// for a trace of some GB), optionally an existing trace file instead of a
+// generated one.
+
+static int openFile (const char *fileName)
+{
+   int fd = open (fileName, O_RDONLY);
+   if (fd == -1)
+      syserr ("open (\"%s\") failed", fileName);
+   return fd;
+}
+
+int main (int argc, char *argv[])
+{
+   long numLines = argc > 1 ? atol (argv[1]) : 2000000;
+   char *fileName = argc > 2 ? NULL : createTrace (numLines);
+   const char *input = fileName ? fileName : argv[2];
+   int maxThreads = sysconf (_SC_NPROCESSORS_ONLN);
+
+   CountingController seqController;
+   ObjectsParser parser (&seqController);
+   BlockingLinesSource seqSource (openFile (input));
+   double t = getCurrentSecs ();
+   seqSource.setup (&parser);
+   double seqSecs = getCurrentSecs () - t;
+   printRate ("sequential", seqController.numCommands, seqSecs);
+
+   for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+      CountingController controller;
+      ChunkedObjectsSource source (&controller, numThreads);
+      source.add (openFile (input));
+      t = getCurrentSecs ();
+      source.run ();
+      double secs = getCurrentSecs () - t;
+
+      char stage[64];
+      snprintf (stage, sizeof (stage), "chunked, %d thread(s), speedup %.2f",
+                numThreads, seqSecs / secs);
+      printRate (stage, controller.numCommands, secs);
+
+      if (controller.numCommands != seqController.numCommands)
+         fprintf (stderr, "*** %ld commands, expected %ld\n",
+                  controller.numCommands, seqController.numCommands);
+   }
+
+   if (fileName) {
+      unlink (fileName);
+      free (fileName);
+   }
+   return 0;
+}
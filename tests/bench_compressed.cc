@@ -0,0 +1,86 @@
+#include "benchtools.hh"
+#include "common/tools.hh"
+#include "common/decompress.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+using namespace rtfl::tests;
+
+// Benchmark for compressed input: lines per second for reading and parsing
+// a trace file compressed with gzip (and zstd, if the program is available),
+// decompressed in-process (see Decompressor), compared to "zcat |"
+// ("zstdcat |"). The uncompressed file is measured for reference. Argument:
+// number of lines.
+
+static void bench (const char *stage, int fd)
+{
+   CountingController controller;
+   ObjectsParser parser (&controller);
+   BlockingLinesSource source (fd);
+   double t = getCurrentSecs ();
+   source.setup (&parser);
+   printRate (stage, controller.numCommands, getCurrentSecs () - t);
+}
+
+static void benchFile (const char *stage, const char *fileName)
+{
+   int fd = open (fileName, O_RDONLY);
+   if (fd == -1)
+      syserr ("open (\"%s\") failed", fileName);
+   bench (stage, fd);
+}
+
+static void benchCommand (const char *stage, const char *cmd,
+                          const char *fileName)
+{
+   char buf[4096];
+   snprintf (buf, sizeof (buf), "%s < %s", cmd, fileName);
+   FILE *pipe = popen (buf, "r");
+   if (pipe == NULL)
+      syserr ("popen (\"%s\") failed", buf);
+   bench (stage, dup (fileno (pipe)));
+   pclose (pipe);
+}
+
+static bool compress (const char *cmd, const char *fileName,
+                      const char *compressedName)
+{
+   char buf[4096];
+   snprintf (buf, sizeof (buf), "%s < %s > %s", cmd, fileName,
+             compressedName);
+   return system (buf) == 0;
+}
+
+int main (int argc, char *argv[])
+{
+   long numLines = argc > 1 ? atol (argv[1]) : 2000000;
+   char *fileName = createTrace (numLines);
+   char gzName[1024], zstName[1024];
+   snprintf (gzName, sizeof (gzName), "%s.gz", fileName);
+   snprintf (zstName, sizeof (zstName), "%s.zst", fileName);
+
+   benchFile ("uncompressed", fileName);
+
+   if (compress ("gzip -c", fileName, gzName)) {
+      if (Decompressor::isSupported (Decompressor::GZIP))
+         benchFile ("gzip, in-process", gzName);
+      benchCommand ("gzip, \"zcat |\"", "zcat", gzName);
+      unlink (gzName);
+   }
+
+   if (compress ("zstd -q -c 2>/dev/null", fileName, zstName)) {
+      if (Decompressor::isSupported (Decompressor::ZSTD))
+         benchFile ("zstd, in-process", zstName);
+      benchCommand ("zstd, \"zstdcat |\"", "zstd -q -d -c", zstName);
+   }
+   unlink (zstName);
+
+   unlink (fileName);
+   free (fileName);
+   return 0;
+}
@@ -0,0 +1,139 @@
+#include "benchtools.hh"
+#include "common/tools.hh"
+#include "objects/objdelete_controller.hh"
+#include "objects/objident_controller.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace lout::object;
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+using namespace rtfl::tests;
+
+// Benchmark for ObjIdentController and EquivalenceRelation, with traces of
+// objects of classes with multiple inheritance, where the pointers to the
+// base classes differ from the pointer to the subclass: lines per second for
+// ObjDeleteController and ObjIdentController, and operations per second for
+// EquivalenceRelation alone (put, relate and get, reported as "lines").
+// Argument: number of objects.
+
+static const int NUM_BASES = 3, NUM_ALIVE = 20000;
+
+static char *createIdentTrace (long numObjects, long *numLines)
+{
+   char *fileName = strdup ("/tmp/rtfl-bench-XXXXXX");
+   int fd = mkstemp (fileName);
+   if (fd == -1)
+      syserr ("mkstemp failed");
+
+   FILE *file = fdopen (fd, "w");
+   const char *prefix = "[rtfl-obj-1.0]bench.cc";
+   *numLines = 0;
+   for (long i = 0; i < numObjects + NUM_ALIVE; i++) {
+      if (i < numObjects) {
+         // Constructors of the base classes, then of the subclass, which
+         // declares all base pointers as identical.
+         long addr = 0x100000L + 64 * (i % (2 * NUM_ALIVE));
+         fprintf (file, "%s:10:1234:enter:0x%lx:a:0:Sub:\n", prefix, addr);
+         for (int j = 0; j < NUM_BASES; j++)
+            fprintf (file, "%s:11:1234:create:0x%lx:Base%d\n", prefix,
+                     addr + 16 * j, j);
+         for (int j = 1; j < NUM_BASES; j++)
+            fprintf (file, "%s:12:1234:ident:0x%lx:0x%lx\n", prefix, addr,
+                     addr + 16 * j);
+         fprintf (file, "%s:13:1234:create:0x%lx:Sub\n", prefix, addr);
+         fprintf (file, "%s:14:1234:leave:0x%lx\n", prefix, addr);
+
+         // Some use, via all pointers.
+         for (int j = 0; j < NUM_BASES; j++)
+            fprintf (file, "%s:15:1234:msg:0x%lx:a:1:message %ld\n", prefix,
+                     addr + 16 * j, i);
+         fprintf (file, "%s:16:1234:set:0x%lx:counter:%ld\n", prefix,
+                  addr + 16, i);
+         *numLines += 3 + 2 * NUM_BASES + NUM_BASES + 1;
+      }
+
+      if (i >= NUM_ALIVE) {
+         long addr = 0x100000L + 64 * ((i - NUM_ALIVE) % (2 * NUM_ALIVE));
+         fprintf (file, "%s:17:1234:delete:0x%lx\n", prefix, addr);
+         (*numLines)++;
+      }
+   }
+   fclose (file);
+
+   return fileName;
+}
+
+static void benchControllers (const char *fileName, long numLines)
+{
+   int fd = open (fileName, O_RDONLY);
+   if (fd == -1)
+      syserr ("open (\"%s\") failed", fileName);
+
+   BlockingLinesSource source (fd);
+   CountingController controller;
+   ObjIdentController identController (&controller);
+   ObjDeleteController deleteController (&identController);
+   ObjectsParser parser (&deleteController);
+   double t = getCurrentSecs ();
+   source.setup (&parser);
+   printRate ("read, parse, controllers", numLines, getCurrentSecs () - t);
+}
+
+static void benchRelation (long numObjects)
+{
+   EquivalenceRelation relation (true, true);
+   char buf[64];
+   double t = getCurrentSecs ();
+
+   for (long i = 0; i < numObjects; i++)
+      for (int j = 0; j < NUM_BASES; j++) {
+         snprintf (buf, sizeof (buf), "0x%lx", 0x100000L + 64 * i + 16 * j);
+         relation.put (new String (buf), new String (buf));
+      }
+
+   for (long i = 0; i < numObjects; i++) {
+      snprintf (buf, sizeof (buf), "0x%lx", 0x100000L + 64 * i);
+      String key1 (buf);
+      for (int j = 1; j < NUM_BASES; j++) {
+         snprintf (buf, sizeof (buf), "0x%lx", 0x100000L + 64 * i + 16 * j);
+         String key2 (buf);
+         relation.relate (&key1, &key2);
+      }
+   }
+
+   long n = 0;
+   for (int k = 0; k < 4; k++)
+      for (long i = 0; i < numObjects; i++)
+         for (int j = 0; j < NUM_BASES; j++) {
+            snprintf (buf, sizeof (buf), "0x%lx",
+                      0x100000L + 64 * i + 16 * j);
+            String key (buf);
+            if (relation.get (&key))
+               n++;
+         }
+
+   printRate ("EquivalenceRelation (operations)",
+              numObjects * NUM_BASES * 6 - numObjects, getCurrentSecs () - t);
+   if (n != numObjects * NUM_BASES * 4)
+      fprintf (stderr, "%ld keys not found\n", numObjects * NUM_BASES * 4 - n);
+}
+
+int main (int argc, char *argv[])
+{
+   long numObjects = argc > 1 ? atol (argv[1]) : 100000;
+   long numLines;
+   char *fileName = createIdentTrace (numObjects, &numLines);
+
+   for (int i = 0; i < 2; i++) {
+      benchControllers (fileName, numLines);
+      benchRelation (numObjects);
+   }
+
+   unlink (fileName);
+   free (fileName);
+   return 0;
+}
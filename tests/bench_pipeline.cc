@@ -0,0 +1,90 @@
+#include "benchtools.hh"
+#include "common/threaded_lines.hh"
+#include "objects/objdelete_controller.hh"
+#include "objects/objident_controller.hh"
+#include "objects/objects_pipe.hh"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+using namespace rtfl::tests;
+
+// Benchmark for the pipelined mode of rtfl-objbase (ThreadedLinesSource and
+// ObjectsPipe): lines per second for reading, parsing and the controllers
+// ObjDeleteController and ObjIdentController, each both sequentially (as
+// BlockingLinesSource) and pipelined. Argument: number of lines.
+
+static LinesSource *createSource (const char *fileName, bool pipelined)
+{
+   int fd = open (fileName, O_RDONLY);
+   if (fd == -1)
+      syserr ("open (\"%s\") failed", fileName);
+   return pipelined ? (LinesSource*) new ThreadedLinesSource (fd) :
+      new BlockingLinesSource (fd);
+}
+
+static void benchRead (const char *fileName, bool pipelined, long numLines)
+{
+   LinesSource *source = createSource (fileName, pipelined);
+   CountingLinesSink sink;
+   double t = getCurrentSecs ();
+   source->setup (&sink);
+   printRate (pipelined ? "read (threaded)" : "read", sink.numLines,
+              getCurrentSecs () - t);
+   delete source;
+}
+
+static void benchParse (const char *fileName, bool pipelined, long numLines)
+{
+   LinesSource *source = createSource (fileName, pipelined);
+   CountingController controller;
+   ObjectsParser parser (&controller);
+   double t = getCurrentSecs ();
+   source->setup (&parser);
+   printRate (pipelined ? "read, parse (threaded reading)" : "read, parse",
+              controller.numCommands, getCurrentSecs () - t);
+   delete source;
+}
+
+static void benchAll (const char *fileName, bool pipelined, long numLines)
+{
+   LinesSource *source = createSource (fileName, pipelined);
+   CountingController controller;
+   ObjIdentController identController (&controller);
+   ObjDeleteController deleteController (&identController);
+   double t = getCurrentSecs ();
+
+   if (pipelined) {
+      ObjectsPipe pipe (&deleteController);
+      ObjectsParser parser (&pipe);
+      pipe.run (source, &parser);
+   } else {
+      ObjectsParser parser (&deleteController);
+      source->setup (&parser);
+   }
+
+   printRate (pipelined ? "read, parse, controllers (pipelined)" :
+              "read, parse, controllers", controller.numCommands,
+              getCurrentSecs () - t);
+   delete source;
+}
+
+int main (int argc, char *argv[])
+{
+   long numLines = argc > 1 ? atol (argv[1]) : 200000;
+   char *fileName = createTrace (numLines);
+
+   for (int i = 0; i < 2; i++) {
+      bool pipelined = i == 1;
+      benchRead (fileName, pipelined, numLines);
+      benchParse (fileName, pipelined, numLines);
+      benchAll (fileName, pipelined, numLines);
+   }
+
+   unlink (fileName);
+   free (fileName);
+   return 0;
+}
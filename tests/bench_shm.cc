@@ -0,0 +1,146 @@
+#define DBG_RTFL
+#define DBG_RTFL_SHM
+
+#include "debug_rtfl.hh"
+#include "benchtools.hh"
+#include "common/shm_ring.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::tests;
+
+// Benchmark for the transport of messages from the tested program: latency
+// of a single RTFL call (percentiles, in nanoseconds) for several producer
+// threads, when printing to stdout (redirected to /dev/null, so this is the
+// lower bound for pipes), and when putting into a shared memory ring (see
+// RTFL_SHM), drained by a consumer thread. Arguments: number of calls per
+// thread, number of threads.
+//
+// Each measurement runs in a child process, since debug_rtfl.hh reads
+// RTFL_SHM only once.
+
+static long numCalls;
+static long *latencies;
+
+static long nanos ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void *produce (void *data)
+{
+   long *lat = latencies + (long) data * numCalls;
+   void *obj = (void*) (0x10000L + (long) data * 16);
+
+   for (long i = 0; i < numCalls; i++) {
+      long t = nanos ();
+      DBG_OBJ_MSGF_O ("bench", 0, obj, "some message: i = %d", (int) i);
+      lat[i] = nanos () - t;
+   }
+
+   return NULL;
+}
+
+static int compareLong (const void *a, const void *b)
+{
+   long la = *(const long*) a, lb = *(const long*) b;
+   return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static void runProducers (const char *stage, int numThreads,
+                          const char *segment)
+{
+   fflush (stdout);
+   pid_t pid = fork ();
+   if (pid == -1)
+      syserr ("fork failed");
+
+   if (pid == 0) {
+      // The report goes to the original stdout, the messages to /dev/null
+      // (or the ring).
+      FILE *report = fdopen (dup (1), "w");
+      int devNull = open ("/dev/null", O_WRONLY);
+      dup2 (devNull, 1);
+      close (devNull);
+      if (segment)
+         setenv ("RTFL_SHM", segment, 1);
+      else
+         unsetenv ("RTFL_SHM");
+
+      long n = numCalls * numThreads;
+      latencies = new long[n];
+      pthread_t *threads = new pthread_t[numThreads];
+      double t = getCurrentSecs ();
+      for (long i = 0; i < numThreads; i++)
+         pthread_create (&threads[i], NULL, produce, (void*) i);
+      for (int i = 0; i < numThreads; i++)
+         pthread_join (threads[i], NULL);
+      t = getCurrentSecs () - t;
+
+      qsort (latencies, n, sizeof (long), compareLong);
+      fprintf (report, "%-26s %8.0f calls/ms   p50 %6ld  p90 %6ld  p99 %6ld  "
+               "p99.9 %8ld  max %9ld ns\n", stage, n / t / 1000,
+               latencies[n / 2], latencies[n * 90 / 100],
+               latencies[n * 99 / 100], latencies[n * 999 / 1000],
+               latencies[n - 1]);
+      fclose (report);
+      _exit (0);
+   }
+
+   waitpid (pid, NULL, 0);
+}
+
+static void *consume (void *data)
+{
+   CountingLinesSink sink;
+   ((ShmLinesSource*) data)->setup (&sink);
+   return (void*) sink.numLines;
+}
+
+static void benchShm (const char *stage, int numThreads,
+                      ShmRing::Policy policy, uint32_t dataSize)
+{
+   char segment[1024];
+   snprintf (segment, sizeof (segment), "/dev/shm/rtfl-bench-%d",
+             (int) getpid ());
+
+   ShmRing *ring = ShmRing::create (segment, policy, dataSize);
+   if (ring == NULL)
+      syserr ("cannot create \"%s\"", segment);
+
+   ShmLinesSource source (ring);
+   pthread_t consumer;
+   pthread_create (&consumer, NULL, consume, &source);
+
+   runProducers (stage, numThreads, segment);
+
+   source.stop ();
+   void *numLines;
+   pthread_join (consumer, &numLines);
+   printf ("%-26s %ld of %ld lines received\n", "", (long) numLines,
+           numCalls * numThreads);
+}
+
+int main (int argc, char *argv[])
+{
+   numCalls = argc > 1 ? atol (argv[1]) : 1000000;
+   int numThreads = argc > 2 ? atoi (argv[2]) : 4;
+
+   runProducers ("stdout (/dev/null)", numThreads, NULL);
+   benchShm ("ring, block", numThreads, ShmRing::BLOCK,
+             ShmRing::DEFAULT_DATA_SIZE);
+   benchShm ("ring (64 KB), drop", numThreads, ShmRing::DROP, 64 * 1024);
+   benchShm ("ring (64 KB), spill", numThreads, ShmRing::SPILL, 64 * 1024);
+
+   return 0;
+}
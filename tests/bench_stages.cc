@@ -0,0 +1,117 @@
+#include "benchtools.hh"
+#include "common/output_buffer.hh"
+#include "objects/objects_writer.hh"
+#include "objects/objdelete_controller.hh"
+#include "objects/objident_controller.hh"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+using namespace rtfl::tests;
+
+// Benchmark for the two ways to compose the controllers of rtfl-objbase:
+// ObjDeleteController, ObjIdentController and ObjectsWriter (with virtual
+// calls between them, as used by the viewers), and the same stages composed
+// at compile time (see FinalController), as used by rtfl-objbase. The latter
+// is also measured with the lines passed one by one, instead of in batches
+// (see ObjectsController::objCommands). Output goes to /dev/null. Argument:
+// number of lines.
+
+typedef FinalController<ObjectsWriter> WriterStage;
+typedef FinalController<ObjIdentStage<WriterStage> > IdentStage;
+typedef FinalController<ObjDeleteStage<IdentStage> > DeleteStage;
+
+// Passes the lines of a batch one by one.
+class SingleLinesSink: public LinesSink
+{
+private:
+   LinesSink *sink;
+
+public:
+   SingleLinesSink (LinesSink *sink) { this->sink = sink; }
+
+   void setLinesSource (LinesSource *source)
+   { sink->setLinesSource (source); }
+   void processLine (char *line) { sink->processLine (line); }
+   void timeout (int type) { sink->timeout (type); }
+   void finish () { sink->finish (); }
+};
+
+static void run (const char *fileName, ObjectsController *controller,
+                 bool batched = true)
+{
+   int fd = open (fileName, O_RDONLY);
+   if (fd == -1)
+      syserr ("open (\"%s\") failed", fileName);
+   BlockingLinesSource source (fd);
+   ObjectsParser parser (controller);
+   SingleLinesSink singleLines (&parser);
+   if (batched)
+      source.setup (&parser);
+   else
+      source.setup (&singleLines);
+}
+
+static OutputBuffer *createOutput ()
+{
+   int fd = open ("/dev/null", O_WRONLY);
+   if (fd == -1)
+      syserr ("open (\"/dev/null\") failed");
+   return new OutputBuffer (fd, OutputBuffer::NONE);
+}
+
+static void benchParse (const char *fileName, long numLines)
+{
+   CountingController controller;
+   double t = getCurrentSecs ();
+   run (fileName, &controller);
+   printRate ("read, parse", numLines, getCurrentSecs () - t);
+}
+
+static void benchVirtual (const char *fileName, long numLines)
+{
+   double t = getCurrentSecs ();
+   {
+      ObjectsWriter writer (createOutput ());
+      ObjIdentController identController (&writer);
+      ObjDeleteController deleteController (&identController);
+      run (fileName, &deleteController);
+   }
+   printRate ("read, parse, controllers (virtual)", numLines,
+              getCurrentSecs () - t);
+}
+
+static void benchComposed (const char *fileName, long numLines,
+                           bool batched)
+{
+   double t = getCurrentSecs ();
+   {
+      WriterStage writer (createOutput ());
+      IdentStage identStage (&writer);
+      DeleteStage deleteStage (&identStage);
+      run (fileName, &deleteStage, batched);
+   }
+   printRate (batched ? "read, parse, controllers (composed)" :
+              "read, parse, controllers (per line)", numLines,
+              getCurrentSecs () - t);
+}
+
+int main (int argc, char *argv[])
+{
+   long numLines = argc > 1 ? atol (argv[1]) : 200000;
+   char *fileName = createTrace (numLines);
+
+   for (int i = 0; i < 2; i++) {
+      benchParse (fileName, numLines);
+      benchVirtual (fileName, numLines);
+      benchComposed (fileName, numLines, true);
+      benchComposed (fileName, numLines, false);
+   }
+
+   unlink (fileName);
+   free (fileName);
+   return 0;
+}
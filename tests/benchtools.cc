@@ -0,0 +1,188 @@
+#include "benchtools.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+using namespace rtfl::tools;
+
+namespace rtfl {
+
+namespace tests {
+
+/**
+ * \brief Write a typical stream of RTFL commands with (about) `numLines`
+ *    lines into a temporary file, and return its name (to be freed).
+ *
+ * Objects are created, associated, used and deleted again; addresses are
+ * reused, and some objects are declared identical.
+ */
+char *createTrace (long numLines)
+{
+   char *fileName = strdup ("/tmp/rtfl-bench-XXXXXX");
+   int fd = mkstemp (fileName);
+   if (fd == -1)
+      syserr ("mkstemp failed");
+
+   FILE *file = fdopen (fd, "w");
+   const char *prefix = "[rtfl-obj-1.0]bench.cc";
+   long n = 0;
+   for (int i = 0; n < numLines; i++) {
+      long addr = 0x10000L + 16 * (i % 5000);
+      fprintf (file, "%s:%d:1234:create:0x%lx:Class%d\n", prefix, 10,
+               addr, i % 20);
+      fprintf (file, "%s:%d:1234:create:0x%lx:Class%d\n", prefix, 11,
+               addr + 8, i % 20);
+      fprintf (file, "%s:%d:1234:ident:0x%lx:0x%lx\n", prefix, 12, addr,
+               addr + 8);
+      fprintf (file, "%s:%d:1234:assoc:0x%lx:0x%lx\n", prefix, 13, addr,
+               0x10000L + 16 * ((i + 1) % 5000));
+      fprintf (file, "%s:%d:1234:enter:0x%lx:a:0:method%d:%d\n", prefix, 14,
+               addr, i % 50, i);
+      fprintf (file, "%s:%d:1234:msg:0x%lx:a:1:some message\\: i = %d\n",
+               prefix, 15, addr, i);
+      fprintf (file, "%s:%d:1234:set:0x%lx:counter:%d\n", prefix, 16, addr,
+               i);
+      fprintf (file, "%s:%d:1234:leave:0x%lx\n", prefix, 17, addr);
+      fprintf (file, "%s:%d:1234:delete:0x%lx\n", prefix, 18, addr);
+      fprintf (file, "%s:%d:1234:delete:0x%lx\n", prefix, 19, addr + 8);
+      n += 10;
+   }
+   fclose (file);
+
+   return fileName;
+}
+
+double getCurrentSecs ()
+{
+   struct timeval tv;
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void printRate (const char *stage, long numLines, double secs)
+{
+   printf ("%-40s %10.0f lines/s (%ld lines, %.3f s)\n", stage,
+           numLines / secs, numLines, secs);
+}
+
+// ----------------------------------------------------------------------
+
+CountingLinesSink::CountingLinesSink ()
+{
+   numLines = 0;
+}
+
+void CountingLinesSink::setLinesSource (LinesSource *source)
+{
+}
+
+void CountingLinesSink::processLine (char *line)
+{
+   numLines++;
+}
+
+void CountingLinesSink::timeout (int type)
+{
+}
+
+void CountingLinesSink::finish ()
+{
+}
+
+// ----------------------------------------------------------------------
+
+CountingController::CountingController ()
+{
+   numCommands = 0;
+}
+
+void CountingController::objMsg (CommonLineInfo *info, const char *id,
+                                 const char *aspect, int prio,
+                                 const char *message)
+{
+   numCommands++;
+}
+
+void CountingController::objMark (CommonLineInfo *info, const char *id,
+                                  const char *aspect, int prio,
+                                  const char *message)
+{
+   numCommands++;
+}
+
+void CountingController::objMsgStart (CommonLineInfo *info, const char *id)
+{
+   numCommands++;
+}
+
+void CountingController::objMsgEnd (CommonLineInfo *info, const char *id)
+{
+   numCommands++;
+}
+
+void CountingController::objEnter (CommonLineInfo *info, const char *id,
+                                   const char *aspect, int prio,
+                                   const char *funname, const char *args)
+{
+   numCommands++;
+}
+
+void CountingController::objLeave (CommonLineInfo *info, const char *id,
+                                   const char *vals)
+{
+   numCommands++;
+}
+
+void CountingController::objCreate (CommonLineInfo *info, const char *id,
+                                    const char *klass)
+{
+   numCommands++;
+}
+
+void CountingController::objIdent (CommonLineInfo *info, const char *id1,
+                                   const char *id2)
+{
+   numCommands++;
+}
+
+void CountingController::objNoIdent (CommonLineInfo *info)
+{
+   numCommands++;
+}
+
+void CountingController::objAssoc (CommonLineInfo *info, const char *parent,
+                                   const char *child)
+{
+   numCommands++;
+}
+
+void CountingController::objSet (CommonLineInfo *info, const char *id,
+                                 const char *var, const char *val)
+{
+   numCommands++;
+}
+
+void CountingController::objClassColor (CommonLineInfo *info,
+                                        const char *klass, const char *color)
+{
+   numCommands++;
+}
+
+void CountingController::objObjectColor (CommonLineInfo *info, const char *id,
+                                         const char *color)
+{
+   numCommands++;
+}
+
+void CountingController::objDelete (CommonLineInfo *info, const char *id)
+{
+   numCommands++;
+}
+
+} // namespace tests
+   
+} // namespace rtfl
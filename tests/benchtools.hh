@@ -0,0 +1,71 @@
+#ifndef __TESTS_BENCH_TOOLS_HH__
+#define __TESTS_BENCH_TOOLS_HH__
+
+#include "objects/objects_parser.hh"
+
+namespace rtfl {
+
+namespace tests {
+
+char *createTrace (long numLines);
+double getCurrentSecs ();
+void printRate (const char *stage, long numLines, double secs);
+
+/**
+ * \brief Counts lines, as the last sink of a benchmark.
+ */
+class CountingLinesSink: public rtfl::tools::LinesSink
+{
+public:
+   long numLines;
+
+   CountingLinesSink ();
+
+   void setLinesSource (rtfl::tools::LinesSource *source);
+   void processLine (char *line);
+   void timeout (int type);
+   void finish ();
+};
+
+/**
+ * \brief Counts commands, as the last controller of a benchmark.
+ */
+class CountingController: public rtfl::objects::ObjectsControllerBase
+{
+public:
+   long numCommands;
+
+   CountingController ();
+
+   void objMsg (rtfl::tools::CommonLineInfo *info, const char *id,
+                const char *aspect, int prio, const char *message);
+   void objMark (rtfl::tools::CommonLineInfo *info, const char *id,
+                 const char *aspect, int prio, const char *message);
+   void objMsgStart (rtfl::tools::CommonLineInfo *info, const char *id);
+   void objMsgEnd (rtfl::tools::CommonLineInfo *info, const char *id);
+   void objEnter (rtfl::tools::CommonLineInfo *info, const char *id,
+                  const char *aspect, int prio, const char *funname,
+                  const char *args);
+   void objLeave (rtfl::tools::CommonLineInfo *info, const char *id,
+                  const char *vals);
+   void objCreate (rtfl::tools::CommonLineInfo *info, const char *id,
+                   const char *klass);
+   void objIdent (rtfl::tools::CommonLineInfo *info, const char *id1,
+                  const char *id2);
+   void objNoIdent (rtfl::tools::CommonLineInfo *info);
+   void objAssoc (rtfl::tools::CommonLineInfo *info, const char *parent,
+                  const char *child);
+   void objSet (rtfl::tools::CommonLineInfo *info, const char *id,
+                const char *var, const char *val);
+   void objClassColor (rtfl::tools::CommonLineInfo *info, const char *klass,
+                       const char *color);
+   void objObjectColor (rtfl::tools::CommonLineInfo *info, const char *id,
+                        const char *color);
+   void objDelete (rtfl::tools::CommonLineInfo *info, const char *id);
+};
+
+} // namespace tests
+   
+} // namespace rtfl
+
+#endif // __TESTS_BENCH_TOOLS_HH__
@@ -0,0 +1,142 @@
+#include "common/threaded_lines.hh"
+#include "objects/objdelete_controller.hh"
+#include "objects/objident_controller.hh"
+#include "objects/objects_pipe.hh"
+#include "objects/objects_writer.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+// Test ObjectsPipe (option -p of rtfl-objbase): the output must be identical
+// to the output of the sequential processing, for a stream with reused ids,
+// identical objects, and commands with and without arguments.
+
+static char *createTempFile (int *fd)
+{
+   char *fileName = strdup ("/tmp/rtfl-test-XXXXXX");
+   if ((*fd = mkstemp (fileName)) == -1)
+      syserr ("mkstemp failed");
+   return fileName;
+}
+
+static char *createInput ()
+{
+   int fd;
+   char *fileName = createTempFile (&fd);
+   FILE *file = fdopen (fd, "w");
+   const char *prefix = "[rtfl-obj-1.0]test.cc";
+
+   fprintf (file, "%s:1:42:class-color:Class0:#ff0000\n", prefix);
+   for (int i = 0; i < 5000; i++) {
+      long addr = 0x1000L + 16 * (i % 300);
+      fprintf (file, "%s:10:42:create:0x%lx:Class%d\n", prefix, addr, i % 7);
+      fprintf (file, "%s:11:42:create:0x%lx:Class%d\n", prefix, addr + 8,
+               i % 7);
+      fprintf (file, "%s:12:42:ident:0x%lx:0x%lx\n", prefix, addr, addr + 8);
+      fprintf (file, "%s:13:42:assoc:0x%lx:0x%lx\n", prefix, addr,
+               0x1000L + 16 * ((i + 1) % 300));
+      fprintf (file, "%s:14:42:enter:0x%lx:a:0:method%d:%d\n", prefix, addr,
+               i % 11, i);
+      fprintf (file, "%s:15:42:msg:0x%lx:a:1:message\\: %d\n", prefix, addr,
+               i);
+      fprintf (file, "%s:16:42:msg-start:0x%lx\n", prefix, addr);
+      fprintf (file, "%s:17:42:mark:0x%lx:a:2:mark %d\n", prefix, addr, i);
+      fprintf (file, "%s:18:42:msg-end:0x%lx\n", prefix, addr);
+      fprintf (file, "%s:19:42:set:0x%lx:counter:%d\n", prefix, addr, i);
+      fprintf (file, "%s:20:42:object-color:0x%lx:#00ff00\n", prefix, addr);
+      fprintf (file, "%s:21:42:leave:0x%lx\n", prefix, addr);
+      fprintf (file, "%s:22:42:delete:0x%lx\n", prefix, addr);
+      if (i % 3 == 0)
+         fprintf (file, "%s:23:42:delete:0x%lx\n", prefix, addr + 8);
+   }
+   fclose (file);
+
+   return fileName;
+}
+
+static char *process (const char *inputFileName, bool pipelined)
+{
+   int outputFd;
+   char *outputFileName = createTempFile (&outputFd);
+
+   int inputFd = open (inputFileName, O_RDONLY);
+   if (inputFd == -1)
+      syserr ("open (\"%s\") failed", inputFileName);
+   LinesSource *source = pipelined ? (LinesSource*)
+      new ThreadedLinesSource (inputFd) : new BlockingLinesSource (inputFd);
+
+   // The writer owns the output buffer, and closes it at the end.
+   ObjectsWriter writer (new OutputBuffer (outputFd, OutputBuffer::NONE));
+   ObjIdentController identController (&writer);
+   ObjDeleteController deleteController (&identController);
+
+   if (pipelined) {
+      ObjectsPipe pipe (&deleteController);
+      ObjectsParser parser (&pipe);
+      pipe.run (source, &parser);
+   } else {
+      ObjectsParser parser (&deleteController);
+      source->setup (&parser);
+   }
+
+   delete source;
+   return outputFileName;
+}
+
+static char *readFile (const char *fileName, long *size)
+{
+   FILE *file = fopen (fileName, "r");
+   if (file == NULL)
+      syserr ("fopen (\"%s\") failed", fileName);
+
+   long alloc = 65536;
+   char *data = (char*) malloc (alloc);
+   *size = 0;
+   size_t n;
+   while ((n = fread (data + *size, 1, alloc - *size, file)) > 0) {
+      *size += n;
+      if (*size == alloc)
+         data = (char*) realloc (data, alloc *= 2);
+   }
+
+   fclose (file);
+   return data;
+}
+
+int main (int argc, char *argv[])
+{
+   char *inputFileName = createInput ();
+   char *sequentialFileName = process (inputFileName, false);
+   char *pipelinedFileName = process (inputFileName, true);
+
+   long sequentialSize, pipelinedSize;
+   char *sequential = readFile (sequentialFileName, &sequentialSize);
+   char *pipelined = readFile (pipelinedFileName, &pipelinedSize);
+
+   bool equal = sequentialSize == pipelinedSize &&
+      memcmp (sequential, pipelined, sequentialSize) == 0;
+
+   unlink (inputFileName);
+   unlink (sequentialFileName);
+   unlink (pipelinedFileName);
+
+   if (sequentialSize == 0) {
+      printf ("no output\n");
+      return 1;
+   }
+
+   if (!equal) {
+      printf ("pipelined output (%ld bytes) differs from sequential output "
+              "(%ld bytes)\n", pipelinedSize, sequentialSize);
+      return 1;
+   }
+
+   printf ("pipelined output identical (%ld bytes)\n", sequentialSize);
+   return 0;
+}
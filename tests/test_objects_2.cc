@@ -0,0 +1,156 @@
+#include "objects/objident_controller.hh"
+#include "objects/objects_writer.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+// Test the selective mode of ObjIdentController (option -I of
+// rtfl-objbase): an object created shortly before the timeout of an earlier
+// one must still be held back for the whole timeout (one second), so that a
+// late "obj-ident" is applied to its commands. Commands of the earlier
+// object are passed when its own timeout has expired.
+//
+// Furthermore, "obj-enter", "obj-leave", "obj-msg-start" and "obj-msg-end"
+// must keep their order, also when they refer to an object which is not held
+// back, since they form one stack.
+
+struct Step
+{
+   int delayMillis;
+   const char *lines;
+};
+
+static const Step identSteps[] = {
+   { 0, "[rtfl-obj-1.0]t.cc:1:42:create:0x100:A\n" },
+   { 700, "[rtfl-obj-1.0]t.cc:2:42:create:0x210:B\n"
+          "[rtfl-obj-1.0]t.cc:3:42:set:0x210:x:1\n" },
+   // After the timeout of 0x100, but before the one of 0x210.
+   { 600, "[rtfl-obj-1.0]t.cc:4:42:msg:0x100:a:0:hello\n" },
+   { 100, "[rtfl-obj-1.0]t.cc:5:42:ident:0x200:0x210\n"
+          "[rtfl-obj-1.0]t.cc:6:42:create:0x200:C\n" },
+   { 0, NULL }
+};
+
+// In this order.
+static const char *identExpected[] = {
+   ":create:0x100:A", ":msg:0x100:a:0:hello", ":create:0x200:B",
+   ":set:0x200:x:1", ":create:0x200:C", NULL
+};
+
+static const Step stackSteps[] = {
+   { 0, "[rtfl-obj-1.0]t.cc:1:42:create:0x100:A\n"
+        // 0x300 is not held back itself.
+        "[rtfl-obj-1.0]t.cc:2:42:enter:0x300:a:0:f:\n"
+        "[rtfl-obj-1.0]t.cc:3:42:enter:0x100:a:0:g:\n"
+        "[rtfl-obj-1.0]t.cc:4:42:enter:0x300:a:0:h:\n"
+        "[rtfl-obj-1.0]t.cc:5:42:msg:0x300:a:0:in h\n"
+        "[rtfl-obj-1.0]t.cc:6:42:leave:0x300\n"
+        "[rtfl-obj-1.0]t.cc:7:42:leave:0x100\n"
+        "[rtfl-obj-1.0]t.cc:8:42:leave:0x300\n" },
+   // Still held back after the timeout of 0x100, behind 0x500.
+   { 700, "[rtfl-obj-1.0]t.cc:9:42:create:0x500:B\n"
+          "[rtfl-obj-1.0]t.cc:10:42:enter:0x300:a:0:i:\n" },
+   // After the timeout of 0x500.
+   { 1200, "[rtfl-obj-1.0]t.cc:11:42:leave:0x300\n" },
+   { 0, NULL }
+};
+
+static const char *stackExpected[] = {
+   ":create:0x100:A", ":enter:0x300:a:0:f:", ":enter:0x100:a:0:g:",
+   ":enter:0x300:a:0:h:", ":msg:0x300:a:0:in h", ":leave:0x300",
+   ":leave:0x100", ":leave:0x300", ":create:0x500:B", ":enter:0x300:a:0:i:",
+   ":leave:0x300", NULL
+};
+
+struct Input
+{
+   const Step *steps;
+   int fd;
+};
+
+static void *writeInput (void *data)
+{
+   Input *input = (Input*) data;
+   for (int i = 0; input->steps[i].lines; i++) {
+      usleep (input->steps[i].delayMillis * 1000);
+      if (write (input->fd, input->steps[i].lines,
+                 strlen (input->steps[i].lines)) == -1)
+         syserr ("write failed");
+   }
+   close (input->fd);
+   return NULL;
+}
+
+static bool run (const Step *steps, const char **expected,
+                 const char *unexpected)
+{
+   int inputFds[2];
+   if (pipe (inputFds) == -1)
+      syserr ("pipe failed");
+
+   char outputFileName[] = "/tmp/rtfl-test-XXXXXX";
+   int outputFd = mkstemp (outputFileName);
+   if (outputFd == -1)
+      syserr ("mkstemp failed");
+
+   Input input = { steps, inputFds[1] };
+   pthread_t writer;
+   pthread_create (&writer, NULL, writeInput, &input);
+
+   {
+      // The writer owns the output buffer, and closes it at the end.
+      ObjectsWriter objectsWriter (new OutputBuffer (outputFd,
+                                                     OutputBuffer::NONE));
+      ObjIdentController identController (&objectsWriter);
+      identController.setSelective (true);
+      ObjectsParser parser (&identController);
+      BlockingLinesSource source (inputFds[0]);
+      source.setup (&parser);
+   }
+
+   pthread_join (writer, NULL);
+
+   char output[4096];
+   FILE *file = fopen (outputFileName, "r");
+   size_t n = fread (output, 1, sizeof (output) - 1, file);
+   output[n] = 0;
+   fclose (file);
+   unlink (outputFileName);
+
+   const char *pos = output;
+   for (int i = 0; expected[i]; i++) {
+      const char *found = strstr (pos, expected[i]);
+      if (found == NULL) {
+         printf ("\"%s\" not found (in this order) in:\n%s", expected[i],
+                 output);
+         return false;
+      }
+      pos = found + strlen (expected[i]);
+   }
+
+   if (unexpected && strstr (output, unexpected)) {
+      printf ("\"%s\" found in:\n%s", unexpected, output);
+      return false;
+   }
+
+   return true;
+}
+
+int main (int argc, char *argv[])
+{
+   // The id 0x210 must have been mapped.
+   if (!run (identSteps, identExpected, "0x210"))
+      return 1;
+   printf ("late \"obj-ident\" applied\n");
+
+   if (!run (stackSteps, stackExpected, NULL))
+      return 1;
+   printf ("order of the stack kept\n");
+   return 0;
+}
@@ -0,0 +1,48 @@
+#include "objects/objcount_snapshots.hh"
+
+#include <stdio.h>
+
+using namespace lout::misc;
+using namespace rtfl::objects;
+
+// Test SnapshotStore::findGrowing() (see rtfl-objcount): a count which has
+// decreased within the last columns must not be reported as growing, also
+// when the cache of decoded columns is already filled, so that the column
+// decoded from is the next one to be evicted.
+
+enum { NUM_COLUMNS = 30 };
+
+static bool checkGrowing (bool fillCache, const char *situation)
+{
+   SnapshotStore store;
+   for (int c = 0; c < NUM_COLUMNS; c++) {
+      // 10, 5, 20 in the last three columns.
+      int count = c == 27 ? 10 : c == 28 ? 5 : c == 29 ? 20 : 0;
+      store.add (&count, 1);
+   }
+
+   // Afterwards, the slot of column 27 is the next one to be evicted.
+   if (fillCache) {
+      store.getColumn (27);
+      for (int c = 0; c < 15; c++)
+         store.getColumn (c);
+   }
+
+   SimpleVector<bool> growing (1);
+   store.findGrowing (3, &growing);
+   if (growing.size () != 1 || growing.get (0)) {
+      printf ("%s: decreasing count reported as growing\n", situation);
+      return false;
+   }
+   return true;
+}
+
+int main (int argc, char *argv[])
+{
+   if (!checkGrowing (false, "fresh store") ||
+       !checkGrowing (true, "filled cache"))
+      return 1;
+
+   printf ("decreasing count not reported as growing\n");
+   return 0;
+}
@@ -0,0 +1,216 @@
+#include "objects/objdelete_controller.hh"
+#include "objects/objident_controller.hh"
+#include "objects/objects_writer.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace lout::misc;
+using namespace rtfl::tools;
+using namespace rtfl::objects;
+
+// Test the batches of commands (see ObjectsController::objCommands): the
+// ids mapped by ObjDeleteController and ObjIdentController must be the same
+// when the lines are passed to the parser together, and when the commands
+// are passed one by one (by an ObjectsBuffer, which does not pass batches,
+// in front of the controllers). The input contains objects created and deleted again
+// (also with ids longer than the buffers of ObjDeleteController), and
+// identities declared within a batch. It is passed once as it is (so that
+// ObjIdentController holds back most commands), and once after
+// "obj-noident" (so that no command is held back).
+
+typedef FinalController<ObjectsWriter> WriterStage;
+typedef FinalController<ObjIdentStage<WriterStage> > IdentStage;
+typedef FinalController<ObjDeleteStage<IdentStage> > DeleteStage;
+
+enum { NUM_LINES = 5000, NUM_IDS = 40 };
+
+// Timeouts are not needed here; all held commands are passed by finish().
+class NoTimeouts: public LinesSource
+{
+public:
+   void setup (LinesSink *sink) { }
+   void addTimeout (double secs, int type) { }
+   void removeTimeout (int type) { }
+};
+
+static void createInput (SimpleVector<char*> *lines, bool noIdent)
+{
+   if (noIdent) {
+      lines->increase ();
+      lines->setLast (strdup ("[rtfl-obj-1.0]t.cc:0:42:noident"));
+   }
+
+   char buf[256];
+   unsigned int r = 1;
+   for (int i = 0; i < NUM_LINES; i++) {
+      r = r * 1103515245 + 12345;
+      int n = (r >> 16) % NUM_IDS;
+      char id[128];
+      if (n % 8 == 0)
+         // Longer than ObjDeleteStageBase::ID_BUF_SIZE.
+         snprintf (id, sizeof (id), "0x%d%070d", n, 0);
+      else
+         snprintf (id, sizeof (id), "0x%x", 0x100 + n * 16);
+
+      switch ((r >> 8) % 8) {
+      case 0:
+         snprintf (buf, sizeof (buf),
+                   "[rtfl-obj-1.0]t.cc:%d:42:create:%s:C%d", i, id, n);
+         break;
+      case 1:
+         snprintf (buf, sizeof (buf), "[rtfl-obj-1.0]t.cc:%d:42:delete:%s",
+                   i, id);
+         break;
+      case 2:
+         snprintf (buf, sizeof (buf),
+                   "[rtfl-obj-1.0]t.cc:%d:42:ident:%s:0x%x", i, id,
+                   0x100 + ((n + 1) % NUM_IDS) * 16);
+         break;
+      case 3:
+         snprintf (buf, sizeof (buf),
+                   "[rtfl-obj-1.0]t.cc:%d:42:assoc:%s:0x%x", i, id,
+                   0x100 + ((n + 3) % NUM_IDS) * 16);
+         break;
+      case 4:
+         snprintf (buf, sizeof (buf),
+                   "[rtfl-obj-1.0]t.cc:%d:42:enter:%s:a:0:f:", i, id);
+         break;
+      case 5:
+         snprintf (buf, sizeof (buf), "[rtfl-obj-1.0]t.cc:%d:42:leave:%s",
+                   i, id);
+         break;
+      default:
+         snprintf (buf, sizeof (buf),
+                   "[rtfl-obj-1.0]t.cc:%d:42:set:%s:x:%d", i, id, i);
+         break;
+      }
+
+      lines->increase ();
+      lines->setLast (strdup (buf));
+   }
+}
+
+static char *readOutput (int fd)
+{
+   off_t size = lseek (fd, 0, SEEK_END);
+   char *output = (char*) malloc (size + 1);
+   if (pread (fd, output, size, 0) != size)
+      syserr ("pread failed");
+   output[size] = 0;
+   close (fd);
+   return output;
+}
+
+static int createOutputFile ()
+{
+   char fileName[] = "/tmp/rtfl-test-XXXXXX";
+   int fd = mkstemp (fileName);
+   if (fd == -1)
+      syserr ("mkstemp failed");
+   unlink (fileName);
+   return fd;
+}
+
+// Lines passed to the parser are modified, so each run gets copies.
+static void passLines (ObjectsController *controller,
+                       SimpleVector<char*> *lines, bool batched)
+{
+   ObjectsBuffer unbatched (controller);
+   ObjectsParser parser (batched ? controller : &unbatched);
+   NoTimeouts source;
+   parser.setLinesSource (&source);
+
+   SimpleVector<char*> copies (lines->size ());
+   for (int i = 0; i < lines->size (); i++) {
+      copies.increase ();
+      copies.setLast (strdup (lines->get (i)));
+   }
+
+   if (batched)
+      // In batches of different sizes.
+      for (int i = 0, n = 1; i < copies.size (); i += n, n = n * 2 + 1)
+         parser.processLines (copies.getArray () + i,
+                              min (n, copies.size () - i));
+   else
+      for (int i = 0; i < copies.size (); i++)
+         parser.processLine (copies.get (i));
+
+   parser.finish ();
+   for (int i = 0; i < copies.size (); i++)
+      free (copies.get (i));
+}
+
+static char *runVirtual (SimpleVector<char*> *lines, bool batched)
+{
+   int fd = createOutputFile ();
+   {
+      ObjectsWriter writer (new OutputBuffer (dup (fd), OutputBuffer::NONE));
+      ObjIdentController identController (&writer);
+      ObjDeleteController deleteController (&identController);
+      passLines (&deleteController, lines, batched);
+   }
+   return readOutput (fd);
+}
+
+static char *runComposed (SimpleVector<char*> *lines, bool batched)
+{
+   int fd = createOutputFile ();
+   {
+      WriterStage writer (new OutputBuffer (dup (fd), OutputBuffer::NONE));
+      IdentStage identStage (&writer);
+      DeleteStage deleteStage (&identStage);
+      passLines (&deleteStage, lines, batched);
+   }
+   return readOutput (fd);
+}
+
+static bool check (const char *situation, char *unbatched, char *batched)
+{
+   bool ok = true;
+   if (strcmp (unbatched, batched) != 0) {
+      int i = 0;
+      while (unbatched[i] == batched[i])
+         i++;
+      printf ("%s: output differs at offset %d:\n%.200s\n---\n%.200s\n",
+              situation, i, unbatched + i, batched + i);
+      ok = false;
+   } else if (strstr (unbatched, ":create:0x") == NULL ||
+              strstr (unbatched, "0000-") == NULL) {
+      printf ("%s: expected commands not found in:\n%.2000s\n", situation,
+              unbatched);
+      ok = false;
+   }
+
+   free (unbatched);
+   free (batched);
+   return ok;
+}
+
+static bool checkInput (bool noIdent)
+{
+   SimpleVector<char*> lines (NUM_LINES + 1);
+   createInput (&lines, noIdent);
+
+   bool ok = check (noIdent ? "virtual, noident" : "virtual",
+                    runVirtual (&lines, false), runVirtual (&lines, true));
+   ok = check (noIdent ? "composed, noident" : "composed",
+               runComposed (&lines, false), runComposed (&lines, true)) && ok;
+
+   for (int i = 0; i < lines.size (); i++)
+      free (lines.get (i));
+   return ok;
+}
+
+int main (int argc, char *argv[])
+{
+   bool ok = checkInput (false);
+   ok = checkInput (true) && ok;
+   if (!ok)
+      return 1;
+
+   printf ("same ids mapped with and without batches\n");
+   return 0;
+}
@@ -0,0 +1,59 @@
+#include "common/lines.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace rtfl::tools;
+
+// Test TimeoutQueue: timeouts must expire in the order of their times,
+// cancelled and removed timeouts must not expire at all.
+int main (int argc, char *argv[])
+{
+   enum { N = 1000 };
+   TimeoutQueue queue;
+   TimeoutQueue::Timeout *handles[N];
+
+   // Negative delays, so that all timeouts have already expired. The type is
+   // the delay in seconds (as an integer), so it can be checked below.
+   srand (1);
+   for (int i = 0; i < N; i++) {
+      int delay = rand () % 10000;
+      handles[i] = queue.add (- delay, delay);
+   }
+
+   // Cancel every third timeout, and remove all of some types.
+   int expected = N;
+   for (int i = 0; i < N; i += 3) {
+      queue.cancel (handles[i]);
+      handles[i] = NULL;
+      expected--;
+   }
+   for (int i = 0; i < N; i++)
+      if (handles[i] && handles[i]->getType () % 7 == 0) {
+         int type = handles[i]->getType ();
+         for (int j = 0; j < N; j++)
+            if (handles[j] && handles[j]->getType () == type) {
+               handles[j] = NULL;
+               expected--;
+            }
+         queue.remove (type);
+      }
+
+   int type, lastType = 10000, count = 0;
+   while (queue.popExpired (&type)) {
+      if (type % 7 == 0 || type > lastType) {
+         printf ("unexpected timeout %d (after %d)\n", type, lastType);
+         return 1;
+      }
+      lastType = type;
+      count++;
+   }
+
+   if (count != expected || queue.getNextTime () != -1) {
+      printf ("%d timeouts expired, expected %d\n", count, expected);
+      return 1;
+   }
+
+   printf ("%d timeouts expired in order\n", count);
+   return 0;
+}
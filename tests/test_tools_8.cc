@@ -0,0 +1,256 @@
+#define DBG_RTFL
+#define DBG_RTFL_SHM
+
+#include "debug_rtfl.hh"
+#include "common/shm_ring.hh"
+#include "common/tools.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+using namespace rtfl::tools;
+
+// Test the shared memory ring (see RTFL_SHM): with the policy "spill" and a
+// small ring, the lines of each producer thread must arrive in order, and
+// none may be lost. Space claimed by a producer which has died before
+// finishing its record must be skipped, but space claimed by a producer
+// which is only stopped must not.
+
+enum { NUM_THREADS = 4, NUM_LINES = 20000, MAX_EVENTS = 256 };
+
+class CheckingLinesSink: public LinesSink
+{
+public:
+   long numLines, numErrors;
+   int next[NUM_THREADS];
+   char events[MAX_EVENTS];
+
+   CheckingLinesSink ();
+
+   void setLinesSource (LinesSource *source) { }
+   void processLine (char *line);
+   void timeout (int type) { }
+   void finish () { }
+};
+
+CheckingLinesSink::CheckingLinesSink ()
+{
+   numLines = numErrors = 0;
+   memset (next, 0, sizeof (next));
+   events[0] = 0;
+}
+
+void CheckingLinesSink::processLine (char *line)
+{
+   int thread, i;
+   if (sscanf (line, "%d %d", &thread, &i) == 2) {
+      if (thread < 0 || thread >= NUM_THREADS || i != next[thread]) {
+         if (numErrors++ == 0)
+            printf ("line \"%s\" out of order\n", line);
+      } else
+         next[thread]++;
+   } else if (strlen (events) + strlen (line) + 2 < MAX_EVENTS) {
+      strcat (events, " ");
+      strcat (events, line);
+   }
+
+   __atomic_add_fetch (&numLines, 1, __ATOMIC_RELEASE);
+}
+
+static CheckingLinesSink sink;
+
+static long getNumLines ()
+{
+   return __atomic_load_n (&sink.numLines, __ATOMIC_ACQUIRE);
+}
+
+static bool waitForLines (long numLines, int secs)
+{
+   for (int i = 0; i < secs * 1000 && getNumLines () < numLines; i++)
+      usleep (1000);
+   return getNumLines () >= numLines;
+}
+
+static void put (const char *line)
+{
+   rtfl_shm_put (rtfl_shm (), line, strlen (line));
+}
+
+static void *produce (void *data)
+{
+   char line[64];
+   for (int i = 0; i < NUM_LINES; i++) {
+      snprintf (line, sizeof (line), "%d %d\n", (int) (long) data, i);
+      put (line);
+   }
+   return NULL;
+}
+
+static void *consume (void *data)
+{
+   ((ShmLinesSource*) data)->setup (&sink);
+   return NULL;
+}
+
+// Claims space for a record like rtfl_shm_put(), but leaves it to the
+// caller to set the first word; returns the position of the record.
+
+static uint64_t claim (rtfl_shm_header *shm, int len)
+{
+   uint64_t size = shm->dataSize;
+   uint64_t need = (4 + (len - 1) + 7) & ~(uint64_t)7;
+   char *data = (char*)shm + RTFL_SHM_HEADER_SIZE;
+   rtfl_shm_slot *slot = rtfl_shm_get_slot (shm);
+   uint64_t head, pos, pad;
+
+   do {
+      head = __atomic_load_n (&shm->head, __ATOMIC_RELAXED);
+      pos = head & (size - 1);
+      pad = pos + need > size ? size - pos : 0;
+      slot->size = pad + need;
+      __atomic_store_n (&slot->head, head, __ATOMIC_RELEASE);
+   } while (!__atomic_compare_exchange_n (&shm->head, &head,
+                                          head + pad + need, false,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+   if (pad) {
+      __atomic_store_n ((uint32_t*)(data + pos),
+                        (uint32_t)((pad - 4) << 2 | RTFL_SHM_PAD),
+                        __ATOMIC_RELEASE);
+      pos = 0;
+   }
+
+   return pos;
+}
+
+static void finishRecord (rtfl_shm_header *shm, uint64_t pos,
+                          const char *line)
+{
+   int len = strlen (line);
+   char *data = (char*)shm + RTFL_SHM_HEADER_SIZE;
+   memcpy (data + pos + 4, line, len - 1);
+   __atomic_store_n ((uint32_t*)(data + pos),
+                     (uint32_t)((len - 1) << 2 | RTFL_SHM_READY),
+                     __ATOMIC_RELEASE);
+   __atomic_store_n (&rtfl_shm_get_slot (shm)->head, RTFL_SHM_NO_CLAIM,
+                     __ATOMIC_RELEASE);
+}
+
+static bool testSpill (ShmRing *ring)
+{
+   pthread_t threads[NUM_THREADS];
+   for (long i = 0; i < NUM_THREADS; i++)
+      pthread_create (&threads[i], NULL, produce, (void*) i);
+   for (int i = 0; i < NUM_THREADS; i++)
+      pthread_join (threads[i], NULL);
+
+   long numLines = NUM_THREADS * NUM_LINES;
+   waitForLines (numLines, 10);
+
+   if (sink.numErrors > 0 || getNumLines () != numLines) {
+      printf ("spill: %ld of %ld lines received, %ld out of order, %ld "
+              "dropped\n", getNumLines (), numLines, sink.numErrors,
+              ring->getNumDropped ());
+      return false;
+   }
+
+   if (ring->getNumSpilled () == 0) {
+      printf ("spill: no lines spilled\n");
+      return false;
+   }
+
+   printf ("spill: %ld lines in order, %ld of them spilled\n", numLines,
+           ring->getNumSpilled ());
+   return true;
+}
+
+static bool testDeadProducer ()
+{
+   long numLines = getNumLines ();
+
+   pid_t pid = fork ();
+   if (pid == -1)
+      syserr ("fork failed");
+   if (pid == 0) {
+      claim (rtfl_shm (), strlen ("dead\n"));
+      _exit (0);
+   }
+
+   waitpid (pid, NULL, 0);
+   put ("after-dead\n");
+
+   if (!waitForLines (numLines + 1, 5) ||
+       strcmp (sink.events, " after-dead") != 0) {
+      printf ("dead producer: lines after it not received (%s)\n",
+              sink.events);
+      return false;
+   }
+
+   printf ("dead producer: skipped\n");
+   return true;
+}
+
+static bool testStoppedProducer ()
+{
+   long numLines = getNumLines ();
+   sink.events[0] = 0;
+
+   pid_t pid = fork ();
+   if (pid == -1)
+      syserr ("fork failed");
+   if (pid == 0) {
+      uint64_t pos = claim (rtfl_shm (), strlen ("stopped\n"));
+      raise (SIGSTOP);
+      finishRecord (rtfl_shm (), pos, "stopped\n");
+      _exit (0);
+   }
+
+   waitpid (pid, NULL, WUNTRACED);
+   put ("after-stopped\n");
+
+   // Longer than ShmRing::STALE_MILLIS.
+   usleep (2500000);
+   bool waited = getNumLines () == numLines;
+
+   kill (pid, SIGCONT);
+   waitpid (pid, NULL, 0);
+
+   if (!waited || !waitForLines (numLines + 2, 5) ||
+       strcmp (sink.events, " stopped after-stopped") != 0) {
+      printf ("stopped producer: lines not received in order (%s)\n",
+              sink.events);
+      return false;
+   }
+
+   printf ("stopped producer: waited for\n");
+   return true;
+}
+
+int main (int argc, char *argv[])
+{
+   char segment[64];
+   snprintf (segment, sizeof (segment), "/tmp/rtfl-test-%d", (int) getpid ());
+
+   ShmRing *ring = ShmRing::create (segment, ShmRing::SPILL, 64 * 1024);
+   if (ring == NULL)
+      syserr ("cannot create \"%s\"", segment);
+   setenv ("RTFL_SHM", segment, 1);
+
+   ShmLinesSource source (ring);
+   pthread_t consumer;
+   pthread_create (&consumer, NULL, consume, &source);
+
+   bool ok = testSpill (ring) && testDeadProducer () &&
+      testStoppedProducer ();
+
+   source.stop ();
+   pthread_join (consumer, NULL);
+
+   return ok ? 0 : 1;
+}